@@ -0,0 +1,460 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// churn.cc for XWinWM - benchmark of a steady stream of busy clients
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Runs xwinwm on a fresh Xvfb with the WindowsWM stand-in preloaded and,
+ * for as long as asked, keeps it busy with rounds of what clients do all
+ * day: storms of windows being mapped and unmapped, dialogs that are gone
+ * as soon as they are up, titles changed over and over, floods of
+ * ConfigureRequests and chains of transients.
+ *
+ * Each request is timed until xwinwm has dealt with it, which is when
+ * WM_STATE appears for a map and when the ConfigureNotify arrives for a
+ * resize.  What has no answer of its own, unmaps and title changes, is
+ * timed until a resize of a window kept for the purpose is answered,
+ * since xwinwm handles the events of a screen in order.  The events
+ * xwinwm read, and how much its resident size grew after the first round,
+ * are shown with the latencies.
+ *
+ *   churn xwinwm wmstub.so [seconds]
+ */
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/select.h>
+}
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "session.hh"
+
+// the size of a round
+static const unsigned int Mains = 10, StormSize = 50, Dialogs = 10,
+  NameChanges = 200, Resizes = 200, ChainDepth = 8;
+
+// how long xwinwm has to answer a request before it is given up on
+static const double Timeout = 10.0;
+
+
+struct Scenario {
+  const char *name;
+  std::vector<double> latency; // in seconds
+};
+
+enum { MapStorm, UnmapStorm, ShortDialogs, TitleSpam, ConfigureFlood,
+       TransientChains, ScenarioCount };
+
+
+// the time by which the given share of the samples were done, in ms
+static double percentile(std::vector<double> &samples, double share) {
+  if (samples.empty())
+    return 0.0;
+
+  std::vector<double>::iterator it =
+    samples.begin() + (size_t) ((samples.size() - 1) * share);
+  std::nth_element(samples.begin(), it, samples.end());
+  return *it * 1e3;
+}
+
+
+class Churn {
+public:
+  Churn(BenchSession &s);
+
+  // maps the windows every round uses, returns False if xwinwm did not
+  // manage them
+  bool setUp(void);
+  // returns False if xwinwm stopped answering
+  bool round(void);
+
+  inline Scenario &scenario(unsigned int i) { return scenarios[i]; }
+
+private:
+  // a request waiting for xwinwm
+  struct Pending {
+    Scenario *scenario;
+    double issued;
+    int width;
+  };
+  typedef std::map<Window, Pending> MapList;
+  typedef std::multimap<Window, Pending> ResizeList;
+
+  BenchSession &session;
+  Display *display;
+  Atom wm_state, net_wm_window_type, net_wm_window_type_dialog;
+  Window marker;
+  int marker_width;
+  double marker_answered;
+  std::vector<Window> mains;
+  unsigned long serial;
+  MapList mapping;
+  ResizeList resizing;
+  Scenario scenarios[ScenarioCount];
+
+  Window create(const char *name, Window transient_for);
+  void map(Window w, Scenario *s);
+  void resize(Window w, int x, int y, int width, int height, Scenario *s);
+
+  void handle(const XEvent &e);
+  // waits until every request has been answered
+  bool settle(void);
+  // returns when xwinwm was done with everything asked so far, or 0.0
+  double sync(void);
+  void answered(Scenario *s, double issued, double when);
+};
+
+
+Churn::Churn(BenchSession &s)
+  : session(s), display(s.display()), marker(None), marker_width(200),
+    marker_answered(0.0), serial(0) {
+  wm_state = XInternAtom(display, "WM_STATE", False);
+  net_wm_window_type = XInternAtom(display, "_NET_WM_WINDOW_TYPE", False);
+  net_wm_window_type_dialog =
+    XInternAtom(display, "_NET_WM_WINDOW_TYPE_DIALOG", False);
+
+  scenarios[MapStorm].name = "map storm";
+  scenarios[UnmapStorm].name = "unmap storm";
+  scenarios[ShortDialogs].name = "short-lived dialogs";
+  scenarios[TitleSpam].name = "WM_NAME spam";
+  scenarios[ConfigureFlood].name = "ConfigureRequest flood";
+  scenarios[TransientChains].name = "transient chains";
+}
+
+
+Window Churn::create(const char *name, Window transient_for) {
+  const int x = (serial * 17) % 700, y = (serial * 13) % 500;
+  ++serial;
+
+  XSetWindowAttributes attrib;
+  attrib.event_mask = PropertyChangeMask | StructureNotifyMask;
+  Window w = XCreateWindow(display, DefaultRootWindow(display), x, y,
+                           400, 300, 0, CopyFromParent, InputOutput,
+                           CopyFromParent, CWEventMask, &attrib);
+
+  char *names[] = { const_cast<char *>(name) };
+  XTextProperty text;
+  XStringListToTextProperty(names, 1, &text);
+
+  XSizeHints size;
+  size.flags = PPosition | PSize;
+  size.x = x;
+  size.y = y;
+  size.width = 400;
+  size.height = 300;
+
+  XWMHints hints;
+  hints.flags = InputHint | StateHint;
+  hints.input = True;
+  hints.initial_state = NormalState;
+
+  XClassHint klass;
+  klass.res_name = const_cast<char *>("churn");
+  klass.res_class = const_cast<char *>("Churn");
+
+  XSetWMProperties(display, w, &text, &text, 0, 0, &size, &hints, &klass);
+  XFree(text.value);
+
+  if (transient_for != None) {
+    XSetTransientForHint(display, w, transient_for);
+    XChangeProperty(display, w, net_wm_window_type, XA_ATOM, 32,
+                    PropModeReplace,
+                    (unsigned char *) &net_wm_window_type_dialog, 1);
+  }
+
+  return w;
+}
+
+
+void Churn::map(Window w, Scenario *s) {
+  Pending p = { s, now(), 0 };
+  mapping[w] = p;
+  XMapWindow(display, w);
+}
+
+
+void Churn::resize(Window w, int x, int y, int width, int height,
+                   Scenario *s) {
+  Pending p = { s, now(), width };
+  resizing.insert(ResizeList::value_type(w, p));
+  XMoveResizeWindow(display, w, x, y, width, height);
+}
+
+
+void Churn::answered(Scenario *s, double issued, double when) {
+  if (s)
+    s->latency.push_back(when - issued);
+}
+
+
+void Churn::handle(const XEvent &e) {
+  const double when = now();
+
+  if (e.type == PropertyNotify && e.xproperty.atom == wm_state &&
+      e.xproperty.state == PropertyNewValue) {
+    MapList::iterator it = mapping.find(e.xproperty.window);
+    if (it == mapping.end())
+      return;
+    answered(it->second.scenario, it->second.issued, when);
+    mapping.erase(it);
+    return;
+  }
+
+  if (e.type != ConfigureNotify)
+    return;
+
+  /*
+    xwinwm may well deal with only the last of several resizes it finds
+    queued, and that answers the ones before it too.  Other
+    ConfigureNotifies, such as the synthetic one after a real one, are
+    left alone.
+  */
+  const Window w = e.xconfigure.window;
+  std::pair<ResizeList::iterator, ResizeList::iterator> range =
+    resizing.equal_range(w);
+
+  ResizeList::iterator it = range.first;
+  for (; it != range.second; ++it) {
+    if (it->second.width == e.xconfigure.width)
+      break;
+  }
+  if (it == range.second)
+    return;
+
+  const double issued = it->second.issued;
+  for (it = range.first; it != range.second; ) {
+    if (it->second.issued > issued) {
+      ++it;
+      continue;
+    }
+    answered(it->second.scenario, it->second.issued, when);
+    if (w == marker)
+      marker_answered = when;
+    resizing.erase(it++);
+  }
+}
+
+
+bool Churn::settle(void) {
+  const double deadline = now() + Timeout;
+  const int xfd = ConnectionNumber(display);
+
+  XFlush(display);
+  while (! mapping.empty() || ! resizing.empty()) {
+    while (XPending(display)) {
+      XEvent e;
+      XNextEvent(display, &e);
+      handle(e);
+    }
+    if (mapping.empty() && resizing.empty())
+      break;
+
+    if (now() > deadline || ! session.running())
+      return False;
+
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(xfd, &rfds);
+    timeval tv = { 0, 100000 };
+    select(xfd + 1, &rfds, 0, 0, &tv);
+  }
+  return True;
+}
+
+
+double Churn::sync(void) {
+  marker_width = (marker_width < 599) ? marker_width + 1 : 200;
+  resize(marker, 900, 600, marker_width, 200, (Scenario *) 0);
+  return (settle()) ? marker_answered : 0.0;
+}
+
+
+bool Churn::setUp(void) {
+  marker = create("churn marker", None);
+  map(marker, (Scenario *) 0);
+
+  for (unsigned int i = 0; i < Mains; ++i) {
+    char name[64];
+    sprintf(name, "churn main %u", i);
+    mains.push_back(create(name, None));
+    map(mains.back(), (Scenario *) 0);
+  }
+
+  return settle();
+}
+
+
+bool Churn::round(void) {
+  char name[64];
+
+  // map storm, then the same windows unmapped and destroyed in one go
+  std::vector<Window> storm;
+  for (unsigned int i = 0; i < StormSize; ++i) {
+    sprintf(name, "churn storm %u", i);
+    storm.push_back(create(name, None));
+  }
+  for (unsigned int i = 0; i < StormSize; ++i)
+    map(storm[i], &scenarios[MapStorm]);
+  if (! settle())
+    return False;
+
+  std::vector<double> issued;
+  for (unsigned int i = 0; i < StormSize; ++i) {
+    issued.push_back(now());
+    XUnmapWindow(display, storm[i]);
+  }
+  for (unsigned int i = 0; i < StormSize; ++i)
+    XDestroyWindow(display, storm[i]);
+  double done = sync();
+  if (done == 0.0)
+    return False;
+  for (unsigned int i = 0; i < issued.size(); ++i)
+    answered(&scenarios[UnmapStorm], issued[i], done);
+
+  // dialogs, one at a time, destroyed as soon as they are managed
+  for (unsigned int i = 0; i < Dialogs; ++i) {
+    Window dialog = create("churn dialog", mains[i % Mains]);
+    map(dialog, &scenarios[ShortDialogs]);
+    if (! settle())
+      return False;
+    XDestroyWindow(display, dialog);
+  }
+
+  issued.clear();
+  for (unsigned int i = 0; i < NameChanges; ++i) {
+    sprintf(name, "churn main %u, title %u", i % Mains, i);
+    issued.push_back(now());
+    XStoreName(display, mains[i % Mains], name);
+  }
+  done = sync();
+  if (done == 0.0)
+    return False;
+  for (unsigned int i = 0; i < issued.size(); ++i)
+    answered(&scenarios[TitleSpam], issued[i], done);
+
+  // every resize of a window is to a new width, so each can be told apart
+  for (unsigned int i = 0; i < Resizes; ++i) {
+    const unsigned int n = i / Mains;
+    resize(mains[i % Mains], 20 + n, 20 + n, 300 + n, 200 + n,
+           &scenarios[ConfigureFlood]);
+  }
+  if (! settle())
+    return False;
+
+  std::vector<Window> chain;
+  for (unsigned int i = 0; i < ChainDepth; ++i) {
+    sprintf(name, "churn transient %u", i);
+    chain.push_back(create(name, (i > 0) ? chain.back() : None));
+  }
+  for (unsigned int i = 0; i < ChainDepth; ++i)
+    map(chain[i], &scenarios[TransientChains]);
+  if (! settle())
+    return False;
+
+  // from the top of the chain down, so the transients lose their owner
+  for (unsigned int i = 0; i < ChainDepth; ++i)
+    XDestroyWindow(display, chain[i]);
+  return sync() != 0.0;
+}
+
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s xwinwm wmstub.so [seconds]\n", argv[0]);
+    return 1;
+  }
+
+  const double seconds = (argc > 3) ? strtod(argv[3], 0) : 60.0;
+
+  printf("xwinwm under client churn over Xvfb, with the WindowsWM "
+         "stand-in, %.0f s\n", seconds);
+
+  BenchSession session;
+  if (! session.open()) {
+    printf("  Xvfb could not be started, skipped\n");
+    return 0;
+  }
+
+  Churn churn(session);
+  if (! session.startWM(argv[1], argv[2])) {
+    printf("  xwinwm could not be started\n");
+    return 1;
+  }
+  if (! churn.setUp()) {
+    printf("  xwinwm did not manage the first windows\n");
+    return 1;
+  }
+
+  // the first round fills the caches, the growth after it is what counts
+  if (! churn.round()) {
+    printf("  xwinwm stopped answering in the first round\n");
+    return 1;
+  }
+  for (unsigned int i = 0; i < ScenarioCount; ++i)
+    churn.scenario(i).latency.clear();
+
+  const unsigned long first_resident = session.memory("VmRSS");
+  const unsigned long first_events = session.counters().events;
+  const double start = now();
+
+  unsigned long rounds = 0;
+  bool answering = True;
+  while (now() - start < seconds) {
+    if (! (answering = churn.round()))
+      break;
+    ++rounds;
+  }
+
+  const double elapsed = now() - start;
+  const unsigned long events = session.counters().events - first_events;
+  const unsigned long resident = session.memory("VmRSS");
+
+  for (unsigned int i = 0; i < ScenarioCount; ++i) {
+    Scenario &s = churn.scenario(i);
+    const unsigned long count = s.latency.size();
+    const double p50 = percentile(s.latency, 0.50),
+      p99 = percentile(s.latency, 0.99);
+    printf("  %-24s %8lu requests  p50 %7.2f ms  p99 %7.2f ms\n", s.name,
+           count, p50, p99);
+  }
+
+  printf("  %lu rounds, %lu events read, %.0f events/s\n", rounds, events,
+         (elapsed > 0.0) ? events / elapsed : 0.0);
+  printf("  %lu kB resident after the first round, %lu kB at the end, "
+         "%+ld kB\n", first_resident, resident,
+         (long) resident - (long) first_resident);
+
+  if (! answering) {
+    printf("  xwinwm stopped answering after %lu rounds\n", rounds);
+    return 1;
+  }
+  return 0;
+}
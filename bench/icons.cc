@@ -0,0 +1,194 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// icons.cc for XWinWM - benchmark of the icon conversion kernels
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Converts icons of the sizes applications commonly put in _NET_WM_ICON to
+ * the 32x32 taskbar icon, with the kernels in Image.cc and with a plain
+ * per-pixel loop written straight from the definitions, and checks that
+ * both give the same pixels.  The cost of hashing an icon, which is all a
+ * hit in the icon cache costs, is shown next to them.
+ */
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+}
+
+#include <algorithm>
+#include <vector>
+
+#include "Image.hh"
+
+typedef std::vector<unsigned int> Pixels;
+
+static const unsigned int TargetSize = 32;
+
+
+static double now(void) {
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+// a round, anti-aliased blob on a transparent background, with some noise
+static void makeIcon(unsigned int size, Pixels &icon) {
+  icon.resize(size * size);
+  unsigned int seed = size * 2654435761u;
+  const double r = size / 2.0;
+
+  for (unsigned int y = 0; y < size; ++y) {
+    for (unsigned int x = 0; x < size; ++x) {
+      seed = seed * 1103515245u + 12345u;
+      const double dx = x + 0.5 - r, dy = y + 0.5 - r;
+      double a = (r - 1.0 - __builtin_sqrt(dx * dx + dy * dy)) * 255.0;
+      a = std::max(0.0, std::min(255.0, a));
+      icon[y * size + x] = ((unsigned int) a << 24) |
+                           ((x * 255 / size) << 16) |
+                           ((y * 255 / size) << 8) |
+                           ((seed >> 16) & 0xff);
+    }
+  }
+}
+
+
+static void naivePremultiply(Pixels &icon) {
+  for (unsigned int i = 0; i < icon.size(); ++i) {
+    const unsigned int p = icon[i], a = p >> 24;
+    unsigned int out = a << 24;
+    for (unsigned int shift = 0; shift < 24; shift += 8)
+      out |= ((((p >> shift) & 0xff) * a + 127) / 255) << shift;
+    icon[i] = out;
+  }
+}
+
+
+static unsigned int overlap(unsigned int a, unsigned int b,
+                            unsigned int c, unsigned int d) {
+  const unsigned int lo = std::max(a, c), hi = std::min(b, d);
+  return (hi > lo) ? hi - lo : 0;
+}
+
+
+// every destination pixel visits the source pixels it covers
+static void naiveScale(const Pixels &src, unsigned int sw, unsigned int sh,
+                       Pixels &dst, unsigned int dw, unsigned int dh) {
+  dst.resize(dw * dh);
+  const unsigned int total = sw * sh;
+
+  for (unsigned int j = 0; j < dh; ++j) {
+    for (unsigned int n = 0; n < dw; ++n) {
+      unsigned int sum[4] = { 0, 0, 0, 0 };
+
+      for (unsigned int i = j * sh / dh; i * dh < (j + 1) * sh; ++i) {
+        const unsigned int wy = overlap(i * dh, (i + 1) * dh,
+                                        j * sh, (j + 1) * sh);
+        for (unsigned int x = n * sw / dw; x * dw < (n + 1) * sw; ++x) {
+          const unsigned int w = wy * overlap(x * dw, (x + 1) * dw,
+                                              n * sw, (n + 1) * sw);
+          const unsigned int p = src[i * sw + x];
+          for (unsigned int c = 0; c < 4; ++c)
+            sum[c] += ((p >> (c * 8)) & 0xff) * w;
+        }
+      }
+
+      unsigned int out = 0;
+      for (unsigned int c = 0; c < 4; ++c)
+        out |= ((sum[c] + total / 2) / total) << (c * 8);
+      dst[j * dw + n] = out;
+    }
+  }
+}
+
+
+int main(int argc, char **argv) {
+  const unsigned long passes = (argc > 1) ? strtoul(argv[1], 0, 0) : 200;
+  const unsigned int sizes[] = { 256, 128, 64, 48, 16 };
+
+  printf("%s kernels, %lu passes, converting to %ux%u\n", pixelKernels(),
+         passes, TargetSize, TargetSize);
+
+  volatile unsigned int sink = 0;
+
+  for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    const unsigned int size = sizes[s];
+    Pixels icon, a, b, scaled_a, scaled_b;
+    makeIcon(size, icon);
+
+    // check the kernels against the plain loops first
+    a = icon;
+    premultiplyPixels(&a[0], a.size());
+    b = icon;
+    naivePremultiply(b);
+    if (a != b) {
+      fprintf(stderr, "%s: premultiplied %ux%u icons differ\n", argv[0],
+              size, size);
+      return 1;
+    }
+
+    scaled_a.resize(TargetSize * TargetSize);
+    scalePixels(&a[0], size, size, &scaled_a[0], TargetSize, TargetSize);
+    naiveScale(b, size, size, scaled_b, TargetSize, TargetSize);
+    if (scaled_a != scaled_b) {
+      fprintf(stderr, "%s: scaled %ux%u icons differ\n", argv[0],
+              size, size);
+      return 1;
+    }
+
+    unsigned long n;
+    double start = now();
+    for (n = 0; n < passes; ++n) {
+      b = icon;
+      naivePremultiply(b);
+      naiveScale(b, size, size, scaled_b, TargetSize, TargetSize);
+      sink += scaled_b[0];
+    }
+    const double naive = (now() - start) / passes;
+
+    start = now();
+    for (n = 0; n < passes; ++n) {
+      a = icon;
+      premultiplyPixels(&a[0], a.size());
+      scalePixels(&a[0], size, size, &scaled_a[0], TargetSize, TargetSize);
+      sink += scaled_a[0];
+    }
+    const double fast = (now() - start) / passes;
+
+    unsigned int hash[2];
+    start = now();
+    for (n = 0; n < passes; ++n) {
+      hashPixels(&icon[0], icon.size(), hash);
+      sink += hash[0];
+    }
+    const double hit = (now() - start) / passes;
+
+    printf("  %3ux%-3u  per-pixel loop %8.1f us  kernels %8.1f us  "
+           "(%4.1fx)  cache hit %6.1f us\n", size, size, naive * 1e6,
+           fast * 1e6, naive / fast, hit * 1e6);
+  }
+
+  return 0;
+}
@@ -0,0 +1,921 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// replay.cc for XWinWM - profiles a recorded session offline
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Plays a trace recorded with xwinwm -trace back through the same code,
+ * with no server: the Xlib calls xwinwm makes are defined below, and the
+ * questions it asks about windows are answered with what the server said
+ * when the trace was recorded.  Every event is timed as it is handled, so
+ * a session that went wrong can be profiled, or run under a debugger, as
+ * often as needed and always the same way.
+ *
+ * Each answer is looked up by what was asked, the window and, for
+ * properties, the atom and offset.  The answers recorded for the same
+ * question are given in turn, the last of them for as long as it is asked
+ * again, and a question that was never answered is taken to be about a
+ * window that has gone.  The windows xwinwm creates are given the ids
+ * they had, so the events recorded for them find them again.
+ *
+ * Once the ring has gone round, the start of the session is no longer in
+ * the trace, and neither are the windows that were managed then; the
+ * events for those are handled as if they came from strangers.  Frames
+ * are given the size the WindowsWM stand-in gives them.
+ *
+ *   replay trace [rc]
+ */
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/windowswm.h>
+
+#ifdef    SHAPE
+#  include <X11/extensions/shape.h>
+#endif // SHAPE
+
+#ifdef    XKB
+#  include <X11/XKBlib.h>
+#endif // XKB
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+}
+
+// Window.cc reaches past X to the native windows where there is Win32,
+// so they are faked too
+#ifdef    HAVE_WINDOWS_H
+#define NONAMELESSUNION
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#define _NO_BOOL_TYPEDEF
+#include <windows.h>
+#endif // HAVE_WINDOWS_H
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Trace.hh"
+#include "Util.hh"
+#include "blackbox.hh"
+#include "i18n.hh"
+
+I18n i18n;
+
+// the slowest events are listed by themselves
+static const unsigned int Slowest = 10;
+
+
+static double now(void) {
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+// ------------------------------------------------------------------------
+// the answers
+
+struct Question {
+  unsigned int kind;
+  unsigned long window, atom;
+  long offset;
+
+  bool operator<(const Question &q) const {
+    if (kind != q.kind) return kind < q.kind;
+    if (window != q.window) return window < q.window;
+    if (atom != q.atom) return atom < q.atom;
+    return offset < q.offset;
+  }
+};
+
+struct Answer {
+  int status;
+  unsigned long key;
+  std::vector<unsigned char> data;
+};
+
+typedef std::map<Question, std::deque<Answer> > AnswerMap;
+
+static AnswerMap answers;
+static std::map<std::string, Answer> extensions;
+static std::map<std::string, Atom> atoms;
+static std::deque<Window> created;
+static std::vector<BTraceScreen> trace_screens;
+
+// the requests xwinwm would have sent, whether or not they have a reply
+static unsigned long requests;
+
+
+static Question question(unsigned int kind, Window w, Atom atom = None,
+                         long offset = 0) {
+  Question q;
+  q.kind = kind;
+  q.window = w;
+  q.atom = atom;
+  q.offset = offset;
+  return q;
+}
+
+
+// files the record under the question it answers
+static void learn(const std::vector<unsigned char> &record) {
+  const BTraceRecord *r = (const BTraceRecord *) &record[0];
+  const unsigned char *payload = &record[sizeof(BTraceRecord)];
+  const unsigned char *end = &record[0] + record.size();
+
+  Answer answer;
+  answer.status = r->status;
+  answer.key = r->key;
+  answer.data.assign(payload, end);
+
+  switch (r->kind) {
+  case BTrace::Property: {
+    const BTraceProperty *p = (const BTraceProperty *) payload;
+    answers[question(r->kind, r->window, r->key, p->offset)]
+      .push_back(answer);
+    break;
+  }
+
+  case BTrace::Focus:
+    // the window is the answer
+    answer.data.resize(sizeof(Window));
+    memcpy(&answer.data[0], &r->window, sizeof(Window));
+    answers[question(r->kind, None)].push_back(answer);
+    break;
+
+  case BTrace::Extension: {
+    // the name is not terminated, and the padding after it is zeros
+    const char *name = (const char *) payload + sizeof(int) * 3;
+    extensions[std::string(name, strnlen(name, end - (const unsigned char *)
+                                                     name))] = answer;
+    break;
+  }
+
+  case BTrace::Created:
+    created.push_back(r->window);
+    break;
+
+  default:
+    answers[question(r->kind, r->window)].push_back(answer);
+  }
+}
+
+
+// the answers to the same question are given in turn, and the last one
+// again and again
+static bool ask(const Question &q, Answer &answer) {
+  ++requests;
+
+  AnswerMap::iterator it = answers.find(q);
+  if (it == answers.end() || it->second.empty())
+    return false;
+
+  answer = it->second.front();
+  if (it->second.size() > 1)
+    it->second.pop_front();
+  return true;
+}
+
+
+// a copy of the data, in memory XFree() can free
+static unsigned char *copy(const unsigned char *data, unsigned long length) {
+  unsigned char *p = (unsigned char *) malloc(length + 1);
+  memcpy(p, data, length);
+  // Xlib always adds a terminator
+  p[length] = '\0';
+  return p;
+}
+
+
+// ------------------------------------------------------------------------
+// the display
+
+static std::vector<Screen> fake_screens;
+static std::vector<Visual> fake_visuals;
+static int fake_fd = -1;
+static char fake_name[] = ":0.0";
+static Window next_window = 0x7f000000;
+static Atom next_atom = 0x7f000000;
+static XErrorHandler error_handler;
+
+
+static int putPixel(XImage *image, int x, int y, unsigned long pixel) {
+  char *p = image->data + y * image->bytes_per_line;
+  if (image->bits_per_pixel == 1) {
+    if (pixel)
+      p[x / 8] |= 1 << (x % 8);
+    else
+      p[x / 8] &= ~(1 << (x % 8));
+  } else {
+    memcpy(p + x * (image->bits_per_pixel / 8), &pixel,
+           image->bits_per_pixel / 8);
+  }
+  return 1;
+}
+
+
+static int destroyImage(XImage *image) {
+  free(image->data);
+  free(image);
+  return 1;
+}
+
+
+extern "C" {
+
+Display *XOpenDisplay(_Xconst char *) {
+  _XPrivDisplay d = (_XPrivDisplay) calloc(1, sizeof(*d));
+
+  fake_screens.resize(trace_screens.size());
+  fake_visuals.resize(trace_screens.size());
+  for (unsigned int i = 0; i < trace_screens.size(); ++i) {
+    const BTraceScreen &t = trace_screens[i];
+    Visual &v = fake_visuals[i];
+    memset(&v, 0, sizeof(v));
+    v.visualid = 0x21 + i;
+    v.c_class = t.visual_class;
+    v.red_mask = t.red_mask;
+    v.green_mask = t.green_mask;
+    v.blue_mask = t.blue_mask;
+    v.bits_per_rgb = 8;
+    v.map_entries = 256;
+
+    Screen &s = fake_screens[i];
+    memset(&s, 0, sizeof(s));
+    s.display = (Display *) d;
+    s.root = t.root;
+    s.width = t.width;
+    s.height = t.height;
+    s.root_depth = t.depth;
+    s.root_visual = &v;
+    s.cmap = 0x20 + i;
+    s.white_pixel = t.red_mask | t.green_mask | t.blue_mask;
+  }
+
+  // BaseDisplay marks the connection close-on-exec
+  fake_fd = open("/dev/null", O_RDONLY);
+  d->fd = fake_fd;
+  d->nscreens = fake_screens.size();
+  d->default_screen = 0;
+  d->screens = &fake_screens[0];
+  d->display_name = fake_name;
+  return (Display *) d;
+}
+
+int XCloseDisplay(Display *display) {
+  close(fake_fd);
+  free(display);
+  return 0;
+}
+
+char *XDisplayName(_Xconst char *) { return fake_name; }
+
+Status XInitThreads(void) { return 0; }
+
+Bool XSupportsLocale(void) { return True; }
+
+char *XSetLocaleModifiers(_Xconst char *) {
+  static char none[] = "";
+  return none;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler) {
+  XErrorHandler old = error_handler;
+  error_handler = handler;
+  return old;
+}
+
+int (*XSynchronize(Display *, Bool))(Display *) { return 0; }
+
+int XFree(void *data) {
+  free(data);
+  return 1;
+}
+
+int XFlush(Display *) { return 1; }
+int XSync(Display *, Bool) { ++requests; return 1; }
+int XPending(Display *) { return 0; }
+int XEventsQueued(Display *, int) { return 0; }
+int XPutBackEvent(Display *, XEvent *) { return 0; }
+Bool XCheckTypedEvent(Display *, int, XEvent *) { return False; }
+Bool XCheckTypedWindowEvent(Display *, Window, int, XEvent *) {
+  return False;
+}
+
+int XNextEvent(Display *, XEvent *) {
+  // the events come from the trace, never from here
+  abort();
+}
+
+
+// extensions
+
+static Bool extension(const char *name, int *opcode, int *event_base,
+                      int *error_base) {
+  std::map<std::string, Answer>::const_iterator it = extensions.find(name);
+  if (it == extensions.end() || ! it->second.status)
+    return False;
+
+  const int *bases = (const int *) &it->second.data[0];
+  if (opcode) *opcode = bases[0];
+  *event_base = bases[1];
+  *error_base = bases[2];
+  return True;
+}
+
+Bool XQueryExtension(Display *, _Xconst char *name, int *opcode,
+                     int *event_base, int *error_base) {
+  return extension(name, opcode, event_base, error_base);
+}
+
+#ifdef    SHAPE
+Bool XShapeQueryExtension(Display *, int *event_base, int *error_base) {
+  return extension(SHAPENAME, 0, event_base, error_base);
+}
+
+void XShapeSelectInput(Display *, Window, unsigned long) { ++requests; }
+
+Status XShapeQueryExtents(Display *, Window, Bool *shaped, int *, int *,
+                          unsigned int *, unsigned int *, Bool *clip_shaped,
+                          int *, int *, unsigned int *, unsigned int *) {
+  ++requests;
+  *shaped = *clip_shaped = False;
+  return 1;
+}
+#endif // SHAPE
+
+#ifdef    XKB
+Bool XkbQueryExtension(Display *, int *, int *, int *, int *, int *) {
+  return False;
+}
+
+XkbDescPtr XkbGetMap(Display *, unsigned int, unsigned int) { return 0; }
+
+Status XkbGetControls(Display *, unsigned long, XkbDescPtr) {
+  return BadImplementation;
+}
+
+void XkbFreeKeyboard(XkbDescPtr, unsigned int, Bool) {}
+
+Bool XkbSetIgnoreLockMods(Display *, unsigned int, unsigned int,
+                          unsigned int, unsigned int, unsigned int) {
+  return False;
+}
+#endif // XKB
+
+Bool XWindowsWMSelectInput(Display *, unsigned long) { return True; }
+
+Bool XWindowsWMFrameGetRect(Display *, unsigned int frame_style,
+                            unsigned int, unsigned int,
+                            short ix, short iy, short iw, short ih,
+                            short *rx, short *ry, short *rw, short *rh) {
+  ++requests;
+  const short border = (frame_style & WindowsWMFrameStyleBorder) ? 4 : 0;
+  const short caption = (frame_style & WindowsWMFrameStyleCaption) ? 23 : 0;
+  *rx = ix - border;
+  *ry = iy - border - caption;
+  *rw = iw + border * 2;
+  *rh = ih + border * 2 + caption;
+  return True;
+}
+
+Bool XWindowsWMFrameDraw(Display *, int, Window, unsigned int, unsigned int,
+                         short, short, short, short) {
+  ++requests;
+  return True;
+}
+
+Bool XWindowsWMFrameSetTitle(Display *, int, Window, unsigned int,
+                             const char *) {
+  ++requests;
+  return True;
+}
+
+
+#ifdef    HAVE_WINDOWS_H
+// the native windows of the recording are long gone
+WINBOOL WINAPI ShowWindow(HWND, int) { return 0; }
+WINBOOL WINAPI SetForegroundWindow(HWND) { return 0; }
+#endif // HAVE_WINDOWS_H
+
+
+// the keyboard
+
+XModifierKeymap *XGetModifierMapping(Display *) { return 0; }
+int XFreeModifiermap(XModifierKeymap *) { return 1; }
+KeyCode XKeysymToKeycode(Display *, KeySym) { return 0; }
+
+
+// atoms
+
+Atom XInternAtom(Display *, _Xconst char *name, Bool only_if_exists) {
+  std::map<std::string, Atom>::const_iterator it = atoms.find(name);
+  if (it != atoms.end())
+    return it->second;
+  if (only_if_exists)
+    return None;
+
+  // unseen while recording, so the number cannot be told apart from one
+  // the server would have given
+  ++requests;
+  return atoms[name] = next_atom++;
+}
+
+
+// what is asked about windows
+
+int XGetWindowProperty(Display *, Window w, Atom property, long offset,
+                       long, Bool, Atom, Atom *type, int *format,
+                       unsigned long *nitems, unsigned long *bytes_after,
+                       unsigned char **value) {
+  *type = None;
+  *format = 0;
+  *nitems = *bytes_after = 0;
+  *value = 0;
+
+  Answer answer;
+  if (! ask(question(BTrace::Property, w, property, offset), answer))
+    return Success;
+  if (answer.status != Success)
+    return answer.status;
+
+  const BTraceProperty *p = (const BTraceProperty *) &answer.data[0];
+  *type = p->type;
+  *format = p->format;
+  *nitems = p->nitems;
+  *bytes_after = p->bytes_after;
+  if (p->type != None)
+    *value = copy(&answer.data[sizeof(BTraceProperty)],
+                  answer.data.size() - sizeof(BTraceProperty));
+  return Success;
+}
+
+Status XGetWindowAttributes(Display *, Window w,
+                            XWindowAttributes *attributes) {
+  Answer answer;
+  if (! ask(question(BTrace::Attributes, w), answer) || ! answer.status)
+    return 0;
+
+  memcpy(attributes, &answer.data[0], sizeof(XWindowAttributes));
+  // the pointers are the ones of the recording
+  attributes->screen = (Screen *) 0;
+  attributes->visual = (Visual *) 0;
+  for (unsigned int i = 0; i < fake_screens.size(); ++i) {
+    if (fake_screens[i].root == attributes->root) {
+      attributes->screen = &fake_screens[i];
+      attributes->visual = &fake_visuals[i];
+    }
+  }
+  return answer.status;
+}
+
+Status XQueryTree(Display *, Window w, Window *root, Window *parent,
+                  Window **children, unsigned int *count) {
+  *children = 0;
+  *count = 0;
+
+  Answer answer;
+  if (! ask(question(BTrace::Tree, w), answer) || ! answer.status)
+    return 0;
+
+  const Window *family = (const Window *) &answer.data[0];
+  *root = family[0];
+  *parent = family[1];
+  const unsigned long length = answer.data.size() - sizeof(Window) * 2;
+  *count = length / sizeof(Window);
+  if (*count > 0)
+    *children = (Window *) copy(&answer.data[sizeof(Window) * 2], length);
+  return answer.status;
+}
+
+int XGetInputFocus(Display *, Window *focus, int *revert_to) {
+  *focus = PointerRoot;
+  *revert_to = RevertToPointerRoot;
+
+  Answer answer;
+  if (ask(question(BTrace::Focus, None), answer)) {
+    memcpy(focus, &answer.data[0], sizeof(Window));
+    *revert_to = answer.key;
+  }
+  return 1;
+}
+
+XWMHints *XGetWMHints(Display *, Window w) {
+  Answer answer;
+  if (! ask(question(BTrace::WMHints, w), answer) || ! answer.status)
+    return 0;
+  return (XWMHints *) copy(&answer.data[0], sizeof(XWMHints));
+}
+
+Status XGetWMNormalHints(Display *, Window w, XSizeHints *hints,
+                         long *supplied) {
+  Answer answer;
+  if (! ask(question(BTrace::NormalHints, w), answer) || ! answer.status)
+    return 0;
+  memcpy(hints, &answer.data[0], sizeof(XSizeHints));
+  *supplied = answer.key;
+  return answer.status;
+}
+
+static Status text(BTrace::Kind kind, Window w, XTextProperty *property) {
+  property->value = 0;
+  property->encoding = None;
+  property->format = 0;
+  property->nitems = 0;
+
+  Answer answer;
+  if (! ask(question(kind, w), answer) || ! answer.status)
+    return 0;
+
+  const unsigned long *header = (const unsigned long *) &answer.data[0];
+  property->encoding = header[0];
+  property->format = header[1];
+  property->nitems = header[2];
+  property->value = copy(&answer.data[sizeof(long) * 3],
+                         answer.data.size() - sizeof(long) * 3);
+  return answer.status;
+}
+
+Status XGetWMName(Display *, Window w, XTextProperty *name) {
+  return text(BTrace::WMName, w, name);
+}
+
+Status XGetWMIconName(Display *, Window w, XTextProperty *name) {
+  return text(BTrace::WMIconName, w, name);
+}
+
+Status XGetWMProtocols(Display *, Window w, Atom **protocols, int *count) {
+  *protocols = 0;
+  *count = 0;
+
+  Answer answer;
+  if (! ask(question(BTrace::Protocols, w), answer) || ! answer.status)
+    return 0;
+
+  *count = answer.data.size() / sizeof(Atom);
+  *protocols = (Atom *) copy(&answer.data[0], answer.data.size());
+  return answer.status;
+}
+
+Status XGetTransientForHint(Display *, Window w, Window *transient) {
+  Answer answer;
+  if (! ask(question(BTrace::TransientFor, w), answer) || ! answer.status)
+    return 0;
+  *transient = answer.key;
+  return answer.status;
+}
+
+int Xutf8TextPropertyToTextList(Display *, const XTextProperty *property,
+                                char ***list, int *count) {
+  // the strings are separated by NULs, and copy() ends the last one
+  std::vector<const char *> strings;
+  const char *p = (const char *) property->value;
+  const char *end = p + property->nitems;
+  if (p && property->format == 8) {
+    for (; p < end; p += strlen(p) + 1)
+      strings.push_back(p);
+  }
+
+  *count = strings.size();
+  *list = (char **) malloc((strings.size() + 1) * sizeof(char *));
+  for (unsigned int i = 0; i < strings.size(); ++i)
+    (*list)[i] = strdup(strings[i]);
+  (*list)[strings.size()] = 0;
+  return Success;
+}
+
+void XFreeStringList(char **list) {
+  if (! list)
+    return;
+  for (char **p = list; *p; ++p)
+    free(*p);
+  free(list);
+}
+
+
+// windows
+
+Window XCreateWindow(Display *, Window, int, int, unsigned int,
+                     unsigned int, unsigned int, int, unsigned int, Visual *,
+                     unsigned long, XSetWindowAttributes *) {
+  ++requests;
+  if (created.empty())
+    return next_window++;
+
+  const Window w = created.front();
+  created.pop_front();
+  return w;
+}
+
+#define   REQUEST(declaration) \
+  int declaration { ++requests; return 1; }
+
+REQUEST(XDestroyWindow(Display *, Window))
+REQUEST(XMapWindow(Display *, Window))
+REQUEST(XUnmapWindow(Display *, Window))
+REQUEST(XMoveWindow(Display *, Window, int, int))
+REQUEST(XMoveResizeWindow(Display *, Window, int, int, unsigned int,
+                          unsigned int))
+REQUEST(XConfigureWindow(Display *, Window, unsigned int, XWindowChanges *))
+REQUEST(XRaiseWindow(Display *, Window))
+REQUEST(XLowerWindow(Display *, Window))
+REQUEST(XRestackWindows(Display *, Window *, int))
+REQUEST(XReparentWindow(Display *, Window, Window, int, int))
+REQUEST(XChangeWindowAttributes(Display *, Window, unsigned long,
+                                XSetWindowAttributes *))
+REQUEST(XSetWindowBorderWidth(Display *, Window, unsigned int))
+REQUEST(XSelectInput(Display *, Window, long))
+REQUEST(XChangeSaveSet(Display *, Window, int))
+REQUEST(XDefineCursor(Display *, Window, Cursor))
+REQUEST(XChangeProperty(Display *, Window, Atom, Atom, int, int,
+                        _Xconst unsigned char *, int))
+REQUEST(XDeleteProperty(Display *, Window, Atom))
+REQUEST(XSetWMHints(Display *, Window, XWMHints *))
+REQUEST(XSetInputFocus(Display *, Window, int, Time))
+REQUEST(XGrabButton(Display *, unsigned int, unsigned int, Window, Bool,
+                    unsigned int, int, int, Window, Cursor))
+REQUEST(XUngrabButton(Display *, unsigned int, unsigned int, Window))
+REQUEST(XUngrabPointer(Display *, Time))
+REQUEST(XGrabServer(Display *))
+REQUEST(XUngrabServer(Display *))
+REQUEST(XInstallColormap(Display *, Colormap))
+REQUEST(XUninstallColormap(Display *, Colormap))
+REQUEST(XChangeGC(Display *, GC, unsigned long, XGCValues *))
+REQUEST(XFreePixmap(Display *, Pixmap))
+REQUEST(XPutImage(Display *, Drawable, GC, XImage *, int, int, int, int,
+                  unsigned int, unsigned int))
+
+Status XSendEvent(Display *, Window, Bool, long, XEvent *) {
+  ++requests;
+  return 1;
+}
+
+Cursor XCreateFontCursor(Display *, unsigned int) {
+  ++requests;
+  return next_window++;
+}
+
+Colormap XCreateColormap(Display *, Window, Visual *, int) {
+  ++requests;
+  return next_window++;
+}
+
+Colormap *XListInstalledColormaps(Display *, Window w, int *count) {
+  ++requests;
+  for (unsigned int i = 0; i < fake_screens.size(); ++i) {
+    if (fake_screens[i].root == w) {
+      Colormap *list = (Colormap *) malloc(sizeof(Colormap));
+      *list = fake_screens[i].cmap;
+      *count = 1;
+      return list;
+    }
+  }
+  *count = 0;
+  return 0;
+}
+
+XVisualInfo *XGetVisualInfo(Display *, long, XVisualInfo *, int *count) {
+  *count = 0;
+  return 0;
+}
+
+VisualID XVisualIDFromVisual(Visual *visual) { return visual->visualid; }
+
+
+// drawing
+
+GC XCreateGC(Display *, Drawable, unsigned long, XGCValues *) {
+  ++requests;
+  // never looked into, only passed back
+  return (GC) malloc(1);
+}
+
+int XFreeGC(Display *, GC gc) {
+  ++requests;
+  free(gc);
+  return 1;
+}
+
+Pixmap XCreatePixmap(Display *, Drawable, unsigned int, unsigned int,
+                     unsigned int) {
+  ++requests;
+  return next_window++;
+}
+
+XImage *XCreateImage(Display *, Visual *, unsigned int depth, int format,
+                     int offset, char *data, unsigned int width,
+                     unsigned int height, int pad, int bytes_per_line) {
+  XImage *image = (XImage *) calloc(1, sizeof(XImage));
+  image->width = width;
+  image->height = height;
+  image->xoffset = offset;
+  image->format = format;
+  image->data = data;
+  image->byte_order = image->bitmap_bit_order = LSBFirst;
+  image->bitmap_unit = image->bitmap_pad = pad;
+  image->depth = depth;
+  image->bits_per_pixel = (depth == 1) ? 1 : (depth <= 8) ? 8 :
+                          (depth <= 16) ? 16 : 32;
+  image->bytes_per_line = bytes_per_line ? bytes_per_line :
+    ((width * image->bits_per_pixel + pad - 1) / pad) * (pad / 8);
+  image->f.put_pixel = putPixel;
+  image->f.destroy_image = destroyImage;
+  return image;
+}
+
+
+// colors
+
+Status XAllocColor(Display *, Colormap, XColor *color) {
+  ++requests;
+  color->pixel = ((color->red >> 8) << 16) | ((color->green >> 8) << 8) |
+    (color->blue >> 8);
+  return 1;
+}
+
+int XFreeColors(Display *, Colormap, unsigned long *, int, unsigned long) {
+  ++requests;
+  return 1;
+}
+
+Status XParseColor(Display *, Colormap, _Xconst char *spec, XColor *color) {
+  // the server knows the names, the trace does not, so they are all grey
+  unsigned int r = 0x80, g = 0x80, b = 0x80;
+  if (sscanf(spec, "#%2x%2x%2x", &r, &g, &b) != 3)
+    sscanf(spec, "rgb:%2x/%2x/%2x", &r, &g, &b);
+  color->red = r << 8 | r;
+  color->green = g << 8 | g;
+  color->blue = b << 8 | b;
+  color->flags = DoRed | DoGreen | DoBlue;
+  return 1;
+}
+
+} // extern "C"
+
+
+// ------------------------------------------------------------------------
+
+
+static const char *eventName(int type) {
+  const char *name = eventTypeName(type);
+  if (name)
+    return name;
+
+  static char number[32];
+  sprintf(number, "extension event %d", type);
+  return number;
+}
+
+
+struct Tally {
+  unsigned long count, requests;
+  double total, max;
+
+  Tally(void): count(0), requests(0), total(0.0), max(0.0) {}
+};
+
+struct Handled {
+  double seconds, at;
+  int type;
+  Window window;
+
+  bool operator<(const Handled &h) const { return seconds > h.seconds; }
+};
+
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s trace [rc]\n", argv[0]);
+    return 1;
+  }
+
+  BTraceReader reader;
+  if (! reader.open(argv[1])) {
+    fprintf(stderr, "%s: %s\n", argv[0], reader.error().c_str());
+    return 1;
+  }
+  trace_screens = reader.screens();
+  if (trace_screens.empty()) {
+    fprintf(stderr, "%s: %s: the screens were not recorded\n", argv[0],
+            argv[1]);
+    return 1;
+  }
+
+  BTraceReader::AtomList::const_iterator at = reader.atoms().begin();
+  for (; at != reader.atoms().end(); ++at)
+    atoms[at->second] = at->first;
+
+  std::vector<std::vector<unsigned char> > records;
+  std::vector<unsigned char> record;
+  while (reader.next(record))
+    records.push_back(record);
+
+  // what was asked before the first event was asked by the constructor
+  unsigned int i = 0;
+  for (; i < records.size(); ++i) {
+    if (((const BTraceRecord *) &records[i][0])->kind == BTrace::Event)
+      break;
+    learn(records[i]);
+  }
+
+  char rc[] = "/dev/null";
+  char *program[] = { argv[0], 0 };
+  Blackbox blackbox(program, (char *) 0, (argc > 2) ? argv[2] : rc);
+  blackbox.run();
+
+  std::map<int, Tally> tallies;
+  std::vector<Handled> handled;
+  Tally total;
+  const unsigned long long start = (i < records.size()) ?
+    ((const BTraceRecord *) &records[i][0])->time : 0;
+
+  while (i < records.size() && ! blackbox.doShutdown()) {
+    const BTraceRecord *r = (const BTraceRecord *) &records[i][0];
+    XEvent e;
+    memcpy(&e, &records[i][sizeof(BTraceRecord)], sizeof(e));
+
+    // and what was asked after it, by its handler
+    for (++i; i < records.size(); ++i) {
+      if (((const BTraceRecord *) &records[i][0])->kind == BTrace::Event)
+        break;
+      learn(records[i]);
+    }
+
+    const unsigned long before = requests;
+    const double t = now();
+    blackbox.handleEvent(&e);
+    const double seconds = now() - t;
+
+    Tally &tally = tallies[e.type];
+    ++tally.count;
+    tally.requests += requests - before;
+    tally.total += seconds;
+    tally.max = std::max(tally.max, seconds);
+    ++total.count;
+    total.requests += requests - before;
+    total.total += seconds;
+
+    Handled h;
+    h.seconds = seconds;
+    h.at = (r->time - start) / 1e9;
+    h.type = e.type;
+    h.window = e.xany.window;
+    handled.push_back(h);
+  }
+
+  printf("xwinwm replaying %s, %u screen%s\n", argv[1],
+         (unsigned int) trace_screens.size(),
+         (trace_screens.size() == 1) ? "" : "s");
+  std::map<int, Tally>::const_iterator it = tallies.begin();
+  for (; it != tallies.end(); ++it)
+    printf("  %-24s %8lu  avg %8.2f us  max %9.2f us  %6.1f requests\n",
+           eventName(it->first), it->second.count,
+           it->second.total / it->second.count * 1e6, it->second.max * 1e6,
+           (double) it->second.requests / it->second.count);
+  printf("  %lu events in %.1f ms, %lu requests\n", total.count,
+         total.total * 1e3, total.requests);
+
+  const unsigned int slowest = std::min((unsigned int) handled.size(),
+                                        Slowest);
+  std::partial_sort(handled.begin(), handled.begin() + slowest,
+                    handled.end());
+  if (slowest > 0)
+    printf("  the slowest:\n");
+  for (unsigned int n = 0; n < slowest; ++n)
+    printf("    %9.2f us  %-24s 0x%08lx  %.3f s in\n",
+           handled[n].seconds * 1e6, eventName(handled[n].type),
+           handled[n].window, handled[n].at);
+
+  return 0;
+}
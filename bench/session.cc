@@ -0,0 +1,256 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// session.cc for XWinWM - a private Xvfb with xwinwm running on it
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+#include <vector>
+
+#include "session.hh"
+
+
+double now(void) {
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+// stops a child, and makes sure it is gone
+static void finish(pid_t pid) {
+  if (pid <= 0)
+    return;
+  kill(pid, SIGTERM);
+  waitpid(pid, 0, 0);
+}
+
+
+static void quiet(void) {
+  int null = ::open("/dev/null", O_WRONLY);
+  dup2(null, 1);
+  dup2(null, 2);
+}
+
+
+BenchSession::BenchSession(void)
+  : server(0), wm(0), xdisplay((Display *) 0), shared(&none) {
+  memset(&none, 0, sizeof(none));
+}
+
+
+BenchSession::~BenchSession(void) {
+  close();
+}
+
+
+/*
+ * Xvfb picks the display itself, and tells us which through -displayfd,
+ * so a benchmark never finds one it did not start.
+ */
+bool BenchSession::open(void) {
+  int fds[2];
+  if (pipe(fds) == -1)
+    return False;
+
+  char fd[16];
+  sprintf(fd, "%d", fds[1]);
+
+  server = fork();
+  if (server == 0) {
+    ::close(fds[0]);
+    quiet();
+    execlp("Xvfb", "Xvfb", "-displayfd", fd, "-nolisten", "tcp",
+           "-screen", "0", "1280x1024x24", (char *) 0);
+    _exit(127);
+  }
+  ::close(fds[1]);
+
+  if (server == -1) {
+    server = 0;
+    ::close(fds[0]);
+    return False;
+  }
+
+  char number[16];
+  ssize_t n = 0, r;
+  while (n < (ssize_t) sizeof(number) - 1 &&
+         (r = read(fds[0], number + n, sizeof(number) - 1 - n)) > 0) {
+    n += r;
+    if (number[n - 1] == '\n')
+      break;
+  }
+  ::close(fds[0]);
+
+  if (n <= 0) {
+    close();
+    return False;
+  }
+
+  number[n] = '\0';
+  name = ":" + std::string(number, strcspn(number, "\n"));
+
+  xdisplay = XOpenDisplay(name.c_str());
+  if (! xdisplay) {
+    close();
+    return False;
+  }
+
+  return True;
+}
+
+
+bool BenchSession::startWM(const char *xwinwm, const char *stub) {
+  // LD_PRELOAD wants a path it does not have to search for
+  std::string preload = stub;
+  if (preload.find('/') == std::string::npos)
+    preload = "./" + preload;
+
+  std::vector<char> path(32);
+  strcpy(&path[0], "/tmp/xwinwm-bench.XXXXXX");
+  int fd = mkstemp(&path[0]);
+  if (fd == -1) {
+    fprintf(stderr, "cannot share the counters with xwinwm\n");
+    return False;
+  }
+  counters_path = &path[0];
+
+  void *p = MAP_FAILED;
+  if (write(fd, &none, sizeof(none)) == sizeof(none))
+    p = mmap(0, sizeof(WMStubCounters), PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "cannot share the counters with xwinwm\n");
+    return False;
+  }
+  shared = (WMStubCounters *) p;
+
+  // the exec closes this pipe, a failed one writes errno into it first
+  int fds[2];
+  if (pipe(fds) == -1)
+    return False;
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+  wm = fork();
+  if (wm == 0) {
+    ::close(fds[0]);
+    setenv("DISPLAY", name.c_str(), 1);
+    setenv("LD_PRELOAD", preload.c_str(), 1);
+    setenv(WMSTUB_COUNTERS, counters_path.c_str(), 1);
+    quiet();
+    execl(xwinwm, xwinwm, "-rc", "/dev/null", (char *) 0);
+    int error = errno;
+    ssize_t ret = write(fds[1], &error, sizeof(error));
+    (void) ret;
+    _exit(127);
+  }
+  ::close(fds[1]);
+
+  if (wm == -1) {
+    wm = 0;
+    ::close(fds[0]);
+    return False;
+  }
+
+  int error;
+  ssize_t n;
+  while ((n = read(fds[0], &error, sizeof(error))) == -1 && errno == EINTR)
+    continue;
+  ::close(fds[0]);
+
+  if (n > 0) {
+    fprintf(stderr, "cannot run %s: %s\n", xwinwm, strerror(error));
+    waitpid(wm, 0, 0);
+    wm = 0;
+    return False;
+  }
+  return True;
+}
+
+
+void BenchSession::close(void) {
+  finish(wm);
+  wm = 0;
+
+  if (shared != &none) {
+    munmap(shared, sizeof(WMStubCounters));
+    shared = &none;
+  }
+  if (! counters_path.empty()) {
+    unlink(counters_path.c_str());
+    counters_path.erase();
+  }
+
+  if (xdisplay) {
+    XCloseDisplay(xdisplay);
+    xdisplay = (Display *) 0;
+  }
+
+  finish(server);
+  server = 0;
+}
+
+
+bool BenchSession::running(void) {
+  if (wm > 0 && waitpid(wm, 0, WNOHANG) == wm)
+    wm = 0;
+  return wm > 0;
+}
+
+
+unsigned long BenchSession::memory(const char *field) const {
+  if (wm <= 0)
+    return 0;
+
+  char path[64];
+  sprintf(path, "/proc/%ld/status", (long) wm);
+
+  FILE *f = fopen(path, "r");
+  if (! f)
+    return 0;
+
+  const size_t length = strlen(field);
+  char line[256];
+  unsigned long kb = 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, field, length) == 0 && line[length] == ':') {
+      kb = strtoul(line + length + 1, 0, 10);
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
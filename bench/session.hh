@@ -0,0 +1,76 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// session.hh for XWinWM - a private Xvfb with xwinwm running on it
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __session_hh
+#define   __session_hh
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <sys/types.h>
+}
+
+#include <string>
+
+#include "wmstub.hh"
+
+double now(void);
+
+/*
+ * The benchmarks that drive xwinwm the way clients would all go through
+ * one of these: open() starts Xvfb on the first free display and connects
+ * to it, and startWM() starts xwinwm there with the WindowsWM stand-in
+ * preloaded, sharing its counters with us.  Everything is stopped again
+ * by close(), or when the session goes away.
+ */
+class BenchSession {
+public:
+  BenchSession(void);
+  ~BenchSession(void);
+
+  // returns False if Xvfb could not be started, most likely as there is
+  // none
+  bool open(void);
+  // returns False if xwinwm could not be run at all
+  bool startWM(const char *xwinwm, const char *stub);
+  void close(void);
+
+  // False once xwinwm has exited
+  bool running(void);
+
+  // the field of /proc/pid/status for xwinwm, in kB, or 0
+  unsigned long memory(const char *field) const;
+
+  inline Display *display(void) const { return xdisplay; }
+  inline const WMStubCounters &counters(void) const { return *shared; }
+
+private:
+  std::string name;
+  pid_t server, wm;
+  Display *xdisplay;
+  std::string counters_path;
+  // all zero until xwinwm is started
+  WMStubCounters none, *shared;
+
+  BenchSession(const BenchSession &_nocopy);
+  BenchSession &operator=(const BenchSession &_nocopy);
+};
+
+#endif // __session_hh
@@ -0,0 +1,163 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// spawn.cc for XWinWM - benchmark of the ways of starting commands
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Starts "true" over and over with fork, with spawnCommand() and through
+ * the spawn server, from a process that has first grown to the given
+ * number of megabytes, the way a window manager that has run for a while
+ * has.  Each launch is waited for before the next, so the rate includes
+ * running the shell; the time spent inside the launching call is what
+ * the window manager itself would be held up.  bexec() through the server
+ * is timed too, which does not wait for the pid.
+ */
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+#include <string>
+
+#include "Spawn.hh"
+
+
+static double now(void) {
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+// the way xwinwm used to start commands, for comparison
+static pid_t forkCommand(const std::string &command,
+                         const std::string &displaystring) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    setsid();
+    if (! displaystring.empty())
+      putenv(const_cast<char *>(displaystring.c_str()));
+    std::string cmd = "exec ";
+    cmd += command;
+    execl("/bin/sh", "/bin/sh", "-c", cmd.c_str(), (char *) 0);
+    _exit(127);
+  }
+
+  return pid;
+}
+
+
+typedef pid_t (*Launcher)(const std::string &, const std::string &);
+
+struct Result {
+  double rate, blocked;   // launches per second, usec in the call
+};
+
+
+// the rate is 0 if a launch failed
+static Result run(Launcher launch, unsigned long count, bool ours) {
+  Result result = { 0, 0 };
+  double in_call = 0;
+  const double begin = now();
+
+  for (unsigned long n = 0; n < count; ++n) {
+    const double start = now();
+    pid_t pid = launch("true", "DISPLAY=:0");
+    in_call += now() - start;
+
+    if (pid == -1)
+      return result;
+
+    if (ours) {
+      waitpid(pid, 0, 0);
+    } else {
+      // the server's children are reaped by the server
+      while (kill(pid, 0) == 0 || errno != ESRCH)
+        usleep(50);
+    }
+  }
+
+  result.rate = count / (now() - begin);
+  result.blocked = in_call / count * 1e6;
+  return result;
+}
+
+
+int main(int argc, char **argv) {
+  const unsigned long count = (argc > 1) ? strtoul(argv[1], 0, 0) : 200;
+  const unsigned long megabytes = (argc > 2) ? strtoul(argv[2], 0, 0) : 256;
+
+  // forked while small, like xwinwm does from main()
+  if (! startSpawnServer()) {
+    fprintf(stderr, "%s: cannot start the spawn server\n", argv[0]);
+    return 1;
+  }
+
+  // every page is touched, so fork has them all to copy or map
+  const size_t size = megabytes << 20;
+  char *ballast = (char *) malloc(size);
+  if (! ballast) {
+    fprintf(stderr, "%s: cannot allocate %lu MB\n", argv[0], megabytes);
+    return 1;
+  }
+  memset(ballast, 1, size);
+
+  printf("%lu launches from a %lu MB process\n", count, megabytes);
+
+  // the server goes first, as starting it again now would fork all this
+  const Result served = run(spawnCommand, count, false);
+
+  // bexec() does not wait for the pid, so only the call is timed; the
+  // pause keeps the shells from piling up on the server
+  double in_bexec = 0;
+  for (unsigned long n = 0; n < count; ++n) {
+    const double start = now();
+    bexec("true", "DISPLAY=:0");
+    in_bexec += now() - start;
+    usleep(2000);
+  }
+  stopSpawnServer();
+
+  const Result spawned = run(spawnCommand, count, true);
+  const Result forked = run(forkCommand, count, true);
+
+  printf("  fork and exec    %8.0f launches/s  %8.1f us in the call\n",
+         forked.rate, forked.blocked);
+  printf("  spawnCommand     %8.0f launches/s  %8.1f us in the call\n",
+         spawned.rate, spawned.blocked);
+  printf("  spawn server     %8.0f launches/s  %8.1f us in the call\n",
+         served.rate, served.blocked);
+  printf("  bexec, served    %8s             %8.1f us in the call\n",
+         "", in_bexec / count * 1e6);
+
+  free(ballast);
+  return 0;
+}
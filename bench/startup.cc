@@ -0,0 +1,223 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// startup.cc for XWinWM - benchmark of coming up over a populated display
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * For each count given, starts a fresh Xvfb, maps that many windows with
+ * the properties an xterm would have, then starts xwinwm with the
+ * WindowsWM stand-in preloaded and times it until every window has
+ * WM_STATE, which is the last thing managing one does.  The round trips
+ * xwinwm made by then and its peak resident size are shown with the
+ * time.  Without Xvfb the benchmark says so and does nothing.
+ *
+ *   startup xwinwm wmstub.so [count ...]
+ */
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+}
+
+#include <set>
+#include <vector>
+
+#include "session.hh"
+
+// how long xwinwm is given to manage everything
+static const double Timeout = 120.0;
+
+
+// what an xterm puts on its window, _NET_WM_ICON included
+static Window createClient(Display *d, unsigned int n) {
+  const int x = (n * 17) % 900, y = (n * 13) % 700;
+
+  XSetWindowAttributes attrib;
+  attrib.event_mask = PropertyChangeMask;
+  Window w = XCreateWindow(d, DefaultRootWindow(d), x, y, 484, 316, 0,
+                           CopyFromParent, InputOutput, CopyFromParent,
+                           CWEventMask, &attrib);
+
+  char title[64];
+  sprintf(title, "user@host: ~/src/%u", n);
+  char *titles[] = { title };
+  XTextProperty name;
+  XStringListToTextProperty(titles, 1, &name);
+
+  char *argv[] = { const_cast<char *>("xterm"), const_cast<char *>("-ls") };
+
+  XSizeHints size;
+  size.flags = PPosition | PSize | PMinSize | PResizeInc | PBaseSize |
+    PWinGravity;
+  size.x = x;
+  size.y = y;
+  size.width = 484;
+  size.height = 316;
+  size.min_width = size.base_width = 4;
+  size.min_height = size.base_height = 4;
+  size.width_inc = 6;
+  size.height_inc = 13;
+  size.win_gravity = NorthWestGravity;
+
+  XWMHints hints;
+  hints.flags = InputHint | StateHint;
+  hints.input = True;
+  hints.initial_state = NormalState;
+
+  XClassHint klass;
+  klass.res_name = const_cast<char *>("xterm");
+  klass.res_class = const_cast<char *>("XTerm");
+
+  XSetWMProperties(d, w, &name, &name, argv, 2, &size, &hints, &klass);
+  XFree(name.value);
+
+  Atom protocols[] = {
+    XInternAtom(d, "WM_DELETE_WINDOW", False),
+    XInternAtom(d, "WM_TAKE_FOCUS", False)
+  };
+  XSetWMProtocols(d, w, protocols, 2);
+
+  unsigned long pid = 10000 + n;
+  XChangeProperty(d, w, XInternAtom(d, "_NET_WM_PID", False), XA_CARDINAL,
+                  32, PropModeReplace, (unsigned char *) &pid, 1);
+
+  XChangeProperty(d, w, XInternAtom(d, "_NET_WM_NAME", False),
+                  XInternAtom(d, "UTF8_STRING", False), 8, PropModeReplace,
+                  (unsigned char *) title, strlen(title));
+
+  // a 32x32 icon, given as longs as format 32 always is
+  std::vector<unsigned long> icon(2 + 32 * 32);
+  icon[0] = icon[1] = 32;
+  for (unsigned int i = 0; i < 32 * 32; ++i)
+    icon[2 + i] = 0xff000000ul | ((n * 2654435761u + i) & 0xffffff);
+  XChangeProperty(d, w, XInternAtom(d, "_NET_WM_ICON", False), XA_CARDINAL,
+                  32, PropModeReplace, (unsigned char *) &icon[0],
+                  icon.size());
+
+  XMapWindow(d, w);
+  return w;
+}
+
+
+struct Result {
+  double seconds;
+  unsigned long managed, replies, frame_requests, resident;
+};
+
+enum Outcome { Ran, NoServer, NoWM };
+
+
+static Outcome run(const char *xwinwm, const char *stub, unsigned int count,
+                Result &result) {
+  BenchSession session;
+  if (! session.open())
+    return NoServer;
+
+  Display *d = session.display();
+  std::set<Window> clients;
+  for (unsigned int n = 0; n < count; ++n)
+    clients.insert(createClient(d, n));
+  XSync(d, False);
+
+  const Atom wm_state = XInternAtom(d, "WM_STATE", False);
+  const double start = now();
+
+  if (! session.startWM(xwinwm, stub))
+    return NoWM;
+
+  std::set<Window> managed;
+  const int xfd = ConnectionNumber(d);
+  while (managed.size() < clients.size() && now() - start < Timeout) {
+    while (XPending(d)) {
+      XEvent e;
+      XNextEvent(d, &e);
+      if (e.type == PropertyNotify && e.xproperty.atom == wm_state &&
+          e.xproperty.state == PropertyNewValue &&
+          clients.count(e.xproperty.window))
+        managed.insert(e.xproperty.window);
+    }
+    if (managed.size() == clients.size() || ! session.running())
+      break;
+
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(xfd, &rfds);
+    timeval tv = { 0, 100000 };
+    select(xfd + 1, &rfds, 0, 0, &tv);
+  }
+
+  result.seconds = now() - start;
+  result.managed = managed.size();
+  result.replies = session.counters().replies;
+  result.frame_requests = session.counters().frame_requests;
+  result.resident = session.memory("VmHWM");
+  return Ran;
+}
+
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s xwinwm wmstub.so [count ...]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<unsigned int> counts;
+  for (int i = 3; i < argc; ++i)
+    counts.push_back(strtoul(argv[i], 0, 0));
+  if (counts.empty()) {
+    counts.push_back(10);
+    counts.push_back(100);
+    counts.push_back(1000);
+  }
+
+  printf("xwinwm startup over Xvfb, with the WindowsWM stand-in\n");
+  for (unsigned int i = 0; i < counts.size(); ++i) {
+    Result result;
+    const Outcome outcome = run(argv[1], argv[2], counts[i], result);
+    if (outcome == NoServer) {
+      printf("  Xvfb could not be started, skipped\n");
+      return 0;
+    } else if (outcome == NoWM) {
+      printf("  xwinwm could not be started\n");
+      return 1;
+    }
+
+    if (result.managed < counts[i])
+      printf("  %5u windows: only %lu managed after %.1f s\n", counts[i],
+             result.managed, result.seconds);
+    else
+      printf("  %5u windows  %8.1f ms  %7lu round trips (%5.1f a window)  "
+             "%6lu WindowsWM calls  %6lu kB peak RSS\n", counts[i],
+             result.seconds * 1e3, result.replies,
+             (double) result.replies / counts[i], result.frame_requests,
+             result.resident);
+  }
+
+  return 0;
+}
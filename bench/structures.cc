@@ -0,0 +1,609 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// structures.cc for XWinWM - microbenchmarks of the core data structures
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Times the data structures and algorithms xwinwm leans on the most, none
+ * of which need an X server: Rect, smart placement over random layouts,
+ * the timer queue, the color and GC caches, the map windows are looked up
+ * in, and the walk raiseWindow() and lowerWindow() make over trees of
+ * transients.
+ *
+ * The caches run against a display made up here: the Xlib calls they and
+ * BaseDisplay make are defined below, and count the requests they stand
+ * for, so a cache that starts missing shows up as requests as well as
+ * time.  Screen 0 is TrueColor and screen 1 PseudoColor, as only the
+ * latter allocates colors.
+ */
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+}
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "BaseDisplay.hh"
+#include "Color.hh"
+#include "GCCache.hh"
+#include "Placement.hh"
+#include "Stacking.hh"
+#include "Timer.hh"
+#include "Util.hh"
+#include "blackbox.hh"
+#include "i18n.hh"
+
+I18n i18n;
+
+// what a benchmark loop adds up, so the compiler cannot drop the work
+static unsigned long sink;
+
+
+static double now(void) {
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+// the same numbers every run, so runs can be compared
+static unsigned int seed = 2463534242u;
+
+static unsigned int random32(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static int between(int low, int high) {
+  return low + (int) (random32() % (unsigned int) (high - low + 1));
+}
+
+
+static void report(const char *what, double seconds, unsigned long ops) {
+  printf("  %-36s %10.1f ns/op\n", what, seconds * 1e9 / ops);
+}
+
+
+// ------------------------------------------------------------------------
+// the display
+
+static struct {
+  unsigned long gcs, gc_changes, colors, parses, frees;
+} requests;
+
+static Screen fake_screens[2];
+static Visual fake_visuals[2];
+static int fake_fd = -1;
+static char fake_name[] = ":0.0";
+
+extern "C" {
+
+Display *XOpenDisplay(_Xconst char *) {
+  _XPrivDisplay d = (_XPrivDisplay) calloc(1, sizeof(*d));
+
+  fake_visuals[0].c_class = TrueColor;
+  fake_visuals[0].red_mask = 0xff0000;
+  fake_visuals[0].green_mask = 0xff00;
+  fake_visuals[0].blue_mask = 0xff;
+  fake_visuals[0].bits_per_rgb = 8;
+  fake_visuals[0].map_entries = 256;
+  fake_visuals[1].c_class = PseudoColor;
+  fake_visuals[1].bits_per_rgb = 8;
+  fake_visuals[1].map_entries = 256;
+
+  for (int i = 0; i < 2; ++i) {
+    Screen &s = fake_screens[i];
+    s.display = (Display *) d;
+    s.root = 0x100 + i;
+    s.width = 1280;
+    s.height = 1024;
+    s.root_depth = (i == 0) ? 24 : 8;
+    s.root_visual = &fake_visuals[i];
+    s.cmap = 0x200 + i;
+  }
+
+  // BaseDisplay marks the connection close-on-exec
+  fake_fd = open("/dev/null", O_RDONLY);
+  d->fd = fake_fd;
+  d->nscreens = 2;
+  d->default_screen = 0;
+  d->screens = fake_screens;
+  d->display_name = fake_name;
+  return (Display *) d;
+}
+
+int XCloseDisplay(Display *display) {
+  close(fake_fd);
+  free(display);
+  return 0;
+}
+
+char *XDisplayName(_Xconst char *) { return fake_name; }
+
+Bool XQueryExtension(Display *, _Xconst char *, int *, int *, int *) {
+  return False;
+}
+
+Bool XShapeQueryExtension(Display *, int *, int *) { return False; }
+
+Bool XWindowsWMSelectInput(Display *, unsigned long) { return True; }
+
+XErrorHandler XSetErrorHandler(XErrorHandler) { return 0; }
+
+XModifierKeymap *XGetModifierMapping(Display *) { return 0; }
+
+GC XCreateGC(Display *, Drawable, unsigned long, XGCValues *) {
+  ++requests.gcs;
+  // never looked into, only passed back
+  return (GC) malloc(1);
+}
+
+int XChangeGC(Display *, GC, unsigned long, XGCValues *) {
+  ++requests.gc_changes;
+  return 1;
+}
+
+int XFreeGC(Display *, GC gc) {
+  ++requests.frees;
+  free(gc);
+  return 1;
+}
+
+Status XAllocColor(Display *, Colormap, XColor *color) {
+  ++requests.colors;
+  color->pixel = requests.colors & 0xff;
+  return 1;
+}
+
+int XFreeColors(Display *, Colormap, unsigned long *, int, unsigned long) {
+  ++requests.frees;
+  return 1;
+}
+
+Status XParseColor(Display *, Colormap, _Xconst char *spec, XColor *color) {
+  ++requests.parses;
+  unsigned int r, g, b;
+  if (sscanf(spec, "#%2x%2x%2x", &r, &g, &b) != 3)
+    return 0;
+  color->red = r << 8 | r;
+  color->green = g << 8 | g;
+  color->blue = b << 8 | b;
+  return 1;
+}
+
+} // extern "C"
+
+
+class FakeDisplay: public BaseDisplay {
+public:
+  FakeDisplay(void): BaseDisplay("structures") {}
+
+protected:
+  virtual void process_event(XEvent *) {}
+  virtual bool handleSignal(int) { return False; }
+};
+
+
+static unsigned long countRequests(void) {
+  return requests.gcs + requests.gc_changes + requests.colors +
+    requests.parses + requests.frees;
+}
+
+
+// ------------------------------------------------------------------------
+
+static void benchRect(void) {
+  const unsigned int count = 1024, mask = count - 1, ops = 1 << 22;
+  std::vector<Rect> rects;
+  for (unsigned int i = 0; i < count; ++i)
+    rects.push_back(Rect(between(0, 1279), between(0, 1023),
+                         between(1, 640), between(1, 480)));
+
+  printf("Rect, over %u random rectangles\n", count);
+
+  double start = now();
+  for (unsigned int i = 0; i < ops; ++i)
+    sink += rects[i & mask].intersects(rects[(i * 7 + 3) & mask]);
+  report("intersects()", now() - start, ops);
+
+  start = now();
+  for (unsigned int i = 0; i < ops; ++i)
+    sink += (rects[i & mask] & rects[(i * 7 + 3) & mask]).width();
+  report("operator&", now() - start, ops);
+
+  start = now();
+  for (unsigned int i = 0; i < ops; ++i)
+    sink += (rects[i & mask] | rects[(i * 7 + 3) & mask]).height();
+  report("operator|", now() - start, ops);
+
+  start = now();
+  Rect r;
+  for (unsigned int i = 0; i < ops; ++i) {
+    r.setRect(i & 511, i & 255, (i & 127) + 1, (i & 63) + 1);
+    sink += r.right();
+  }
+  report("setRect()", now() - start, ops);
+}
+
+
+static void benchPlacement(void) {
+  const Rect area(0, 0, 1280, 1024);
+  const unsigned int layouts = 32;
+  const unsigned int sizes[] = { 5, 10, 20, 40 };
+
+  printf("smartPlace, a 400x300 window in 1280x1024, %u random layouts\n",
+         layouts);
+
+  for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    std::vector<RectList> frames(layouts);
+    unsigned long spaces = 0;
+    for (unsigned int l = 0; l < layouts; ++l) {
+      RectList free_space(1, area);
+      for (unsigned int i = 0; i < sizes[s]; ++i) {
+        frames[l].push_back(Rect(between(0, 1100), between(0, 850),
+                                 between(150, 700), between(100, 500)));
+        free_space = calcSpace(frames[l].back(), free_space);
+      }
+      spaces += free_space.size();
+    }
+
+    for (int by_row = 1; by_row >= 0; --by_row) {
+      unsigned int rounds = 0;
+      const double start = now();
+      double elapsed;
+      do {
+        for (unsigned int l = 0; l < layouts; ++l) {
+          Rect win(0, 0, 400, 300);
+          sink += smartPlace(win, area, frames[l], by_row, False, False);
+        }
+        ++rounds;
+      } while ((elapsed = now() - start) < 0.25);
+
+      char what[64];
+      sprintf(what, "%2u windows, %s, %lu spaces", sizes[s],
+              (by_row) ? "by row" : "by column", spaces / layouts);
+      report(what, elapsed, (unsigned long) rounds * layouts);
+    }
+  }
+}
+
+
+// ------------------------------------------------------------------------
+
+class NullHandler: public TimeoutHandler {
+public:
+  virtual void timeout(void) { ++sink; }
+};
+
+
+static void benchTimers(BaseDisplay &display) {
+  const unsigned int sizes[] = { 4, 64, 1024 };
+  NullHandler handler;
+
+  printf("timers\n");
+
+  for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    const unsigned int count = sizes[s];
+    std::vector<BTimer *> timers;
+    for (unsigned int i = 0; i < count; ++i) {
+      timers.push_back(new BTimer(&display, &handler));
+      timers.back()->setTimeout(1000 + between(0, 60000));
+    }
+
+    // what restarting a timer costs with the others all running
+    for (unsigned int i = 0; i < count; ++i)
+      timers[i]->start();
+
+    const unsigned int ops = 1 << 16;
+    double start = now();
+    for (unsigned int i = 0; i < ops; ++i) {
+      BTimer *timer = timers[random32() % count];
+      timer->stop();
+      timer->start();
+    }
+    char what[64];
+    sprintf(what, "stop() and start(), %u running", count);
+    report(what, now() - start, ops);
+
+    for (unsigned int i = 0; i < count; ++i)
+      timers[i]->stop();
+
+    // and what the event loop does to run them, as runTimers() does
+    TimerQueue queue;
+    unsigned int rounds = 0;
+    start = now();
+    double elapsed;
+    do {
+      for (unsigned int i = 0; i < count; ++i)
+        queue.push(timers[i]);
+      while (! queue.empty()) {
+        BTimer *timer = queue.top();
+        queue.pop();
+        timer->fireTimeout();
+      }
+      ++rounds;
+    } while ((elapsed = now() - start) < 0.25);
+    sprintf(what, "queued and fired, %u at once", count);
+    report(what, elapsed, (unsigned long) rounds * count);
+
+    for (unsigned int i = 0; i < count; ++i)
+      delete timers[i];
+  }
+}
+
+
+// ------------------------------------------------------------------------
+
+static void benchColors(BaseDisplay &display) {
+  const unsigned int palettes[] = { 8, 64, 512 };
+  const unsigned int ops = 1 << 18;
+
+  printf("BColor and BGCCache, on the made up display\n");
+
+  for (unsigned int p = 0; p < sizeof(palettes) / sizeof(palettes[0]); ++p) {
+    const unsigned int count = palettes[p];
+    std::vector<int> rgb;
+    for (unsigned int i = 0; i < count; ++i)
+      rgb.push_back(random32() & 0xffffff);
+
+    for (unsigned int screen = 0; screen < 2; ++screen) {
+      unsigned long before = countRequests();
+      double start = now();
+      for (unsigned int i = 0; i < ops; ++i) {
+        const int c = rgb[random32() % count];
+        BColor color((c >> 16) & 0xff, (c >> 8) & 0xff, c & 0xff, &display,
+                     screen);
+        sink += color.pixel();
+      }
+      char what[64];
+      sprintf(what, "pixel(), %s, %u colors",
+              (screen == 0) ? "TrueColor" : "PseudoColor", count);
+      report(what, now() - start, ops);
+      if (countRequests() != before)
+        printf("  %-36s %10.3f requests/op\n", "",
+               (double) (countRequests() - before) / ops);
+    }
+
+    char name[16];
+    unsigned long before = countRequests();
+    double start = now();
+    for (unsigned int i = 0; i < ops; ++i) {
+      sprintf(name, "#%06x", rgb[random32() % count]);
+      BColor color(name, &display, 1);
+      sink += color.pixel();
+    }
+    char what[64];
+    sprintf(what, "pixel() by name, %u colors", count);
+    report(what, now() - start, ops);
+    printf("  %-36s %10.3f requests/op\n", "",
+           (double) (countRequests() - before) / ops);
+
+    // the colors stay, as a style would keep them
+    std::vector<BColor *> colors;
+    for (unsigned int i = 0; i < count; ++i)
+      colors.push_back(new BColor((rgb[i] >> 16) & 0xff, (rgb[i] >> 8) & 0xff,
+                                  rgb[i] & 0xff, &display, 0));
+
+    before = countRequests();
+    start = now();
+    for (unsigned int i = 0; i < ops; ++i) {
+      BPen pen(*colors[random32() % count], 0, (i & 1) ? GXcopy : GXxor);
+      sink += (unsigned long) pen.gc();
+    }
+    sprintf(what, "BPen::gc(), %u colors", count);
+    report(what, now() - start, ops);
+    printf("  %-36s %10.3f requests/op\n", "",
+           (double) (countRequests() - before) / ops);
+
+    for (unsigned int i = 0; i < count; ++i)
+      delete colors[i];
+  }
+
+  const BGCCache *gcs = display.gcCache();
+  printf("  gc cache: %lu hits, %lu misses, %lu evictions\n", gcs->hits(),
+         gcs->misses(), gcs->evictions());
+}
+
+
+// ------------------------------------------------------------------------
+
+static void benchLookup(void) {
+  const unsigned int sizes[] = { 16, 256, 4096 };
+  const unsigned int ops = 1 << 20;
+
+  printf("Blackbox::WindowLookup, a tenth of the lookups missing\n");
+
+  for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    const unsigned int count = sizes[s];
+
+    // ids the way the server hands them out: a range for each client,
+    // counted up within it
+    std::vector<Window> ids;
+    Blackbox::WindowLookup lookup;
+    for (unsigned int i = 0; i < count; ++i) {
+      const Window w = ((Window) (1 + i % 40) << 21) | (i / 40 * 3 + 1);
+      ids.push_back(w);
+      lookup.insert(Blackbox::WindowLookup::value_type(w, 0));
+    }
+
+    double start = now();
+    for (unsigned int i = 0; i < ops; ++i) {
+      const unsigned int r = random32();
+      // frames, icons and the root are looked up too, and are not there
+      const Window w = (r % 10) ? ids[r % count] : (Window) r | 0x1000000;
+      sink += lookup.find(w) != lookup.end();
+    }
+    char what[64];
+    sprintf(what, "find(), %u windows", count);
+    report(what, now() - start, ops);
+
+    start = now();
+    for (unsigned int i = 0; i < ops / 4; ++i) {
+      const Window w = ids[random32() % count];
+      lookup.erase(w);
+      lookup.insert(Blackbox::WindowLookup::value_type(w, 0));
+    }
+    sprintf(what, "erase() and insert(), %u windows", count);
+    report(what, now() - start, ops / 4);
+  }
+}
+
+
+// ------------------------------------------------------------------------
+
+// a window with its transients and nothing else
+struct Node {
+  typedef std::list<Node*> List;
+
+  Window id;
+  Node *transient_for;
+  List transients;
+
+  inline const List &getTransients(void) const { return transients; }
+  inline bool isTransient(void) const { return transient_for != 0; }
+  inline Node *getTransientFor(void) const { return transient_for; }
+};
+
+
+// what Workspace::Stacker does, without the screen
+class NodeStacker {
+public:
+  NodeStacker(Node::List &l, std::vector<Window> &v, bool r)
+    : list(l), stack(v.begin()), raise(r) {}
+
+  void operator()(Node *n) {
+    *stack++ = n->id;
+    list.remove(n);
+    if (raise)
+      list.push_front(n);
+    else
+      list.push_back(n);
+  }
+
+private:
+  Node::List &list;
+  std::vector<Window>::iterator stack;
+  bool raise;
+};
+
+
+static Node *addNode(std::vector<Node *> &nodes, Node::List &stacking,
+                     Node *transient_for) {
+  Node *n = new Node;
+  n->id = nodes.size() + 1;
+  n->transient_for = transient_for;
+  if (transient_for)
+    transient_for->transients.push_back(n);
+  nodes.push_back(n);
+  stacking.push_front(n);
+  return n;
+}
+
+
+static void benchStacking(void) {
+  struct Shape {
+    const char *name;
+    unsigned int depth, fan;
+  } shapes[] = {
+    { "a lone window", 0, 0 },
+    { "a chain of 8 transients", 8, 1 },
+    { "a chain of 64 transients", 64, 1 },
+    { "3 levels of 4 transients each", 3, 4 },
+    { "2 levels of 16 transients each", 2, 16 }
+  };
+  const unsigned int others = 100;
+
+  printf("raising and lowering a tree of transients, with %u other "
+         "windows\n", others);
+
+  for (unsigned int s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+    std::vector<Node *> nodes;
+    Node::List stacking;
+    for (unsigned int i = 0; i < others; ++i)
+      addNode(nodes, stacking, 0);
+
+    // the tree is built a level at a time
+    std::vector<Node *> level(1, addNode(nodes, stacking, 0));
+    for (unsigned int d = 0; d < shapes[s].depth; ++d) {
+      std::vector<Node *> next;
+      for (unsigned int i = 0; i < level.size(); ++i) {
+        for (unsigned int f = 0; f < shapes[s].fan; ++f)
+          next.push_back(addNode(nodes, stacking, level[i]));
+      }
+      level.swap(next);
+    }
+    // the window asked to be raised is the deepest of its tree
+    Node *target = level.back();
+
+    unsigned int rounds = 0;
+    const double start = now();
+    double elapsed;
+    do {
+      const bool raise = rounds & 1;
+      Node *root = transientRoot(target);
+      std::vector<Window> stack(1 + countTransients(root));
+      NodeStacker stacker(stacking, stack, raise);
+      if (raise) {
+        stacker(root);
+        raiseTransients(root, stacker);
+      } else {
+        lowerTransients(root, stacker);
+        stacker(root);
+      }
+      sink += stack.front();
+      ++rounds;
+    } while ((elapsed = now() - start) < 0.25);
+
+    report(shapes[s].name, elapsed, rounds);
+
+    for (unsigned int i = 0; i < nodes.size(); ++i)
+      delete nodes[i];
+  }
+}
+
+
+int main(int, char **) {
+  benchRect();
+  benchPlacement();
+  benchLookup();
+  benchStacking();
+
+  FakeDisplay display;
+  benchTimers(display);
+  benchColors(display);
+
+  // the result only has to be used
+  return (sink == 42) ? 1 : 0;
+}
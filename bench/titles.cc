@@ -0,0 +1,259 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// titles.cc for XWinWM - benchmark of the window title conversions
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Runs a corpus of window titles, one per line in UTF-8, through the title
+ * conversions in Util.cc and through the plain byte at a time loops they
+ * replaced.  If an X display can be opened, the locale based conversion
+ * the window manager used before is measured as well.
+ */
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+}
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Util.hh"
+
+typedef std::vector<std::string> Corpus;
+
+
+static double now(void) {
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static bool naiveValidUTF8(const char *s, size_t len) {
+  const unsigned char *p = (const unsigned char *) s;
+  size_t i = 0;
+
+  while (i < len) {
+    unsigned int c = p[i], n;
+    if (c < 0x80) n = 1;
+    else if ((c & 0xe0) == 0xc0) n = 2;
+    else if ((c & 0xf0) == 0xe0) n = 3;
+    else if ((c & 0xf8) == 0xf0) n = 4;
+    else return False;
+
+    if (i + n > len) return False;
+    for (unsigned int k = 1; k < n; ++k)
+      if ((p[i + k] & 0xc0) != 0x80) return False;
+    i += n;
+  }
+
+  return True;
+}
+
+
+static void naiveLatin1ToUTF8(const char *s, size_t len, std::string &out) {
+  out.erase();
+  for (size_t i = 0; i < len; ++i) {
+    unsigned char c = s[i];
+    if (c < 0x80) {
+      out += c;
+    } else {
+      out += (char) (0xc0 | (c >> 6));
+      out += (char) (0x80 | (c & 0x3f));
+    }
+  }
+}
+
+
+// the Latin-1 form of a UTF-8 title, if it has one
+static bool toLatin1(const std::string &utf8, std::string &out) {
+  out.erase();
+  for (size_t i = 0; i < utf8.length(); ++i) {
+    unsigned char c = utf8[i];
+    if (c < 0x80) {
+      out += c;
+    } else if ((c == 0xc2 || c == 0xc3) && i + 1 < utf8.length()) {
+      out += (char) (((c & 0x03) << 6) | (utf8[++i] & 0x3f));
+    } else {
+      return False;
+    }
+  }
+  return True;
+}
+
+
+static void report(const char *what, double secs, unsigned long titles,
+                   unsigned long bytes) {
+  printf("  %-34s %8.1f ns/title %8.1f MB/s\n", what,
+         secs * 1e9 / titles, bytes / secs / (1024.0 * 1024.0));
+}
+
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s corpus [passes]\n", argv[0]);
+    return 1;
+  }
+
+  Corpus utf8, latin1;
+  std::ifstream in(argv[1]);
+  std::string line, l1;
+  while (std::getline(in, line)) {
+    if (line.empty()) continue;
+    utf8.push_back(line);
+    if (toLatin1(line, l1)) latin1.push_back(l1);
+  }
+  if (utf8.empty()) {
+    fprintf(stderr, "%s: no titles in %s\n", argv[0], argv[1]);
+    return 1;
+  }
+
+  const unsigned long passes = (argc > 2) ? strtoul(argv[2], 0, 0) : 20000;
+  unsigned long utf8_bytes = 0, latin1_bytes = 0;
+  Corpus::const_iterator it;
+  for (it = utf8.begin(); it != utf8.end(); ++it) utf8_bytes += it->length();
+  for (it = latin1.begin(); it != latin1.end(); ++it)
+    latin1_bytes += it->length();
+
+  // check the fast paths against the plain loops first
+  std::string a, b;
+  for (it = utf8.begin(); it != utf8.end(); ++it) {
+    if (! isValidUTF8(it->data(), it->length())) {
+      fprintf(stderr, "%s: valid title rejected: %s\n", argv[0], it->c_str());
+      return 1;
+    }
+  }
+  for (it = latin1.begin(); it != latin1.end(); ++it) {
+    latin1ToUTF8(it->data(), it->length(), a);
+    naiveLatin1ToUTF8(it->data(), it->length(), b);
+    if (a != b) {
+      fprintf(stderr, "%s: Latin-1 conversion differs: %s\n", argv[0],
+              b.c_str());
+      return 1;
+    }
+  }
+  const char *bad[] = { "\xc0\xaf", "\xed\xa0\x80", "caf\xe9", "\xf4\x90\x80\x80",
+                        "abcdefghijklmnopqrstuvwxyz\xe2\x82" };
+  for (unsigned int i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    if (isValidUTF8(bad[i], strlen(bad[i]))) {
+      fprintf(stderr, "%s: invalid title %u accepted\n", argv[0], i);
+      return 1;
+    }
+  }
+
+  printf("%lu titles (%lu in Latin-1), %lu passes\n",
+         (unsigned long) utf8.size(), (unsigned long) latin1.size(), passes);
+
+  volatile unsigned long sink = 0;
+  double start;
+  unsigned long n;
+
+  printf("UTF-8 validation:\n");
+  start = now();
+  for (n = 0; n < passes; ++n)
+    for (it = utf8.begin(); it != utf8.end(); ++it)
+      sink += naiveValidUTF8(it->data(), it->length());
+  report("byte at a time", now() - start, passes * utf8.size(),
+         passes * utf8_bytes);
+
+  start = now();
+  for (n = 0; n < passes; ++n)
+    for (it = utf8.begin(); it != utf8.end(); ++it)
+      sink += isValidUTF8(it->data(), it->length());
+  report("isValidUTF8", now() - start, passes * utf8.size(),
+         passes * utf8_bytes);
+
+  printf("Latin-1 to UTF-8:\n");
+  start = now();
+  for (n = 0; n < passes; ++n)
+    for (it = latin1.begin(); it != latin1.end(); ++it) {
+      naiveLatin1ToUTF8(it->data(), it->length(), a);
+      sink += a.length();
+    }
+  report("byte at a time", now() - start, passes * latin1.size(),
+         passes * latin1_bytes);
+
+  start = now();
+  for (n = 0; n < passes; ++n)
+    for (it = latin1.begin(); it != latin1.end(); ++it) {
+      latin1ToUTF8(it->data(), it->length(), a);
+      sink += a.length();
+    }
+  report("latin1ToUTF8", now() - start, passes * latin1.size(),
+         passes * latin1_bytes);
+
+  Display *display = XOpenDisplay(0);
+  if (! display) {
+    printf("no X display, skipping the Xlib conversions\n");
+    return 0;
+  }
+  setlocale(LC_ALL, "");
+
+  // XmbTextPropertyToTextList is slow enough that fewer passes will do
+  const unsigned long xpasses = passes / 10 + 1;
+  XTextProperty prop;
+  prop.encoding = XA_STRING;
+  prop.format = 8;
+
+  printf("STRING property to text, %lu passes:\n", xpasses);
+  start = now();
+  for (n = 0; n < xpasses; ++n)
+    for (it = latin1.begin(); it != latin1.end(); ++it) {
+      prop.value = (unsigned char *) it->c_str();
+      prop.nitems = it->length();
+      char **list;
+      int num;
+      if (XmbTextPropertyToTextList(display, &prop, &list, &num) >= Success &&
+          num > 0) {
+        sink += strlen(list[0]);
+        XFreeStringList(list);
+      }
+    }
+  report("XmbTextPropertyToTextList", now() - start, xpasses * latin1.size(),
+         xpasses * latin1_bytes);
+
+  const Atom utf8_string = XInternAtom(display, "UTF8_STRING", False),
+    compound_text = XInternAtom(display, "COMPOUND_TEXT", False);
+  start = now();
+  for (n = 0; n < xpasses; ++n)
+    for (it = latin1.begin(); it != latin1.end(); ++it) {
+      prop.value = (unsigned char *) it->c_str();
+      prop.nitems = it->length();
+      sink += textPropertyToString(display, prop, utf8_string,
+                                   compound_text).length();
+    }
+  report("textPropertyToString", now() - start, xpasses * latin1.size(),
+         xpasses * latin1_bytes);
+
+  XCloseDisplay(display);
+  return 0;
+}
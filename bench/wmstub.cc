@@ -0,0 +1,173 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// wmstub.cc for XWinWM - a stand-in for the WindowsWM extension
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Loaded into xwinwm with LD_PRELOAD, so it can run on a server without
+ * the WindowsWM extension, such as Xvfb.  The server is said to have the
+ * extension, and the calls xwinwm makes are answered here without a
+ * request; the frames are given the size Windows would give them.  Every
+ * reply Xlib waits for and every event read is counted on the way, in the
+ * file named by XWINWM_BENCH_COUNTERS.
+ */
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/extensions/windowswm.h>
+#include <X11/extensions/windowswmstr.h>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+}
+
+#include "wmstub.hh"
+
+// the extension events are never sent, these only have to be out of the
+// way of the core ones
+static const int StubOpcode = 255, StubEventBase = 120, StubErrorBase = 255;
+
+// the sizes of the Windows frame parts
+static const short BorderSize = 4, CaptionSize = 23;
+
+
+static WMStubCounters *counters;
+
+// maps the counters before xwinwm is running
+static struct Loader {
+  Loader(void) {
+    static WMStubCounters unshared;
+    counters = &unshared;
+
+    const char *path = getenv(WMSTUB_COUNTERS);
+    if (! path)
+      return;
+
+    int fd = open(path, O_RDWR);
+    if (fd == -1)
+      return;
+
+    void *p = mmap(0, sizeof(WMStubCounters), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    close(fd);
+    if (p != MAP_FAILED)
+      counters = (WMStubCounters *) p;
+
+    // the commands xwinwm starts should not be counted in
+    unsetenv("LD_PRELOAD");
+  }
+} loader;
+
+
+static inline void count(unsigned long &counter) {
+  __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+}
+
+
+extern "C" {
+
+// Xlib's own, through which every request that has a reply goes
+Status _XReply(Display *display, void *reply, int extra, Bool discard) {
+  typedef Status (*Reply)(Display *, void *, int, Bool);
+  static Reply next = (Reply) dlsym(RTLD_NEXT, "_XReply");
+
+  count(counters->replies);
+  return next(display, reply, extra, discard);
+}
+
+
+int XNextEvent(Display *display, XEvent *event) {
+  typedef int (*Next)(Display *, XEvent *);
+  static Next next = (Next) dlsym(RTLD_NEXT, "XNextEvent");
+
+  const int ret = next(display, event);
+  count(counters->events);
+  return ret;
+}
+
+
+Bool XQueryExtension(Display *display, _Xconst char *name, int *opcode,
+                     int *event_base, int *error_base) {
+  typedef Bool (*Query)(Display *, _Xconst char *, int *, int *, int *);
+  static Query next = (Query) dlsym(RTLD_NEXT, "XQueryExtension");
+
+  if (strcmp(name, WINDOWSWMNAME) != 0)
+    return next(display, name, opcode, event_base, error_base);
+
+  *opcode = StubOpcode;
+  *event_base = StubEventBase;
+  *error_base = StubErrorBase;
+  return True;
+}
+
+
+Bool XWindowsWMQueryExtension(Display *, int *event_base, int *error_base) {
+  *event_base = StubEventBase;
+  *error_base = StubErrorBase;
+  return True;
+}
+
+
+Bool XWindowsWMSelectInput(Display *, unsigned long) {
+  count(counters->frame_requests);
+  return True;
+}
+
+
+Bool XWindowsWMFrameGetRect(Display *, unsigned int frame_style,
+                            unsigned int, unsigned int,
+                            short ix, short iy, short iw, short ih,
+                            short *rx, short *ry, short *rw, short *rh) {
+  count(counters->frame_requests);
+
+  const short border =
+    (frame_style & WindowsWMFrameStyleBorder) ? BorderSize : 0;
+  const short caption =
+    (frame_style & WindowsWMFrameStyleCaption) ? CaptionSize : 0;
+
+  *rx = ix - border;
+  *ry = iy - border - caption;
+  *rw = iw + border * 2;
+  *rh = ih + border * 2 + caption;
+  return True;
+}
+
+
+Bool XWindowsWMFrameDraw(Display *, int, Window, unsigned int, unsigned int,
+                         short, short, short, short) {
+  count(counters->frame_requests);
+  return True;
+}
+
+
+Bool XWindowsWMFrameSetTitle(Display *, int, Window, unsigned int,
+                             const char *) {
+  count(counters->frame_requests);
+  return True;
+}
+
+} // extern "C"
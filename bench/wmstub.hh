@@ -0,0 +1,35 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// wmstub.hh for XWinWM - what the WindowsWM stand-in counts
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __wmstub_hh
+#define   __wmstub_hh
+
+// the file the counters are kept in, shared by the stand-in loaded into
+// xwinwm and whoever started it
+#define   WMSTUB_COUNTERS "XWINWM_BENCH_COUNTERS"
+
+struct WMStubCounters {
+  unsigned long replies;        // round trips, as seen by _XReply()
+  unsigned long frame_requests; // WindowsWM calls the stand-in answered
+  unsigned long events;         // taken off the queue with XNextEvent()
+};
+
+#endif // __wmstub_hh
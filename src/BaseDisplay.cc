@@ -39,6 +39,10 @@ extern "C" {
 #  include <X11/extensions/shape.h>
 #endif // SHAPE
 
+#ifdef    XKB
+#  include <X11/XKBlib.h>
+#endif // XKB
+
 #ifdef    HAVE_FCNTL_H
 #  include <fcntl.h>
 #endif // HAVE_FCNTL_H
@@ -80,15 +84,33 @@ extern "C" {
 #  include <sys/types.h>
 #  include <sys/wait.h>
 #endif // HAVE_SYS_WAIT_H
+
+#ifdef    HAVE_CLOCK_GETTIME
+#  include <time.h>
+#endif // HAVE_CLOCK_GETTIME
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#  include <pthread.h>
+#  define   SCREEN_THREADS
+#endif
+
+#include <errno.h>
 }
 
+#include <algorithm>
 #include <string>
 using std::string;
 
 #include "i18n.hh"
 #include "BaseDisplay.hh"
+#include "Color.hh"
+#include "EventReader.hh"
 #include "GCCache.hh"
+#include "Icon.hh"
+#include "PropertyFetcher.hh"
+#include "RoundTrips.hh"
 #include "Timer.hh"
+#include "TracedCalls.hh"
 #include "Util.hh"
 
 
@@ -120,7 +142,21 @@ static int handleXErrors(Display *d, XErrorEvent *e) {
 }
 
 
-// signal handler to allow for proper and gentle shutdown
+/*
+ * Only crashes are dealt with in the signal handler itself.  Every other
+ * signal is noted, and a byte written to a pipe wakes the event loop,
+ * which then calls handleSignals(); that way reconfiguring, reaping and
+ * shutting down never run in the middle of whatever was interrupted.
+ */
+static int signal_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t signals_pending = 0;
+static volatile sig_atomic_t signal_pending[NSIG];
+
+#ifdef    HAVE_CLOCK_GETTIME
+// when the first SIGCHLD not yet looked at arrived; clock_gettime() may be
+// called from a signal handler, unlike gettimeofday()
+static timespec child_signal_time;
+#endif // HAVE_CLOCK_GETTIME
 
 #ifndef   HAVE_SIGACTION
 static RETSIGTYPE signalhandler(int sig) {
@@ -131,28 +167,9 @@ static void signalhandler(int sig) {
   static int re_enter = 0;
 
   switch (sig) {
-  case SIGCHLD:
-    int status;
-    waitpid(-1, &status, WNOHANG | WUNTRACED);
-
-#ifndef   HAVE_SIGACTION
-    // assume broken, braindead sysv signal semantics
-    signal(SIGCHLD, (RETSIGTYPE (*)(int)) signalhandler);
-#endif // HAVE_SIGACTION
-
-    break;
-
-  default:
-    if (base_display->handleSignal(sig)) {
-
-#ifndef   HAVE_SIGACTION
-      // assume broken, braindead sysv signal semantics
-      signal(sig, (RETSIGTYPE (*)(int)) signalhandler);
-#endif // HAVE_SIGACTION
-
-      return;
-    }
-
+  case SIGSEGV:
+  case SIGFPE:
+    // these cannot wait
     fprintf(stderr, i18n(BaseDisplaySet, BaseDisplaySignalCaught,
                          "%s:  signal %d caught\n"),
             base_display->getApplicationName(), sig);
@@ -166,16 +183,40 @@ static void signalhandler(int sig) {
       base_display->shutdown();
     }
 
-    if (sig != SIGTERM && sig != SIGINT) {
-      fprintf(stderr, i18n(BaseDisplaySet, BaseDisplayAborting,
-                           "aborting... dumping core\n"));
-      abort();
+    fprintf(stderr, i18n(BaseDisplaySet, BaseDisplayAborting,
+                         "aborting... dumping core\n"));
+    abort();
+
+    break;
+
+  default: {
+    const int saved_errno = errno;
+
+#ifdef    HAVE_CLOCK_GETTIME
+    if (sig == SIGCHLD && ! signal_pending[SIGCHLD])
+      clock_gettime(CLOCK_MONOTONIC, &child_signal_time);
+#endif // HAVE_CLOCK_GETTIME
+
+    signal_pending[sig] = 1;
+    signals_pending = 1;
+
+    // the pipe does not block; if it is full, the loop has plenty to wake
+    // up to anyway
+    if (signal_pipe[1] != -1) {
+      const char c = sig;
+      write(signal_pipe[1], &c, 1);
     }
 
-    exit(0);
+    errno = saved_errno;
+
+#ifndef   HAVE_SIGACTION
+    // assume broken, braindead sysv signal semantics
+    signal(sig, (RETSIGTYPE (*)(int)) signalhandler);
+#endif // HAVE_SIGACTION
 
     break;
   }
+  }
 }
 
 
@@ -186,6 +227,18 @@ BaseDisplay::BaseDisplay(const char *app_name, const char *dpy_name) {
 
   ::base_display = this;
 
+  children_reaped = reap_rounds = reap_latency = reap_latency_max = 0;
+
+  if (pipe(signal_pipe) == -1) {
+    fprintf(stderr, "BaseDisplay::BaseDisplay: couldn't create the signal "
+            "pipe\n");
+    ::exit(2);
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(signal_pipe[i], F_SETFD, FD_CLOEXEC);
+    fcntl(signal_pipe[i], F_SETFL, O_NONBLOCK);
+  }
+
 #ifdef    HAVE_SIGACTION
   struct sigaction action;
 
@@ -214,7 +267,7 @@ BaseDisplay::BaseDisplay(const char *app_name, const char *dpy_name) {
   signal(SIGCHLD, (RETSIGTYPE (*)(int)) signalhandler);
 #endif // HAVE_SIGACTION
 
-  if (! (display = XOpenDisplay(dpy_name))) {
+  if (! (display = tracedOpenDisplay(dpy_name))) {
     fprintf(stderr,
             i18n(BaseDisplaySet, BaseDisplayXConnectFail,
                "BaseDisplay::BaseDisplay: connection to X server failed.\n"));
@@ -230,15 +283,16 @@ BaseDisplay::BaseDisplay(const char *app_name, const char *dpy_name) {
   display_name = XDisplayName(dpy_name);
 
 #ifdef    SHAPE
-  shape.extensions = XShapeQueryExtension(display, &shape.event_basep,
-                                          &shape.error_basep);
+  shape.extensions = tracedShapeQueryExtension(display, &shape.event_basep,
+                                               &shape.error_basep);
 #else // !SHAPE
   shape.extensions = False;
 #endif // SHAPE
 
   int windows_wm_major_opcode;
-  windows_wm.extensions = XQueryExtension(display, WINDOWSWMNAME, &windows_wm_major_opcode,
-                                          &windows_wm.event_basep, &windows_wm.error_basep);
+  windows_wm.extensions =
+    tracedQueryExtension(display, WINDOWSWMNAME, &windows_wm_major_opcode,
+                         &windows_wm.event_basep, &windows_wm.error_basep);
   XWindowsWMSelectInput(display, WindowsWMControllerNotifyMask | WindowsWMActivationNotifyMask);
 
   XSetErrorHandler((XErrorHandler) handleXErrors);
@@ -249,7 +303,8 @@ BaseDisplay::BaseDisplay(const char *app_name, const char *dpy_name) {
 
   NumLockMask = ScrollLockMask = 0;
 
-  const XModifierKeymap* const modmap = XGetModifierMapping(display);
+  const XModifierKeymap* const modmap =
+    BROUNDTRIP(GetModifierMapping, XGetModifierMapping(display));
   if (modmap && modmap->max_keypermod > 0) {
     const int mask_table[] = {
       ShiftMask, LockMask, ControlMask, Mod1Mask,
@@ -260,8 +315,10 @@ BaseDisplay::BaseDisplay(const char *app_name, const char *dpy_name) {
     // get the values of the keyboard lock modifiers
     // Note: Caps lock is not retrieved the same way as Scroll and Num lock
     // since it doesn't need to be.
-    const KeyCode num_lock = XKeysymToKeycode(display, XK_Num_Lock);
-    const KeyCode scroll_lock = XKeysymToKeycode(display, XK_Scroll_Lock);
+    const KeyCode num_lock =
+      BROUNDTRIP(KeysymToKeycode, XKeysymToKeycode(display, XK_Num_Lock));
+    const KeyCode scroll_lock =
+      BROUNDTRIP(KeysymToKeycode, XKeysymToKeycode(display, XK_Scroll_Lock));
 
     for (size_t cnt = 0; cnt < size; ++cnt) {
       if (! modmap->modifiermap[cnt]) continue;
@@ -273,90 +330,955 @@ BaseDisplay::BaseDisplay(const char *app_name, const char *dpy_name) {
     }
   }
 
-  MaskList[0] = 0;
-  MaskList[1] = LockMask;
-  MaskList[2] = NumLockMask;
-  MaskList[3] = LockMask | NumLockMask;
-  MaskList[4] = ScrollLockMask;
-  MaskList[5] = ScrollLockMask | LockMask;
-  MaskList[6] = ScrollLockMask | NumLockMask;
-  MaskList[7] = ScrollLockMask | LockMask | NumLockMask;
-  MaskListLength = sizeof(MaskList) / sizeof(MaskList[0]);
+  ignored_locks = saved_ignored_locks = 0;
+  updateMaskList();
 
   if (modmap) XFreeModifiermap(const_cast<XModifierKeymap*>(modmap));
 
   gccache = (BGCCache*) 0;
+  iconcache = (BIconCache*) 0;
+  fetcher = (BPropertyFetcher *) 0;
+  sharded = False;
+  arrivals = 0;
+  reader = (BEventReader *) 0;
+
+  screen_threads = screen_threads_stopping = False;
+  turn_lock = turn_done = (void *) 0;
+  turn_next = turn_serving = 0;
+#ifdef    SCREEN_THREADS
+  pthread_mutex_t *mutex = new pthread_mutex_t;
+  pthread_mutex_init(mutex, 0);
+  turn_lock = mutex;
+
+  pthread_cond_t *cond = new pthread_cond_t;
+  pthread_cond_init(cond, 0);
+  turn_done = cond;
+#endif // SCREEN_THREADS
 }
 
 
 BaseDisplay::~BaseDisplay(void) {
+  stopScreenThreads();
+
+  delete fetcher;
+  delete reader;
+  delete iconcache;
   delete gccache;
 
+  restoreLockModifiers();
+
+  // each screen's colors were allocated on its own connection, if it has
+  // one
+  for (unsigned int i = 0; i < screenInfoList.size(); ++i) {
+    ScreenScope scope(this, i);
+    BColor::destroyColorCache(this, i);
+  }
+
+  for (unsigned int i = 0; i < screen_loops.size(); ++i)
+    closeScreenConnection(i);
+
+#ifdef    SCREEN_THREADS
+  pthread_mutex_destroy((pthread_mutex_t *) turn_lock);
+  delete (pthread_mutex_t *) turn_lock;
+  pthread_cond_destroy((pthread_cond_t *) turn_done);
+  delete (pthread_cond_t *) turn_done;
+#endif // SCREEN_THREADS
+
   XCloseDisplay(display);
+
+  // the handlers stay, but have nowhere to write
+  int fds[2] = { signal_pipe[0], signal_pipe[1] };
+  signal_pipe[0] = signal_pipe[1] = -1;
+  close(fds[0]);
+  close(fds[1]);
+}
+
+
+// the most events taken from one screen before moving to the next
+static const unsigned int ShardBudget = 16;
+
+
+bool BaseDisplay::threads = False;
+
+
+void BaseDisplay::initThreads(void) {
+  if (! threads)
+    threads = XInitThreads();
+}
+
+
+bool BaseDisplay::startEventReader(void) {
+  if (! threads || reader)
+    return False;
+
+  reader = new BEventReader(display, screenInfoList[0].getRootWindow());
+  if (! reader->start()) {
+    delete reader;
+    reader = (BEventReader *) 0;
+    return False;
+  }
+
+  return True;
+}
+
+
+__thread BaseDisplay::ScreenLoop *BaseDisplay::current_loop = 0;
+
+
+Display *BaseDisplay::getXDisplay(void) const {
+  return (current_loop) ? current_loop->display : display;
+}
+
+
+int BaseDisplay::currentScreen(void) const {
+  return (current_loop) ? (int) current_loop->screen : -1;
+}
+
+
+bool BaseDisplay::openScreenConnection(unsigned int screen) {
+#ifdef    SCREEN_THREADS
+  if (! threads || screen >= screenInfoList.size())
+    return False;
+  if (screen < screen_loops.size() && screen_loops[screen])
+    return True;
+
+  Display *d = XOpenDisplay(DisplayString(display));
+  if (! d)
+    return False;
+
+  ScreenLoop *loop = new ScreenLoop;
+  if (pipe(loop->wake_fd) == -1) {
+    delete loop;
+    XCloseDisplay(d);
+    return False;
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(loop->wake_fd[i], F_SETFD, FD_CLOEXEC);
+    fcntl(loop->wake_fd[i], F_SETFL, O_NONBLOCK);
+  }
+
+  loop->basedisplay = this;
+  loop->screen = screen;
+  loop->display = d;
+  loop->thread = (void *) 0;
+
+  screen_loops.resize(screenInfoList.size(), (ScreenLoop *) 0);
+  screen_loops[screen] = loop;
+  return True;
+#else // !SCREEN_THREADS
+  (void) screen;
+  return False;
+#endif // SCREEN_THREADS
+}
+
+
+// the windows the connection made go with it, so its screen has to be gone
+void BaseDisplay::closeScreenConnection(unsigned int screen) {
+  if (screen >= screen_loops.size() || ! screen_loops[screen])
+    return;
+
+  ScreenLoop *loop = screen_loops[screen];
+  screen_loops[screen] = (ScreenLoop *) 0;
+
+  XCloseDisplay(loop->display);
+  close(loop->wake_fd[0]);
+  close(loop->wake_fd[1]);
+  delete loop;
+
+  if (std::count(screen_loops.begin(), screen_loops.end(),
+                 (ScreenLoop *) 0) == (long) screen_loops.size())
+    screen_loops.clear();
+}
+
+
+BaseDisplay::ScreenScope::ScreenScope(BaseDisplay *d, int screen)
+  : display(d), saved(current_loop) {
+  if (screen < 0)
+    return;
+
+  current_loop = ((unsigned int) screen < d->screen_loops.size()) ?
+                 d->screen_loops[screen] : (ScreenLoop *) 0;
+}
+
+
+BaseDisplay::ScreenScope::~ScreenScope(void) {
+  // its thread has to look again at its events, timers and messages
+  if (current_loop && current_loop != saved)
+    display->wakeScreen(current_loop);
+  current_loop = saved;
+}
+
+
+void BaseDisplay::wakeScreen(ScreenLoop *loop) {
+  const char c = 0;
+  write(loop->wake_fd[1], &c, 1);
+}
+
+
+// the event loop drains the signal pipe whether or not a signal came
+void BaseDisplay::wakeMain(void) {
+  const char c = 0;
+  write(signal_pipe[1], &c, 1);
+}
+
+
+/*
+ * the threads are given their turns by ticket, in the order they asked,
+ * so that none of them can take turn after turn while the others wait.
+ * Without screen threads, the event loop always has the turn.
+ */
+void BaseDisplay::takeTurn(void) {
+#ifdef    SCREEN_THREADS
+  if (! screen_threads)
+    return;
+
+  pthread_mutex_t *lock = (pthread_mutex_t *) turn_lock;
+  pthread_mutex_lock(lock);
+  const unsigned long ticket = turn_next++;
+  while (ticket != turn_serving)
+    pthread_cond_wait((pthread_cond_t *) turn_done, lock);
+  pthread_mutex_unlock(lock);
+#endif // SCREEN_THREADS
+}
+
+
+void BaseDisplay::endTurn(void) {
+#ifdef    SCREEN_THREADS
+  if (! screen_threads)
+    return;
+
+  // what was asked in this turn goes out before the next one asks more
+  XFlush(getXDisplay());
+  // events read from the main connection by the wrong thread do not wake
+  // the event loop by themselves
+  if (current_loop && ! reader && XEventsQueued(display, QueuedAlready) > 0)
+    wakeMain();
+
+  pthread_mutex_t *lock = (pthread_mutex_t *) turn_lock;
+  pthread_mutex_lock(lock);
+  ++turn_serving;
+  pthread_cond_broadcast((pthread_cond_t *) turn_done);
+  pthread_mutex_unlock(lock);
+#endif // SCREEN_THREADS
+}
+
+
+void BaseDisplay::yieldTurn(void) {
+  endTurn();
+  takeTurn();
+}
+
+
+// called by the event loop, which has the first turn
+void BaseDisplay::startScreenThreads(void) {
+#ifdef    SCREEN_THREADS
+  if (screen_loops.empty() || screen_threads)
+    return;
+
+  turn_next = 1;
+  turn_serving = 0;
+  screen_threads = True;
+  screen_threads_stopping = False;
+
+  ScreenLoopList::iterator it = screen_loops.begin();
+  for (; it != screen_loops.end(); ++it) {
+    ScreenLoop *loop = *it;
+    if (! loop)
+      continue;
+
+    pthread_t *t = new pthread_t;
+    if (pthread_create(t, 0, screenThreadMain, loop) != 0) {
+      delete t;
+      // nothing else would read its connection
+      fprintf(stderr, "%s: cannot start the thread of screen %u\n",
+              application_name, loop->screen);
+      shutdown();
+      break;
+    }
+    loop->thread = t;
+  }
+#endif // SCREEN_THREADS
+}
+
+
+// called with the turn, which it keeps
+void BaseDisplay::stopScreenThreads(void) {
+#ifdef    SCREEN_THREADS
+  if (! screen_threads)
+    return;
+
+  screen_threads_stopping = True;
+  ScreenLoopList::iterator it = screen_loops.begin();
+  for (; it != screen_loops.end(); ++it) {
+    if (*it && (*it)->thread)
+      wakeScreen(*it);
+  }
+  endTurn();
+
+  for (it = screen_loops.begin(); it != screen_loops.end(); ++it) {
+    ScreenLoop *loop = *it;
+    if (! loop || ! loop->thread)
+      continue;
+
+    pthread_t *t = (pthread_t *) loop->thread;
+    pthread_join(*t, 0);
+    delete t;
+    loop->thread = (void *) 0;
+  }
+
+  screen_threads = False;
+#endif // SCREEN_THREADS
+}
+
+
+void *BaseDisplay::screenThreadMain(void *data) {
+  ScreenLoop *loop = (ScreenLoop *) data;
+  loop->basedisplay->runScreenLoop(loop);
+  return (void *) 0;
+}
+
+
+/*
+ * the event loop of a screen thread.  An event and the messages it posted
+ * make one turn, so a screen waits for no more than that of another, and
+ * the thread only waits for more once it has nothing left.
+ */
+void BaseDisplay::runScreenLoop(ScreenLoop *loop) {
+  current_loop = loop;
+  const int xfd = ConnectionNumber(loop->display);
+
+  takeTurn();
+  while (run_state == RUNNING && ! internal_error &&
+         ! screen_threads_stopping) {
+    bool busy = False;
+    if (XPending(loop->display)) {
+      XEvent e;
+      XNextEvent(loop->display, &e);
+      dispatch(&e);
+      busy = True;
+    }
+    runMessages(loop->messages.size());
+    runTimers();
+
+    if (busy || ! loop->messages.empty() || run_state != RUNNING ||
+        XEventsQueued(loop->display, QueuedAlready) > 0) {
+      yieldTurn();
+      continue;
+    }
+
+    timeval now, tm, *timeout = (timeval *) 0;
+    if (! loop->timers.empty()) {
+      gettimeofday(&now, 0);
+      tm = loop->timers.top()->timeRemaining(now);
+      timeout = &tm;
+    }
+
+    endTurn();
+
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(xfd, &rfds);
+    FD_SET(loop->wake_fd[0], &rfds);
+    select(std::max(xfd, loop->wake_fd[0]) + 1, &rfds, 0, 0, timeout);
+
+    char buffer[64];
+    while (read(loop->wake_fd[0], buffer, sizeof(buffer)) > 0)
+      ;
+
+    takeTurn();
+  }
+  endTurn();
+
+  // a shutdown asked for from this screen, which the event loop sleeps
+  // through otherwise
+  if (run_state != RUNNING)
+    wakeMain();
 }
 
 
 void BaseDisplay::eventLoop(void) {
   run();
+  startScreenThreads();
 
   const int xfd = ConnectionNumber(display);
 
   while (run_state == RUNNING && ! internal_error) {
-    if (XPending(display)) {
+    if (signals_pending) {
+      handleSignals();
+      continue;
+    }
+
+    if (sharded) {
+      readShards();
+      if (runShards()) {
+        // one message per round keeps long chains of work from starving
+        // the screens, and timers are not put off by a steady stream
+        runMessages(1);
+        runTimers();
+        continue;
+      }
+    } else {
       XEvent e;
-      XNextEvent(display, &e);
-      process_event(&e);
+      if (nextEvent(&e)) {
+        dispatch(&e);
+        runMessages(messages.size());
+        yieldTurn();
+        continue;
+      }
+    }
+
+    if (! messages.empty()) {
+      runMessages(messages.size());
+      continue;
+    }
+
+    int fd = xfd;
+    if (reader) {
+      // nothing else sends what the handlers asked for while the thread
+      // sits in XNextEvent
+      XFlush(display);
+      if (! reader->prepareWait())
+        continue;
+      fd = reader->fd();
+    }
+
+    fd_set rfds;
+    timeval now, tm, *timeout = (timeval *) 0;
+
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    FD_SET(signal_pipe[0], &rfds);
+
+    if (! timerList.empty()) {
+      const BTimer* const timer = timerList.top();
+
+      gettimeofday(&now, 0);
+      tm = timer->timeRemaining(now);
+
+      timeout = &tm;
+    }
+
+    endTurn();
+    select(std::max(fd, signal_pipe[0]) + 1, &rfds, 0, 0, timeout);
+    takeTurn();
+
+    // a screen thread may have woken us, see wakeMain()
+    if (screen_threads && FD_ISSET(signal_pipe[0], &rfds)) {
+      char buffer[64];
+      while (read(signal_pipe[0], buffer, sizeof(buffer)) > 0)
+        ;
+    }
+
+    runTimers();
+  }
+
+  stopScreenThreads();
+}
+
+
+// deals with the signals caught since the last time here, in signal order
+void BaseDisplay::handleSignals(void) {
+  char buffer[64];
+  while (read(signal_pipe[0], buffer, sizeof(buffer)) > 0)
+    ;
+  signals_pending = 0;
+
+  for (int sig = 1; sig < NSIG; ++sig) {
+    if (! signal_pending[sig])
+      continue;
+
+    if (sig == SIGCHLD) {
+      reapChildren();
+      continue;
+    }
+
+    signal_pending[sig] = 0;
+    if (handleSignal(sig))
+      continue;
+
+    fprintf(stderr, i18n(BaseDisplaySet, BaseDisplaySignalCaught,
+                         "%s:  signal %d caught\n"),
+            getApplicationName(), sig);
+
+    if (sig == SIGTERM || sig == SIGINT) {
+      // the event loop ends, and everything is cleaned up on the way out
+      fprintf(stderr, i18n(BaseDisplaySet, BaseDisplayShuttingDown,
+                           "shutting down\n"));
+      shutdown();
+      continue;
+    }
+
+    internal_error = True;
+    fprintf(stderr, i18n(BaseDisplaySet, BaseDisplayAborting,
+                         "aborting... dumping core\n"));
+    abort();
+  }
+}
+
+
+/*
+ * One SIGCHLD may stand for any number of children, as signals of a kind
+ * are not queued, so every child that has exited is reaped.
+ */
+void BaseDisplay::reapChildren(void) {
+  unsigned long latency = 0;
+#ifdef    HAVE_CLOCK_GETTIME
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  latency = (now.tv_sec - child_signal_time.tv_sec) * 1000000 +
+    (now.tv_nsec - child_signal_time.tv_nsec) / 1000;
+#endif // HAVE_CLOCK_GETTIME
+
+  // a child exiting from here on signals again
+  signal_pending[SIGCHLD] = 0;
+
+  unsigned long count = 0;
+  int status;
+  while (waitpid(-1, &status, WNOHANG) > 0)
+    ++count;
+
+  if (count == 0)
+    return;
+
+  children_reaped += count;
+  ++reap_rounds;
+  reap_latency += latency;
+  reap_latency_max = std::max(reap_latency_max, latency);
+}
+
+
+void BaseDisplay::runTimers(void) {
+  TimerQueue &timerList = (current_loop) ? current_loop->timers :
+                                           this->timerList;
+  timeval now;
+  gettimeofday(&now, 0);
+
+  // there is a small chance for deadlock here:
+  // *IF* the timer list keeps getting refreshed *AND* the time between
+  // timer->start() and timer->shouldFire() is within the timer's period
+  // then the timer will keep firing.  This should be VERY near impossible.
+  while (! timerList.empty()) {
+    BTimer *timer = timerList.top();
+    if (! timer->shouldFire(now))
+      break;
+
+    timerList.pop();
+
+    // halt the timer before firing it, so that the handler can start it
+    // again for another round
+    timer->halt();
+    timer->fireTimeout();
+    if (timer->isRecurring() && ! timer->isTiming())
+      timer->start();
+  }
+}
+
+
+void BaseDisplay::setEventSharding(bool s) {
+  sharded = s;
+  shards.resize((sharded) ? screenInfoList.size() + 1 : 0);
+}
+
+
+void BaseDisplay::handleEvent(XEvent *e) {
+  dispatch(e);
+  runMessages(messages.size());
+}
+
+
+void BaseDisplay::dispatch(XEvent *e) {
+  if (fetcher && fetcher->isCompletion(e)) {
+    fetcher->complete();
+    return;
+  }
+
+  // what the event loop is given for a screen with a connection of its
+  // own, such as the WindowsWM events, is done on that connection
+  ScreenScope scope(this, (current_loop || screen_loops.empty()) ?
+                          -1 : eventScreen(e));
+  process_event(e);
+}
+
+
+// takes the next event if there is one, without waiting
+bool BaseDisplay::nextEvent(XEvent *e) {
+  if (reader) {
+    if (! put_back.empty()) {
+      *e = put_back.front();
+      put_back.pop_front();
+      return True;
+    }
+    return reader->pop(*e);
+  }
+
+  if (! XPending(display))
+    return False;
+
+  XNextEvent(display, e);
+  return True;
+}
+
+
+void BaseDisplay::shardEvent(const XEvent &e, bool front) {
+  int screen = eventScreen(&e);
+  if (screen < 0 || (unsigned int) screen >= screenInfoList.size())
+    screen = screenInfoList.size();
+
+  ShardedEvent sharded_event;
+  sharded_event.event = e;
+  if (front) {
+    // put back to be handled next, so it goes before everything queued
+    sharded_event.arrival = 0;
+    shards[screen].push_front(sharded_event);
+  } else {
+    sharded_event.arrival = ++arrivals;
+    shards[screen].push_back(sharded_event);
+  }
+}
+
+
+// moves every event that has arrived into the queue of its screen
+void BaseDisplay::readShards(void) {
+  XEvent e;
+
+  if (reader) {
+    // the thread keeps adding, so take no more than a ring's worth
+    for (unsigned long n = reader->capacity(); n > 0 && reader->pop(e); --n)
+      shardEvent(e, False);
+    return;
+  }
+
+  int count = XEventsQueued(display, QueuedAfterFlush);
+  while (count-- > 0) {
+    XNextEvent(display, &e);
+    shardEvent(e, False);
+  }
+}
+
+
+/*
+ * Handles up to ShardBudget events from each screen, returns False if
+ * there were none.  An event that belonged to no screen when it was read
+ * may be for a window that an earlier event, such as a MapRequest, is
+ * about to manage, so the screens stop at the oldest of those until it has
+ * been handled, and it waits for every event that came before it.
+ */
+bool BaseDisplay::runShards(void) {
+  bool handled = False;
+
+  for (size_t i = 0; i < shards.size() && run_state == RUNNING; ++i) {
+    if (runShard(i))
+      handled = True;
+  }
+
+  return handled;
+}
+
+
+// returns True if any event was handled
+bool BaseDisplay::runShard(size_t i) {
+  const size_t none = shards.size() - 1;
+  bool handled = False;
+
+  for (unsigned int n = 0; n < ShardBudget && ! shards[i].empty() &&
+         run_state == RUNNING; ++n) {
+    // the handler can read more events and change the queues, so this is
+    // worked out again every time
+    const unsigned long arrival = shards[i].front().arrival;
+    if (i != none) {
+      if (! shards[none].empty() && shards[none].front().arrival < arrival)
+        break;
     } else {
-      fd_set rfds;
-      timeval now, tm, *timeout = (timeval *) 0;
+      bool waiting = False;
+      for (size_t j = 0; j < none && ! waiting; ++j)
+        waiting = (! shards[j].empty() && shards[j].front().arrival < arrival);
+      if (waiting)
+        break;
+    }
+
+    XEvent e = shards[i].front().event;
+    shards[i].pop_front();
+    dispatch(&e);
+    handled = True;
+  }
+
+  return handled;
+}
+
+
+void BaseDisplay::postMessage(BMessageHandler *handler, unsigned int message,
+                              unsigned long data) {
+  Message m;
+  m.handler = handler;
+  m.message = message;
+  m.data = data;
+  ((current_loop) ? current_loop->messages : messages).push_back(m);
+}
+
+
+void BaseDisplay::postScreenMessage(unsigned int screen,
+                                    BMessageHandler *handler,
+                                    unsigned int message,
+                                    unsigned long data) {
+  ScreenScope scope(this, screen);
+  if (current_loop)
+    postMessage(handler, message, data);
+  else
+    postMainMessage(handler, message, data);
+}
+
 
-      FD_ZERO(&rfds);
-      FD_SET(xfd, &rfds);
+void BaseDisplay::postMainMessage(BMessageHandler *handler,
+                                  unsigned int message, unsigned long data) {
+  Message m;
+  m.handler = handler;
+  m.message = message;
+  m.data = data;
+  messages.push_back(m);
+
+  if (current_loop)
+    wakeMain();
+}
 
-      if (! timerList.empty()) {
-        const BTimer* const timer = timerList.top();
 
-        gettimeofday(&now, 0);
-        tm = timer->timeRemaining(now);
+void BaseDisplay::cancelMessages(BMessageHandler *handler) {
+  std::vector<MessageQueue*> queues(1, &messages);
+  ScreenLoopList::iterator loop = screen_loops.begin();
+  for (; loop != screen_loops.end(); ++loop) {
+    if (*loop)
+      queues.push_back(&(*loop)->messages);
+  }
 
-        timeout = &tm;
+  for (size_t i = 0; i < queues.size(); ++i) {
+    MessageQueue::iterator it = queues[i]->begin();
+    while (it != queues[i]->end()) {
+      if (it->handler == handler)
+        it = queues[i]->erase(it);
+      else
+        ++it;
+    }
+  }
+}
+
+
+// takes the oldest queued event of a type, on window unless that is None
+bool BaseDisplay::findShardedEvent(int type, Window window, XEvent *e) {
+  size_t shard = 0;
+  ShardQueue::iterator found;
+  bool any = False;
+
+  for (size_t i = 0; i < shards.size(); ++i) {
+    ShardQueue::iterator it = shards[i].begin();
+    for (; it != shards[i].end(); ++it) {
+      if (it->event.type == type &&
+          (window == None || it->event.xany.window == window)) {
+        if (! any || it->arrival < found->arrival) {
+          shard = i;
+          found = it;
+          any = True;
+        }
+        break;
       }
+    }
+  }
 
-      select(xfd + 1, &rfds, 0, 0, timeout);
+  if (! any)
+    return False;
 
-      // check for timer timeout
-      gettimeofday(&now, 0);
+  *e = found->event;
+  shards[shard].erase(found);
+  return True;
+}
+
+
+bool BaseDisplay::checkTypedWindowEvent(Window window, int type,
+                                        XEvent *e) {
+  if (current_loop)
+    return XCheckTypedWindowEvent(current_loop->display, window, type, e);
+
+  if (findShardedEvent(type, window, e))
+    return True;
+
+  if (reader) {
+    EventQueue::iterator it = put_back.begin();
+    for (; it != put_back.end(); ++it) {
+      if (it->type == type && it->xany.window == window) {
+        *e = *it;
+        put_back.erase(it);
+        return True;
+      }
+    }
+    if (reader->take(type, window, *e))
+      return True;
+  }
+
+  return XCheckTypedWindowEvent(display, window, type, e);
+}
+
+
+void BaseDisplay::syncEvents(void) {
+  if (reader && ! current_loop)
+    BROUNDTRIP(Sync, reader->sync());
+  else
+    BROUNDTRIP(Sync, XSync(getXDisplay(), False));
+}
 
-      // there is a small chance for deadlock here:
-      // *IF* the timer list keeps getting refreshed *AND* the time between
-      // timer->start() and timer->shouldFire() is within the timer's period
-      // then the timer will keep firing.  This should be VERY near impossible.
-      while (! timerList.empty()) {
-        BTimer *timer = timerList.top();
-        if (! timer->shouldFire(now))
-          break;
-
-        timerList.pop();
-
-        timer->fireTimeout();
-        timer->halt();
-        if (timer->isRecurring())
-          timer->start();
+
+bool BaseDisplay::checkTypedEvent(int type, XEvent *e) {
+  if (current_loop)
+    return XCheckTypedEvent(current_loop->display, type, e);
+
+  if (findShardedEvent(type, None, e))
+    return True;
+
+  if (reader) {
+    EventQueue::iterator it = put_back.begin();
+    for (; it != put_back.end(); ++it) {
+      if (it->type == type) {
+        *e = *it;
+        put_back.erase(it);
+        return True;
       }
     }
+    if (reader->take(type, None, *e))
+      return True;
+  }
+
+  return XCheckTypedEvent(display, type, e);
+}
+
+
+void BaseDisplay::putBackEvent(XEvent *e) {
+  if (current_loop)
+    XPutBackEvent(current_loop->display, e);
+  else if (sharded)
+    shardEvent(*e, True);
+  else if (reader)
+    put_back.push_front(*e);
+  else
+    XPutBackEvent(display, e);
+}
+
+
+void BaseDisplay::runMessages(size_t limit) {
+  MessageQueue &messages = (current_loop) ? current_loop->messages :
+                                            this->messages;
+  while (limit-- > 0 && ! messages.empty()) {
+    const Message m = messages.front();
+    messages.pop_front();
+    m.handler->handleMessage(m.message, m.data);
   }
 }
 
 
+// the timer fires in the turn of whichever screen started it
 void BaseDisplay::addTimer(BTimer *timer) {
   if (! timer) return;
 
-  timerList.push(timer);
+  ((current_loop) ? current_loop->timers : timerList).push(timer);
 }
 
 
 void BaseDisplay::removeTimer(BTimer *timer) {
   timerList.release(timer);
+
+  ScreenLoopList::iterator it = screen_loops.begin();
+  for (; it != screen_loops.end(); ++it) {
+    if (*it)
+      (*it)->timers.release(timer);
+  }
+}
+
+
+/*
+ * Fills MaskList with every combination of the lock modifiers that the
+ * server does not ignore by itself.  A lock key without a modifier would
+ * only repeat the same combinations, so those are left out.
+ */
+void BaseDisplay::updateMaskList(void) {
+  const unsigned int locks[] = { LockMask, (unsigned int) NumLockMask,
+                                 (unsigned int) ScrollLockMask };
+
+  MaskListLength = MaskListNoScrollLockLength = 0;
+  for (unsigned int i = 0; i < 8; ++i) {
+    unsigned int mask = 0;
+    for (unsigned int j = 0; j < 3; ++j) {
+      if (i & (1 << j))
+        mask |= locks[j];
+    }
+    mask &= ~ignored_locks;
+
+    if (std::find(MaskList, MaskList + MaskListLength, mask) ==
+        MaskList + MaskListLength)
+      MaskList[MaskListLength++] = mask;
+
+    // the first four leave scroll lock out
+    if (i == 3)
+      MaskListNoScrollLockLength = MaskListLength;
+  }
+}
+
+
+/*
+ * Asks the server to ignore caps lock and num lock when it activates
+ * passive grabs, so that a grab takes one request rather than one for each
+ * combination of them.  Scroll lock is left alone, since whether it stops
+ * a grab is a per screen setting.  This changes the keyboard for every
+ * client, so it is only done when asked for and undone by
+ * restoreLockModifiers().
+ */
+bool BaseDisplay::ignoreLockModifiers(void) {
+#ifdef    XKB
+  int opcode, event, error, major = XkbMajorVersion, minor = XkbMinorVersion;
+  if (! BROUNDTRIP(XkbQueryExtension,
+                   XkbQueryExtension(display, &opcode, &event, &error,
+                                     &major, &minor)))
+    return False;
+
+  XkbDescPtr xkb = BROUNDTRIP(XkbGetMap,
+                              XkbGetMap(display, 0, XkbUseCoreKbd));
+  if (! xkb)
+    return False;
+  if (BROUNDTRIP(XkbGetControls,
+                 XkbGetControls(display, XkbIgnoreLockModsMask, xkb))
+      != Success) {
+    XkbFreeKeyboard(xkb, 0, True);
+    return False;
+  }
+  saved_ignored_locks = xkb->ctrls->ignore_lock.real_mods;
+  XkbFreeKeyboard(xkb, 0, True);
+
+  const unsigned int mods = LockMask | NumLockMask;
+  if (! XkbSetIgnoreLockMods(display, XkbUseCoreKbd, mods, mods, 0, 0))
+    return False;
+
+  ignored_locks = mods;
+  updateMaskList();
+  return True;
+#else // !XKB
+  return False;
+#endif // XKB
+}
+
+
+/*
+ * Puts back the lock modifiers the server ignored before
+ * ignoreLockModifiers().  Done when the display is closed, and before a
+ * restart execs, which never gets that far.
+ */
+void BaseDisplay::restoreLockModifiers(void) {
+#ifdef    XKB
+  if (! ignored_locks)
+    return;
+
+  XkbSetIgnoreLockMods(display, XkbUseCoreKbd, ignored_locks,
+                       saved_ignored_locks & ignored_locks, 0, 0);
+  // exec would drop the request with the rest of the output buffer
+  XFlush(display);
+
+  ignored_locks = 0;
+  updateMaskList();
+#endif // XKB
 }
 
 
@@ -364,20 +1286,21 @@ void BaseDisplay::removeTimer(BTimer *timer) {
  * Grabs a button, but also grabs the button in every possible combination
  * with the keyboard lock keys, so that they do not cancel out the event.
 
- * if allow_scroll_lock is true then only the top half of the lock mask
- * table is used and scroll lock is ignored.  This value defaults to false.
+ * if allow_scroll_lock is true then only the combinations without scroll
+ * lock are grabbed, and scroll lock disables the grab.  This value
+ * defaults to false.
  */
 void BaseDisplay::grabButton(unsigned int button, unsigned int modifiers,
                              Window grab_window, bool owner_events,
                              unsigned int event_mask, int pointer_mode,
                              int keyboard_mode, Window confine_to,
                              Cursor cursor, bool allow_scroll_lock) const {
-  unsigned int length = (allow_scroll_lock) ? MaskListLength / 2:
-                                              MaskListLength;
+  size_t length = (allow_scroll_lock) ? MaskListNoScrollLockLength :
+                                        MaskListLength;
   for (size_t cnt = 0; cnt < length; ++cnt) {
-    XGrabButton(display, button, modifiers | MaskList[cnt], grab_window,
-                owner_events, event_mask, pointer_mode, keyboard_mode,
-                confine_to, cursor);
+    XGrabButton(getXDisplay(), button, modifiers | MaskList[cnt],
+                grab_window, owner_events, event_mask, pointer_mode,
+                keyboard_mode, confine_to, cursor);
   }
 }
 
@@ -389,8 +1312,72 @@ void BaseDisplay::grabButton(unsigned int button, unsigned int modifiers,
 void BaseDisplay::ungrabButton(unsigned int button, unsigned int modifiers,
                                Window grab_window) const {
   for (size_t cnt = 0; cnt < MaskListLength; ++cnt) {
-    XUngrabButton(display, button, modifiers | MaskList[cnt], grab_window);
+    XUngrabButton(getXDisplay(), button, modifiers | MaskList[cnt],
+                  grab_window);
+  }
+}
+
+
+bool BButtonGrabs::Grab::operator==(const Grab &g) const {
+  return sameButton(g) && event_mask == g.event_mask &&
+         pointer_mode == g.pointer_mode && keyboard_mode == g.keyboard_mode &&
+         confine_to == g.confine_to && cursor == g.cursor &&
+         owner_events == g.owner_events &&
+         allow_scroll_lock == g.allow_scroll_lock;
+}
+
+
+void BButtonGrabs::add(unsigned int button, unsigned int modifiers,
+                       bool owner_events, unsigned int event_mask,
+                       int pointer_mode, int keyboard_mode,
+                       Window confine_to, Cursor cursor,
+                       bool allow_scroll_lock) {
+  Grab g;
+  g.button = button;
+  g.modifiers = modifiers;
+  g.event_mask = event_mask;
+  g.pointer_mode = pointer_mode;
+  g.keyboard_mode = keyboard_mode;
+  g.confine_to = confine_to;
+  g.cursor = cursor;
+  g.owner_events = owner_events;
+  g.allow_scroll_lock = allow_scroll_lock;
+  wanted.push_back(g);
+}
+
+
+void BButtonGrabs::commit(void) {
+  GrabList::const_iterator it, begin = grabbed.begin(), end = grabbed.end();
+
+  /*
+    a grab that stays only needs to be made again if something about it
+    changed, and then the new one replaces the old one.  It is released
+    first only if it changes how many lock combinations it covers.
+  */
+  for (it = begin; it != end; ++it) {
+    GrabList::const_iterator w = wanted.begin();
+    while (w != wanted.end() && ! w->sameButton(*it))
+      ++w;
+    if (w == wanted.end() || w->allow_scroll_lock != it->allow_scroll_lock)
+      display->ungrabButton(it->button, it->modifiers, window);
+  }
+
+  for (it = wanted.begin(); it != wanted.end(); ++it) {
+    if (std::find(begin, end, *it) != end)
+      continue;
+    display->grabButton(it->button, it->modifiers, window, it->owner_events,
+                        it->event_mask, it->pointer_mode, it->keyboard_mode,
+                        it->confine_to, it->cursor, it->allow_scroll_lock);
   }
+
+  grabbed.swap(wanted);
+  wanted.clear();
+}
+
+
+void BButtonGrabs::release(void) {
+  begin();
+  commit();
 }
 
 
@@ -409,6 +1396,22 @@ BGCCache* BaseDisplay::gcCache(void) const {
 }
 
 
+BIconCache* BaseDisplay::iconCache(void) const {
+  if (! iconcache)
+    iconcache = new BIconCache(this);
+
+  return iconcache;
+}
+
+
+BPropertyFetcher* BaseDisplay::propertyFetcher(void) const {
+  if (! fetcher)
+    fetcher = new BPropertyFetcher(const_cast<BaseDisplay*>(this));
+
+  return fetcher;
+}
+
+
 ScreenInfo::ScreenInfo(BaseDisplay *d, unsigned int num) {
   basedisplay = d;
   screen_number = num;
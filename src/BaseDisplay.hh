@@ -30,16 +30,30 @@ extern "C" {
 #include <X11/Xatom.h>
 }
 
+#include <deque>
 #include <vector>
 #include <string>
 
 // forward declaration
 class BaseDisplay;
+class BEventReader;
 class BGCCache;
+class BIconCache;
+class BPropertyFetcher;
 
 #include "Timer.hh"
 #include "Util.hh"
 
+/*
+ * receives messages posted with BaseDisplay::postMessage().  They are used
+ * for work that one screen's events cause on another screen, so that it is
+ * done in its own turn instead of inside the other screen's event handling.
+ */
+class BMessageHandler {
+public:
+  virtual void handleMessage(unsigned int message, unsigned long data) = 0;
+};
+
 class ScreenInfo {
 private:
   BaseDisplay *basedisplay;
@@ -84,29 +98,117 @@ private:
   };
   BShape windows_wm;
 
+  // the combinations of the lock modifiers a grab is repeated for, those
+  // without scroll lock first
   unsigned int MaskList[8];
-  size_t MaskListLength;
+  size_t MaskListLength, MaskListNoScrollLockLength;
+  // lock modifiers the server ignores for grabs, and what it ignored before
+  unsigned int ignored_locks, saved_ignored_locks;
 
   enum RunState { STARTUP, RUNNING, SHUTDOWN };
   RunState run_state;
 
   Display *display;
   mutable BGCCache *gccache;
+  mutable BIconCache *iconcache;
+  mutable BPropertyFetcher *fetcher;
 
   typedef std::vector<ScreenInfo> ScreenInfoList;
   ScreenInfoList screenInfoList;
   TimerQueue timerList;
 
+  struct Message {
+    BMessageHandler *handler;
+    unsigned int message;
+    unsigned long data;
+  };
+  typedef std::deque<Message> MessageQueue;
+  MessageQueue messages;
+
+  // events waiting to be handled, one queue per screen and one more for
+  // those that belong to no screen; empty unless sharding is on.  Each is
+  // numbered in the order it arrived, see runShards()
+  typedef std::deque<XEvent> EventQueue;
+  struct ShardedEvent {
+    XEvent event;
+    unsigned long arrival;
+  };
+  typedef std::deque<ShardedEvent> ShardQueue;
+  std::vector<ShardQueue> shards;
+  unsigned long arrivals;
+  bool sharded;
+
+  // with the reader thread running, events come from its ring instead of
+  // straight from Xlib, and those put back wait here
+  BEventReader *reader;
+  EventQueue put_back;
+  static bool threads;
+
+  // a screen with a connection and an event thread of its own, see
+  // openScreenConnection().  Its timers and messages are run by its thread
+  struct ScreenLoop {
+    BaseDisplay *basedisplay;
+    unsigned int screen;
+    Display *display;
+    TimerQueue timers;
+    MessageQueue messages;
+    int wake_fd[2];
+    void *thread;
+  };
+  // by screen number, 0 for those on the main connection
+  typedef std::vector<ScreenLoop*> ScreenLoopList;
+  ScreenLoopList screen_loops;
+  bool screen_threads, screen_threads_stopping;
+  // the screen whose work the calling thread is doing, 0 for none
+  static __thread ScreenLoop *current_loop;
+
+  // only one thread at a time runs the window manager, and they take
+  // turns in the order they asked, see takeTurn()
+  void *turn_lock, *turn_done;
+  unsigned long turn_next, turn_serving;
+
+  // children reaped and the rounds it took; for each round, the time since
+  // the SIGCHLD is added to reap_latency, in microseconds
+  unsigned long children_reaped, reap_rounds;
+  unsigned long reap_latency, reap_latency_max;
+
   const char *display_name, *application_name;
 
   // no copying!
   BaseDisplay(const BaseDisplay &);
   BaseDisplay& operator=(const BaseDisplay&);
 
+  void updateMaskList(void);
+
+  void runMessages(size_t limit);
+  void runTimers(void);
+  void dispatch(XEvent *e);
+  bool nextEvent(XEvent *e);
+  void shardEvent(const XEvent &e, bool front);
+  void readShards(void);
+  bool runShards(void);
+  bool runShard(size_t i);
+  bool findShardedEvent(int type, Window window, XEvent *e);
+  void handleSignals(void);
+  void reapChildren(void);
+
+  void startScreenThreads(void);
+  void stopScreenThreads(void);
+  static void *screenThreadMain(void *data);
+  void runScreenLoop(ScreenLoop *loop);
+  void wakeScreen(ScreenLoop *loop);
+  void wakeMain(void);
+  void takeTurn(void);
+  void endTurn(void);
+  void yieldTurn(void);
+
 protected:
   // pure virtual function... you must override this
   virtual void process_event(XEvent *e) = 0;
 
+  // the screen an event belongs to, or -1 if it cannot be told
+  virtual int eventScreen(const XEvent * /*e*/) { return -1; }
+
   // the masks of the modifiers which are ignored in button events.
   int NumLockMask, ScrollLockMask;
 
@@ -115,9 +217,16 @@ public:
   BaseDisplay(const char *app_name, const char *dpy_name = 0);
   virtual ~BaseDisplay(void);
 
+  // sets Xlib up for use from more than one thread.  It has to be called
+  // before anything else in Xlib, for startEventReader() to work
+  static void initThreads(void);
+  static inline bool threadsInitialized(void) { return threads; }
+
   const ScreenInfo* getScreenInfo(const unsigned int s) const;
 
   BGCCache *gcCache(void) const;
+  BIconCache *iconCache(void) const;
+  BPropertyFetcher *propertyFetcher(void) const;
 
   inline bool hasShapeExtensions(void) const
     { return shape.extensions; }
@@ -128,7 +237,10 @@ public:
   inline bool isStartup(void) const
     { return run_state == STARTUP; }
 
-  inline Display *getXDisplay(void) const { return display; }
+  // the connection of the screen whose work is being done, see
+  // ScreenScope, which is the main one unless screens have their own
+  Display *getXDisplay(void) const;
+  inline Display *getMainXDisplay(void) const { return display; }
 
   inline const char *getXDisplayName(void) const
     { return display_name; }
@@ -152,17 +264,148 @@ public:
                   bool allow_scroll_lock) const;
   void ungrabButton(unsigned int button, unsigned int modifiers,
                     Window grab_window) const;
+  // must be called before any buttons are grabbed
+  bool ignoreLockModifiers(void);
+  void restoreLockModifiers(void);
 
   void eventLoop(void);
+  // handles one event as the event loop would, with the work it posted;
+  // for bench/replay, which has no server to read the events from
+  void handleEvent(XEvent *e);
+
+  /*
+   * with sharding on, the event loop reads everything the server has sent,
+   * sorts it by screen, and takes a few events from each screen in turn,
+   * so a burst on one screen does not hold up the others.
+   */
+  void setEventSharding(bool s);
+  inline bool isEventSharding(void) const { return sharded; }
+
+  /*
+   * moves reading the connection onto a thread of its own, see
+   * BEventReader.  It should be started once startup is over, since the
+   * errors of requests made after it may be reported on the thread.
+   */
+  bool startEventReader(void);
+  inline const BEventReader *eventReader(void) const { return reader; }
+
+  /*
+   * with screen threads on, each screen opened this way gets a connection
+   * of its own, read by a thread of its own once the event loop starts,
+   * so that a burst of work on one screen does not hold up the events of
+   * the others.  The threads take turns running the window manager, the
+   * event loop's included, so a screen waits at most for the event
+   * another is in the middle of, not for all of those queued behind it.
+   * The screen has to be made inside a ScreenScope, and the connection is
+   * closed with the display, or by closeScreenConnection().
+   *
+   * Requests on different connections are not ordered against each
+   * other, so each thread flushes its connection at the end of its turn,
+   * and a screen's work is done on its own connection wherever it comes
+   * from.  What the screens share, such as the cursors, is made on the
+   * main connection at startup.
+   */
+  bool openScreenConnection(unsigned int screen);
+  void closeScreenConnection(unsigned int screen);
+  inline bool hasScreenConnections(void) const
+    { return ! screen_loops.empty(); }
+  // the screen whose work is being done, or -1
+  int currentScreen(void) const;
+
+  /*
+   * until the end of the scope, getXDisplay(), the timers and the messages
+   * are those of a screen with a connection of its own; for the work the
+   * event loop does for it, such as a WindowsWM event on one of its
+   * windows or the reply to a read it asked for.  For a screen without
+   * one they are the main connection's, and -1 changes nothing.
+   */
+  class ScreenScope {
+  public:
+    ScreenScope(BaseDisplay *d, int screen);
+    ~ScreenScope(void);
+
+  private:
+    BaseDisplay *display;
+    ScreenLoop *saved;
+  };
+  friend class ScreenScope;
+
+  // runs handler->handleMessage() after the current event or round
+  void postMessage(BMessageHandler *handler, unsigned int message,
+                   unsigned long data = 0);
+  // the same, but done in the turn of a screen or of the event loop, which
+  // is where the message goes when there are no screen threads
+  void postScreenMessage(unsigned int screen, BMessageHandler *handler,
+                         unsigned int message, unsigned long data = 0);
+  void postMainMessage(BMessageHandler *handler, unsigned int message,
+                       unsigned long data = 0);
+  // drops the messages posted to a handler that is going away
+  void cancelMessages(BMessageHandler *handler);
+
+  // like XCheckTypedWindowEvent, XCheckTypedEvent and XPutBackEvent, but
+  // they also see the events already sorted into the screen queues
+  bool checkTypedWindowEvent(Window window, int type, XEvent *e);
+  bool checkTypedEvent(int type, XEvent *e);
+  void putBackEvent(XEvent *e);
+  // like XSync, but also makes sure that every event the server sent
+  // before it is where the above look, which XSync alone does not with
+  // the event reader running
+  void syncEvents(void);
 
   // from TimerQueueManager interface
   virtual void addTimer(BTimer *timer);
   virtual void removeTimer(BTimer *timer);
 
+  inline unsigned long childrenReaped(void) const { return children_reaped; }
+  inline unsigned long reapRounds(void) const { return reap_rounds; }
+  inline unsigned long reapLatency(void) const { return reap_latency; }
+  inline unsigned long reapLatencyMax(void) const
+    { return reap_latency_max; }
+
   // another pure virtual... this is used to handle signals that BaseDisplay
-  // doesn't understand itself
+  // doesn't understand itself.  It is called from the event loop, not
+  // from the signal handler, so it may do anything.
   virtual bool handleSignal(int sig) = 0;
 };
 
 
+/*
+ * the passive button grabs on one window.  Its owner lists every grab the
+ * window should have between begin() and commit(); commit() then grabs
+ * only what is new and releases only what is no longer listed.
+ */
+class BButtonGrabs {
+public:
+  BButtonGrabs(const BaseDisplay * const _display, Window _window)
+    : display(_display), window(_window) {}
+
+  inline void begin(void) { wanted.clear(); }
+  void add(unsigned int button, unsigned int modifiers, bool owner_events,
+           unsigned int event_mask, int pointer_mode, int keyboard_mode,
+           Window confine_to, Cursor cursor, bool allow_scroll_lock);
+  void commit(void);
+
+  // releases every grab
+  void release(void);
+
+private:
+  struct Grab {
+    unsigned int button, modifiers, event_mask;
+    int pointer_mode, keyboard_mode;
+    Window confine_to;
+    Cursor cursor;
+    bool owner_events, allow_scroll_lock;
+
+    inline bool sameButton(const Grab &g) const
+    { return button == g.button && modifiers == g.modifiers; }
+    bool operator==(const Grab &g) const;
+  };
+  typedef std::vector<Grab> GrabList;
+
+  const BaseDisplay *display;
+  Window window;
+  GrabList grabbed, wanted;
+};
+
+
 #endif // __BaseDisplay_hh
@@ -28,16 +28,435 @@
 
 #include "Color.hh"
 #include "BaseDisplay.hh"
+#include "RoundTrips.hh"
 
 extern "C" {
 #include <stdio.h>
+
+#ifdef    HAVE_X11_XLIBINT_H
+#  include <X11/Xlibint.h>
+// which would break <algorithm>
+#  undef    min
+#  undef    max
+#  define   ASYNC_REPLIES
+#endif // HAVE_X11_XLIBINT_H
 }
 
 #include <assert.h>
+#include <list>
+#include <map>
 
-BColor::ColorCache BColor::colorcache;
+BColor::AllocatorList BColor::allocators;
 bool BColor::cleancache = false;
 
+
+BPixelFormat::Channel::Channel(unsigned long mask): shift(0), bits(0) {
+  if (! mask) return;
+
+  while (! (mask & 1)) {
+    mask >>= 1;
+    ++shift;
+  }
+  while (mask & 1) {
+    mask >>= 1;
+    ++bits;
+  }
+}
+
+
+BPixelFormat::BPixelFormat(const Visual * const visual, int depth)
+  : truecolor(visual->c_class == TrueColor),
+    red(visual->red_mask), green(visual->green_mask), blue(visual->blue_mask),
+    alpha((depth == 32) ? ~(visual->red_mask | visual->green_mask |
+                            visual->blue_mask) & 0xfffffffful : 0ul) {}
+
+
+/*
+ * The colors of one screen are kept in an open addressed hash table keyed
+ * on their packed RGB value, with a reference count, so that each is
+ * allocated from the server once and freed in one request with all the
+ * others nothing uses any more.  TrueColor pixels are worked out from the
+ * visual and never reach the table or the server.
+ *
+ * A color is asked for with request() as soon as its value is known, and
+ * the reply is left to Xlib, so that all the colors of a style cost one
+ * round trip between them when the first pixel is wanted instead of one
+ * each.  Color names are parsed once per screen.
+ */
+class BColor::Allocator {
+public:
+  Allocator(const BaseDisplay * const _display, unsigned int _screen);
+  ~Allocator(void);
+
+  bool parse(const std::string &name, int &_r, int &_g, int &_b);
+  void request(int _r, int _g, int _b);
+  unsigned long allocate(int _r, int _g, int _b);
+  void release(int _r, int _g, int _b);
+  void cleanup(void);
+
+  const BaseDisplay * const display;
+  const unsigned int screen;
+
+private:
+  struct Entry {
+    unsigned int key;           // 0x01rrggbb, or 0 for a free slot
+    unsigned int count;
+    unsigned long pixel;
+    bool owned;                 // did XAllocColor succeed?
+    bool pending;               // is the reply still to be collected?
+  };
+  typedef std::vector<Entry> Table;
+
+  // an AllocColor request whose reply Xlib hands to replied()
+  struct Pending {
+    unsigned int key;
+    unsigned long sequence;
+    unsigned long pixel;
+    bool done, owned;
+#ifdef    ASYNC_REPLIES
+    _XAsyncHandler async;
+
+    static Bool replied(Display *dpy, xReply *rep, char *buf, int len,
+                        XPointer data);
+#endif // ASYNC_REPLIES
+  };
+  typedef std::list<Pending*> PendingList;
+
+  // parsed names, 0 if the name is not a color
+  typedef std::map<std::string, unsigned int> NameMap;
+
+  BPixelFormat format;
+  Colormap colormap;
+  Table table;
+  unsigned int used;
+  PendingList pending;
+  NameMap names;
+
+  static inline unsigned int makeKey(int _r, int _g, int _b)
+  { return 0x01000000 | (_r & 0xff) << 16 | (_g & 0xff) << 8 | (_b & 0xff); }
+
+  Entry *find(unsigned int key);
+  Entry *insert(unsigned int key);
+  void rehash(unsigned int size, bool drop_unused);
+  void collect(void);
+};
+
+
+BColor::Allocator::Allocator(const BaseDisplay * const _display,
+                             unsigned int _screen)
+  : display(_display), screen(_screen),
+    format(_display->getScreenInfo(_screen)->getVisual(),
+           _display->getScreenInfo(_screen)->getDepth()),
+    colormap(_display->getScreenInfo(_screen)->getColormap()),
+    table(64), used(0) {
+  for (Table::iterator it = table.begin(); it != table.end(); ++it)
+    it->key = 0;
+}
+
+
+// gives back every pixel still held, in use or not, in one request
+BColor::Allocator::~Allocator(void) {
+  collect();
+
+  std::vector<unsigned long> pixels;
+  for (Table::const_iterator it = table.begin(); it != table.end(); ++it) {
+    if (it->key && it->owned)
+      pixels.push_back(it->pixel);
+  }
+
+  if (! pixels.empty())
+    XFreeColors(display->getXDisplay(), colormap, &pixels[0], pixels.size(),
+                0);
+}
+
+
+// returns the slot holding key, or the free slot where it belongs
+BColor::Allocator::Entry *BColor::Allocator::find(unsigned int key) {
+  // every bit of the key ends up in the low bits the mask keeps
+  unsigned int h = key;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+
+  const unsigned int mask = table.size() - 1;
+  unsigned int i = h & mask;
+
+  while (table[i].key && table[i].key != key)
+    i = (i + 1) & mask;
+  return &table[i];
+}
+
+
+// fills a free slot for key, which the table may be grown for
+BColor::Allocator::Entry *BColor::Allocator::insert(unsigned int key) {
+  // keep the table at most half full
+  if ((used + 1) * 2 > table.size())
+    rehash(table.size() * 2, False);
+
+  Entry *entry = find(key);
+  entry->key = key;
+  entry->count = 0;
+  entry->pixel = 0;
+  entry->owned = entry->pending = False;
+  ++used;
+  return entry;
+}
+
+
+void BColor::Allocator::rehash(unsigned int size, bool drop_unused) {
+  Table old(size);
+  old.swap(table);
+  for (Table::iterator it = table.begin(); it != table.end(); ++it)
+    it->key = 0;
+
+  used = 0;
+  for (Table::const_iterator it = old.begin(); it != old.end(); ++it) {
+    if (! it->key || (drop_unused && it->count == 0 && ! it->pending))
+      continue;
+    *find(it->key) = *it;
+    ++used;
+  }
+}
+
+
+/*
+ * Sets _r, _g and _b from a color name, which the server is asked about
+ * only the first time it is seen.  Returns False if it is not a color.
+ */
+bool BColor::Allocator::parse(const std::string &name,
+                              int &_r, int &_g, int &_b) {
+  NameMap::const_iterator it = names.find(name);
+  if (it == names.end()) {
+    XColor xcol;
+    xcol.red = 0;
+    xcol.green = 0;
+    xcol.blue = 0;
+    xcol.pixel = 0;
+
+    unsigned int key = 0;
+    if (BROUNDTRIP(ParseColor,
+                   XParseColor(display->getXDisplay(), colormap,
+                               name.c_str(), &xcol)))
+      key = makeKey(xcol.red >> 8, xcol.green >> 8, xcol.blue >> 8);
+    it = names.insert(NameMap::value_type(name, key)).first;
+  }
+
+  if (! it->second)
+    return False;
+
+  _r = (it->second >> 16) & 0xff;
+  _g = (it->second >> 8) & 0xff;
+  _b = it->second & 0xff;
+  return True;
+}
+
+
+/*
+ * Sends the AllocColor request for a color nothing has allocated yet,
+ * without waiting for the reply.  Does nothing if this Xlib cannot leave
+ * replies to a handler, in which case allocate() asks itself.
+ */
+void BColor::Allocator::request(int _r, int _g, int _b) {
+#ifdef    ASYNC_REPLIES
+  if (format.isTrueColor())
+    return;
+
+  const unsigned int key = makeKey(_r, _g, _b);
+  if (find(key)->key)
+    return;
+  insert(key)->pending = True;
+
+  Pending *p = new Pending;
+  p->key = key;
+  p->pixel = 0;
+  p->done = p->owned = False;
+
+  Display *dpy = display->getXDisplay();
+  LockDisplay(dpy);
+  xAllocColorReq *req;
+  GetReq(AllocColor, req);
+  req->cmap = colormap;
+  req->red = _r | _r << 8;
+  req->green = _g | _g << 8;
+  req->blue = _b | _b << 8;
+
+  p->sequence = dpy->request;
+  p->async.next = dpy->async_handlers;
+  p->async.handler = Pending::replied;
+  p->async.data = (XPointer) p;
+  dpy->async_handlers = &p->async;
+  UnlockDisplay(dpy);
+  SyncHandle();
+
+  pending.push_back(p);
+#else // !ASYNC_REPLIES
+  (void) _r;
+  (void) _g;
+  (void) _b;
+#endif // ASYNC_REPLIES
+}
+
+
+#ifdef    ASYNC_REPLIES
+/*
+ * called by Xlib, with the display locked, for every reply and error it
+ * reads while there are requests out, like the property fetcher's.
+ */
+Bool BColor::Allocator::Pending::replied(Display *dpy, xReply *rep,
+                                         char *buf, int len, XPointer data) {
+  Pending *p = (Pending *) data;
+  if (dpy->last_request_read != p->sequence)
+    return False;
+
+  if (rep->generic.type != X_Error) {
+    xAllocColorReply replbuf;
+    xAllocColorReply *repl = (xAllocColorReply *)
+      _XGetAsyncReply(dpy, (char *) &replbuf, rep, buf, len,
+                      (SIZEOF(xAllocColorReply) - SIZEOF(xReply)) >> 2,
+                      True);
+    p->pixel = repl->pixel;
+    p->owned = True;
+  }
+  p->done = True;
+
+  DeqAsyncHandler(dpy, &p->async);
+  return True;
+}
+#endif // ASYNC_REPLIES
+
+
+/*
+ * Waits for the replies to every request sent so far, which takes the
+ * one round trip however many there are, and moves them into the table.
+ */
+void BColor::Allocator::collect(void) {
+  if (pending.empty())
+    return;
+
+  BROUNDTRIP(Sync, XSync(display->getXDisplay(), False));
+
+  PendingList::iterator it = pending.begin();
+  while (it != pending.end()) {
+    Pending *p = *it;
+    if (! p->done) {
+      // cannot happen once the server has answered the sync
+      ++it;
+      continue;
+    }
+
+    Entry *entry = find(p->key);
+    assert(entry->key == p->key);
+    entry->pending = False;
+    entry->owned = p->owned;
+    entry->pixel = p->pixel;
+    if (! entry->owned)
+      fprintf(stderr, "BColor::allocate: color alloc error: rgb:%x/%x/%x\n",
+              (p->key >> 16) & 0xff, (p->key >> 8) & 0xff, p->key & 0xff);
+
+    delete p;
+    it = pending.erase(it);
+  }
+}
+
+
+unsigned long BColor::Allocator::allocate(int _r, int _g, int _b) {
+  if (format.isTrueColor())
+    return format.pixel(_r, _g, _b);
+
+  const unsigned int key = makeKey(_r, _g, _b);
+  Entry *entry = find(key);
+  if (entry->key) {
+    if (entry->pending) {
+      collect();
+      entry = find(key);
+    }
+    ++entry->count;
+    return entry->pixel;
+  }
+
+  XColor xcol;
+  xcol.red =   _r | _r << 8;
+  xcol.green = _g | _g << 8;
+  xcol.blue =  _b | _b << 8;
+  xcol.pixel = 0;
+
+  bool owned = BROUNDTRIP(AllocColor,
+                          XAllocColor(display->getXDisplay(), colormap,
+                                      &xcol));
+  if (! owned) {
+    fprintf(stderr, "BColor::allocate: color alloc error: rgb:%x/%x/%x\n",
+            _r, _g, _b);
+    xcol.pixel = 0;
+  }
+
+  entry = insert(key);
+  entry->count = 1;
+  entry->owned = owned;
+  entry->pixel = xcol.pixel;
+  return xcol.pixel;
+}
+
+
+void BColor::Allocator::release(int _r, int _g, int _b) {
+  if (format.isTrueColor())
+    return;
+
+  Entry *entry = find(makeKey(_r, _g, _b));
+  if (entry->key && entry->count > 0)
+    --entry->count;
+}
+
+
+void BColor::Allocator::cleanup(void) {
+  // requested colors nothing took in the end are freed with the rest
+  collect();
+
+  std::vector<unsigned long> pixels;
+  for (Table::const_iterator it = table.begin(); it != table.end(); ++it) {
+    if (it->key && it->count == 0 && it->owned && ! it->pending)
+      pixels.push_back(it->pixel);
+  }
+
+  if (pixels.empty())
+    return;
+
+  XFreeColors(display->getXDisplay(), colormap, &pixels[0], pixels.size(), 0);
+  rehash(table.size(), True);
+}
+
+
+BColor::Allocator *BColor::allocator(const BaseDisplay * const _display,
+                                     unsigned int _screen) {
+  AllocatorList::iterator it = allocators.begin(), end = allocators.end();
+  for (; it != end; ++it) {
+    if ((*it)->display == _display && (*it)->screen == _screen)
+      return *it;
+  }
+
+  Allocator *a = new Allocator(_display, _screen);
+  allocators.push_back(a);
+  return a;
+}
+
+
+/*
+ * Frees the colors of a screen, which must be done while its connection
+ * is the current one; a color released after this releases nothing.
+ */
+void BColor::destroyColorCache(const BaseDisplay * const _display,
+                               unsigned int _screen) {
+  AllocatorList::iterator it = allocators.begin(), end = allocators.end();
+  for (; it != end; ++it) {
+    if ((*it)->display == _display && (*it)->screen == _screen) {
+      delete *it;
+      allocators.erase(it);
+      return;
+    }
+  }
+}
+
 BColor::BColor(const BaseDisplay * const _display, unsigned int _screen)
   : allocated(false), r(-1), g(-1), b(-1), p(0), dpy(_display), scrn(_screen)
 {}
@@ -100,24 +519,18 @@ void BColor::parseColorName(void) {
 
   if (scrn == ~(0u))
     scrn = DefaultScreen(display()->getXDisplay());
-  Colormap colormap = display()->getScreenInfo(scrn)->getColormap();
 
   // get rgb values from colorname
-  XColor xcol;
-  xcol.red = 0;
-  xcol.green = 0;
-  xcol.blue = 0;
-  xcol.pixel = 0;
-
-  if (! XParseColor(display()->getXDisplay(), colormap,
-                    colorname.c_str(), &xcol)) {
+  int _r, _g, _b;
+  if (! allocator(display(), scrn)->parse(colorname, _r, _g, _b)) {
     fprintf(stderr, "BColor::allocate: color parse error: \"%s\"\n",
             colorname.c_str());
     setRGB(0, 0, 0);
     return;
   }
 
-  setRGB(xcol.red >> 8, xcol.green >> 8, xcol.blue >> 8);
+  setRGB(_r, _g, _b);
+  allocator(display(), scrn)->request(r, g, b);
 }
 
 
@@ -125,7 +538,6 @@ void BColor::allocate(void) {
   assert(dpy != 0);
 
   if (scrn == ~(0u)) scrn = DefaultScreen(display()->getXDisplay());
-  Colormap colormap = display()->getScreenInfo(scrn)->getColormap();
 
   if (! isValid()) {
     if (colorname.empty()) {
@@ -136,35 +548,9 @@ void BColor::allocate(void) {
     }
   }
 
-  // see if we have allocated this color before
-  RGB rgb(display(), scrn, r, g, b);
-  ColorCache::iterator it = colorcache.find(rgb);
-  if (it != colorcache.end()) {
-    // found
-    allocated = true;
-    p = (*it).second.p;
-    (*it).second.count++;
-    return;
-  }
-
-  // allocate color from rgb values
-  XColor xcol;
-  xcol.red =   r | r << 8;
-  xcol.green = g | g << 8;
-  xcol.blue =  b | b << 8;
-  xcol.pixel = 0;
-
-  if (! XAllocColor(display()->getXDisplay(), colormap, &xcol)) {
-    fprintf(stderr, "BColor::allocate: color alloc error: rgb:%x/%x/%x\n",
-            r, g, b);
-    xcol.pixel = 0;
-  }
-
-  p = xcol.pixel;
+  p = allocator(display(), scrn)->allocate(r, g, b);
   allocated = true;
 
-  colorcache.insert(ColorCacheItem(rgb, PixelRef(p)));
-
   if (cleancache)
     doCacheCleanup();
 }
@@ -176,10 +562,13 @@ void BColor::deallocate(void) {
 
   assert(dpy != 0);
 
-  ColorCache::iterator it = colorcache.find(RGB(display(), scrn, r, g, b));
-  if (it != colorcache.end()) {
-    if ((*it).second.count >= 1)
-      (*it).second.count--;
+  // the allocator is gone with the display
+  AllocatorList::iterator it = allocators.begin(), end = allocators.end();
+  for (; it != end; ++it) {
+    if ((*it)->display == display() && (*it)->screen == scrn) {
+      (*it)->release(r, g, b);
+      break;
+    }
   }
 
   if (cleancache)
@@ -206,39 +595,9 @@ void BColor::cleanupColorCache(void) {
 
 
 void BColor::doCacheCleanup(void) {
-  // ### TODO - support multiple displays!
-  ColorCache::iterator it = colorcache.begin();
-  if (it == colorcache.end()) {
-    // nothing to do
-    return;
-  }
-
-  const BaseDisplay* const display = (*it).first.display;
-  unsigned long *pixels = new unsigned long[ colorcache.size() ];
-  unsigned int i, count;
-
-  for (i = 0; i < display->getNumberOfScreens(); i++) {
-    count = 0;
-    it = colorcache.begin();
-
-    while (it != colorcache.end()) {
-      if ((*it).second.count != 0 || (*it).first.screen != i) {
-        ++it;
-        continue;
-      }
-
-      pixels[ count++ ] = (*it).second.p;
-      ColorCache::iterator it2 = it;
-      ++it;
-      colorcache.erase(it2);
-    }
-
-    if (count > 0)
-      XFreeColors(display->getXDisplay(),
-                  display->getScreenInfo(i)->getColormap(),
-                  pixels, count, 0);
-  }
+  AllocatorList::iterator it = allocators.begin(), end = allocators.end();
+  for (; it != end; ++it)
+    (*it)->cleanup();
 
-  delete [] pixels;
   cleancache = false;
 }
@@ -29,11 +29,50 @@ extern "C" {
 #include <X11/Xlib.h>
 }
 
-#include <map>
 #include <string>
+#include <vector>
 
 class BaseDisplay;
 
+/*
+ * works out the pixel values of a TrueColor visual from 8 bit channels,
+ * without asking the server.  The alpha channel is used only for a 32 bit
+ * visual.
+ */
+class BPixelFormat {
+public:
+  BPixelFormat(const Visual * const visual, int depth);
+
+  inline bool isTrueColor(void) const { return truecolor; }
+
+  inline unsigned long pixel(unsigned int argb) const {
+    return channel(argb >> 16, red) | channel(argb >> 8, green) |
+           channel(argb, blue) | channel(argb >> 24, alpha);
+  }
+  inline unsigned long pixel(int r, int g, int b) const {
+    return channel(r, red) | channel(g, green) | channel(b, blue);
+  }
+
+private:
+  struct Channel {
+    int shift, bits;
+
+    Channel(unsigned long mask);
+  };
+
+  static inline unsigned long channel(unsigned int value, const Channel &c) {
+    if (! c.bits) return 0;
+
+    value &= 0xff;
+    unsigned long v = (c.bits <= 8) ? (value >> (8 - c.bits)) :
+                      ((unsigned long) value << (c.bits - 8));
+    return v << c.shift;
+  }
+
+  bool truecolor;
+  Channel red, green, blue, alpha;
+};
+
 class BColor {
 public:
   BColor(const BaseDisplay * const _display = 0, unsigned int _screen = ~(0u));
@@ -69,11 +108,13 @@ public:
   // operators
   BColor &operator=(const BColor &c);
   inline bool operator==(const BColor &c) const
-  { return (r == c.r && b == c.b && b == c.b); }
+  { return (r == c.r && g == c.g && b == c.b); }
   inline bool operator!=(const BColor &c) const
   { return (! operator==(c)); }
 
   static void cleanupColorCache(void);
+  static void destroyColorCache(const BaseDisplay * const _display,
+                                unsigned int _screen);
 
 private:
   void parseColorName(void);
@@ -87,41 +128,12 @@ private:
   unsigned int scrn;
   std::string colorname;
 
-  // global color allocator/deallocator
-  struct RGB {
-    const BaseDisplay* const display;
-    const unsigned int screen;
-    const int r, g, b;
-
-    RGB(void) : display(0), screen(~(0u)), r(-1), g(-1), b(-1) { }
-    RGB(const BaseDisplay * const a, const unsigned int b,
-        const int x, const int y, const int z)
-      : display(a), screen(b), r(x), g(y), b(z) {}
-    RGB(const RGB &x)
-      : display(x.display), screen(x.screen), r(x.r), g(x.g), b(x.b) {}
-
-    inline bool operator==(const RGB &x) const {
-      return display == x.display &&
-              screen == x.screen &&
-                   r == x.r && g == x.g && b == x.b;
-    }
-
-    inline bool operator<(const RGB &x) const {
-      unsigned long p1, p2;
-      p1 = (screen << 24 | r << 16 | g << 8 | b) & 0x00ffffff;
-      p2 = (x.screen << 24 | x.r << 16 | x.g << 8 | x.b) & 0x00ffffff;
-      return p1 < p2;
-    }
-  };
-  struct PixelRef {
-    const unsigned long p;
-    unsigned int count;
-    inline PixelRef(void) : p(0), count(0) { }
-    inline PixelRef(const unsigned long x) : p(x), count(1) { }
-  };
-  typedef std::map<RGB,PixelRef> ColorCache;
-  typedef ColorCache::value_type ColorCacheItem;
-  static ColorCache colorcache;
+  // the colors of one screen, see Color.cc
+  class Allocator;
+  typedef std::vector<Allocator*> AllocatorList;
+  static AllocatorList allocators;
+  static Allocator *allocator(const BaseDisplay * const _display,
+                              unsigned int _screen);
   static bool cleancache;
   static void doCacheCleanup(void);
 };
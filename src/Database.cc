@@ -0,0 +1,586 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Database.cc for XWinWM - compiled resource files
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <stdio.h>
+
+#ifdef    HAVE_STDLIB_H
+#  include <stdlib.h>
+#endif // HAVE_STDLIB_H
+
+#ifdef    HAVE_STRING_H
+#  include <string.h>
+#endif // HAVE_STRING_H
+
+#ifdef    HAVE_CTYPE_H
+#  include <ctype.h>
+#endif // HAVE_CTYPE_H
+
+#ifdef    HAVE_UNISTD_H
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif // HAVE_UNISTD_H
+
+#ifdef    HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif // HAVE_FCNTL_H
+
+#ifdef    HAVE_SYS_STAT_H
+#  include <sys/stat.h>
+#endif // HAVE_SYS_STAT_H
+
+#ifdef    HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif // HAVE_SYS_MMAN_H
+
+#ifdef    HAVE_TIME_H
+#  include <time.h>
+#endif // HAVE_TIME_H
+}
+
+#include <map>
+#include <vector>
+
+#include "Database.hh"
+#include "Util.hh"
+
+/*
+ * The image is a Header, a hash table of buckets holding entry numbers
+ * plus one (zero for an empty bucket), the entries, and the NUL terminated
+ * names and values the entries point into.  It is only ever read back on
+ * the machine that wrote it, so everything is in native byte order.
+ */
+struct BDatabase::Header {
+  char magic[8];
+  time_t mtime;                 // of the file the image was compiled from
+  long mtime_nsec;
+  unsigned long length;         // its size
+  unsigned long long inode;     // its inode
+  unsigned long long hash;      // and the hash of its contents
+  time_t read;                  // when it was read
+  unsigned int size;            // of the whole image
+  unsigned int checksum;        // of everything after the header
+  unsigned int entries, buckets;
+};
+
+struct BDatabase::Entry {
+  unsigned int hash;
+  unsigned int name, value;     // offsets into the strings
+  unsigned int value_length;
+  int number;
+  unsigned int flags;
+};
+
+// what is known of the file when it is read
+struct BDatabase::Source {
+  time_t mtime;
+  long mtime_nsec;
+  unsigned long length;
+  unsigned long long inode;
+  unsigned long long hash;
+  time_t read;
+};
+
+enum { HasNumber = 1<<0, HasBoolean = 1<<1, BooleanTrue = 1<<2 };
+
+static const char Magic[8] = { 'X', 'W', 'W', 'M', 'R', 'C', '3', '\n' };
+
+
+static unsigned int fnv(const char *s, size_t len) {
+  unsigned int h = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+
+// the 64 bit FNV-1a, for telling one version of a file from another
+static unsigned long long fnv64(const char *s, size_t len) {
+  unsigned long long h = 14695981039346656037ull;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char) s[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+
+static std::string trim(const std::string &s) {
+  static const char whitespace[] = " \t\r";
+  const std::string::size_type first = s.find_first_not_of(whitespace);
+  if (first == std::string::npos) return std::string();
+  return s.substr(first, s.find_last_not_of(whitespace) - first + 1);
+}
+
+
+static std::string lowercase(const std::string &s) {
+  std::string l(s);
+  for (std::string::iterator it = l.begin(); it != l.end(); ++it)
+    *it = tolower((unsigned char) *it);
+  return l;
+}
+
+
+typedef std::map<std::string, std::string> ValueMap;
+
+/*
+ * Reads "name: value" lines the way XrmGetFileDatabase does: a line ending
+ * in a backslash continues on the next one, "\n" in a value is a newline,
+ * lines starting with ! are comments and a later value for a name replaces
+ * an earlier one.
+ */
+static void parse(const std::string &text, ValueMap &values) {
+  std::string::size_type pos = 0;
+
+  while (pos < text.size()) {
+    std::string line;
+    for (;;) {
+      std::string::size_type end = text.find('\n', pos);
+      if (end == std::string::npos) end = text.size();
+      line.append(text, pos, end - pos);
+      pos = end + 1;
+
+      if (line.empty() || line[line.size() - 1] != '\\' || pos >= text.size())
+        break;
+      line.erase(line.size() - 1);
+    }
+
+    line = trim(line);
+    if (line.empty() || line[0] == '!' || line[0] == '#')
+      continue;
+
+    const std::string::size_type colon = line.find(':');
+    if (colon == std::string::npos)
+      continue;
+
+    const std::string name = trim(line.substr(0, colon));
+    const std::string raw = trim(line.substr(colon + 1));
+    if (name.empty())
+      continue;
+
+    std::string value;
+    for (std::string::size_type i = 0; i < raw.size(); ++i) {
+      if (raw[i] == '\\' && i + 1 < raw.size()) {
+        ++i;
+        value += (raw[i] == 'n') ? '\n' : raw[i];
+      } else {
+        value += raw[i];
+      }
+    }
+
+    values[name] = value;
+  }
+}
+
+
+// where the image of filename is kept, or an empty string if nowhere
+static std::string cacheFile(const std::string &filename) {
+  std::string path;
+  const char *dir = getenv("XDG_CACHE_HOME");
+  if (dir && *dir) {
+    path = dir;
+  } else {
+    const char *home = getenv("HOME");
+    if (! home) return std::string();
+    path = home;
+    path += "/.cache";
+    mkdir(path.c_str(), 0700);
+  }
+
+  path += "/xwinwm";
+  mkdir(path.c_str(), 0700);
+
+  char name[16];
+  sprintf(name, "/%08x.rc", fnv(filename.data(), filename.size()));
+  return path + name;
+}
+
+
+BDatabase::BDatabase(void): image(0), image_size(0), mapped(False) {}
+
+
+BDatabase::~BDatabase(void) {
+  clear();
+}
+
+
+void BDatabase::clear(void) {
+  if (! image) return;
+
+#ifdef    HAVE_SYS_MMAN_H
+  if (mapped)
+    munmap((void *) image, image_size);
+  else
+#endif // HAVE_SYS_MMAN_H
+    free((void *) image);
+
+  image = 0;
+  image_size = 0;
+  mapped = False;
+}
+
+
+/*
+ * A file whose size, modification time, to the nanosecond where there is
+ * one, and inode are those the image was made from is taken to be the
+ * same file, without reading it.  That is ambiguous only when it was
+ * changed within a second of when it was read, as the time may then be
+ * that of the change the image missed, and the hash of what the file
+ * holds decides; such an image is made again once the file is older.  A
+ * file rewritten with its old time and size in place is missed, as make
+ * would miss it.
+ */
+bool BDatabase::load(const std::string &filename) {
+  clear();
+
+  if (filename.empty())
+    return False;
+
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+    return False;
+
+  Source source;
+  describe(st, source);
+
+  const std::string cachefile = cacheFile(filename);
+  const Header *header = (! cachefile.empty() && map(cachefile, source)) ?
+                         (const Header *) image : (const Header *) 0;
+  if (header && ! racy(header->mtime, header->read))
+    return True;
+
+  std::string text;
+  if (! readFile(filename, source, text)) {
+    clear();
+    return False;
+  }
+
+  if (header) {
+    // while it is still ambiguous, there is no better image to make
+    if (header->hash == source.hash && racy(source.mtime, source.read))
+      return True;
+    clear();
+  }
+
+  return compile(cachefile, source, text);
+}
+
+
+void BDatabase::describe(const struct stat &st, Source &source) {
+  source.mtime = st.st_mtime;
+#ifdef    HAVE_STRUCT_STAT_ST_MTIM
+  source.mtime_nsec = st.st_mtim.tv_nsec;
+#else // !HAVE_STRUCT_STAT_ST_MTIM
+  source.mtime_nsec = 0;
+#endif // HAVE_STRUCT_STAT_ST_MTIM
+  source.length = st.st_size;
+  source.inode = st.st_ino;
+  source.hash = 0;
+  source.read = 0;
+}
+
+
+// True if a file last changed at mtime could have changed again unseen
+// after it was read at the time read
+bool BDatabase::racy(time_t mtime, time_t read) {
+  return read <= mtime + 1;
+}
+
+
+// reads the whole file, and what it is now, hash included
+bool BDatabase::readFile(const std::string &filename, Source &source,
+                         std::string &text) {
+  FILE *file = fopen(filename.c_str(), "r");
+  if (! file)
+    return False;
+
+  struct stat st;
+  if (fstat(fileno(file), &st) != 0) {
+    fclose(file);
+    return False;
+  }
+  describe(st, source);
+  source.read = time(0);
+
+  char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    text.append(buffer, n);
+  fclose(file);
+
+  source.hash = fnv64(text.data(), text.size());
+  return True;
+}
+
+
+/*
+ * Maps the image in the cache, if it was made from the file as it is now
+ * and has not been damaged since.  Every count in the header is checked
+ * against the size of the image before anything is found through it.
+ */
+bool BDatabase::map(const std::string &cachefile, const Source &source) {
+#ifdef    HAVE_SYS_MMAN_H
+  struct stat st;
+  int fd = open(cachefile.c_str(), O_RDONLY);
+  if (fd < 0)
+    return False;
+
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header)) {
+    close(fd);
+    return False;
+  }
+
+  void *data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return False;
+
+  const size_t size = st.st_size;
+  const Header *header = (const Header *) data;
+  const size_t body = size - sizeof(Header);
+
+  bool valid =
+    memcmp(header->magic, Magic, sizeof(Magic)) == 0 &&
+    header->size == size &&
+    header->mtime == source.mtime &&
+    header->mtime_nsec == source.mtime_nsec &&
+    header->length == source.length &&
+    header->inode == source.inode &&
+    header->buckets > 0 && (header->buckets & (header->buckets - 1)) == 0 &&
+    header->buckets <= body / sizeof(unsigned int) &&
+    header->entries < header->buckets &&
+    header->entries <= (body - header->buckets * sizeof(unsigned int)) /
+                       sizeof(Entry) &&
+    header->checksum == fnv((const char *) (header + 1), body);
+
+  if (! valid) {
+    munmap(data, size);
+    return False;
+  }
+
+  const unsigned int *table = (const unsigned int *) (header + 1);
+  const Entry *entries = (const Entry *) (table + header->buckets);
+  const char *strings = (const char *) (entries + header->entries);
+  const char *end = (const char *) data + size;
+  const size_t length = end - strings;
+
+  for (unsigned int i = 0; valid && i < header->entries; ++i) {
+    const Entry &e = entries[i];
+    valid = e.name < length &&
+            memchr(strings + e.name, 0, length - e.name) &&
+            e.value < length && e.value_length < length - e.value &&
+            strings[e.value + e.value_length] == '\0';
+  }
+  for (unsigned int i = 0; valid && i < header->buckets; ++i)
+    valid = table[i] <= header->entries;
+
+  if (! valid) {
+    munmap(data, size);
+    return False;
+  }
+
+  image = (const char *) data;
+  image_size = size;
+  mapped = True;
+  return True;
+#else // !HAVE_SYS_MMAN_H
+  return False;
+#endif // HAVE_SYS_MMAN_H
+}
+
+
+/*
+ * Parses the text of the file and builds the image in memory, then writes
+ * it to the cache for next time.  Failing to write it is not an error.
+ */
+bool BDatabase::compile(const std::string &cachefile, const Source &source,
+                        const std::string &text) {
+  ValueMap values;
+  parse(text, values);
+
+  unsigned int buckets = 16;
+  while (buckets < values.size() * 2)
+    buckets <<= 1;
+
+  std::vector<unsigned int> table(buckets, 0);
+  std::vector<Entry> entries;
+  std::string strings;
+
+  entries.reserve(values.size());
+  for (ValueMap::const_iterator it = values.begin(); it != values.end();
+       ++it) {
+    const std::string &name = it->first, &value = it->second;
+
+    Entry e;
+    e.hash = fnv(name.data(), name.size());
+    e.name = strings.size();
+    strings.append(name.c_str(), name.size() + 1);
+    e.value = strings.size();
+    e.value_length = value.size();
+    strings.append(value.c_str(), value.size() + 1);
+
+    e.number = 0;
+    e.flags = 0;
+
+    char *endp;
+    long number = strtol(value.c_str(), &endp, 0);
+    if (! value.empty() && *endp == '\0') {
+      e.number = (int) number;
+      e.flags |= HasNumber;
+    }
+
+    const std::string word = lowercase(value);
+    if (word == "true" || word == "yes" || word == "on")
+      e.flags |= HasBoolean | BooleanTrue;
+    else if (word == "false" || word == "no" || word == "off")
+      e.flags |= HasBoolean;
+
+    unsigned int i = e.hash & (buckets - 1);
+    while (table[i])
+      i = (i + 1) & (buckets - 1);
+    entries.push_back(e);
+    table[i] = entries.size();
+  }
+
+  const size_t size = sizeof(Header) + buckets * sizeof(unsigned int) +
+                      entries.size() * sizeof(Entry) + strings.size();
+  char *data = (char *) malloc(size);
+  if (! data)
+    return False;
+
+  Header *header = (Header *) data;
+  char *p = (char *) (header + 1);
+  memcpy(p, &table[0], buckets * sizeof(unsigned int));
+  p += buckets * sizeof(unsigned int);
+  if (! entries.empty())
+    memcpy(p, &entries[0], entries.size() * sizeof(Entry));
+  p += entries.size() * sizeof(Entry);
+  memcpy(p, strings.data(), strings.size());
+
+  memset(header, 0, sizeof(Header));
+  memcpy(header->magic, Magic, sizeof(Magic));
+  header->mtime = source.mtime;
+  header->mtime_nsec = source.mtime_nsec;
+  header->length = source.length;
+  header->inode = source.inode;
+  header->hash = source.hash;
+  header->read = source.read;
+  header->size = size;
+  header->entries = entries.size();
+  header->buckets = buckets;
+  header->checksum = fnv((const char *) (header + 1), size - sizeof(Header));
+
+  image = data;
+  image_size = size;
+  mapped = False;
+
+  if (cachefile.empty())
+    return True;
+
+  // write a new file and rename it over the old one, so another instance
+  // mapping the image never sees it half written
+  const std::string tmpfile = cachefile + '.' +
+                              itostring((unsigned long) getpid());
+  int fd = open(tmpfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    return True;
+
+  bool written = (write(fd, data, size) == (ssize_t) size);
+  if (close(fd) != 0) written = False;
+
+  if (! written || rename(tmpfile.c_str(), cachefile.c_str()) != 0)
+    unlink(tmpfile.c_str());
+
+  return True;
+}
+
+
+const char *BDatabase::text(unsigned int offset) const {
+  const Header *header = (const Header *) image;
+  const unsigned int *table = (const unsigned int *) (header + 1);
+  const Entry *entries = (const Entry *) (table + header->buckets);
+  return (const char *) (entries + header->entries) + offset;
+}
+
+
+const BDatabase::Entry *BDatabase::lookup(const std::string &key) const {
+  const Header *header = (const Header *) image;
+  const unsigned int *table = (const unsigned int *) (header + 1);
+  const Entry *entries = (const Entry *) (table + header->buckets);
+  const unsigned int mask = header->buckets - 1;
+  const unsigned int hash = fnv(key.data(), key.size());
+
+  for (unsigned int i = hash & mask; table[i]; i = (i + 1) & mask) {
+    const Entry *e = entries + table[i] - 1;
+    if (e->hash == hash && key == text(e->name))
+      return e;
+  }
+  return (const Entry *) 0;
+}
+
+
+const BDatabase::Entry *BDatabase::find(const std::string &rname,
+                                        const std::string &rclass) const {
+  if (! image)
+    return (const Entry *) 0;
+
+  const Entry *e = lookup(rname);
+  if (! e) e = lookup(rclass);
+  if (! e) e = lookup('*' + rname.substr(rname.rfind('.') + 1));
+  if (! e) e = lookup('*' + rclass.substr(rclass.rfind('.') + 1));
+  return e;
+}
+
+
+bool BDatabase::getValue(const std::string &rname, const std::string &rclass,
+                         std::string &value) const {
+  const Entry *e = find(rname, rclass);
+  if (! e) return False;
+
+  value.assign(text(e->value), e->value_length);
+  return True;
+}
+
+
+bool BDatabase::getValue(const std::string &rname, const std::string &rclass,
+                         int &value) const {
+  const Entry *e = find(rname, rclass);
+  if (! e || ! (e->flags & HasNumber)) return False;
+
+  value = e->number;
+  return True;
+}
+
+
+bool BDatabase::getValue(const std::string &rname, const std::string &rclass,
+                         bool &value) const {
+  const Entry *e = find(rname, rclass);
+  if (! e || ! (e->flags & HasBoolean)) return False;
+
+  value = (e->flags & BooleanTrue) != 0;
+  return True;
+}
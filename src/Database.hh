@@ -0,0 +1,92 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Database.hh for XWinWM - compiled resource files
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+
+#ifndef   __Database_hh
+#define   __Database_hh
+
+extern "C" {
+#include <stddef.h>
+#include <time.h>
+}
+
+#include <string>
+
+/*
+ * a resource file in the format of the X resource manager, "name: value"
+ * one to a line, compiled to a binary image the first time it is read.
+ * The image is written to $XDG_CACHE_HOME/xwinwm and mapped back into
+ * memory while the file's size, modification time and inode stay the
+ * same, so a later start or reload costs a stat and an mmap instead of
+ * reading and parsing the file, and each lookup is a probe of the hash
+ * table inside the image.
+ *
+ * Names are matched whole, without the wildcards of Xrm: a value is found
+ * under its full name, its full class, or "*" and the last component of
+ * either.
+ */
+class BDatabase {
+public:
+  BDatabase(void);
+  ~BDatabase(void);
+
+  // returns False and leaves the database empty if the file cannot be read
+  bool load(const std::string &filename);
+  void clear(void);
+
+  inline bool isLoaded(void) const { return image != 0; }
+  inline bool fromCache(void) const { return mapped; }
+
+  // these return False and leave value alone if the resource is not set,
+  // or is not a number or a boolean
+  bool getValue(const std::string &rname, const std::string &rclass,
+                std::string &value) const;
+  bool getValue(const std::string &rname, const std::string &rclass,
+                int &value) const;
+  bool getValue(const std::string &rname, const std::string &rclass,
+                bool &value) const;
+
+private:
+  struct Header;
+  struct Entry;
+  struct Source;
+
+  const char *image;
+  size_t image_size;
+  bool mapped;
+
+  BDatabase(const BDatabase&);
+  BDatabase& operator=(const BDatabase&);
+
+  const char *text(unsigned int offset) const;
+  static void describe(const struct stat &st, Source &source);
+  static bool racy(time_t mtime, time_t read);
+  static bool readFile(const std::string &filename, Source &source,
+                       std::string &text);
+  bool map(const std::string &cachefile, const Source &source);
+  bool compile(const std::string &cachefile, const Source &source,
+               const std::string &text);
+  const Entry *lookup(const std::string &key) const;
+  const Entry *find(const std::string &rname,
+                    const std::string &rclass) const;
+};
+
+#endif // __Database_hh
@@ -0,0 +1,424 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// EventReader.cc for XWinWM - reads X events on a thread of its own
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+
+#ifdef    HAVE_UNISTD_H
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif // HAVE_UNISTD_H
+
+#ifdef    HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif // HAVE_FCNTL_H
+
+#ifdef    HAVE_SYS_EVENTFD_H
+#  include <sys/eventfd.h>
+#endif // HAVE_SYS_EVENTFD_H
+
+#ifdef    HAVE_SYS_TIME_H
+#  include <sys/time.h>
+#endif // HAVE_SYS_TIME_H
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#  include <pthread.h>
+#  define   READER_THREAD
+#endif
+}
+
+#include "EventReader.hh"
+#include "RoundTrips.hh"
+#include "TracedCalls.hh"
+
+
+// how long the thread sleeps when the ring is full
+static const unsigned int StallSleep = 1000; // usec
+
+// the tail is made known to the thread at least this often, so that a
+// long batch does not keep it waiting for room until the batch is done
+static const unsigned long TailInterval = 64;
+
+
+BEventReader::BEventReader(Display *d, Window root)
+  : display(d), ring((XEvent *) 0), head(0), _events(0), _max_backlog(0),
+    _stalls(0), shared_tail(0), tail(0), cached_head(0), running(False),
+    stopping(False), thread((void *) 0), sync_sent(0), sync_seen(0),
+    sync_lock((void *) 0), sync_done((void *) 0) {
+  wake_fd[0] = wake_fd[1] = -1;
+
+#ifdef    READER_THREAD
+  pthread_mutex_t *mutex = new pthread_mutex_t;
+  pthread_mutex_init(mutex, 0);
+  sync_lock = mutex;
+
+  pthread_cond_t *cond = new pthread_cond_t;
+  pthread_cond_init(cond, 0);
+  sync_done = cond;
+#endif // READER_THREAD
+
+  // the thread is told to stop with an event sent to this window
+  XSetWindowAttributes attrib;
+  attrib.override_redirect = True;
+  window = tracedCreateWindow(display, root, -1, -1, 1, 1, 0, 0, InputOnly,
+                              CopyFromParent, CWOverrideRedirect, &attrib);
+}
+
+
+BEventReader::~BEventReader(void) {
+  stop();
+
+  XDestroyWindow(display, window);
+
+  if (wake_fd[0] != -1) close(wake_fd[0]);
+  if (wake_fd[1] != -1 && wake_fd[1] != wake_fd[0]) close(wake_fd[1]);
+  delete [] ring;
+
+#ifdef    READER_THREAD
+  pthread_mutex_destroy((pthread_mutex_t *) sync_lock);
+  delete (pthread_mutex_t *) sync_lock;
+  pthread_cond_destroy((pthread_cond_t *) sync_done);
+  delete (pthread_cond_t *) sync_done;
+#endif // READER_THREAD
+}
+
+
+bool BEventReader::start(void) {
+#ifdef    READER_THREAD
+  if (running)
+    return True;
+
+#ifdef    HAVE_SYS_EVENTFD_H
+  wake_fd[0] = wake_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd[0] == -1)
+    return False;
+#else // !HAVE_SYS_EVENTFD_H
+  if (pipe(wake_fd) == -1) {
+    wake_fd[0] = wake_fd[1] = -1;
+    return False;
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(wake_fd[i], F_SETFL, O_NONBLOCK);
+    fcntl(wake_fd[i], F_SETFD, FD_CLOEXEC);
+  }
+#endif // HAVE_SYS_EVENTFD_H
+
+  if (! ring)
+    ring = new XEvent[Size];
+
+  // the window has to exist before the thread can be told about it
+  BROUNDTRIP(Sync, XSync(display, False));
+
+  pthread_t *t = new pthread_t;
+  if (pthread_create(t, 0, threadMain, this) != 0) {
+    delete t;
+    return False;
+  }
+
+  thread = t;
+  running = True;
+  return True;
+#else // !READER_THREAD
+  return False;
+#endif // READER_THREAD
+}
+
+
+void BEventReader::stop(void) {
+#ifdef    READER_THREAD
+  if (! running)
+    return;
+
+  __atomic_store_n(&stopping, True, __ATOMIC_SEQ_CST);
+  sendMarker(Stop, 0);
+
+  // the thread may be waiting for room in a full ring
+  tail = cached_head = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&shared_tail, tail, __ATOMIC_SEQ_CST);
+
+  pthread_t *t = (pthread_t *) thread;
+  pthread_join(*t, 0);
+  delete t;
+
+  thread = (void *) 0;
+  running = False;
+#endif // READER_THREAD
+}
+
+
+void *BEventReader::threadMain(void *data) {
+  ((BEventReader *) data)->run();
+  return (void *) 0;
+}
+
+
+void BEventReader::run(void) {
+  XEvent e;
+
+  while (True) {
+    XNextEvent(display, &e);
+
+    if (e.type == ClientMessage && e.xclient.window == window) {
+#ifdef    READER_THREAD
+      if (e.xclient.data.l[0] == Sync) {
+        // everything before the marker is in the ring by now
+        pthread_mutex_lock((pthread_mutex_t *) sync_lock);
+        sync_seen = e.xclient.data.l[1];
+        pthread_cond_broadcast((pthread_cond_t *) sync_done);
+        pthread_mutex_unlock((pthread_mutex_t *) sync_lock);
+        continue;
+      }
+#endif // READER_THREAD
+
+      if (__atomic_load_n(&stopping, __ATOMIC_SEQ_CST))
+        break;
+    }
+
+    push(e);
+  }
+}
+
+
+// sends one of the events the thread looks out for, through the server
+void BEventReader::sendMarker(Marker marker, unsigned long data) {
+  // it comes back to this connection, see BPropertyFetcher::notify()
+  XEvent e;
+  e.xclient.type = ClientMessage;
+  e.xclient.window = window;
+  e.xclient.message_type = None;
+  e.xclient.format = 32;
+  e.xclient.data.l[0] = marker;
+  e.xclient.data.l[1] = data;
+  e.xclient.data.l[2] = e.xclient.data.l[3] = e.xclient.data.l[4] = 0;
+  XSendEvent(display, window, False, NoEventMask, &e);
+  XFlush(display);
+}
+
+
+// only ever called by the thread
+void BEventReader::push(const XEvent &e) {
+  unsigned long t = __atomic_load_n(&shared_tail, __ATOMIC_ACQUIRE);
+
+  if (head - t >= Size) {
+    __atomic_store_n(&_stalls, _stalls + 1, __ATOMIC_RELAXED);
+
+    do {
+      if (__atomic_load_n(&stopping, __ATOMIC_SEQ_CST))
+        return;
+      usleep(StallSleep);
+      t = __atomic_load_n(&shared_tail, __ATOMIC_ACQUIRE);
+    } while (head - t >= Size);
+  }
+
+  ring[head % Size] = e;
+  const unsigned long h = head;
+  __atomic_store_n(&head, h + 1, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&_events, _events + 1, __ATOMIC_RELAXED);
+
+  if (h + 1 - t > _max_backlog)
+    __atomic_store_n(&_max_backlog, h + 1 - t, __ATOMIC_RELAXED);
+
+  /*
+   * The event loop publishes its tail and then looks at the head before
+   * it sleeps, and this stores the head and then looks at the tail, so at
+   * least one of them sees the other.  If the ring was empty as far as
+   * the thread can tell, the event loop may be asleep.
+   */
+  if (__atomic_load_n(&shared_tail, __ATOMIC_SEQ_CST) == h)
+    wake();
+}
+
+
+void BEventReader::wake(void) {
+#ifdef    HAVE_SYS_EVENTFD_H
+  const eventfd_t one = 1;
+  ssize_t ret = write(wake_fd[1], &one, sizeof(one));
+#else // !HAVE_SYS_EVENTFD_H
+  const char one = 1;
+  ssize_t ret = write(wake_fd[1], &one, sizeof(one));
+#endif // HAVE_SYS_EVENTFD_H
+  // a full pipe will wake the event loop anyway
+  (void) ret;
+}
+
+
+// makes the tail known and looks for new events, returns True if there are
+// none
+bool BEventReader::empty(void) {
+  if (tail != cached_head)
+    return False;
+
+  __atomic_store_n(&shared_tail, tail, __ATOMIC_SEQ_CST);
+  cached_head = __atomic_load_n(&head, __ATOMIC_SEQ_CST);
+  return tail == cached_head;
+}
+
+
+bool BEventReader::pop(XEvent &e) {
+  if (! overflow.empty()) {
+    e = overflow.front();
+    overflow.pop_front();
+    return True;
+  }
+
+  while (! empty()) {
+    // the slot is the thread's again once the tail is published, so it is
+    // read first
+    const XEvent &slot = ring[tail % Size];
+    const bool taken = (slot.type == 0);    // already taken by take()
+    if (! taken)
+      e = slot;
+
+    if (++tail % TailInterval == 0)
+      __atomic_store_n(&shared_tail, tail, __ATOMIC_RELEASE);
+
+    if (! taken)
+      return True;
+  }
+
+  return False;
+}
+
+
+/*
+ * Everything from the tail up to the head belongs to the event loop, so
+ * events can be taken out of the middle.  Their slots are marked, and
+ * skipped when the tail gets to them.
+ */
+bool BEventReader::take(int type, Window w, XEvent &e) {
+  if (! running)
+    return False;
+
+  std::deque<XEvent>::iterator it = overflow.begin();
+  for (; it != overflow.end(); ++it) {
+    if (it->type == type && (w == None || it->xany.window == w)) {
+      e = *it;
+      overflow.erase(it);
+      return True;
+    }
+  }
+
+  cached_head = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+  for (unsigned long i = tail; i != cached_head; ++i) {
+    XEvent &slot = ring[i % Size];
+    if (slot.type == type && (w == None || slot.xany.window == w)) {
+      e = slot;
+      slot.type = 0;
+      return True;
+    }
+  }
+
+  return False;
+}
+
+
+/*
+ * The marker goes through the server like any other event, so once the
+ * thread has seen it, every event the server sent before it has been put
+ * in the ring.  The ring is emptied into the overflow while waiting, as
+ * the thread cannot get to the marker while it waits for room.
+ */
+bool BEventReader::sync(void) {
+#ifdef    READER_THREAD
+  if (! running)
+    return False;
+
+  const unsigned long marker = ++sync_sent;
+  sendMarker(Sync, marker);
+
+  pthread_mutex_t *mutex = (pthread_mutex_t *) sync_lock;
+  pthread_mutex_lock(mutex);
+  while (sync_seen != marker) {
+    pthread_mutex_unlock(mutex);
+    spill();
+    pthread_mutex_lock(mutex);
+    if (sync_seen == marker)
+      break;
+
+    timeval now;
+    gettimeofday(&now, 0);
+    timespec until;
+    until.tv_sec = now.tv_sec;
+    until.tv_nsec = (now.tv_usec + StallSleep) * 1000;
+    if (until.tv_nsec >= 1000000000) {
+      until.tv_sec += 1;
+      until.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait((pthread_cond_t *) sync_done, mutex, &until);
+  }
+  pthread_mutex_unlock(mutex);
+
+  return True;
+#else // !READER_THREAD
+  return False;
+#endif // READER_THREAD
+}
+
+
+// moves what is in the ring to the overflow, to make room for the thread
+void BEventReader::spill(void) {
+  for (unsigned long n = Size; n > 0 && ! empty(); --n) {
+    const XEvent &slot = ring[tail % Size];
+    ++tail;
+    if (slot.type != 0)
+      overflow.push_back(slot);
+  }
+
+  __atomic_store_n(&shared_tail, tail, __ATOMIC_SEQ_CST);
+}
+
+
+bool BEventReader::prepareWait(void) {
+#ifdef    HAVE_SYS_EVENTFD_H
+  eventfd_t value;
+  while (read(wake_fd[0], &value, sizeof(value)) > 0) ;
+#else // !HAVE_SYS_EVENTFD_H
+  char buf[64];
+  while (read(wake_fd[0], buf, sizeof(buf)) > 0) ;
+#endif // HAVE_SYS_EVENTFD_H
+
+  return overflow.empty() && empty();
+}
+
+
+unsigned long BEventReader::events(void) const {
+  return __atomic_load_n(&_events, __ATOMIC_RELAXED);
+}
+
+
+unsigned long BEventReader::backlog(void) const {
+  return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - tail + overflow.size();
+}
+
+
+unsigned long BEventReader::maxBacklog(void) const {
+  return __atomic_load_n(&_max_backlog, __ATOMIC_RELAXED);
+}
+
+
+unsigned long BEventReader::stalls(void) const {
+  return __atomic_load_n(&_stalls, __ATOMIC_RELAXED);
+}
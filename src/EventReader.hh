@@ -0,0 +1,120 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// EventReader.hh for XWinWM - reads X events on a thread of its own
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __EventReader_hh
+#define   __EventReader_hh
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+#include <deque>
+
+/*
+ * a thread that does nothing but wait for events and copy them into a
+ * ring, so that reading the connection goes on while the window manager
+ * is busy.  The ring has one writer and one reader and needs no lock: the
+ * thread only moves the head and the event loop only moves the tail.  The
+ * event loop is woken through fd() when the ring goes from empty to not
+ * empty, and takes whatever has piled up since in one go.
+ *
+ * An event the thread has read but not yet put in the ring is seen by
+ * neither side, so XSync() is not enough to be sure that an event is
+ * not on its way.  sync() is, and is the same one round trip.
+ *
+ * Xlib must have been set up with XInitThreads() before the display was
+ * opened.
+ */
+class BEventReader {
+public:
+  BEventReader(Display *d, Window root);
+  ~BEventReader(void);
+
+  // returns False if the thread could not be started
+  bool start(void);
+  void stop(void);
+
+  // takes the oldest event, returns False if there is none
+  bool pop(XEvent &e);
+  // takes the oldest event of a type, on window unless that is None
+  bool take(int type, Window window, XEvent &e);
+
+  // waits until the server has handled every request sent so far and
+  // every event it sent before then can be taken; returns False if the
+  // thread is not running
+  bool sync(void);
+
+  /*
+   * readable when events have arrived.  prepareWait() must be called
+   * before waiting on it, and if it returns False there are events
+   * already and the wait would never end.
+   */
+  inline int fd(void) const { return wake_fd[0]; }
+  bool prepareWait(void);
+
+  inline unsigned long capacity(void) const { return Size; }
+
+  // events read, events waiting, the most there ever were waiting, and
+  // how often the thread found the ring full
+  unsigned long events(void) const;
+  unsigned long backlog(void) const;
+  unsigned long maxBacklog(void) const;
+  unsigned long stalls(void) const;
+
+private:
+  enum { Size = 4096 };
+  // what the events sent to window ask of the thread
+  enum Marker { Stop = 0, Sync };
+
+  Display *display;
+  Window window;
+  int wake_fd[2];
+
+  XEvent *ring;
+  // written by the thread
+  unsigned long head, _events, _max_backlog, _stalls;
+  // written by the event loop; tail is kept to itself until the thread
+  // needs to know, and cached_head is what it last saw of head
+  unsigned long shared_tail, tail, cached_head;
+
+  bool running, stopping;
+  void *thread;
+
+  // sync() counts its markers, and the thread says which it has seen
+  unsigned long sync_sent, sync_seen;
+  void *sync_lock, *sync_done;
+  // events moved out of the ring while sync() waits, which come before
+  // anything still in it; only the event loop touches this
+  std::deque<XEvent> overflow;
+
+  BEventReader(const BEventReader &_nocopy);
+  BEventReader &operator=(const BEventReader &_nocopy);
+
+  static void *threadMain(void *data);
+  void run(void);
+  void push(const XEvent &e);
+  void wake(void);
+  void sendMarker(Marker marker, unsigned long data);
+  void spill(void);
+  bool empty(void);
+};
+
+#endif // __EventReader_hh
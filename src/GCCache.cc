@@ -26,106 +26,123 @@
 #  include "../config.h"
 #endif // HAVE_CONFIG_H
 
-extern "C" {
-#include <stdio.h>
-}
-
 #include "GCCache.hh"
 #include "BaseDisplay.hh"
 #include "Color.hh"
-#include "Util.hh"
 
 
-BGCCacheContext::~BGCCacheContext(void) {
-  if (gc)
-    XFreeGC(display->getXDisplay(), gc);
-}
+// GCs kept for each screen before unused ones are recycled
+static const unsigned int ContextsPerScreen = 128u;
 
 
-void BGCCacheContext::set(const BColor &_color,
-                          const XFontStruct * const _font,
-                          const int _function, const int _subwindow) {
-  XGCValues gcv;
-  pixel = gcv.foreground = _color.pixel();
-  function = gcv.function = _function;
-  subwindow = gcv.subwindow_mode = _subwindow;
-  unsigned long mask = GCForeground | GCFunction | GCSubwindowMode;
-
-  if (_font) {
-    fontid = gcv.font = _font->fid;
-    mask |= GCFont;
-  } else {
-    fontid = 0;
-  }
+BGCCache::BGCCache(const BaseDisplay * const _display,
+                   unsigned int screen_count)
+  : display(_display), table(256u, (BGCCacheItem*) 0), used(0),
+    screens(screen_count), _hits(0), _misses(0), _evictions(0) { }
+
 
-  XChangeGC(display->getXDisplay(), gc, mask, &gcv);
+BGCCache::~BGCCache(void) {
+  for (Table::iterator it = table.begin(); it != table.end(); ++it) {
+    if (*it) destroy(*it);
+  }
 }
 
 
-void BGCCacheContext::set(const XFontStruct * const _font) {
-  if (! _font) {
-    fontid = 0;
-    return;
-  }
+unsigned int BGCCache::hash(unsigned long pixel, unsigned long fontid,
+                            int function, int subwindow,
+                            unsigned int screen) {
+  unsigned int h = (unsigned int) pixel * 0x9e3779b1u;
+  h ^= (unsigned int) fontid + 0x7f4a7c15u + (h << 6) + (h >> 2);
+  h ^= (unsigned int) (function << 4 | subwindow) + 0x7f4a7c15u +
+       (h << 6) + (h >> 2);
+  h ^= screen + 0x7f4a7c15u + (h << 6) + (h >> 2);
+  return h ^ (h >> 16);
+}
 
-  XGCValues gcv;
-  fontid = gcv.font = _font->fid;
-  XChangeGC(display->getXDisplay(), gc, GCFont, &gcv);
+
+unsigned int BGCCache::slot(const BGCCacheItem *item) const {
+  return hash(item->pixel, item->fontid, item->function, item->subwindow,
+              item->screen) & (table.size() - 1);
 }
 
 
-BGCCache::BGCCache(const BaseDisplay * const _display,
-                   unsigned int screen_count)
-  : display(_display),  context_count(128u),
-    cache_size(16u), cache_buckets(8u * screen_count),
-    cache_total_size(cache_size * cache_buckets) {
-
-  contexts = new BGCCacheContext*[context_count];
-  unsigned int i;
-  for (i = 0; i < context_count; i++) {
-    contexts[i] = new BGCCacheContext(display);
-  }
+void BGCCache::insert(BGCCacheItem *item) {
+  const unsigned int mask = table.size() - 1;
+  unsigned int i = slot(item);
+  while (table[i])
+    i = (i + 1) & mask;
+  table[i] = item;
 
-  cache = new BGCCacheItem*[cache_total_size];
-  for (i = 0; i < cache_total_size; ++i) {
-    cache[i] = new BGCCacheItem;
-  }
+  // keep the table at most half full
+  if (++used * 2 > table.size())
+    grow();
 }
 
 
-BGCCache::~BGCCache(void) {
-  std::for_each(contexts, contexts + context_count, PointerAssassin());
-  std::for_each(cache, cache + cache_total_size, PointerAssassin());
-  delete [] cache;
-  delete [] contexts;
+/*
+ * Takes an item out of the table and moves the items after it back into
+ * the gap where their probe sequence allows, so lookups never need to skip
+ * over deleted slots.
+ */
+void BGCCache::remove(BGCCacheItem *item) {
+  const unsigned int mask = table.size() - 1;
+  unsigned int i = slot(item);
+  while (table[i] != item)
+    i = (i + 1) & mask;
+  table[i] = 0;
+  --used;
+
+  for (unsigned int j = (i + 1) & mask; table[j]; j = (j + 1) & mask) {
+    const unsigned int k = slot(table[j]);
+    // leave it if its home slot is cyclically in (i, j]
+    if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+      continue;
+    table[i] = table[j];
+    table[j] = 0;
+    i = j;
+  }
 }
 
 
-BGCCacheContext *BGCCache::nextContext(unsigned int scr) {
-  Window hd = display->getScreenInfo(scr)->getRootWindow();
+void BGCCache::grow(void) {
+  Table old(table.size() * 2, (BGCCacheItem*) 0);
+  old.swap(table);
 
-  BGCCacheContext *c;
+  const unsigned int mask = table.size() - 1;
+  for (Table::const_iterator it = old.begin(); it != old.end(); ++it) {
+    if (! *it) continue;
+    unsigned int i = slot(*it);
+    while (table[i])
+      i = (i + 1) & mask;
+    table[i] = *it;
+  }
+}
 
-  for (unsigned int i = 0; i < context_count; ++i) {
-    c = contexts[i];
 
-    if (! c->gc) {
-      c->gc = XCreateGC(display->getXDisplay(), hd, 0, 0);
-      c->used = false;
-      c->screen = scr;
-    }
-    if (! c->used && c->screen == scr)
-      return c;
-  }
+void BGCCache::unlink(BGCCacheItem *item) {
+  ScreenCache &s = screens[item->screen];
+  if (item->prev) item->prev->next = item->next;
+  else s.lru_head = item->next;
+  if (item->next) item->next->prev = item->prev;
+  else s.lru_tail = item->prev;
+  item->prev = item->next = 0;
+}
+
 
-  fprintf(stderr, "BGCCache: context fault!\n");
-  abort();
-  return (BGCCacheContext*) 0; // not reached
+void BGCCache::append(BGCCacheItem *item) {
+  ScreenCache &s = screens[item->screen];
+  item->prev = s.lru_tail;
+  item->next = 0;
+  if (s.lru_tail) s.lru_tail->next = item;
+  else s.lru_head = item;
+  s.lru_tail = item;
 }
 
 
-void BGCCache::release(BGCCacheContext *ctx) {
-  ctx->used = false;
+void BGCCache::destroy(BGCCacheItem *item) {
+  if (item->_gc)
+    XFreeGC(display->getXDisplay(), item->_gc);
+  delete item;
 }
 
 
@@ -133,72 +150,71 @@ BGCCacheItem *BGCCache::find(const BColor &_color,
                              const XFontStruct * const _font,
                              int _function, int _subwindow) {
   const unsigned long pixel = _color.pixel();
+  const unsigned long fontid = (_font) ? _font->fid : 0ul;
   const unsigned int screen = _color.screen();
-  const int key = _color.red() ^ _color.green() ^ _color.blue();
-  int k = (key % cache_size) * cache_buckets;
-  unsigned int i = 0; // loop variable
-  BGCCacheItem *c = cache[ k ], *prev = 0;
-
-  /*
-    this will either loop cache_buckets times then return/abort or
-    it will stop matching
-  */
-  while (c->ctx &&
-         (c->ctx->pixel != pixel || c->ctx->function != _function ||
-          c->ctx->subwindow != _subwindow || c->ctx->screen != screen)) {
-    if (i < (cache_buckets - 1)) {
-      prev = c;
-      c = cache[ ++k ];
-      ++i;
-      continue;
-    }
-    if (c->count == 0 && c->ctx->screen == screen) {
-      // use this cache item
-      c->ctx->set(_color, _font, _function, _subwindow);
-      c->ctx->used = true;
-      c->count = 1;
-      c->hits = 1;
+  const unsigned int mask = table.size() - 1;
+
+  unsigned int i = hash(pixel, fontid, _function, _subwindow, screen) & mask;
+  for (BGCCacheItem *c; (c = table[i]); i = (i + 1) & mask) {
+    if (c->pixel == pixel && c->fontid == fontid &&
+        c->function == _function && c->subwindow == _subwindow &&
+        c->screen == screen) {
+      if (c->count++ == 0)
+        unlink(c);
+      ++_hits;
       return c;
     }
-    // cache fault!
-    fprintf(stderr, "BGCCache: cache fault, count: %d, screen: %d, item screen: %d\n", c->count, screen, c->ctx->screen);
-    abort();
   }
 
-  if (c->ctx) {
-    // reuse existing context
-    if (_font && _font->fid && _font->fid != c->ctx->fontid)
-      c->ctx->set(_font);
-    c->count++;
-    c->hits++;
-    if (prev && c->hits > prev->hits) {
-      cache[ k     ] = prev;
-      cache[ k - 1 ] = c;
-    }
+  ++_misses;
+
+  ScreenCache &s = screens[screen];
+  BGCCacheItem *c;
+  if (s.count >= ContextsPerScreen && s.lru_head) {
+    // recycle the GC on this screen that has gone unused the longest
+    c = s.lru_head;
+    unlink(c);
+    remove(c);
+    ++_evictions;
   } else {
-    c->ctx = nextContext(screen);
-    c->ctx->set(_color, _font, _function, _subwindow);
-    c->ctx->used = true;
-    c->count = 1;
-    c->hits = 1;
+    c = new BGCCacheItem;
+    c->_gc = XCreateGC(display->getXDisplay(),
+                       display->getScreenInfo(screen)->getRootWindow(), 0, 0);
+    ++s.count;
   }
 
+  XGCValues gcv;
+  c->pixel = gcv.foreground = pixel;
+  c->function = gcv.function = _function;
+  c->subwindow = gcv.subwindow_mode = _subwindow;
+  c->fontid = gcv.font = fontid;
+  c->screen = screen;
+  c->count = 1;
+
+  unsigned long valuemask = GCForeground | GCFunction | GCSubwindowMode;
+  if (fontid) valuemask |= GCFont;
+  XChangeGC(display->getXDisplay(), c->_gc, valuemask, &gcv);
+
+  insert(c);
   return c;
 }
 
 
 void BGCCache::release(BGCCacheItem *_item) {
-  _item->count--;
+  if (_item->count > 0 && --_item->count == 0)
+    append(_item);
 }
 
 
 void BGCCache::purge(void) {
-  for (unsigned int i = 0; i < cache_total_size; ++i) {
-    BGCCacheItem *d = cache[ i ];
-
-    if (d->ctx && d->count == 0) {
-      release(d->ctx);
-      d->ctx = 0;
+  ScreenCacheList::iterator it = screens.begin();
+  for (; it != screens.end(); ++it) {
+    while (it->lru_head) {
+      BGCCacheItem *c = it->lru_head;
+      unlink(c);
+      remove(c);
+      destroy(c);
+      --it->count;
     }
   }
 }
@@ -32,48 +32,27 @@ extern "C" {
 #include "BaseDisplay.hh"
 #include "Color.hh"
 
-class BGCCacheItem;
+#include <vector>
 
-class BGCCacheContext {
+class BGCCacheItem {
 public:
-  void set(const BColor &_color, const XFontStruct * const _font,
-           const int _function, const int _subwindow);
-  void set(const XFontStruct * const _font);
-
-  ~BGCCacheContext(void);
+  inline const GC &gc(void) const { return _gc; }
 
 private:
-  BGCCacheContext(const BaseDisplay * const _display)
-    : display(_display), gc(0), pixel(0ul), fontid(0ul),
-      function(0), subwindow(0), used(false), screen(~(0u)) {}
+  BGCCacheItem(void)
+    : _gc(0), pixel(0ul), fontid(0ul), function(0), subwindow(0),
+      screen(~(0u)), count(0), prev(0), next(0) { }
 
-  const BaseDisplay *display;
-  GC gc;
+  GC _gc;
   unsigned long pixel;
   unsigned long fontid;
   int function;
   int subwindow;
-  bool used;
   unsigned int screen;
-
-  BGCCacheContext(const BGCCacheContext &_nocopy);
-  BGCCacheContext &operator=(const BGCCacheContext &_nocopy);
-
-  friend class BGCCache;
-  friend class BGCCacheItem;
-};
-
-class BGCCacheItem {
-public:
-  inline const GC &gc(void) const { return ctx->gc; }
-
-private:
-  BGCCacheItem(void) : ctx(0), count(0), hits(0), fault(false) { }
-
-  BGCCacheContext *ctx;
   unsigned int count;
-  unsigned int hits;
-  bool fault;
+
+  // the list of unused items on the screen, least recently used first
+  BGCCacheItem *prev, *next;
 
   BGCCacheItem(const BGCCacheItem &_nocopy);
   BGCCacheItem &operator=(const BGCCacheItem &_nocopy);
@@ -81,32 +60,62 @@ private:
   friend class BGCCache;
 };
 
+/*
+ * GCs are shared by everything drawing with the same pixel, font, function
+ * and subwindow mode on a screen.  They are found in an open addressed hash
+ * table that grows as needed.  Once a screen has more than a few GCs,
+ * the one on that screen that has gone unused the longest is changed to
+ * the new values instead of creating another, so a busy screen cannot take
+ * the GCs of the others.
+ */
 class BGCCache {
 public:
   BGCCache(const BaseDisplay * const _display, unsigned int screen_count);
   ~BGCCache(void);
 
-  // cleans up the cache
+  // frees the GCs nothing is using
   void purge(void);
 
   BGCCacheItem *find(const BColor &_color, const XFontStruct * const _font = 0,
                      int _function = GXcopy, int _subwindow = ClipByChildren);
   void release(BGCCacheItem *_item);
 
+  inline unsigned long hits(void) const { return _hits; }
+  inline unsigned long misses(void) const { return _misses; }
+  inline unsigned long evictions(void) const { return _evictions; }
+  inline unsigned long count(void) const { return used; }
+
 private:
-  BGCCacheContext *nextContext(unsigned int _screen);
-  void release(BGCCacheContext *ctx);
+  typedef std::vector<BGCCacheItem*> Table;
 
-  // this is closely modelled after the Qt GC cache, but with some of the
-  // complexity stripped out
-  const BaseDisplay *display;
+  // the GCs made for one screen, and those of them nothing is using
+  struct ScreenCache {
+    unsigned int count;
+    BGCCacheItem *lru_head, *lru_tail;
 
-  const unsigned int context_count;
-  const unsigned int cache_size;
-  const unsigned int cache_buckets;
-  const unsigned int cache_total_size;
-  BGCCacheContext **contexts;
-  BGCCacheItem **cache;
+    ScreenCache(void): count(0), lru_head(0), lru_tail(0) { }
+  };
+  typedef std::vector<ScreenCache> ScreenCacheList;
+
+  const BaseDisplay *display;
+  Table table;
+  unsigned int used;
+  ScreenCacheList screens;
+  unsigned long _hits, _misses, _evictions;
+
+  static unsigned int hash(unsigned long pixel, unsigned long fontid,
+                           int function, int subwindow, unsigned int screen);
+  unsigned int slot(const BGCCacheItem *item) const;
+  void insert(BGCCacheItem *item);
+  void remove(BGCCacheItem *item);
+  void grow(void);
+
+  void unlink(BGCCacheItem *item);
+  void append(BGCCacheItem *item);
+  void destroy(BGCCacheItem *item);
+
+  BGCCache(const BGCCache &_nocopy);
+  BGCCache &operator=(const BGCCache &_nocopy);
 };
 
 class BPen {
@@ -0,0 +1,429 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Icon.cc for XWinWM - loads the window icons set with _NET_WM_ICON
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+#ifdef    HAVE_STDLIB_H
+#  include <stdlib.h>
+#endif // HAVE_STDLIB_H
+}
+
+#include "Icon.hh"
+#include "BaseDisplay.hh"
+#include "Color.hh"
+#include "Image.hh"
+
+#include <algorithm>
+
+
+// images larger than this on either side are taken to be garbage
+static const unsigned long MaxIconSide = 1024;
+
+// the most pixels read from the property in one request
+static const unsigned long ChunkSize = 16384;
+
+
+/*
+ * Draws premultiplied pixels into a new pixmap of the screen's depth and a
+ * bitmap mask.  A 32 bit visual gets the alpha channel as well, which is
+ * premultiplied by convention, otherwise the colors end up drawn over
+ * black.  Only TrueColor visuals are supported.
+ */
+static bool renderPixels(const ScreenInfo *screen, const unsigned int *pixels,
+                         unsigned int width, unsigned int height,
+                         Pixmap &pixmap, Pixmap &mask) {
+  pixmap = mask = None;
+
+  Visual *visual = screen->getVisual();
+  if (visual->c_class != TrueColor)
+    return False;
+
+  Display *display = screen->getBaseDisplay()->getXDisplay();
+  int depth = screen->getDepth();
+
+  XImage *image = XCreateImage(display, visual, depth, ZPixmap, 0, 0,
+                               width, height, 32, 0);
+  XImage *bitmap = XCreateImage(display, visual, 1, XYBitmap, 0, 0,
+                                width, height, 8, 0);
+  if (! image || ! bitmap) {
+    if (image) XDestroyImage(image);
+    if (bitmap) XDestroyImage(bitmap);
+    return False;
+  }
+  image->data = (char *) malloc(image->bytes_per_line * height);
+  bitmap->data = (char *) malloc(bitmap->bytes_per_line * height);
+
+  const BPixelFormat format(visual, depth);
+
+  const unsigned int *p = pixels;
+  for (unsigned int y = 0; y < height; ++y) {
+    for (unsigned int x = 0; x < width; ++x, ++p) {
+      XPutPixel(image, x, y, format.pixel(*p));
+      XPutPixel(bitmap, x, y, (*p >> 24) >= 0x80);
+    }
+  }
+
+  pixmap = XCreatePixmap(display, screen->getRootWindow(),
+                         width, height, depth);
+  mask = XCreatePixmap(display, screen->getRootWindow(), width, height, 1);
+
+  GC gc = XCreateGC(display, pixmap, 0, 0);
+  XPutImage(display, pixmap, gc, image, 0, 0, 0, 0, width, height);
+  XFreeGC(display, gc);
+
+  gc = XCreateGC(display, mask, 0, 0);
+  XPutImage(display, mask, gc, bitmap, 0, 0, 0, 0, width, height);
+  XFreeGC(display, gc);
+
+  XDestroyImage(image);
+  XDestroyImage(bitmap);
+
+  return True;
+}
+
+
+/*
+ * Turns premultiplied pixels back into the straight alpha _NET_WM_ICON
+ * holds.
+ */
+static void unpremultiplyPixels(const unsigned int *pixels, size_t count,
+                                unsigned long *out) {
+  for (size_t i = 0; i < count; ++i) {
+    const unsigned int p = pixels[i], a = p >> 24;
+    if (a == 0) {
+      out[i] = 0;
+      continue;
+    }
+    if (a == 0xff) {
+      out[i] = p;
+      continue;
+    }
+
+    unsigned int r = (((p >> 16) & 0xff) * 0xff + a / 2) / a;
+    unsigned int g = (((p >> 8) & 0xff) * 0xff + a / 2) / a;
+    unsigned int b = ((p & 0xff) * 0xff + a / 2) / a;
+    if (r > 0xff) r = 0xff;
+    if (g > 0xff) g = 0xff;
+    if (b > 0xff) b = 0xff;
+    out[i] = (a << 24) | (r << 16) | (g << 8) | b;
+  }
+}
+
+
+BIconLoader::BIconLoader(BaseDisplay *d, Window w, Atom a, BIconHandler *h,
+                         unsigned int large, unsigned int small)
+  : display(d), window(w), atom(a), handler(h), state(Idle),
+    offset(0), total(0), fetching(Large) {
+  choice[Large].size = large;
+  choice[Small].size = small;
+  reset();
+}
+
+
+BIconLoader::~BIconLoader(void) {
+  display->propertyFetcher()->cancel(this);
+}
+
+
+void BIconLoader::reset(void) {
+  for (unsigned int i = 0; i < Sizes; ++i) {
+    choice[i].offset = 0;
+    choice[i].icon.width = choice[i].icon.height = 0;
+    std::vector<unsigned int>().swap(choice[i].icon.pixels);
+  }
+  fetching = Large;
+}
+
+
+void BIconLoader::start(void) {
+  // a read still out belongs to the property as it was
+  display->propertyFetcher()->cancel(this);
+
+  state = Scanning;
+  offset = total = 0;
+  reset();
+
+  read(0, 2);
+}
+
+
+void BIconLoader::stop(void) {
+  display->propertyFetcher()->cancel(this);
+
+  state = Idle;
+  reset();
+}
+
+
+void BIconLoader::read(unsigned long at, unsigned long length) {
+  display->propertyFetcher()->fetch(this, window, atom, XA_CARDINAL,
+                                    length, at);
+}
+
+
+void BIconLoader::propertyFetched(const BProperty &property) {
+  switch (state) {
+  case Scanning: scan(property); break;
+  case Fetching: fetch(property); break;
+  case Idle: break;
+  }
+}
+
+
+/*
+ * Takes the width and height of the image at offset, and asks for the
+ * next one, or for the pixels of the chosen images once they are all
+ * known.
+ */
+void BIconLoader::scan(const BProperty &property) {
+  if (! property.exists) {
+    // the property shrank, or the window is gone
+    if (offset > 0)
+      start();
+    else
+      finish();
+    return;
+  }
+
+  unsigned long w = 0, h = 0;
+  if (property.format == 32 && property.values.size() == 2) {
+    w = property.values[0] & 0xfffffffful;
+    h = property.values[1] & 0xfffffffful;
+  }
+
+  unsigned long length = offset + property.values.size() + property.after / 4;
+  if (offset > 0 && length != total) {
+    // the property changed while it was being read
+    start();
+    return;
+  }
+  total = length;
+
+  if (w > 0 && h > 0 && w <= MaxIconSide && h <= MaxIconSide &&
+      offset + 2 + w * h <= total) {
+    for (unsigned int i = 0; i < Sizes; ++i) {
+      if (better(choice[i], w, h)) {
+        choice[i].offset = offset;
+        choice[i].icon.width = w;
+        choice[i].icon.height = h;
+      }
+    }
+
+    offset += 2 + w * h;
+    if (offset < total) {
+      read(offset, 2);
+      return;
+    }
+  }
+
+  // anything after a bad header is ignored
+  if (choice[Large].icon.width == 0) {
+    finish();
+    return;
+  }
+
+  fetching = Large;
+  choice[Large].icon.pixels.reserve(choice[Large].icon.width *
+                                    choice[Large].icon.height);
+  state = Fetching;
+  const BIcon &large = choice[Large].icon;
+  read(choice[Large].offset + 2,
+       std::min((unsigned long) large.width * large.height, ChunkSize));
+}
+
+
+/*
+ * Takes the next chunk of the image being fetched, and asks for the one
+ * after it, moving on to the small image once the large one is done.
+ */
+void BIconLoader::fetch(const BProperty &property) {
+  Choice &c = choice[fetching];
+  const unsigned long count = c.icon.width * c.icon.height;
+  const unsigned long have = c.icon.pixels.size();
+
+  if (! property.exists || property.format != 32 ||
+      property.values.empty() ||
+      c.offset + 2 + have + property.values.size() +
+      property.after / 4 != total) {
+    // the property changed, or the window is gone
+    start();
+    return;
+  }
+
+  for (unsigned long i = 0; i < property.values.size(); ++i)
+    c.icon.pixels.push_back((unsigned int) property.values[i]);
+
+  if (fetching == Large && c.icon.pixels.size() >= count) {
+    Choice &small = choice[Small];
+    if (small.offset == c.offset) {
+      // the same image is the best there is for both
+      small.icon.pixels = c.icon.pixels;
+    } else {
+      fetching = Small;
+      small.icon.pixels.reserve(small.icon.width * small.icon.height);
+    }
+  }
+
+  Choice &next = choice[fetching];
+  const unsigned long next_count = next.icon.width * next.icon.height;
+  const unsigned long next_have = next.icon.pixels.size();
+  if (next_have < next_count) {
+    read(next.offset + 2 + next_have,
+         std::min(next_count - next_have, ChunkSize));
+    return;
+  }
+
+  finish();
+}
+
+
+/*
+ * Prefers the smallest image which covers the wanted size, so that it
+ * never has to be enlarged, and otherwise the largest one there is.
+ */
+bool BIconLoader::better(const Choice &c, unsigned int w, unsigned int h) {
+  const BIcon &best = c.icon;
+  if (best.width == 0)
+    return True;
+
+  bool fits = w >= c.size && h >= c.size;
+  bool best_fits = best.width >= c.size && best.height >= c.size;
+  if (fits != best_fits)
+    return fits;
+
+  if (fits)
+    return w * h < best.width * best.height;
+  return w * h > best.width * best.height;
+}
+
+
+void BIconLoader::finish(void) {
+  state = Idle;
+
+  for (unsigned int i = 0; i < Sizes; ++i) {
+    BIcon &icon = choice[i].icon;
+    if (icon.pixels.size() != icon.width * icon.height ||
+        icon.pixels.empty()) {
+      icon.width = icon.height = 0;
+      icon.pixels.clear();
+    }
+  }
+
+  handler->iconLoaded(choice[Large].icon, choice[Small].icon);
+
+  // the handler has made what it needs out of the images by now
+  reset();
+}
+
+
+bool BIconCache::Key::operator<(const Key &k) const {
+  if (screen != k.screen) return screen < k.screen;
+  if (size != k.size) return size < k.size;
+  if (width != k.width) return width < k.width;
+  if (height != k.height) return height < k.height;
+  if (hash[0] != k.hash[0]) return hash[0] < k.hash[0];
+  return hash[1] < k.hash[1];
+}
+
+
+BIconCache::BIconCache(const BaseDisplay * const _display)
+  : display(_display), _hits(0), _misses(0) {}
+
+
+BIconCache::~BIconCache(void) {
+  ItemMap::iterator it = cache.begin(), end = cache.end();
+  for (; it != end; ++it) {
+    XFreePixmap(display->getXDisplay(), it->second->_pixmap);
+    XFreePixmap(display->getXDisplay(), it->second->_mask);
+    delete it->second;
+  }
+}
+
+
+BIconCacheItem *BIconCache::find(const ScreenInfo *screen, const BIcon &icon,
+                                 unsigned int size) {
+  if (icon.empty())
+    return (BIconCacheItem *) 0;
+
+  Key key;
+  key.screen = screen->getScreenNumber();
+  key.size = size;
+  key.width = icon.width;
+  key.height = icon.height;
+  hashPixels(&icon.pixels[0], icon.pixels.size(), key.hash);
+
+  ItemMap::iterator it = cache.find(key);
+  if (it != cache.end()) {
+    ++_hits;
+    ++it->second->count;
+    return it->second;
+  }
+  ++_misses;
+
+  // averaging straight alpha would let the color of transparent pixels
+  // show, so the image is premultiplied first
+  std::vector<unsigned int> pixels(icon.pixels);
+  premultiplyPixels(&pixels[0], pixels.size());
+
+  std::vector<unsigned int> scaled(size * size);
+  scalePixels(&pixels[0], icon.width, icon.height, &scaled[0], size, size);
+
+  BIconCacheItem *item = new BIconCacheItem;
+  if (! renderPixels(screen, &scaled[0], size, size,
+                     item->_pixmap, item->_mask)) {
+    delete item;
+    return (BIconCacheItem *) 0;
+  }
+
+  item->_data.resize(2 + size * size);
+  item->_data[0] = size;
+  item->_data[1] = size;
+  unpremultiplyPixels(&scaled[0], scaled.size(), &item->_data[2]);
+
+  item->count = 1;
+  cache.insert(ItemMap::value_type(key, item));
+  return item;
+}
+
+
+void BIconCache::release(BIconCacheItem *_item) {
+  if (--_item->count > 0)
+    return;
+
+  ItemMap::iterator it = cache.begin(), end = cache.end();
+  for (; it != end; ++it) {
+    if (it->second == _item) {
+      cache.erase(it);
+      break;
+    }
+  }
+
+  XFreePixmap(display->getXDisplay(), _item->_pixmap);
+  XFreePixmap(display->getXDisplay(), _item->_mask);
+  delete _item;
+}
@@ -0,0 +1,168 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Icon.hh for XWinWM - loads the window icons set with _NET_WM_ICON
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Icon_hh
+#define   __Icon_hh
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+#include <map>
+#include <vector>
+
+#include "PropertyFetcher.hh"
+
+// forward declarations
+class BaseDisplay;
+class ScreenInfo;
+
+// one image out of a _NET_WM_ICON property
+struct BIcon {
+  unsigned int width, height;
+  std::vector<unsigned int> pixels;     // 0xAARRGGBB, not premultiplied
+
+  BIcon(void): width(0), height(0) {}
+
+  inline bool empty(void) const { return pixels.empty(); }
+};
+
+class BIconHandler {
+public:
+  // called with empty icons if the window has none.  Both are the same
+  // image when it is the closest there is to either size.
+  virtual void iconLoaded(const BIcon &large, const BIcon &small) = 0;
+};
+
+/*
+ * reads _NET_WM_ICON from a window a piece at a time.  The property can
+ * hold many images and be several hundred kilobytes large, so only the
+ * width and height of each image are read to pick the ones closest to a
+ * large and a small size, and then only those images are fetched, in
+ * chunks.  Every read goes through the property fetcher, so the window
+ * manager never waits for one and handles events while a large icon is
+ * coming in; the next read is made when the last one is handed back.
+ */
+class BIconLoader: public BPropertyHandler {
+public:
+  BIconLoader(BaseDisplay *d, Window w, Atom a, BIconHandler *h,
+              unsigned int large, unsigned int small);
+  virtual ~BIconLoader(void);
+
+  // starts loading the icon again from the beginning
+  void start(void);
+  void stop(void);
+  inline bool isLoading(void) const { return state != Idle; }
+
+  virtual void propertyFetched(const BProperty &property);
+
+private:
+  enum State { Idle, Scanning, Fetching };
+  enum { Large = 0, Small, Sizes };
+
+  // the image picked for one of the sizes so far
+  struct Choice {
+    unsigned int size;
+    unsigned long offset;
+    BIcon icon;
+  };
+
+  BaseDisplay *display;
+  Window window;
+  Atom atom;
+  BIconHandler *handler;
+
+  State state;
+
+  // all offsets are in 32 bit units, like the property requests
+  unsigned long offset, total;
+  Choice choice[Sizes];
+  unsigned int fetching;                // the choice being read
+
+  BIconLoader(const BIconLoader&);
+  BIconLoader& operator=(const BIconLoader&);
+
+  void scan(const BProperty &property);
+  void fetch(const BProperty &property);
+  void read(unsigned long at, unsigned long length);
+  static bool better(const Choice &c, unsigned int w, unsigned int h);
+  void reset(void);
+  void finish(void);
+};
+
+class BIconCacheItem {
+public:
+  inline Pixmap pixmap(void) const { return _pixmap; }
+  inline Pixmap mask(void) const { return _mask; }
+  // the width, the height and the pixels, as _NET_WM_ICON holds them
+  inline const std::vector<unsigned long> &data(void) const { return _data; }
+
+private:
+  BIconCacheItem(void): _pixmap(None), _mask(None), count(0) {}
+
+  Pixmap _pixmap, _mask;
+  std::vector<unsigned long> _data;
+  unsigned int count;
+
+  BIconCacheItem(const BIconCacheItem &_nocopy);
+  BIconCacheItem &operator=(const BIconCacheItem &_nocopy);
+
+  friend class BIconCache;
+};
+
+/*
+ * icons scaled to a given size, drawn into pixmaps for WM_HINTS and kept
+ * as property data for _NET_WM_ICON.  They are found by a hash of the
+ * original image, so every window of an application shares the one copy
+ * instead of converting the same image again.  An icon is freed when the
+ * last window using it lets go.
+ */
+class BIconCache {
+public:
+  BIconCache(const BaseDisplay * const _display);
+  ~BIconCache(void);
+
+  // returns 0 if the icon cannot be drawn on the screen
+  BIconCacheItem *find(const ScreenInfo *screen, const BIcon &icon,
+                       unsigned int size);
+  void release(BIconCacheItem *_item);
+
+  inline unsigned long hits(void) const { return _hits; }
+  inline unsigned long misses(void) const { return _misses; }
+  inline unsigned long count(void) const { return cache.size(); }
+
+private:
+  struct Key {
+    unsigned int screen, size, width, height, hash[2];
+
+    bool operator<(const Key &k) const;
+  };
+  typedef std::map<Key, BIconCacheItem*> ItemMap;
+
+  const BaseDisplay *display;
+  ItemMap cache;
+  unsigned long _hits, _misses;
+
+  BIconCache(const BIconCache &_nocopy);
+  BIconCache &operator=(const BIconCache &_nocopy);
+};
+
+#endif // __Icon_hh
@@ -0,0 +1,367 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Image.cc for XWinWM - pixel operations on 32 bit ARGB images
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif // __SSE2__
+
+// the AVX2 versions are built with a target attribute and only used if the
+// processor turns out to have it
+#if defined(__GNUC__) && __GNUC__ >= 5 && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define   PIXEL_AVX2
+#  include <immintrin.h>
+#endif // PIXEL_AVX2
+
+#include <algorithm>
+#include <vector>
+
+#include "Image.hh"
+
+
+// x / 255, rounded, for x up to 255 * 255
+static inline unsigned int div255(unsigned int x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+
+static void premultiplyPlain(unsigned int *pixels, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    const unsigned int p = pixels[i], a = p >> 24;
+    if (a == 0xff) continue;
+
+    pixels[i] = (a << 24) |
+                (div255(((p >> 16) & 0xff) * a) << 16) |
+                (div255(((p >> 8) & 0xff) * a) << 8) |
+                div255((p & 0xff) * a);
+  }
+}
+
+
+// adds weight times each channel of a row of pixels to sum, which has four
+// entries per pixel in the order blue, green, red, alpha
+static void accumulatePlain(unsigned int *sum, const unsigned int *row,
+                            unsigned int width, unsigned int weight) {
+  for (unsigned int x = 0; x < width; ++x, sum += 4) {
+    const unsigned int p = row[x];
+    sum[0] += (p & 0xff) * weight;
+    sum[1] += ((p >> 8) & 0xff) * weight;
+    sum[2] += ((p >> 16) & 0xff) * weight;
+    sum[3] += (p >> 24) * weight;
+  }
+}
+
+
+#if defined(__SSE2__)
+/*
+ * the channels are widened to 16 bits, multiplied by the alpha of their
+ * pixel, or by 255 for the alpha itself, and divided by 255 as above
+ */
+static inline __m128i premultiplyHalf(__m128i v) {
+  const __m128i alpha_one = _mm_set_epi16(0xff, 0, 0, 0, 0xff, 0, 0, 0);
+  __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xff), 0xff);
+  a = _mm_or_si128(a, alpha_one);
+
+  v = _mm_add_epi16(_mm_mullo_epi16(v, a), _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+}
+
+
+static void premultiplySSE2(unsigned int *pixels, size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    __m128i *p = (__m128i *) (pixels + i);
+    const __m128i v = _mm_loadu_si128(p);
+    const __m128i lo = premultiplyHalf(_mm_unpacklo_epi8(v, zero));
+    const __m128i hi = premultiplyHalf(_mm_unpackhi_epi8(v, zero));
+    _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+  }
+
+  premultiplyPlain(pixels + i, count - i);
+}
+
+
+// the channels are widened to 32 bits, and multiplied by the weight with
+// pmaddwd, since the high half of each lane is zero
+static void accumulateSSE2(unsigned int *sum, const unsigned int *row,
+                           unsigned int width, unsigned int weight) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i w = _mm_set1_epi32(weight);
+  unsigned int x = 0;
+
+  for (; x + 4 <= width; x += 4, sum += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *) (row + x));
+    const __m128i lo = _mm_unpacklo_epi8(v, zero);
+    const __m128i hi = _mm_unpackhi_epi8(v, zero);
+    const __m128i c[4] = { _mm_unpacklo_epi16(lo, zero),
+                           _mm_unpackhi_epi16(lo, zero),
+                           _mm_unpacklo_epi16(hi, zero),
+                           _mm_unpackhi_epi16(hi, zero) };
+    __m128i *s = (__m128i *) sum;
+
+    for (unsigned int k = 0; k < 4; ++k)
+      _mm_storeu_si128(s + k, _mm_add_epi32(_mm_loadu_si128(s + k),
+                                            _mm_madd_epi16(c[k], w)));
+  }
+
+  accumulatePlain(sum, row + x, width - x, weight);
+}
+#endif // __SSE2__
+
+
+#if defined(PIXEL_AVX2)
+__attribute__((target("avx2")))
+static inline __m256i premultiplyHalfAVX2(__m256i v) {
+  const __m256i alpha_one =
+    _mm256_set_epi16(0xff, 0, 0, 0, 0xff, 0, 0, 0,
+                     0xff, 0, 0, 0, 0xff, 0, 0, 0);
+  __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0xff), 0xff);
+  a = _mm256_or_si256(a, alpha_one);
+
+  v = _mm256_add_epi16(_mm256_mullo_epi16(v, a), _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+}
+
+
+// unpack and pack both work within each 128 bit lane, so the pixels come
+// out in the order they went in
+__attribute__((target("avx2")))
+static void premultiplyAVX2(unsigned int *pixels, size_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m256i *p = (__m256i *) (pixels + i);
+    const __m256i v = _mm256_loadu_si256(p);
+    const __m256i lo = premultiplyHalfAVX2(_mm256_unpacklo_epi8(v, zero));
+    const __m256i hi = premultiplyHalfAVX2(_mm256_unpackhi_epi8(v, zero));
+    _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+  }
+
+  // the plain code is built without VEX encoding, and pays for every
+  // instruction while the upper halves of the registers are dirty
+  _mm256_zeroupper();
+  premultiplyPlain(pixels + i, count - i);
+}
+
+
+__attribute__((target("avx2")))
+static void accumulateAVX2(unsigned int *sum, const unsigned int *row,
+                           unsigned int width, unsigned int weight) {
+  const __m256i w = _mm256_set1_epi32(weight);
+  unsigned int x = 0;
+
+  for (; x + 8 <= width; x += 8, sum += 32) {
+    __m256i *s = (__m256i *) sum;
+    for (unsigned int k = 0; k < 4; ++k) {
+      const __m128i *p = (const __m128i *) (row + x + k * 2);
+      const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(p));
+      _mm256_storeu_si256(s + k, _mm256_add_epi32(_mm256_loadu_si256(s + k),
+                                                  _mm256_madd_epi16(v, w)));
+    }
+  }
+
+  _mm256_zeroupper();
+  accumulatePlain(sum, row + x, width - x, weight);
+}
+#endif // PIXEL_AVX2
+
+
+struct PixelKernels {
+  const char *name;
+  void (*premultiply)(unsigned int *, size_t);
+  void (*accumulate)(unsigned int *, const unsigned int *,
+                     unsigned int, unsigned int);
+};
+
+
+static const PixelKernels &kernels(void) {
+  static const PixelKernels plain =
+    { "C++", premultiplyPlain, accumulatePlain };
+#if defined(__SSE2__)
+  static const PixelKernels sse2 =
+    { "SSE2", premultiplySSE2, accumulateSSE2 };
+#endif // __SSE2__
+#if defined(PIXEL_AVX2)
+  static const PixelKernels avx2 =
+    { "AVX2", premultiplyAVX2, accumulateAVX2 };
+#endif // PIXEL_AVX2
+  static const PixelKernels *chosen = 0;
+
+  if (! chosen) {
+    chosen = &plain;
+#if defined(__SSE2__)
+    chosen = &sse2;
+#endif // __SSE2__
+#if defined(PIXEL_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+      chosen = &avx2;
+#endif // PIXEL_AVX2
+  }
+
+  return *chosen;
+}
+
+
+void premultiplyPixels(unsigned int *pixels, size_t count) {
+  kernels().premultiply(pixels, count);
+}
+
+
+// sum / total, rounded.  A divide for every channel costs more than the
+// rest of the scaling, so this multiplies by the reciprocal instead.  The
+// fraction of the exact quotient is a multiple of 1 / total, and the extra
+// half of that keeps it away from the rounding errors in the product.
+static inline unsigned int divide(unsigned int sum, unsigned int total,
+                                  double reciprocal) {
+  return (unsigned int) ((sum + total / 2 + 0.5) * reciprocal);
+}
+
+
+/*
+ * Source row i covers [i * dst_height, (i + 1) * dst_height) and
+ * destination row j covers [j * src_height, (j + 1) * src_height) on a
+ * common scale, so the weight of a source row in a destination row is the
+ * length of their overlap, and the weights of each destination row add up
+ * to src_height.  The same goes for columns.  All the source rows of one
+ * destination row are summed first, which is where nearly all the work is,
+ * and then the columns of that sum.
+ */
+void scalePixels(const unsigned int *src, unsigned int src_width,
+                 unsigned int src_height, unsigned int *dst,
+                 unsigned int dst_width, unsigned int dst_height) {
+  const PixelKernels &k = kernels();
+  const unsigned int total = src_width * src_height;
+  const double reciprocal = 1.0 / total;
+
+  // the columns are the same for every row, so their weights are worked
+  // out once.  columns[n] to columns[n + 1] are those of destination
+  // column n.
+  std::vector<unsigned int> columns(dst_width + 1), xs, weights;
+  for (unsigned int n = 0; n < dst_width; ++n) {
+    const unsigned int left = n * src_width, right = left + src_width;
+    columns[n] = xs.size();
+    for (unsigned int x = left / dst_width; x * dst_width < right; ++x) {
+      xs.push_back(x * 4);
+      weights.push_back(std::min(right, (x + 1) * dst_width) -
+                        std::max(left, x * dst_width));
+    }
+  }
+  columns[dst_width] = xs.size();
+
+  std::vector<unsigned int> sum(src_width * 4);
+  for (unsigned int j = 0; j < dst_height; ++j) {
+    std::fill(sum.begin(), sum.end(), 0u);
+
+    const unsigned int top = j * src_height, bottom = top + src_height;
+    for (unsigned int i = top / dst_height; i * dst_height < bottom; ++i) {
+      const unsigned int from = std::max(top, i * dst_height),
+                           to = std::min(bottom, (i + 1) * dst_height);
+      k.accumulate(&sum[0], src + i * src_width, src_width, to - from);
+    }
+
+    for (unsigned int n = 0; n < dst_width; ++n, ++dst) {
+#if defined(__SSE2__)
+      // all the sums fit exactly in a double, so this gives the same
+      // result as the integer code below, four channels at a time
+      __m128d bg = _mm_setzero_pd(), ra = _mm_setzero_pd();
+      for (unsigned int m = columns[n]; m < columns[n + 1]; ++m) {
+        const __m128i c = _mm_loadu_si128((const __m128i *) &sum[xs[m]]);
+        const __m128d w = _mm_set1_pd(weights[m]);
+        bg = _mm_add_pd(bg, _mm_mul_pd(_mm_cvtepi32_pd(c), w));
+        const __m128i c_hi = _mm_unpackhi_epi64(c, c);
+        ra = _mm_add_pd(ra, _mm_mul_pd(_mm_cvtepi32_pd(c_hi), w));
+      }
+
+      const __m128d half = _mm_set1_pd(total / 2 + 0.5),
+                     rcp = _mm_set1_pd(reciprocal);
+      __m128i q =
+        _mm_unpacklo_epi64(_mm_cvttpd_epi32(_mm_mul_pd(_mm_add_pd(bg, half),
+                                                       rcp)),
+                           _mm_cvttpd_epi32(_mm_mul_pd(_mm_add_pd(ra, half),
+                                                       rcp)));
+      q = _mm_packs_epi32(q, q);
+      *dst = _mm_cvtsi128_si32(_mm_packus_epi16(q, q));
+#else // !__SSE2__
+      unsigned int b = 0, g = 0, r = 0, a = 0;
+
+      for (unsigned int m = columns[n]; m < columns[n + 1]; ++m) {
+        const unsigned int *c = &sum[xs[m]], w = weights[m];
+        b += c[0] * w;
+        g += c[1] * w;
+        r += c[2] * w;
+        a += c[3] * w;
+      }
+
+      *dst = (divide(a, total, reciprocal) << 24) |
+             (divide(r, total, reciprocal) << 16) |
+             (divide(g, total, reciprocal) << 8) |
+             divide(b, total, reciprocal);
+#endif // __SSE2__
+    }
+  }
+}
+
+
+/*
+ * Eight interleaved lanes per half, so that the multiplies do not wait on
+ * each other, which are mixed and folded together at the end.
+ */
+void hashPixels(const unsigned int *pixels, size_t count,
+                unsigned int hash[2]) {
+  unsigned int a[8], b[8];
+  for (unsigned int k = 0; k < 8; ++k) {
+    a[k] = 2166136261u + k;
+    b[k] = 0x9e3779b9u ^ (unsigned int) count ^ k;
+  }
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    for (unsigned int k = 0; k < 8; ++k) {
+      a[k] = (a[k] ^ pixels[i + k]) * 16777619u;
+      b[k] = (b[k] + pixels[i + k]) * 0x85ebca6bu;
+    }
+  }
+  for (unsigned int k = 0; i < count; ++i, ++k) {
+    a[k] = (a[k] ^ pixels[i]) * 16777619u;
+    b[k] = (b[k] + pixels[i]) * 0x85ebca6bu;
+  }
+
+  hash[0] = 2166136261u;
+  hash[1] = 0x85ebca6bu;
+  for (unsigned int k = 0; k < 8; ++k) {
+    hash[0] = (hash[0] ^ a[k] ^ (a[k] >> 16)) * 16777619u;
+    hash[1] = (hash[1] ^ b[k] ^ (b[k] >> 15)) * 0xc2b2ae35u;
+  }
+  hash[1] ^= hash[1] >> 13;
+}
+
+
+const char *pixelKernels(void) {
+  return kernels().name;
+}
@@ -0,0 +1,56 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Image.hh for XWinWM - pixel operations on 32 bit ARGB images
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Image_hh
+#define   __Image_hh
+
+extern "C" {
+#include <stddef.h>
+}
+
+/*
+ * Pixels are 0xAARRGGBB in an unsigned int.  The SSE2 and AVX2 versions
+ * of these are picked at run time where the processor has them, and give
+ * exactly the same results as the plain C++ ones.
+ */
+
+// converts straight alpha to premultiplied alpha in place
+void premultiplyPixels(unsigned int *pixels, size_t count);
+
+/*
+ * resizes by area averaging: each destination pixel is the mean of the
+ * part of the source it covers.  This works for shrinking and growing, but
+ * should be given premultiplied pixels, so that transparent pixels do not
+ * bleed their color into the result.  Neither image may be larger than
+ * 1024 pixels on a side.
+ */
+void scalePixels(const unsigned int *src, unsigned int src_width,
+                 unsigned int src_height, unsigned int *dst,
+                 unsigned int dst_width, unsigned int dst_height);
+
+// a 64 bit hash of the pixels, as two 32 bit halves
+void hashPixels(const unsigned int *pixels, size_t count,
+                unsigned int hash[2]);
+
+// the name of the instruction set the kernels use on this processor
+const char *pixelKernels(void);
+
+#endif // __Image_hh
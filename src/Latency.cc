@@ -0,0 +1,222 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Latency.cc for XWinWM - dispatch latency histograms in shared memory
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#ifdef    HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif // HAVE_FCNTL_H
+
+#ifdef    HAVE_STRING_H
+#  include <string.h>
+#endif // HAVE_STRING_H
+
+#ifdef    HAVE_UNISTD_H
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif // HAVE_UNISTD_H
+
+#ifdef    HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif // HAVE_SYS_MMAN_H
+
+#ifdef    HAVE_TIME_H
+#  include <time.h>
+#endif // HAVE_TIME_H
+}
+
+#include "Latency.hh"
+#include "Util.hh"
+
+static const char LatencyMagic[8] = {
+  'X', 'W', 'W', 'M', 'L', 'A', 'T', 'N'
+};
+static const unsigned int LatencyVersion = 1;
+
+
+unsigned int BLatencyHistogram::bucket(unsigned long long ns) {
+  if (ns < SubBuckets)
+    return (unsigned int) ns;
+
+  unsigned int magnitude = SubBits;
+  while (magnitude < Magnitudes - 1 && (ns >> (magnitude + 1)) != 0)
+    ++magnitude;
+  if ((ns >> (magnitude + 1)) != 0)
+    return BucketCount - 1;
+
+  // the top bit and the SubBits below it
+  const unsigned int sub = (unsigned int) (ns >> (magnitude - SubBits));
+  return (magnitude - SubBits + 1) * SubBuckets + sub - SubBuckets;
+}
+
+
+unsigned long long BLatencyHistogram::highest(unsigned int bucket) {
+  if (bucket < SubBuckets)
+    return bucket;
+
+  const unsigned int shift = bucket / SubBuckets - 1;
+  const unsigned long long low =
+    (unsigned long long) (SubBuckets + bucket % SubBuckets) << shift;
+  return low + (1ull << shift) - 1;
+}
+
+
+unsigned long long BLatencyHistogram::percentile(double part) const {
+  // the buckets, not count, as a copy can be taken halfway through an add
+  unsigned long long n = 0;
+  for (unsigned int i = 0; i < BucketCount; ++i)
+    n += buckets[i];
+  if (n == 0)
+    return 0;
+
+  unsigned long long rank = (unsigned long long) (part * n + 0.5);
+  if (rank < 1) rank = 1;
+  if (rank > n) rank = n;
+
+  unsigned long long seen = 0;
+  for (unsigned int i = 0; i < BucketCount; ++i) {
+    seen += buckets[i];
+    if (seen >= rank)
+      return (max && highest(i) > max) ? max : highest(i);
+  }
+  return max;
+}
+
+
+BLatency *BLatency::latency = (BLatency *) 0;
+
+
+std::string BLatency::segmentName(const char *display) {
+  // ":0" and ":0.1" are the same server, and so the same xwinwm
+  std::string d = (display) ? display : "";
+  const std::string::size_type colon = d.rfind(':');
+  const std::string::size_type dot = d.rfind('.');
+  if (colon != std::string::npos && dot != std::string::npos && dot > colon)
+    d.erase(dot);
+
+  // the name is one path component
+  std::string name = "/xwinwm-latency-";
+  for (std::string::size_type i = 0; i < d.size(); ++i)
+    name += (d[i] == '/') ? '_' : d[i];
+  return name;
+}
+
+
+bool BLatency::isCompatible(const BLatencySegment &segment) {
+  return (memcmp(segment.magic, LatencyMagic, sizeof(LatencyMagic)) == 0 &&
+          segment.version == LatencyVersion &&
+          segment.histogram_size == sizeof(BLatencyHistogram) &&
+          segment.types == BLatencySegment::Types);
+}
+
+
+bool BLatency::start(const char *display) {
+  if (latency)
+    return True;
+
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_SYS_MMAN_H)
+  BLatency *l = new BLatency;
+  l->name = segmentName(display);
+
+  // whatever an earlier xwinwm left behind is of no use
+  shm_unlink(l->name.c_str());
+  const int fd = shm_open(l->name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1) {
+    delete l;
+    return False;
+  }
+
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, sizeof(BLatencySegment)) == 0)
+    p = mmap(0, sizeof(BLatencySegment), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(l->name.c_str());
+    delete l;
+    return False;
+  }
+
+  // the file starts out zeroed, the magic goes in last
+  l->segment = (BLatencySegment *) p;
+  l->segment->version = LatencyVersion;
+  l->segment->histogram_size = sizeof(BLatencyHistogram);
+  l->segment->types = BLatencySegment::Types;
+  l->segment->pid = getpid();
+  l->segment->started = time(0);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(l->segment->magic, LatencyMagic, sizeof(LatencyMagic));
+
+  latency = l;
+  return True;
+#else // !HAVE_SHM_OPEN || !HAVE_SYS_MMAN_H
+  (void) display;
+  return False;
+#endif // HAVE_SHM_OPEN && HAVE_SYS_MMAN_H
+}
+
+
+void BLatency::stop(void) {
+  delete latency;
+  latency = (BLatency *) 0;
+}
+
+
+BLatency::BLatency(void): segment((BLatencySegment *) 0) {}
+
+
+BLatency::~BLatency(void) {
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_SYS_MMAN_H)
+  if (segment) {
+    munmap(segment, sizeof(BLatencySegment));
+    shm_unlink(name.c_str());
+  }
+#endif // HAVE_SHM_OPEN && HAVE_SYS_MMAN_H
+}
+
+
+unsigned long long BLatency::now(void) {
+  return monotonicTime();
+}
+
+
+void BLatency::add(BLatencyHistogram &h, unsigned int bucket,
+                   unsigned long long ns) {
+  // only the event loop writes, the stores are atomic for the readers
+  __atomic_store_n(&h.buckets[bucket], h.buckets[bucket] + 1,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&h.total, h.total + ns, __ATOMIC_RELAXED);
+  if (ns > h.max)
+    __atomic_store_n(&h.max, ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&h.count, h.count + 1, __ATOMIC_RELAXED);
+}
+
+
+void BLatency::record(int type, unsigned long long start) {
+  const unsigned long long ns = now() - start;
+  const unsigned int bucket = BLatencyHistogram::bucket(ns);
+
+  add(segment->all, bucket, ns);
+  add(segment->type[type & (BLatencySegment::Types - 1)], bucket, ns);
+}
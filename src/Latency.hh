@@ -0,0 +1,109 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Latency.hh for XWinWM - dispatch latency histograms in shared memory
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Latency_hh
+#define   __Latency_hh
+
+#include <string>
+
+/*
+ * With session.latencyHistograms set, the time each call to
+ * Blackbox::process_event() takes is put in a histogram for its event
+ * type, extension events included, and in one for every event.  The
+ * histograms live in shared memory, named after the display, so the
+ * xwinwm-latency program can read them from a running session without
+ * the window manager doing anything for it.
+ *
+ * The buckets are those of an HDR histogram with four significant bits:
+ * below 16 ns every nanosecond has a bucket, above that every power of two
+ * is split in 16, so a bucket is never wider than 1/16 of what it holds.
+ * Anything from 2^40 ns, some 18 minutes, on goes in the last bucket.
+ */
+
+struct BLatencyHistogram {
+  enum { SubBuckets = 16, SubBits = 4, Magnitudes = 40,
+         BucketCount = (Magnitudes - SubBits + 1) * SubBuckets };
+
+  unsigned long long count, total, max;  // the times in ns
+  unsigned int buckets[BucketCount];
+
+  static unsigned int bucket(unsigned long long ns);
+  // the largest time that goes in a bucket
+  static unsigned long long highest(unsigned int bucket);
+  // the time below which the given part of the events were, 0.99 say
+  unsigned long long percentile(double part) const;
+};
+
+// the shared memory, written by one thread and only read by the others
+struct BLatencySegment {
+  enum { Types = 128 };             // the event type is seven bits
+
+  char magic[8];
+  unsigned int version, histogram_size, types;
+  int pid;
+  unsigned long long started;       // time(0) when xwinwm came up
+
+  BLatencyHistogram all;
+  BLatencyHistogram type[Types];
+};
+
+class BLatency {
+public:
+  // times one dispatch, if the histograms are kept
+  class Timing {
+  public:
+    inline Timing(int type)
+      : event(type), start((latency) ? now() : 0) {}
+    inline ~Timing(void) { if (latency) latency->record(event, start); }
+
+  private:
+    int event;
+    unsigned long long start;
+  };
+
+  // sets up the segment, returns False if it cannot be
+  static bool start(const char *display);
+  static void stop(void);
+  static inline BLatency *active(void) { return latency; }
+
+  // the name of the segment the histograms of a display are in
+  static std::string segmentName(const char *display);
+  // whether a segment was set up by an xwinwm built like this one
+  static bool isCompatible(const BLatencySegment &segment);
+
+private:
+  static BLatency *latency;
+
+  BLatencySegment *segment;
+  std::string name;
+
+  BLatency(void);
+  ~BLatency(void);
+  BLatency(const BLatency &_nocopy);
+  BLatency &operator=(const BLatency &_nocopy);
+
+  static unsigned long long now(void);
+  void record(int type, unsigned long long start);
+  static void add(BLatencyHistogram &histogram, unsigned int bucket,
+                  unsigned long long ns);
+};
+
+#endif // __Latency_hh
@@ -0,0 +1,189 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Placement.cc for XWinWM - finding room for a new window
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+
+#include "Placement.hh"
+
+
+/*
+ * Calculate free space available for window placement.
+ */
+RectList calcSpace(const Rect &win, const RectList &spaces) {
+  Rect isect, extra;
+  RectList result;
+  RectList::const_iterator siter, end = spaces.end();
+  for (siter = spaces.begin(); siter != end; ++siter) {
+    const Rect &curr = *siter;
+
+    if(! win.intersects(curr)) {
+      result.push_back(curr);
+      continue;
+    }
+
+    /* Use an intersection of win and curr to determine the space around
+     * curr that we can use.
+     *
+     * NOTE: the spaces calculated can overlap.
+     */
+    isect = curr & win;
+
+    // left
+    extra.setCoords(curr.left(), curr.top(),
+                    isect.left() - 1, curr.bottom());
+    if (extra.valid()) result.push_back(extra);
+
+    // top
+    extra.setCoords(curr.left(), curr.top(),
+                    curr.right(), isect.top() - 1);
+    if (extra.valid()) result.push_back(extra);
+
+    // right
+    extra.setCoords(isect.right() + 1, curr.top(),
+                    curr.right(), curr.bottom());
+    if (extra.valid()) result.push_back(extra);
+
+    // bottom
+    extra.setCoords(curr.left(), isect.bottom() + 1,
+                    curr.right(), curr.bottom());
+    if (extra.valid()) result.push_back(extra);
+  }
+  return result;
+}
+
+
+static bool rowRLBT(const Rect &first, const Rect &second) {
+  if (first.bottom() == second.bottom())
+    return first.right() > second.right();
+  return first.bottom() > second.bottom();
+}
+
+static bool rowRLTB(const Rect &first, const Rect &second) {
+  if (first.y() == second.y())
+    return first.right() > second.right();
+  return first.y() < second.y();
+}
+
+static bool rowLRBT(const Rect &first, const Rect &second) {
+  if (first.bottom() == second.bottom())
+    return first.x() < second.x();
+  return first.bottom() > second.bottom();
+}
+
+static bool rowLRTB(const Rect &first, const Rect &second) {
+  if (first.y() == second.y())
+    return first.x() < second.x();
+  return first.y() < second.y();
+}
+
+static bool colLRTB(const Rect &first, const Rect &second) {
+  if (first.x() == second.x())
+    return first.y() < second.y();
+  return first.x() < second.x();
+}
+
+static bool colLRBT(const Rect &first, const Rect &second) {
+  if (first.x() == second.x())
+    return first.bottom() > second.bottom();
+  return first.x() < second.x();
+}
+
+static bool colRLTB(const Rect &first, const Rect &second) {
+  if (first.right() == second.right())
+    return first.y() < second.y();
+  return first.right() > second.right();
+}
+
+static bool colRLBT(const Rect &first, const Rect &second) {
+  if (first.right() == second.right())
+    return first.bottom() > second.bottom();
+  return first.right() > second.right();
+}
+
+
+bool smartPlace(Rect &win, const Rect &area, const RectList &frames,
+                bool by_row, bool right_left, bool bottom_top) {
+  RectList spaces;
+  spaces.push_back(area); //initially the entire screen is free
+
+  //Find Free Spaces
+  RectList::const_iterator fit = frames.begin(), end = frames.end();
+  for (; fit != end; ++fit)
+    spaces = calcSpace(*fit, spaces);
+
+  if (by_row) {
+    if (! right_left) {
+      if (! bottom_top)
+        std::sort(spaces.begin(), spaces.end(), rowLRTB);
+      else
+        std::sort(spaces.begin(), spaces.end(), rowLRBT);
+    } else {
+      if (! bottom_top)
+        std::sort(spaces.begin(), spaces.end(), rowRLTB);
+      else
+        std::sort(spaces.begin(), spaces.end(), rowRLBT);
+    }
+  } else {
+    if (! bottom_top) {
+      if (! right_left)
+        std::sort(spaces.begin(), spaces.end(), colLRTB);
+      else
+        std::sort(spaces.begin(), spaces.end(), colRLTB);
+    } else {
+      if (! right_left)
+        std::sort(spaces.begin(), spaces.end(), colLRBT);
+      else
+        std::sort(spaces.begin(), spaces.end(), colRLBT);
+    }
+  }
+
+  RectList::const_iterator sit = spaces.begin(), spaces_end = spaces.end();
+  for(; sit != spaces_end; ++sit) {
+    if (sit->width() >= win.width() && sit->height() >= win.height())
+      break;
+  }
+
+  if (sit == spaces_end)
+    return False;
+
+  //set new position based on the empty space found
+  const Rect& where = *sit;
+  win.setX(where.x());
+  win.setY(where.y());
+
+  // adjust the location() based on left/right and top/bottom placement
+  if (by_row) {
+    if (right_left)
+      win.setX(where.right() - win.width());
+    if (bottom_top)
+      win.setY(where.bottom() - win.height());
+  } else {
+    if (bottom_top)
+      win.setY(win.y() + where.height() - win.height());
+    if (right_left)
+      win.setX(win.x() + where.width() - win.width());
+  }
+  return True;
+}
@@ -0,0 +1,44 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Placement.hh for XWinWM - finding room for a new window
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Placement_hh
+#define   __Placement_hh
+
+#include <vector>
+
+#include "Util.hh"
+
+typedef std::vector<Rect> RectList;
+
+// what is left of spaces once win is taken out of them; the spaces that
+// are returned can overlap
+RectList calcSpace(const Rect &win, const RectList &spaces);
+
+/*
+ * Looks for the first space in area that none of the frames cover and win
+ * fits in, going by rows or by columns in the given directions, and moves
+ * win there.  Returns False if there is no such space.  This is all of
+ * the smart placement policies, without the screen they are set on.
+ */
+bool smartPlace(Rect &win, const Rect &area, const RectList &frames,
+                bool by_row, bool right_left, bool bottom_top);
+
+#endif // __Placement_hh
@@ -0,0 +1,580 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// PropertyFetcher.cc for XWinWM - reads window properties off the main loop
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+
+#ifdef    HAVE_X11_XLIBINT_H
+#  include <X11/Xlibint.h>
+// which would break <algorithm>
+#  undef    min
+#  undef    max
+#  define   ASYNC_REPLIES
+#endif // HAVE_X11_XLIBINT_H
+
+#ifdef    HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif // HAVE_FCNTL_H
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#  include <pthread.h>
+#  define   WORKER_THREADS
+#endif
+}
+
+#include "PropertyFetcher.hh"
+#include "RoundTrips.hh"
+#include "TracedCalls.hh"
+
+
+#ifdef    WORKER_THREADS
+#  define LOCK()   pthread_mutex_lock((pthread_mutex_t *) lock)
+#  define UNLOCK() pthread_mutex_unlock((pthread_mutex_t *) lock)
+#else // !WORKER_THREADS
+#  define LOCK()
+#  define UNLOCK()
+#endif // WORKER_THREADS
+
+
+#ifdef    ASYNC_REPLIES
+struct BPropertyFetcher::Pending {
+  _XAsyncHandler async;
+  BPropertyFetcher *fetcher;
+  unsigned long sequence;
+  Result result;
+
+  static Bool replied(Display *dpy, xReply *rep, char *buf, int len,
+                      XPointer data);
+};
+#endif // ASYNC_REPLIES
+
+
+BPropertyFetcher::BPropertyFetcher(BaseDisplay *d)
+  : display(d), next_id(0), _requests(0), _fetched(0), _cancelled(0),
+    message_posted(False), lock((void *) 0), wakeup((void *) 0),
+    stopping(False) {
+  // the workers say they are done with an event sent to this window
+  XSetWindowAttributes attrib;
+  attrib.override_redirect = True;
+  window = tracedCreateWindow(display->getMainXDisplay(),
+                              display->getScreenInfo(0)->getRootWindow(),
+                              -1, -1, 1, 1, 0, 0, InputOnly, CopyFromParent,
+                              CWOverrideRedirect, &attrib);
+
+#ifdef    WORKER_THREADS
+  pthread_mutex_t *mutex = new pthread_mutex_t;
+  pthread_mutex_init(mutex, 0);
+  lock = mutex;
+
+  pthread_cond_t *cond = new pthread_cond_t;
+  pthread_cond_init(cond, 0);
+  wakeup = cond;
+#endif // WORKER_THREADS
+}
+
+
+BPropertyFetcher::~BPropertyFetcher(void) {
+  stop();
+  display->cancelMessages(this);
+
+#ifdef    ASYNC_REPLIES
+  Display *dpy = display->getMainXDisplay();
+  LockDisplay(dpy);
+  PendingList::iterator it = pending.begin();
+  for (; it != pending.end(); ++it) {
+    DeqAsyncHandler(dpy, &(*it)->async);
+    delete *it;
+  }
+  pending.clear();
+  UnlockDisplay(dpy);
+#endif // ASYNC_REPLIES
+
+  XDestroyWindow(display->getMainXDisplay(), window);
+
+#ifdef    WORKER_THREADS
+  pthread_mutex_destroy((pthread_mutex_t *) lock);
+  delete (pthread_mutex_t *) lock;
+  pthread_cond_destroy((pthread_cond_t *) wakeup);
+  delete (pthread_cond_t *) wakeup;
+#endif // WORKER_THREADS
+}
+
+
+bool BPropertyFetcher::start(unsigned int count) {
+#ifdef    WORKER_THREADS
+  if (! BaseDisplay::threadsInitialized() || ! worker_list.empty())
+    return False;
+
+  // the window has to exist before a worker can send to it
+  BROUNDTRIP(Sync, XSync(display->getMainXDisplay(), False));
+
+  for (unsigned int i = 0; i < count; ++i) {
+    Display *d = XOpenDisplay(display->getXDisplayName());
+    if (! d)
+      break;
+    fcntl(ConnectionNumber(d), F_SETFD, 1);
+
+    Worker *worker = new Worker;
+    worker->fetcher = this;
+    worker->display = d;
+
+    pthread_t *t = new pthread_t;
+    if (pthread_create(t, 0, threadMain, worker) != 0) {
+      delete t;
+      delete worker;
+      XCloseDisplay(d);
+      break;
+    }
+
+    worker->thread = t;
+    worker_list.push_back(worker);
+  }
+
+  if (worker_list.empty())
+    return False;
+
+  // anything asked for before now was left for handleMessage()
+  if (! requests_queue.empty()) {
+    display->cancelMessages(this);
+    message_posted = False;
+    pthread_cond_broadcast((pthread_cond_t *) wakeup);
+  }
+
+  return True;
+#else // !WORKER_THREADS
+  (void) count;
+  return False;
+#endif // WORKER_THREADS
+}
+
+
+void BPropertyFetcher::stop(void) {
+#ifdef    WORKER_THREADS
+  if (worker_list.empty())
+    return;
+
+  LOCK();
+  stopping = True;
+  pthread_cond_broadcast((pthread_cond_t *) wakeup);
+  UNLOCK();
+
+  WorkerList::iterator it = worker_list.begin();
+  for (; it != worker_list.end(); ++it) {
+    Worker *worker = *it;
+    pthread_join(*((pthread_t *) worker->thread), 0);
+    delete (pthread_t *) worker->thread;
+    XCloseDisplay(worker->display);
+    delete worker;
+  }
+  worker_list.clear();
+#endif // WORKER_THREADS
+}
+
+
+void BPropertyFetcher::fetch(BPropertyHandler *handler, Window w,
+                             Atom property, Atom type, long length,
+                             long offset) {
+  Request request;
+  request.kind = GetProperty;
+  request.window = w;
+  request.property = property;
+  request.type = type;
+  request.offset = offset;
+  request.length = length;
+  queue(handler, request);
+}
+
+
+void BPropertyFetcher::fetchInputFocus(BPropertyHandler *handler) {
+  Request request;
+  request.kind = GetInputFocus;
+  request.window = None;
+  request.property = request.type = None;
+  request.offset = request.length = 0;
+  queue(handler, request);
+}
+
+
+void BPropertyFetcher::queue(BPropertyHandler *handler,
+                             const Request &_request) {
+  Request request = _request;
+  request.id = ++next_id;
+
+  Handler h;
+  h.handler = handler;
+  h.screen = display->currentScreen();
+  handlers.insert(HandlerMap::value_type(request.id, h));
+  ++_requests;
+
+  if (! worker_list.empty() || ! send(request)) {
+    LOCK();
+    requests_queue.push_back(request);
+#ifdef    WORKER_THREADS
+    if (! worker_list.empty())
+      pthread_cond_signal((pthread_cond_t *) wakeup);
+#endif // WORKER_THREADS
+    UNLOCK();
+  }
+
+  if (worker_list.empty() && ! message_posted) {
+    display->postMainMessage(this, 0);
+    message_posted = True;
+  }
+}
+
+
+void BPropertyFetcher::cancel(BPropertyHandler *handler) {
+  HandlerMap::iterator it = handlers.begin();
+  while (it != handlers.end()) {
+    if (it->second.handler == handler) {
+      handlers.erase(it++);
+      ++_cancelled;
+    } else {
+      ++it;
+    }
+  }
+
+  // those already read or being read are dropped by complete(), as they
+  // no longer have a handler
+  LOCK();
+  RequestQueue::iterator r = requests_queue.begin();
+  while (r != requests_queue.end()) {
+    if (handlers.find(r->id) == handlers.end())
+      r = requests_queue.erase(r);
+    else
+      ++r;
+  }
+  UNLOCK();
+}
+
+
+void BPropertyFetcher::complete(void) {
+  ResultQueue done;
+
+  LOCK();
+  done.swap(results);
+  UNLOCK();
+
+  for (ResultQueue::iterator it = done.begin(); it != done.end(); ++it) {
+    // looked up one at a time, since a handler can cancel others
+    HandlerMap::iterator h = handlers.find(it->id);
+    if (h == handlers.end())
+      continue;
+
+    BPropertyHandler *handler = h->second.handler;
+    BaseDisplay::ScreenScope scope(display, h->second.screen);
+    handlers.erase(h);
+    ++_fetched;
+    if (it->kind == GetInputFocus)
+      handler->inputFocusFetched(it->property.window);
+    else
+      handler->propertyFetched(it->property);
+  }
+}
+
+
+/*
+ * asks on the event loop's connection, and leaves the reply to
+ * Pending::replied() when Xlib comes across it.  Returns False if this
+ * Xlib cannot do that.
+ */
+bool BPropertyFetcher::send(const Request &request) {
+#ifdef    ASYNC_REPLIES
+  Pending *p = new Pending;
+  p->fetcher = this;
+  p->result.id = request.id;
+  p->result.kind = request.kind;
+  p->result.property.window = request.window;
+  p->result.property.property = request.property;
+  p->result.property.offset = request.offset;
+
+  Display *dpy = display->getMainXDisplay();
+  LockDisplay(dpy);
+  if (request.kind == GetInputFocus) {
+    xReq *req;
+    GetEmptyReq(GetInputFocus, req);
+    (void) req;
+  } else {
+    xGetPropertyReq *req;
+    GetReq(GetProperty, req);
+    req->window = request.window;
+    req->property = request.property;
+    req->type = request.type;
+    req->c_delete = xFalse;
+    req->longOffset = request.offset;
+    req->longLength = request.length;
+  }
+  p->sequence = dpy->request;
+  p->async.next = dpy->async_handlers;
+  p->async.handler = Pending::replied;
+  p->async.data = (XPointer) p;
+  dpy->async_handlers = &p->async;
+
+  LOCK();
+  pending.push_back(p);
+  UNLOCK();
+  UnlockDisplay(dpy);
+  SyncHandle();
+
+  return True;
+#else // !ASYNC_REPLIES
+  (void) request;
+  return False;
+#endif // ASYNC_REPLIES
+}
+
+
+#ifdef    ASYNC_REPLIES
+/*
+ * called by Xlib, with the display locked, for every reply and error it
+ * reads while there are requests out; this is the event reader's thread
+ * if there is one.  The same as read() does, from the reply on the wire.
+ */
+Bool BPropertyFetcher::Pending::replied(Display *dpy, xReply *rep,
+                                        char *buf, int len, XPointer data) {
+  Pending *p = (Pending *) data;
+  if (dpy->last_request_read != p->sequence)
+    return False;
+
+  BProperty &property = p->result.property;
+  if (rep->generic.type == X_Error) {
+    // the window is gone, which XGetWindowProperty() would have reported
+    property.type = None;
+    property.format = 0;
+    traceProperty(property.window, property.property, property.offset,
+                  rep->error.errorCode, None, 0, 0, 0, 0);
+  } else if (p->result.kind == GetInputFocus) {
+    xGetInputFocusReply replbuf;
+    xGetInputFocusReply *repl = (xGetInputFocusReply *)
+      _XGetAsyncReply(dpy, (char *) &replbuf, rep, buf, len,
+                      (SIZEOF(xGetInputFocusReply) - SIZEOF(xReply)) >> 2,
+                      True);
+    property.window = repl->focus;
+    property.exists = True;
+    traceInputFocus(repl->focus, repl->revertTo);
+  } else {
+    xGetPropertyReply replbuf;
+    xGetPropertyReply *repl = (xGetPropertyReply *)
+      _XGetAsyncReply(dpy, (char *) &replbuf, rep, buf, len,
+                      (SIZEOF(xGetPropertyReply) - SIZEOF(xReply)) >> 2,
+                      False);
+    property.type = repl->propertyType;
+    property.format = repl->format;
+    property.after = repl->bytesAfter;
+
+    unsigned long size = 0;
+    if (property.format == 8 || property.format == 16 ||
+        property.format == 32)
+      size = repl->nItems * (property.format / 8);
+    if (size > ((unsigned long) repl->length << 2))
+      size = 0;
+
+    std::vector<char> bytes(size + 1);
+    _XGetAsyncData(dpy, (size) ? &bytes[0] : (char *) 0, buf, len,
+                   SIZEOF(xGetPropertyReply), size, repl->length << 2);
+
+    switch (property.format) {
+    case 8:
+      property.data.assign(&bytes[0], size);
+      break;
+    case 16: {
+      const CARD16 *values = (const CARD16 *) &bytes[0];
+      property.values.assign(values, values + size / 2);
+      break;
+    }
+    case 32: {
+      const CARD32 *values = (const CARD32 *) &bytes[0];
+      property.values.assign(values, values + size / 4);
+      break;
+    }
+    }
+    if (size == 0)
+      traceProperty(property.window, property.property, property.offset,
+                    Success, property.type, property.format, 0,
+                    repl->bytesAfter, 0);
+    else
+      traceProperty(property.window, property.property, property.offset,
+                    Success, property.type, property.format, repl->nItems,
+                    repl->bytesAfter, (property.format == 32) ?
+                    (const void *) &property.values[0] : &bytes[0]);
+
+    property.exists = (property.type != None && property.format != 0);
+  }
+
+  DeqAsyncHandler(dpy, &p->async);
+  p->fetcher->replied(p);
+  return True;
+}
+#endif // ASYNC_REPLIES
+
+
+void BPropertyFetcher::replied(Pending *p) {
+#ifdef    ASYNC_REPLIES
+  LOCK();
+  results.push_back(p->result);
+  pending.remove(p);
+  UNLOCK();
+
+  delete p;
+#else // !ASYNC_REPLIES
+  (void) p;
+#endif // ASYNC_REPLIES
+}
+
+
+/*
+ * without workers, the event loop reads what could not be sent without
+ * waiting, and puts the event that says the replies are in behind what
+ * was sent since the last time here.
+ */
+void BPropertyFetcher::handleMessage(unsigned int, unsigned long) {
+  message_posted = False;
+
+  while (! requests_queue.empty()) {
+    const Request request = requests_queue.front();
+    requests_queue.pop_front();
+
+    Result result;
+    result.id = request.id;
+    result.kind = request.kind;
+    read(display->getMainXDisplay(), request, result.property);
+    results.push_back(result);
+  }
+
+  LOCK();
+  const bool waiting = ! pending.empty();
+  UNLOCK();
+  if (waiting)
+    notify(display->getMainXDisplay());
+
+  complete();
+}
+
+
+void *BPropertyFetcher::threadMain(void *data) {
+  Worker *worker = (Worker *) data;
+  worker->fetcher->run(worker);
+  return (void *) 0;
+}
+
+
+void BPropertyFetcher::run(Worker *worker) {
+#ifdef    WORKER_THREADS
+  LOCK();
+
+  while (True) {
+    while (requests_queue.empty() && ! stopping)
+      pthread_cond_wait((pthread_cond_t *) wakeup, (pthread_mutex_t *) lock);
+    if (stopping)
+      break;
+
+    const Request request = requests_queue.front();
+    requests_queue.pop_front();
+    UNLOCK();
+
+    Result result;
+    result.id = request.id;
+    result.kind = request.kind;
+    read(worker->display, request, result.property);
+
+    LOCK();
+    const bool first = results.empty();
+    results.push_back(result);
+
+    if (first) {
+      notify(worker->display);
+      XFlush(worker->display);
+    }
+  }
+
+  UNLOCK();
+#else // !WORKER_THREADS
+  (void) worker;
+#endif // WORKER_THREADS
+}
+
+
+// sends the event that makes the event loop call complete()
+void BPropertyFetcher::notify(Display *d) {
+  // with no event mask, the event goes to whoever made the window,
+  // which is the event loop's connection
+  XEvent e;
+  e.xclient.type = ClientMessage;
+  e.xclient.window = window;
+  e.xclient.message_type = None;
+  e.xclient.format = 32;
+  e.xclient.data.l[0] = e.xclient.data.l[1] = e.xclient.data.l[2] =
+    e.xclient.data.l[3] = e.xclient.data.l[4] = 0;
+  XSendEvent(d, window, False, NoEventMask, &e);
+}
+
+
+void BPropertyFetcher::read(Display *d, const Request &request,
+                            BProperty &property) {
+  property.window = request.window;
+  property.property = request.property;
+  property.offset = request.offset;
+
+  if (request.kind == GetInputFocus) {
+    // the focus is the same whichever connection asks
+    int revert;
+    tracedGetInputFocus(d, &property.window, &revert);
+    property.exists = True;
+    return;
+  }
+
+  unsigned long nitems, after;
+  unsigned char *data = 0;
+
+  if (tracedGetWindowProperty(d, request.window, request.property,
+                              request.offset, request.length, False,
+                              request.type, &property.type, &property.format,
+                              &nitems, &after, &data) != Success) {
+    property.type = None;
+    property.format = 0;
+    return;
+  }
+
+  if (data) {
+    switch (property.format) {
+    case 8:
+      property.data.assign((const char *) data, nitems);
+      break;
+    case 16:
+      property.values.assign((const unsigned short *) data,
+                             (const unsigned short *) data + nitems);
+      break;
+    case 32:
+      // Xlib hands format 32 properties over as longs
+      property.values.assign((const unsigned long *) data,
+                             (const unsigned long *) data + nitems);
+      break;
+    }
+    XFree(data);
+  }
+  property.after = after;
+
+  property.exists = (property.type != None && property.format != 0);
+}
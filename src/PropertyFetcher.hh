@@ -0,0 +1,174 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// PropertyFetcher.hh for XWinWM - reads window properties off the main loop
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __PropertyFetcher_hh
+#define   __PropertyFetcher_hh
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BaseDisplay.hh"
+
+// a property as it was read; exists is False if the window did not have
+// it, or was gone
+struct BProperty {
+  Window window;
+  Atom property, type;
+  int format;
+  bool exists;
+  std::string data;                     // format 8
+  std::vector<unsigned long> values;    // format 16 and 32
+  long offset;                          // where the read began, as asked
+  unsigned long after;                  // bytes left past what was read
+
+  BProperty(void): window(None), property(None), type(None), format(0),
+                   exists(False), offset(0), after(0) {}
+};
+
+/*
+ * the continuations of the reads: whatever was to be done with the reply
+ * goes here instead of after a call that waits for it.
+ */
+class BPropertyHandler {
+public:
+  virtual void propertyFetched(const BProperty &property) = 0;
+  // focus is the window which had the input focus, or None
+  virtual void inputFocusFetched(Window /*focus*/) {}
+};
+
+/*
+ * makes round trips whose replies are large or not needed right away,
+ * such as reading WM_COMMAND, without holding up the event loop.  With
+ * workers started, each has a connection of its own and the event loop
+ * only hears of the result, through an event sent to a window of ours.
+ * Without them, the requests go out on the event loop's connection and
+ * Xlib hands the replies over as they come in, followed by the same
+ * event.  Either way the handler is called from the event loop, in a
+ * BaseDisplay::ScreenScope for the screen that asked, and never after it
+ * has been cancelled.  Everything here is on the main connection.
+ *
+ * Only reads whose answer can wait go through here.  What decides how a
+ * window is first mapped, such as WM_STATE and the hints read when it is
+ * managed, is still read with the window manager waiting for it.
+ */
+class BPropertyFetcher: public BMessageHandler {
+public:
+  BPropertyFetcher(BaseDisplay *d);
+  virtual ~BPropertyFetcher(void);
+
+  // needs BaseDisplay::initThreads(); returns False if they could not be
+  // started, and the reads are left to the event loop
+  bool start(unsigned int count);
+  inline unsigned int workers(void) const { return worker_list.size(); }
+
+  // offset and length are in 32 bit units, as for XGetWindowProperty
+  void fetch(BPropertyHandler *handler, Window window, Atom property,
+             Atom type = AnyPropertyType, long length = 65536l,
+             long offset = 0l);
+  // asks who has the input focus, like XGetInputFocus()
+  void fetchInputFocus(BPropertyHandler *handler);
+  // forgets every read for a handler that is going away
+  void cancel(BPropertyHandler *handler);
+
+  // True for the event that says reads have finished, which should then
+  // be given to complete()
+  inline bool isCompletion(const XEvent *e) const
+  { return e->type == ClientMessage && e->xclient.window == window; }
+  void complete(void);
+
+  virtual void handleMessage(unsigned int message, unsigned long data);
+
+  inline unsigned long requests(void) const { return _requests; }
+  inline unsigned long fetched(void) const { return _fetched; }
+  inline unsigned long cancelled(void) const { return _cancelled; }
+
+private:
+  enum Kind { GetProperty, GetInputFocus };
+
+  struct Request {
+    unsigned long id;
+    Kind kind;
+    Window window;
+    Atom property, type;
+    long offset, length;
+  };
+  struct Result {
+    unsigned long id;
+    Kind kind;
+    BProperty property;
+  };
+  typedef std::deque<Request> RequestQueue;
+  typedef std::deque<Result> ResultQueue;
+  // with the screen that asked, whose work the handler is doing
+  struct Handler {
+    BPropertyHandler *handler;
+    int screen;
+  };
+  typedef std::map<unsigned long, Handler> HandlerMap;
+
+  // a request on the event loop's connection, until its reply is in
+  struct Pending;
+  typedef std::list<Pending*> PendingList;
+
+  struct Worker {
+    BPropertyFetcher *fetcher;
+    Display *display;
+    void *thread;
+  };
+  typedef std::vector<Worker*> WorkerList;
+
+  BaseDisplay *display;
+  Window window;
+
+  // only the event loop touches these
+  HandlerMap handlers;
+  unsigned long next_id, _requests, _fetched, _cancelled;
+  bool message_posted;
+
+  // shared with the workers, under lock
+  void *lock, *wakeup;
+  RequestQueue requests_queue;
+  ResultQueue results;
+  bool stopping;
+  WorkerList worker_list;
+  PendingList pending;
+
+  BPropertyFetcher(const BPropertyFetcher &_nocopy);
+  BPropertyFetcher &operator=(const BPropertyFetcher &_nocopy);
+
+  void stop(void);
+  void queue(BPropertyHandler *handler, const Request &request);
+  bool send(const Request &request);
+  void replied(Pending *p);
+  void notify(Display *d);
+  static void *threadMain(void *data);
+  void run(Worker *worker);
+  static void read(Display *d, const Request &request, BProperty &property);
+};
+
+#endif // __PropertyFetcher_hh
@@ -0,0 +1,148 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// RoundTrips.cc for XWinWM - where the event loop waits on the server
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#  include <pthread.h>
+#  define   LOOP_THREAD
+#endif
+}
+
+#include "RoundTrips.hh"
+#include "Util.hh"
+
+
+static const char * const CallNames[BRoundTrips::CallCount] = {
+  "XSync", "XGetWindowProperty", "XGetWindowAttributes", "XQueryTree",
+  "XGetInputFocus", "XGetWMHints", "XGetWMNormalHints", "XGetWMName",
+  "XGetWMIconName", "XGetWMProtocols", "XGetTransientForHint",
+  "XInternAtom", "XWindowsWMFrameGetRect", "XQueryExtension", "XAllocColor",
+  "XParseColor", "XTranslateCoordinates", "XShapeQueryExtents",
+  "XGetModifierMapping", "XKeysymToKeycode", "XListInstalledColormaps",
+  "XkbQueryExtension", "XkbGetMap", "XkbGetControls"
+};
+
+static const char * const OperationNames[BRoundTrips::OperationCount] = {
+  "no operation", "manage", "unmanage", "focus", "raise", "lower",
+  "configure", "reconfigure", "switch"
+};
+
+#ifdef    LOOP_THREAD
+// static objects are made by the thread that runs main()
+static const pthread_t loop_thread = pthread_self();
+#endif // LOOP_THREAD
+
+static inline bool onLoopThread(void) {
+#ifdef    LOOP_THREAD
+  return pthread_equal(pthread_self(), loop_thread);
+#else // !LOOP_THREAD
+  return True;
+#endif // LOOP_THREAD
+}
+
+
+BRoundTrips::Tally BRoundTrips::table[OperationCount][EventSlots][CallCount];
+int BRoundTrips::event = 0;
+BRoundTrips::Operation BRoundTrips::operation = NoOperation;
+unsigned int BRoundTrips::depth = 0;
+
+
+BRoundTrips::EventScope::EventScope(int type): saved(event) {
+  event = (type > 0 && type < LASTEvent) ? type : LASTEvent;
+}
+
+
+BRoundTrips::EventScope::~EventScope(void) {
+  event = saved;
+}
+
+
+BRoundTrips::OperationScope::OperationScope(Operation o)
+  : outermost(operation == NoOperation), span("operation", OperationNames[o]) {
+  if (outermost)
+    operation = o;
+}
+
+
+BRoundTrips::OperationScope::~OperationScope(void) {
+  if (outermost)
+    operation = NoOperation;
+}
+
+
+BRoundTrips::Wait::Wait(Call c)
+  : call(c), start(0), counted(False), finished(False),
+    span("round trip", CallNames[c]) {
+  if (! onLoopThread() || depth++ > 0)
+    return;
+
+  counted = True;
+  start = monotonicTime();
+}
+
+
+void BRoundTrips::Wait::finish(void) {
+  span.end();
+
+  if (finished || ! onLoopThread())
+    return;
+  finished = True;
+
+  --depth;
+  if (! counted)
+    return;
+
+  Tally &tally = table[operation][event][call];
+  ++tally.calls;
+  tally.nanoseconds += monotonicTime() - start;
+}
+
+
+void BRoundTrips::print(FILE *file, const char *name) {
+  for (unsigned int o = 0; o < OperationCount; ++o) {
+    for (unsigned int e = 0; e < EventSlots; ++e) {
+      const Tally *row = table[o][e];
+      unsigned long calls = 0;
+      unsigned long long nanoseconds = 0;
+      for (unsigned int c = 0; c < CallCount; ++c) {
+        calls += row[c].calls;
+        nanoseconds += row[c].nanoseconds;
+      }
+      if (calls == 0)
+        continue;
+
+      const char *what = (e == 0) ? "between events" :
+                         (e == LASTEvent) ? "extension events" :
+                         eventTypeName(e);
+      fprintf(file, "%s: round trips in %s, %s: %lu, %llu us\n", name,
+              OperationNames[o], what, calls, nanoseconds / 1000);
+      for (unsigned int c = 0; c < CallCount; ++c) {
+        if (row[c].calls > 0)
+          fprintf(file, "%s:   %-24s %8lu  %10llu us\n", name,
+                  CallNames[c], row[c].calls, row[c].nanoseconds / 1000);
+      }
+    }
+  }
+}
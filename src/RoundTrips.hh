@@ -0,0 +1,127 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// RoundTrips.hh for XWinWM - where the event loop waits on the server
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __RoundTrips_hh
+#define   __RoundTrips_hh
+
+extern "C" {
+#include <X11/Xlib.h>
+
+#include <stdio.h>
+}
+
+#include "Timeline.hh"
+
+/*
+ * counts the Xlib calls that wait for the server, and the time spent
+ * waiting, by the event being handled and the operation it led to.  Only
+ * the outermost operation counts, so the focus change a manage makes is
+ * put down to the manage.  What is done between events, for the messages
+ * and timers, has an event of its own, and the calls made on the other
+ * threads do not hold up the event loop and are left out, those of the
+ * screen threads included.
+ *
+ * The calls are counted where they are made: by the wrappers in
+ * TracedCalls.hh for those whose answers go in the trace, and with
+ * BROUNDTRIP() for the rest, so whatever is made some other way is not
+ * counted.  XParseColor() and XKeysymToKeycode() only wait the first time
+ * they are asked something, and are counted every time.  The table is
+ * printed with the other statistics, on SIGUSR2.  The operations and
+ * calls, nested ones and those of the other threads included, are also
+ * the spans of the timeline, when one is recorded.
+ */
+class BRoundTrips {
+public:
+  enum Call { Sync = 0, GetWindowProperty, GetWindowAttributes, QueryTree,
+              GetInputFocus, GetWMHints, GetWMNormalHints, GetWMName,
+              GetWMIconName, GetWMProtocols, GetTransientForHint,
+              InternAtom, FrameGetRect, QueryExtension, AllocColor,
+              ParseColor, TranslateCoordinates, ShapeQueryExtents,
+              GetModifierMapping, KeysymToKeycode, ListInstalledColormaps,
+              XkbQueryExtension, XkbGetMap, XkbGetControls, CallCount };
+  enum Operation { NoOperation = 0, Manage, Unmanage, Focus, Raise, Lower,
+                   Configure, Reconfigure, Switch, OperationCount };
+
+  // the event being handled, for as long as it lasts
+  class EventScope {
+  public:
+    EventScope(int type);
+    ~EventScope(void);
+
+  private:
+    int saved;
+  };
+
+  // an operation, unless one is under way already
+  class OperationScope {
+  public:
+    OperationScope(Operation operation);
+    ~OperationScope(void);
+
+  private:
+    bool outermost;
+    BTimeline::Span span;
+  };
+
+  // one call into Xlib, until finish() or the end of the scope
+  class Wait {
+  public:
+    Wait(Call call);
+    ~Wait(void) { finish(); }
+
+    void finish(void);
+
+  private:
+    Call call;
+    unsigned long long start;
+    bool counted, finished;
+    BTimeline::Span span;
+  };
+
+  static void print(FILE *file, const char *name);
+
+private:
+  // LASTEvent stands for the extension events, and 0 for the time
+  // between events
+  enum { EventSlots = LASTEvent + 1 };
+
+  struct Tally {
+    unsigned long calls;
+    unsigned long long nanoseconds;
+  };
+
+  static Tally table[OperationCount][EventSlots][CallCount];
+  static int event;
+  static Operation operation;
+  // a call made while another is waited for is not counted again
+  static unsigned int depth;
+};
+
+/*
+ * makes an Xlib call that waits for the server, counted as call, and gives
+ * what it returned:
+ *
+ *   if (! BROUNDTRIP(ParseColor, XParseColor(display, map, name, &color)))
+ */
+#define   BROUNDTRIP(call, expression) \
+  (BRoundTrips::Wait(BRoundTrips::call), (expression))
+
+#endif // __RoundTrips_hh
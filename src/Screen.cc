@@ -73,6 +73,7 @@ extern "C" {
 
 #include <algorithm>
 #include <functional>
+#include <set>
 #include <string>
 
 using std::string;
@@ -80,11 +81,13 @@ using std::string;
 #include "i18n.hh"
 #include "blackbox.hh"
 #include "GCCache.hh"
+#include "RoundTrips.hh"
 #include "Screen.hh"
 #ifdef ADD_BLOAT
 #include "Slit.hh"
 #include "Toolbar.hh"
 #endif // ADD_BLOAT
+#include "TracedCalls.hh"
 #include "Util.hh"
 #include "Window.hh"
 #include "Workspace.hh"
@@ -117,7 +120,7 @@ BScreen::BScreen(Blackbox *bb, unsigned int scrn) : ScreenInfo(bb, scrn) {
 
   XErrorHandler old = XSetErrorHandler((XErrorHandler) anotherWMRunning);
   XSelectInput(getBaseDisplay()->getXDisplay(), getRootWindow(), event_mask);
-  XSync(getBaseDisplay()->getXDisplay(), False);
+  BROUNDTRIP(Sync, XSync(getBaseDisplay()->getXDisplay(), False));
   XSetErrorHandler((XErrorHandler) old);
 
   managed = running;
@@ -150,6 +153,8 @@ BScreen::BScreen(Blackbox *bb, unsigned int scrn) : ScreenInfo(bb, scrn) {
                   XA_INTEGER, 32,
                   PropModeReplace, (unsigned char *) &mouse_activate, 1);
 
+  blackbox->setNETSupported(getRootWindow());
+
   XDefineCursor(blackbox->getXDisplay(), getRootWindow(),
                 blackbox->getSessionCursor());
 
@@ -161,6 +166,7 @@ BScreen::BScreen(Blackbox *bb, unsigned int scrn) : ScreenInfo(bb, scrn) {
   blackbox->load_rc(this);
 
   LoadStyle();
+  saveWindowSettings();
 
   XGCValues gcv;
   unsigned long gc_value_mask = GCForeground;
@@ -204,19 +210,28 @@ BScreen::BScreen(Blackbox *bb, unsigned int scrn) : ScreenInfo(bb, scrn) {
 
   updateAvailableArea();
 
-  changeWorkspaceID(0);
+  // after a restart, carry on where the instance before us left off
+  const BSnapshot *snapshot = blackbox->restartSnapshot();
+  const BSnapshotScreen *saved =
+    (snapshot) ? snapshot->findScreen(getScreenNumber()) : 0;
+
+  changeWorkspaceID((saved && saved->workspace < getWorkspaceCount()) ?
+                    saved->workspace : 0);
 
   unsigned int i, j, nchild;
   Window r, p, *children;
-  XQueryTree(blackbox->getXDisplay(), getRootWindow(), &r, &p,
-             &children, &nchild);
+  tracedQueryTree(blackbox->getXDisplay(), getRootWindow(), &r, &p,
+                  &children, &nchild);
+
+  if (saved)
+    adoptSnapshot(snapshot->getWindows(), children, nchild);
 
   // preen the window list of all icon windows... for better dockapp support
   for (i = 0; i < nchild; i++) {
     if (children[i] == None) continue;
 
-    XWMHints *wmhints = XGetWMHints(blackbox->getXDisplay(),
-                                    children[i]);
+    XWMHints *wmhints = tracedGetWMHints(blackbox->getXDisplay(),
+                                         children[i]);
 
     if (wmhints) {
       if ((wmhints->flags & IconWindowHint) &&
@@ -239,7 +254,8 @@ BScreen::BScreen(Blackbox *bb, unsigned int scrn) : ScreenInfo(bb, scrn) {
       continue;
 
     XWindowAttributes attrib;
-    if (XGetWindowAttributes(blackbox->getXDisplay(), children[i], &attrib)) {
+    if (tracedGetWindowAttributes(blackbox->getXDisplay(), children[i],
+                                  &attrib)) {
       if (attrib.override_redirect) continue;
 
       if (attrib.map_state != IsUnmapped) {
@@ -279,76 +295,115 @@ void BScreen::removeWorkspaceNames(void) {
 }
 
 
-void BScreen::reconfigure(void) {
-  LoadStyle();
+/*
+ * Re-reads the style and applies whatever it and the rc file changed.  The
+ * old settings are compared with the new ones and the windows are only
+ * touched for what differs, so a reload that changes nothing costs no
+ * requests at all.  Returns True if the style changed.
+ */
+bool BScreen::reconfigure(void) {
+  BRoundTrips::OperationScope operation(BRoundTrips::Reconfigure);
 
-  XGCValues gcv;
-  unsigned long gc_value_mask = GCForeground;
-  if (! i18n.multibyte()) gc_value_mask |= GCFont;
+  const bool style_changed = LoadStyle();
 
-  gcv.foreground = WhitePixel(blackbox->getXDisplay(),
-                              getScreenNumber());
-  gcv.function = GXinvert;
-  gcv.subwindow_mode = IncludeInferiors;
-  XChangeGC(blackbox->getXDisplay(), opGC,
-            GCForeground | GCFunction | GCSubwindowMode, &gcv);
+  unsigned int changes = 0;
+  if (style_changed)
+    changes |= BlackboxWindow::ReconfigureFrame;
+  if (applied.sloppy_focus != resource.sloppy_focus ||
+      applied.click_raise != resource.click_raise ||
+      applied.allow_scroll_lock != resource.allow_scroll_lock)
+    changes |= BlackboxWindow::ReconfigureGrabs;
+  saveWindowSettings();
 
+#ifdef ADD_BLOAT
   raiseWindows(0, 0);
 
-#ifdef ADD_BLOAT
   toolbar->reconfigure();
 
   slit->reconfigure();
 #endif // ADD_BLOAT
 
-  std::for_each(workspacesList.begin(), workspacesList.end(),
-                std::mem_fun(&Workspace::reconfigure));
+  if (! changes)
+    return style_changed;
+
+  WorkspaceList::iterator wit = workspacesList.begin();
+  for (; wit != workspacesList.end(); ++wit)
+    (*wit)->reconfigure(changes);
 
   BlackboxWindowList::iterator iit = iconList.begin();
   for (; iit != iconList.end(); ++iit) {
     BlackboxWindow *bw = *iit;
     if (bw->validateClient())
-      bw->reconfigure();
+      bw->reconfigure(changes);
   }
+
+  return style_changed;
 }
 
 
-void BScreen::LoadStyle(void) {
-  // we create the window.frame texture by hand because it exists only to
-  // make the code cleaner and is not actually used for display
-  BColor color = readDatabaseColor("window.frame.focusColor",
-                                   "Window.Frame.FocusColor", "white");
+void BScreen::saveWindowSettings(void) {
+  applied.sloppy_focus = resource.sloppy_focus;
+  applied.click_raise = resource.click_raise;
+  applied.allow_scroll_lock = resource.allow_scroll_lock;
+}
+
 
-  color = readDatabaseColor("window.frame.unfocusColor",
-                            "Window.Frame.UnfocusColor", "white");
+// returns True if anything in the style changed
+bool BScreen::LoadStyle(void) {
+  style.load(blackbox->getStyleFilename());
+
+  bool changed = False;
 
   // load toolbar config
 #ifdef ADD_BLOAT
-  readDatabaseColor("toolbar.label.textColor",
-                    "Toolbar.Label.TextColor", "white");
-  resource.tstyle.w_text =
-    readDatabaseColor("toolbar.windowLabel.textColor",
-                      "Toolbar.WindowLabel.TextColor", "white");
-  resource.tstyle.c_text =
-    readDatabaseColor("toolbar.clock.textColor",
-                      "Toolbar.Clock.TextColor", "white");
-  resource.tstyle.b_pic =
-    readDatabaseColor("toolbar.button.picColor",
-                      "Toolbar.Button.PicColor", "black");
+  changed |= readDatabaseColor("toolbar.windowLabel.textColor",
+                               "Toolbar.WindowLabel.TextColor", "white",
+                               resource.tstyle.w_text);
+  changed |= readDatabaseColor("toolbar.clock.textColor",
+                               "Toolbar.Clock.TextColor", "white",
+                               resource.tstyle.c_text);
+  changed |= readDatabaseColor("toolbar.button.picColor",
+                               "Toolbar.Button.PicColor", "black",
+                               resource.tstyle.b_pic);
 
   resource.tstyle.justify = LeftJustify;
 #endif // ADD_BLOAT
 
-  resource.border_color =
-    readDatabaseColor("borderColor", "BorderColor", "black");
-
-  //unsigned int uint_value;
+  changed |= readDatabaseColor("borderColor", "BorderColor", "black",
+                               resource.border_color);
 
   // load bevel, border and handle widths
+  const unsigned int old_handle_width = resource.handle_width,
+    old_border_width = resource.border_width,
+    old_bevel_width = resource.bevel_width,
+    old_frame_width = resource.frame_width;
+  const int limit = getWidth() / 2;
+  int value;
+
   resource.handle_width = 6;
+  if (style.getValue("handleWidth", "HandleWidth", value) &&
+      value > 0 && value <= limit)
+    resource.handle_width = value;
+
   resource.border_width = 1;
+  if (style.getValue("borderWidth", "BorderWidth", value) && value >= 0)
+    resource.border_width = value;
+
   resource.bevel_width = 3;
+  if (style.getValue("bevelWidth", "BevelWidth", value) &&
+      value > 0 && value <= limit)
+    resource.bevel_width = value;
+
   resource.frame_width = resource.bevel_width;
+  if (style.getValue("frameWidth", "FrameWidth", value) &&
+      value >= 0 && value <= limit)
+    resource.frame_width = value;
+
+  changed |= (resource.handle_width != old_handle_width ||
+              resource.border_width != old_border_width ||
+              resource.bevel_width != old_bevel_width ||
+              resource.frame_width != old_frame_width);
+  return changed;
 }
 
 
@@ -429,6 +484,8 @@ unsigned int BScreen::removeLastWorkspace(void) {
 void BScreen::changeWorkspaceID(unsigned int id) {
   if (! current_workspace || id == current_workspace->getID()) return;
 
+  BRoundTrips::OperationScope operation(BRoundTrips::Switch);
+
   current_workspace->hide();
 
   current_workspace = getWorkspace(id);
@@ -443,17 +500,23 @@ void BScreen::changeWorkspaceID(unsigned int id) {
 }
 
 
-void BScreen::manageWindow(Window w) {
-  XWMHints *wmhint = XGetWMHints(blackbox->getXDisplay(), w);
-  if (wmhint && (wmhint->flags & StateHint) &&
-      wmhint->initial_state == WithdrawnState) {
+void BScreen::manageWindow(Window w, const BSnapshotWindow *snapshot,
+                           const XWindowAttributes *attributes) {
+  BRoundTrips::OperationScope operation(BRoundTrips::Manage);
+
+  // a window in the snapshot was managed, so it was not a dock app
+  if (! snapshot) {
+    XWMHints *wmhint = tracedGetWMHints(blackbox->getXDisplay(), w);
+    if (wmhint && (wmhint->flags & StateHint) &&
+        wmhint->initial_state == WithdrawnState) {
 #ifdef ADD_BLOAT
-    slit->addClient(w);
+      slit->addClient(w);
 #endif // ADD_BLOAT
-    return;
+      return;
+    }
   }
 
-  new BlackboxWindow(blackbox, w, this);
+  new BlackboxWindow(blackbox, w, this, snapshot, attributes);
 
   BlackboxWindow *win = blackbox->searchWindow(w);
   if (! win)
@@ -463,12 +526,19 @@ void BScreen::manageWindow(Window w) {
 
   XMapRequestEvent mre;
   mre.window = w;
-  if (blackbox->isStartup()) win->restoreAttributes();
+  if (blackbox->isStartup()) {
+    if (snapshot)
+      win->restoreSnapshot(*snapshot);
+    else
+      win->restoreAttributes();
+  }
   win->mapRequestEvent(&mre);
 }
 
 
 void BScreen::unmanageWindow(BlackboxWindow *w, bool remap) {
+  BRoundTrips::OperationScope operation(BRoundTrips::Unmanage);
+
   w->restore(remap);
 
   if (w->isModal()) w->setModal(False);
@@ -761,7 +831,8 @@ size_t string_within(char begin, char end,
 
 void BScreen::shutdown(void) {
   XSelectInput(blackbox->getXDisplay(), getRootWindow(), NoEventMask);
-  XSync(blackbox->getXDisplay(), False);
+  // the windows look for their ReparentNotify as they are let go
+  blackbox->syncEvents();
 
   while(! windowList.empty())
     unmanageWindow(windowList.front(), True);
@@ -772,6 +843,86 @@ void BScreen::shutdown(void) {
 }
 
 
+void BScreen::saveSnapshot(BSnapshot &snapshot) {
+  BSnapshotScreen saved;
+  saved.screen = getScreenNumber();
+  saved.root = getRootWindow();
+  saved.workspace = getCurrentWorkspaceID();
+  snapshot.addScreen(saved);
+
+  // each workspace from the bottom up, then those in none, like the icons
+  std::set<BlackboxWindow*> done;
+  BSnapshotWindow window;
+  std::string text[BSnapshotWindow::TextCount];
+
+  WorkspaceList::iterator it = workspacesList.begin();
+  for (; it != workspacesList.end(); ++it) {
+    const BlackboxWindowList &stack = (*it)->getStackingList();
+    BlackboxWindowList::const_reverse_iterator w = stack.rbegin();
+    for (; w != stack.rend(); ++w) {
+      if (! done.insert(*w).second)
+        continue;
+      (*w)->saveSnapshot(window, text);
+      snapshot.addWindow(window, text);
+    }
+  }
+
+  BlackboxWindowList::iterator w = windowList.begin();
+  for (; w != windowList.end(); ++w) {
+    if (! done.insert(*w).second)
+      continue;
+    (*w)->saveSnapshot(window, text);
+    snapshot.addWindow(window, text);
+  }
+}
+
+
+/*
+ * manages the windows of a snapshot in the order they were stacked in.  A
+ * window is only taken as it was if the server still has it where it was
+ * left; the rest of the children are then managed as usual, and anything
+ * adopted here is taken out of them.  Everything else the window needs
+ * comes from the snapshot too, so the attributes read here are the only
+ * round trip spent on finding out about it.
+ */
+void BScreen::adoptSnapshot(const BSnapshot::WindowList &windows,
+                            Window *children, unsigned int nchild) {
+  Window * const end = children + nchild;
+
+  BSnapshot::WindowList::const_iterator it = windows.begin();
+  for (; it != windows.end(); ++it) {
+    if (it->screen != getScreenNumber())
+      continue;
+
+    Window *child = std::find(children, end, it->window);
+    if (child == end)
+      continue;
+
+    XWindowAttributes attrib;
+    if (! tracedGetWindowAttributes(blackbox->getXDisplay(), it->window,
+                                    &attrib) ||
+        attrib.override_redirect || attrib.map_state == IsUnmapped ||
+        attrib.x != it->x || attrib.y != it->y ||
+        (unsigned int) attrib.width != it->width ||
+        (unsigned int) attrib.height != it->height)
+      continue;
+
+    *child = None;
+    manageWindow(it->window, &(*it), &attrib);
+  }
+
+  // a transient may have come before the window it is for
+  for (it = windows.begin(); it != windows.end(); ++it) {
+    if (it->screen != getScreenNumber())
+      continue;
+
+    BlackboxWindow *win = blackbox->searchWindow(it->window);
+    if (win && win->getScreen() == this)
+      win->resolveTransient(*it);
+  }
+}
+
+
 void BScreen::showPosition(int /*x*/, int /*y*/) {
 }
 
@@ -847,9 +998,6 @@ void BScreen::buttonPressEvent(const XButtonEvent *xbutton) {
 
 
 void BScreen::toggleFocusModel(FocusModel model) {
-  std::for_each(windowList.begin(), windowList.end(),
-                std::mem_fun(&BlackboxWindow::ungrabButtons));
-  
   if (model == SloppyFocus) {
     saveSloppyFocus(True);
   } else {
@@ -860,15 +1008,27 @@ void BScreen::toggleFocusModel(FocusModel model) {
 
   std::for_each(windowList.begin(), windowList.end(),
                 std::mem_fun(&BlackboxWindow::grabButtons));
+  saveWindowSettings();
 }
 
 
-BColor BScreen::readDatabaseColor(const string &/*rname*/, const string &/*rclass*/,
-				  const string &default_color) {
-  BColor color;
-
-  color = BColor(default_color, getBaseDisplay(), getScreenNumber());
-  return color;
+/*
+ * Sets color from the style, or to default_color if the style has none.
+ * A color whose name has not changed is left alone, since parsing a color
+ * name can take a round trip to the server.  Returns True if it changed.
+ */
+bool BScreen::readDatabaseColor(const string &rname, const string &rclass,
+                                const string &default_color, BColor &color) {
+  string value;
+  if (! style.getValue(rname, rclass, value))
+    value = default_color;
+
+  if (value == color.name() && color.display() == getBaseDisplay() &&
+      color.screen() == getScreenNumber())
+    return False;
+
+  color = BColor(value, getBaseDisplay(), getScreenNumber());
+  return True;
 }
 
 
@@ -45,8 +45,10 @@ extern "C" {
 #include <vector>
 
 #include "Color.hh"
+#include "Database.hh"
 #include "Util.hh"
 #include "Netizen.hh"
+#include "Snapshot.hh"
 #include "Timer.hh"
 #include "Workspace.hh"
 #include "blackbox.hh"
@@ -90,6 +92,14 @@ private:
 
   Rect usableArea;
 
+  BDatabase style;
+
+  // the settings the windows were last set up with, so that reconfigure()
+  // only redoes what has changed since
+  struct WindowSettings {
+    bool sloppy_focus, click_raise, allow_scroll_lock;
+  } applied;
+
   typedef std::list<Strut*> StrutList;
   StrutList strutList;
   typedef std::vector<std::string> WorkspaceNamesList;
@@ -132,11 +142,14 @@ private:
   BScreen(const BScreen&);
   BScreen& operator=(const BScreen&);
 
-  BColor readDatabaseColor(const std::string &rname,
-                           const std::string &rclass,
-                           const std::string &default_color);
+  bool readDatabaseColor(const std::string &rname,
+                         const std::string &rclass,
+                         const std::string &default_color, BColor &color);
 
-  void LoadStyle(void);
+  bool LoadStyle(void);
+  void saveWindowSettings(void);
+  void adoptSnapshot(const BSnapshot::WindowList &windows, Window *children,
+                     unsigned int nchild);
 
 
 public:
@@ -274,7 +287,8 @@ public:
   void addIcon(BlackboxWindow *w);
   void removeIcon(BlackboxWindow *w);
 
-  void manageWindow(Window w);
+  void manageWindow(Window w, const BSnapshotWindow *snapshot = 0,
+                    const XWindowAttributes *attributes = 0);
   void unmanageWindow(BlackboxWindow *w, bool remap);
   void raiseWindows(Window *workspace_stack, unsigned int num);
   void reassociateWindow(BlackboxWindow *w, unsigned int wkspc_id,
@@ -283,9 +297,11 @@ public:
   void prevFocus(void);
   void nextFocus(void);
   void raiseFocus(void);
-  void reconfigure(void);
+  bool reconfigure(void);
   void toggleFocusModel(FocusModel model);
   void shutdown(void);
+  // adds what a restart needs to know about this screen and its windows
+  void saveSnapshot(BSnapshot &snapshot);
   void showPosition(int x, int y);
 
   void buttonPressEvent(const XButtonEvent *xbutton);
@@ -0,0 +1,279 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Snapshot.cc for XWinWM - hands the managed state over across a restart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+#ifdef    HAVE_STDIO_H
+#  include <stdio.h>
+#endif // HAVE_STDIO_H
+
+#ifdef    HAVE_STDLIB_H
+#  include <stdlib.h>
+#endif // HAVE_STDLIB_H
+
+#ifdef    HAVE_STRING_H
+#  include <string.h>
+#endif // HAVE_STRING_H
+
+#ifdef    HAVE_UNISTD_H
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif // HAVE_UNISTD_H
+
+#ifdef    HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif // HAVE_SYS_MMAN_H
+
+#ifdef    HAVE_TIME_H
+#  include <time.h>
+#endif // HAVE_TIME_H
+}
+
+#include <string>
+
+#include "Snapshot.hh"
+#include "RoundTrips.hh"
+#include "TracedCalls.hh"
+
+using std::string;
+
+static const char SnapshotMagic[8] = {
+  'X', 'W', 'W', 'M', 'S', 'N', 'A', 'P'
+};
+static const unsigned int SnapshotVersion = 2;
+static const char * const SnapshotVariable = "XWINWM_SNAPSHOT_FD";
+static const char * const SnapshotAtom = "_XWINWM_SNAPSHOT";
+
+// only the same binary reads what it wrote, so the layout is the native one
+struct SnapshotHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int screen_size, window_size;
+  unsigned int screens, windows;
+  unsigned long texts;
+  unsigned long serial;
+  Window focus;
+};
+
+
+BSnapshot::BSnapshot(Display *d): display(d), focus(None) {}
+
+
+void BSnapshot::addWindow(const BSnapshotWindow &w,
+                          const std::string text[BSnapshotWindow::TextCount]) {
+  windows.push_back(w);
+  BSnapshotWindow &added = windows.back();
+  for (unsigned int i = 0; i < BSnapshotWindow::TextCount; ++i) {
+    added.text_offset[i] = texts.size();
+    added.text_length[i] = text[i].size();
+    texts += text[i];
+  }
+}
+
+
+string BSnapshot::text(const BSnapshotWindow &w, unsigned int which) const {
+  if (which >= BSnapshotWindow::TextCount ||
+      w.text_offset[which] > texts.size() ||
+      w.text_length[which] > texts.size() - w.text_offset[which])
+    return string();
+  return texts.substr(w.text_offset[which], w.text_length[which]);
+}
+
+
+const BSnapshotScreen *BSnapshot::findScreen(unsigned int screen) const {
+  ScreenList::const_iterator it = screens.begin();
+  for (; it != screens.end(); ++it) {
+    if (it->screen == screen)
+      return &(*it);
+  }
+  return (const BSnapshotScreen *) 0;
+}
+
+
+int BSnapshot::createFile(void) {
+#ifdef    HAVE_MEMFD_CREATE
+  // not close-on-exec, as the new instance is to find it open
+  const int memfd = memfd_create("xwinwm-snapshot", 0);
+  if (memfd != -1)
+    return memfd;
+#endif // HAVE_MEMFD_CREATE
+
+  const char *tmpdir = getenv("TMPDIR");
+  string path = (tmpdir && *tmpdir) ? tmpdir : "/tmp";
+  path += "/xwinwm-snapshot.XXXXXX";
+
+  std::vector<char> name(path.begin(), path.end());
+  name.push_back('\0');
+
+  int fd = mkstemp(&name[0]);
+  if (fd != -1)
+    unlink(&name[0]);
+  return fd;
+}
+
+
+bool BSnapshot::handOff(void) {
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SnapshotMagic, sizeof(header.magic));
+  header.version = SnapshotVersion;
+  header.screen_size = sizeof(BSnapshotScreen);
+  header.window_size = sizeof(BSnapshotWindow);
+  header.screens = screens.size();
+  header.windows = windows.size();
+  header.texts = texts.size();
+  // the property holds 32 bits, and it only has to differ from the last
+  header.serial = ((unsigned long) time(0) ^
+                   ((unsigned long) getpid() << 16)) & 0xfffffffful;
+  if (! header.serial) header.serial = 1;
+  header.focus = focus;
+
+  string data((const char *) &header, sizeof(header));
+  if (! screens.empty())
+    data.append((const char *) &screens[0],
+                screens.size() * sizeof(BSnapshotScreen));
+  if (! windows.empty())
+    data.append((const char *) &windows[0],
+                windows.size() * sizeof(BSnapshotWindow));
+  data += texts;
+
+  int fd = createFile();
+  if (fd == -1)
+    return False;
+
+  const char *p = data.data();
+  size_t length = data.size();
+  while (length > 0) {
+    ssize_t n = write(fd, p, length);
+    if (n <= 0) {
+      close(fd);
+      return False;
+    }
+    p += n;
+    length -= n;
+  }
+
+  const unsigned long serial = header.serial;
+  XChangeProperty(display, RootWindow(display, 0),
+                  tracedInternAtom(display, SnapshotAtom, False), XA_CARDINAL,
+                  32, PropModeReplace, (unsigned char *) &serial, 1);
+  BROUNDTRIP(Sync, XSync(display, False));
+
+  // putenv() keeps the pointer, so the string has to last until the exec
+  static char variable[64];
+  sprintf(variable, "%s=%d", SnapshotVariable, fd);
+  putenv(variable);
+
+  return True;
+}
+
+
+bool BSnapshot::load(void) {
+  const char *variable = getenv(SnapshotVariable);
+  if (! variable)
+    return False;
+
+  const int fd = atoi(variable);
+  // nothing we start should see it
+  unsetenv(SnapshotVariable);
+
+  // the serial is good for one restart, whatever becomes of the snapshot
+  Atom atom = tracedInternAtom(display, SnapshotAtom, False);
+  Atom type;
+  int format;
+  unsigned long nitems, after, serial = 0;
+  unsigned char *value = 0;
+  if (tracedGetWindowProperty(display, RootWindow(display, 0), atom, 0l, 1l,
+                              True, XA_CARDINAL, &type, &format, &nitems,
+                              &after, &value) == Success && value) {
+    if (format == 32 && nitems == 1)
+      serial = *((unsigned long *) value);
+    XFree(value);
+  }
+
+  string data;
+  char buffer[4096];
+  for (off_t offset = 0; ; ) {
+    ssize_t n = pread(fd, buffer, sizeof(buffer), offset);
+    if (n < 0)
+      // not a file, so not ours to close either
+      return False;
+    if (n == 0)
+      break;
+    data.append(buffer, n);
+    offset += n;
+  }
+
+  SnapshotHeader header;
+  if (data.size() < sizeof(header))
+    return False;
+  memcpy(&header, data.data(), sizeof(header));
+  if (memcmp(header.magic, SnapshotMagic, sizeof(header.magic)) != 0)
+    return False;
+
+  // it is ours, whether or not it can be used
+  close(fd);
+
+  if (header.version != SnapshotVersion ||
+      header.screen_size != sizeof(BSnapshotScreen) ||
+      header.window_size != sizeof(BSnapshotWindow) ||
+      data.size() != sizeof(header) +
+                     header.screens * sizeof(BSnapshotScreen) +
+                     header.windows * sizeof(BSnapshotWindow) +
+                     header.texts ||
+      ! serial || header.serial != serial)
+    return False;
+
+  const char *p = data.data() + sizeof(header);
+  screens.resize(header.screens);
+  if (header.screens > 0)
+    memcpy(&screens[0], p, header.screens * sizeof(BSnapshotScreen));
+  p += header.screens * sizeof(BSnapshotScreen);
+
+  windows.resize(header.windows);
+  if (header.windows > 0)
+    memcpy(&windows[0], p, header.windows * sizeof(BSnapshotWindow));
+  p += header.windows * sizeof(BSnapshotWindow);
+
+  texts.assign(p, header.texts);
+
+  focus = header.focus;
+
+  // the screens must be the ones they were
+  ScreenList::const_iterator it = screens.begin();
+  for (; it != screens.end(); ++it) {
+    if (it->screen >= (unsigned int) ScreenCount(display) ||
+        it->root != RootWindow(display, it->screen)) {
+      screens.clear();
+      windows.clear();
+      texts.clear();
+      return False;
+    }
+  }
+
+  return True;
+}
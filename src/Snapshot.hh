@@ -0,0 +1,115 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Snapshot.hh for XWinWM - hands the managed state over across a restart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Snapshot_hh
+#define   __Snapshot_hh
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+}
+
+#include <string>
+#include <vector>
+
+// a managed window as it was left by the instance that restarted
+struct BSnapshotWindow {
+  // the strings kept with the snapshot, see BSnapshot::text()
+  enum { Title = 0, IconTitle, ResName, ResClass, Command, Machine,
+         TextCount };
+
+  Window window;
+  unsigned int screen, workspace;
+  unsigned long state;
+  // where the window was put back when it was let go
+  int x, y;
+  unsigned int width, height;
+  int maximized;
+  int premax_x, premax_y;
+  unsigned int premax_w, premax_h;
+
+  // the hints as they were last read, so they need not be read again
+  unsigned long decorations, functions, protocols;
+  XWMHints wm_hints;
+  unsigned long normal_hint_flags;
+  unsigned int min_width, min_height, max_width, max_height,
+    width_inc, height_inc, base_width, base_height, win_gravity;
+  Window transient_for;         // the window itself if it is no transient
+  unsigned long pid;
+  unsigned int text_offset[TextCount], text_length[TextCount];
+};
+
+struct BSnapshotScreen {
+  unsigned int screen;
+  Window root;
+  unsigned int workspace;
+};
+
+/*
+ * what a restart would otherwise have to find out again from the server,
+ * one window at a time.  The instance that restarts fills it in and calls
+ * handOff() right before exec; the snapshot is written to a memfd, or an
+ * unlinked file where there is none, and its descriptor is left open for
+ * the new instance, which finds it in XWINWM_SNAPSHOT_FD.
+ *
+ * A serial is also put on the first root window, and the new instance
+ * only believes a snapshot whose serial the server has too, so one left
+ * over from another session or display is never used.  The windows are
+ * in the order they were stacked in, bottom first.
+ */
+class BSnapshot {
+public:
+  typedef std::vector<BSnapshotScreen> ScreenList;
+  typedef std::vector<BSnapshotWindow> WindowList;
+
+  BSnapshot(Display *d);
+
+  inline void addScreen(const BSnapshotScreen &s) { screens.push_back(s); }
+  // the strings are kept apart from the window, which has a fixed size
+  void addWindow(const BSnapshotWindow &w,
+                 const std::string text[BSnapshotWindow::TextCount]);
+  inline void setFocus(Window w) { focus = w; }
+
+  // returns False if it could not be written, and the new instance will
+  // manage the windows as if it were starting afresh
+  bool handOff(void);
+  // returns False if there is no snapshot, or it does not match the server
+  bool load(void);
+
+  const BSnapshotScreen *findScreen(unsigned int screen) const;
+  inline const WindowList &getWindows(void) const { return windows; }
+  std::string text(const BSnapshotWindow &w, unsigned int which) const;
+  inline Window getFocus(void) const { return focus; }
+
+private:
+  Display *display;
+  ScreenList screens;
+  WindowList windows;
+  std::string texts;
+  Window focus;
+
+  BSnapshot(const BSnapshot &_nocopy);
+  BSnapshot &operator=(const BSnapshot &_nocopy);
+
+  int createFile(void);
+};
+
+#endif // __Snapshot_hh
@@ -0,0 +1,356 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Spawn.cc for XWinWM - starts commands without forking the window manager
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#ifdef    HAVE_STDLIB_H
+#  include <stdlib.h>
+#endif // HAVE_STDLIB_H
+
+#ifdef    HAVE_STRING_H
+#  include <string.h>
+#endif // HAVE_STRING_H
+
+#ifdef    HAVE_UNISTD_H
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif // HAVE_UNISTD_H
+
+#ifdef    HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif // HAVE_FCNTL_H
+
+#ifdef    HAVE_SIGNAL_H
+#  include <signal.h>
+#endif // HAVE_SIGNAL_H
+
+#ifdef    HAVE_SYS_SOCKET_H
+#  include <sys/socket.h>
+#endif // HAVE_SYS_SOCKET_H
+
+#ifdef    HAVE_SYS_SELECT_H
+#  include <sys/select.h>
+#endif // HAVE_SYS_SELECT_H
+
+#include <errno.h>
+
+#if defined(HAVE_SPAWN_H) && defined(HAVE_POSIX_SPAWN)
+#  include <spawn.h>
+#  define   USE_POSIX_SPAWN
+#endif
+
+#if defined(HAVE_PROCESS_H) && defined(__EMX__)
+#  include <process.h>
+#endif //   HAVE_PROCESS_H             __EMX__
+}
+
+#include <vector>
+
+#include "Spawn.hh"
+
+using std::string;
+
+extern char **environ;
+
+// the window manager's end of the socket to the spawn server, or -1
+static int server_fd = -1;
+static pid_t server_pid = -1;
+
+// how long the server has to say it started a command, in seconds
+static const long SpawnReplyTimeout = 2;
+
+
+/*
+ * The environment for a command: ours, with DISPLAY replaced.  The strings
+ * belong to environ and displaystring, which have to outlive the list.
+ */
+static void makeEnvironment(const string &displaystring,
+                            std::vector<char *> &env) {
+  env.clear();
+
+  for (char **e = environ; *e; ++e) {
+    if (! displaystring.empty() && ! strncmp(*e, "DISPLAY=", 8))
+      continue;
+    env.push_back(*e);
+  }
+  if (! displaystring.empty())
+    env.push_back(const_cast<char *>(displaystring.c_str()));
+  env.push_back((char *) 0);
+}
+
+
+static pid_t spawnDirect(const string &command, const string &displaystring) {
+  const string cmd = "exec " + command;
+  char *argv[] = { const_cast<char *>("/bin/sh"), const_cast<char *>("-c"),
+                   const_cast<char *>(cmd.c_str()), (char *) 0 };
+
+  std::vector<char *> env;
+  makeEnvironment(displaystring, env);
+
+#if defined(USE_POSIX_SPAWN)
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+
+  // the children should not inherit what we block or ignore
+  sigset_t mask;
+  sigemptyset(&mask);
+  posix_spawnattr_setsigmask(&attr, &mask);
+  sigset_t defaults;
+  sigfillset(&defaults);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+
+  short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#  ifdef    POSIX_SPAWN_SETSID
+  flags |= POSIX_SPAWN_SETSID;
+#  else // !POSIX_SPAWN_SETSID
+  flags |= POSIX_SPAWN_SETPGROUP;
+  posix_spawnattr_setpgroup(&attr, 0);
+#  endif // POSIX_SPAWN_SETSID
+  posix_spawnattr_setflags(&attr, flags);
+
+  pid_t pid;
+  int ret = posix_spawn(&pid, "/bin/sh", 0, &attr, argv, &env[0]);
+  posix_spawnattr_destroy(&attr);
+
+  return (ret == 0) ? pid : -1;
+#elif defined(__EMX__)
+  return spawnlp(P_NOWAIT, "cmd.exe", "cmd.exe", "/c", command.c_str(),
+                 NULL);
+#else // !USE_POSIX_SPAWN && !__EMX__
+  // everything the child needs is made before, it only calls setsid and
+  // exec
+#  ifdef    HAVE_VFORK
+  pid_t pid = vfork();
+#  else // !HAVE_VFORK
+  pid_t pid = fork();
+#  endif // HAVE_VFORK
+  if (pid == 0) {
+    setsid();
+    execve("/bin/sh", argv, &env[0]);
+    _exit(127);
+  }
+
+  return pid;
+#endif // USE_POSIX_SPAWN
+}
+
+
+static bool readAll(int fd, void *data, size_t length) {
+  char *p = (char *) data;
+  while (length > 0) {
+    ssize_t n = read(fd, p, length);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+
+static bool writeAll(int fd, const void *data, size_t length) {
+  const char *p = (const char *) data;
+  while (length > 0) {
+#if defined(HAVE_SYS_SOCKET_H) && defined(MSG_NOSIGNAL)
+    // a dead server must not take us with it
+    ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+#else
+    ssize_t n = write(fd, p, length);
+#endif
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+
+// what comes before the command and the display string in a request
+struct SpawnRequest {
+  unsigned int length;  // of the strings, with their NULs
+  unsigned int reply;   // whether the pid is wanted back
+};
+
+
+/*
+ * The server's loop.  It ends when the window manager closes its end of
+ * the socket.
+ */
+static void serveSpawns(int fd) {
+  // the commands are reaped by init once we are gone, and by the kernel
+  // until then
+  signal(SIGCHLD, SIG_IGN);
+
+  SpawnRequest header;
+  while (readAll(fd, &header, sizeof(header))) {
+    std::vector<char> request(header.length + 1, '\0');
+    if (! readAll(fd, &request[0], header.length))
+      break;
+
+    const string command(&request[0]);
+    const size_t next = command.size() + 1;
+    const string displaystring((next < header.length) ?
+                               &request[next] : "");
+
+    pid_t pid = spawnDirect(command, displaystring);
+    if (header.reply && ! writeAll(fd, &pid, sizeof(pid)))
+      break;
+  }
+
+  _exit(0);
+}
+
+
+/*
+ * Waits for the pid of a command, but not forever: a server that is
+ * stuck, or stopped, is given up on.  Returns false if it did not answer.
+ */
+static bool readReply(int fd, pid_t *pid) {
+#ifdef    HAVE_SYS_SELECT_H
+  timeval timeout;
+  timeout.tv_sec = SpawnReplyTimeout;
+  timeout.tv_usec = 0;
+
+  while (true) {
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    // select() leaves the time that was left in timeout where it can
+    int ret = select(fd + 1, &rfds, 0, 0, &timeout);
+    if (ret > 0)
+      break;
+    if (ret == 0 || errno != EINTR)
+      return false;
+  }
+#endif // HAVE_SYS_SELECT_H
+
+  return readAll(fd, pid, sizeof(*pid));
+}
+
+
+/*
+ * Hands a command to the server.  Without a reply, this costs one write,
+ * and we are not held up while the shell is started.  Returns false if
+ * the server is gone.
+ */
+static bool sendSpawn(const string &command, const string &displaystring,
+                      pid_t *pid) {
+  SpawnRequest header;
+  header.length = command.size() + displaystring.size() + 2;
+  header.reply = (pid != 0);
+
+  string request((const char *) &header, sizeof(header));
+  request += command;
+  request += '\0';
+  request += displaystring;
+  request += '\0';
+
+  if (writeAll(server_fd, request.data(), request.size()) &&
+      (! pid || readReply(server_fd, pid)))
+    return true;
+
+  // the server is gone, or hung, so we do without.  It is killed so it
+  // cannot start the command after we have started it ourselves
+  if (server_pid > 0)
+    kill(server_pid, SIGKILL);
+  stopSpawnServer();
+  return false;
+}
+
+
+bool startSpawnServer(void) {
+#if defined(HAVE_SYS_SOCKET_H) && ! defined(__EMX__)
+  if (server_fd != -1)
+    return true;
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+    return false;
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    close(fds[0]);
+    // the commands must not get the server's end, or it would stay open
+    // after the server is gone and we would never hear that it went
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    // in a session of its own, so a ^C meant for us does not reach it; it
+    // goes when we do anyway, as its end of the socket is closed
+    setsid();
+    serveSpawns(fds[1]);
+  }
+
+  close(fds[1]);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  server_fd = fds[0];
+  server_pid = pid;
+  return true;
+#else // !HAVE_SYS_SOCKET_H || __EMX__
+  return false;
+#endif // HAVE_SYS_SOCKET_H && !__EMX__
+}
+
+
+void stopSpawnServer(void) {
+  if (server_fd == -1)
+    return;
+
+  // the server ends when it reads the end of the socket
+  close(server_fd);
+  server_fd = -1;
+  server_pid = -1;
+}
+
+
+bool isSpawnServerRunning(void) {
+  return server_fd != -1;
+}
+
+
+pid_t spawnCommand(const string &command, const string &displaystring) {
+  pid_t pid;
+  if (server_fd != -1 && sendSpawn(command, displaystring, &pid))
+    return pid;
+
+  return spawnDirect(command, displaystring);
+}
+
+
+void bexec(const string& command, const string& displaystring) {
+  // nobody wants the pid, so the server need not answer
+  if (server_fd != -1 && sendSpawn(command, displaystring, 0))
+    return;
+
+  spawnDirect(command, displaystring);
+}
@@ -0,0 +1,59 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Spawn.hh for XWinWM - starts commands without forking the window manager
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Spawn_hh
+#define   __Spawn_hh
+
+extern "C" {
+#include <sys/types.h>
+}
+
+#include <string>
+
+/*
+ * Commands are run as "/bin/sh -c 'exec command'" in a session of their
+ * own.  displaystring is "DISPLAY=..." to put in their environment, or
+ * empty to leave it as it is.  Each returns the pid of the shell, or -1.
+ */
+
+/*
+ * with posix_spawn, or vfork where there is none, so the window manager's
+ * memory is never copied.  Goes through the spawn server if it runs.
+ */
+pid_t spawnCommand(const std::string &command,
+                   const std::string &displaystring = std::string());
+
+/*
+ * forks a small process which starts commands for us, so that even
+ * spawnCommand() never costs more than a message and a reply.  On Cygwin
+ * fork and vfork copy everything, so it is worth calling this before the
+ * window manager has grown.  The children of the server are not ours, so
+ * they cannot be waited for.
+ */
+bool startSpawnServer(void);
+void stopSpawnServer(void);
+bool isSpawnServerRunning(void);
+
+// starts command with the environment set for the window manager's display;
+// through the spawn server, it does not wait to hear how that went
+void bexec(const std::string& command, const std::string& displaystring);
+
+#endif // __Spawn_hh
@@ -0,0 +1,95 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Stacking.hh for XWinWM - the order a window and its transients go in
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Stacking_hh
+#define   __Stacking_hh
+
+#include <list>
+
+/*
+ * Workspace::raiseWindow() and lowerWindow() restack a window together
+ * with everything transient for it.  These walk the transients in the
+ * order they are stacked in, bottom first, and hand each to stack().  T
+ * is anything with getTransients() giving a std::list<T*>, so the walk
+ * can be measured without a window manager around it.
+ */
+
+// the number of windows transient for win, directly or not
+template <class T>
+unsigned int countTransients(const T *win) {
+  typedef std::list<T*> List;
+  const List &transients = win->getTransients();
+
+  unsigned int ret = transients.size();
+  typename List::const_iterator it = transients.begin(),
+    end = transients.end();
+  for (; it != end; ++it)
+    ret += countTransients(*it);
+
+  return ret;
+}
+
+
+// the window that is not a transient, at the top of the tree win is in
+template <class T>
+T *transientRoot(T *win) {
+  while (win->isTransient() && win->getTransientFor())
+    win = win->getTransientFor();
+  return win;
+}
+
+
+// each level of transients goes above the one it is transient for
+template <class T, class Stacker>
+void raiseTransients(const T *win, Stacker &stack) {
+  typedef std::list<T*> List;
+  const List &transients = win->getTransients();
+  if (transients.empty()) return; // nothing to do
+
+  // put win's transients in the stack
+  typename List::const_iterator it, end = transients.end();
+  for (it = transients.begin(); it != end; ++it)
+    stack(*it);
+
+  // put transients of win's transients in the stack
+  for (it = transients.begin(); it != end; ++it)
+    raiseTransients(*it, stack);
+}
+
+
+// the reverse of raiseTransients(), for stacking from the bottom up
+template <class T, class Stacker>
+void lowerTransients(const T *win, Stacker &stack) {
+  typedef std::list<T*> List;
+  const List &transients = win->getTransients();
+  if (transients.empty()) return; // nothing to do
+
+  // put transients of win's transients in the stack
+  typename List::const_reverse_iterator it, end = transients.rend();
+  for (it = transients.rbegin(); it != end; ++it)
+    lowerTransients(*it, stack);
+
+  // put win's transients in the stack
+  for (it = transients.rbegin(); it != end; ++it)
+    stack(*it);
+}
+
+#endif // __Stacking_hh
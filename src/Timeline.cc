@@ -0,0 +1,423 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Timeline.cc for XWinWM - a timeline of what xwinwm does, for trace viewers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#ifdef    HAVE_STDIO_H
+#  include <stdio.h>
+#endif // HAVE_STDIO_H
+
+#ifdef    HAVE_STDLIB_H
+#  include <stdlib.h>
+#endif // HAVE_STDLIB_H
+
+#ifdef    HAVE_UNISTD_H
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif // HAVE_UNISTD_H
+
+#ifdef    HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif // HAVE_FCNTL_H
+
+#ifdef    HAVE_SYS_STAT_H
+#  include <sys/stat.h>
+#endif // HAVE_SYS_STAT_H
+
+#include <errno.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#  include <pthread.h>
+#  define   TIMELINE_THREADS
+#endif
+}
+
+#include <string>
+
+#include "Timeline.hh"
+#include "Util.hh"
+
+using std::string;
+
+// how often the buffers are drained
+static const unsigned int WriteInterval = 10000; // us
+
+struct TimelineRecord {
+  unsigned long long time;
+  const char *category, *name;
+  unsigned long window;
+  unsigned int generation;
+  char phase;
+};
+
+// written by the thread that owns it, read by whoever drains it
+struct TimelineBuffer {
+  enum { Size = 8192 };
+
+  TimelineRecord records[Size];
+  unsigned long head, tail;
+  unsigned long dropped;
+  unsigned int id, named;       // the generation it was last named in
+  bool loop;
+  int owned;
+  TimelineBuffer *next;
+};
+
+unsigned int BTimeline::recording = 0;
+
+// the buffers are only ever added to, and taken over when their thread
+// is done with them
+static TimelineBuffer *buffers = (TimelineBuffer *) 0;
+static unsigned int buffer_count = 0;
+
+// the file and what goes with it belong to whoever has the lock
+static FILE *file = (FILE *) 0;
+static unsigned int file_generation = 0, last_generation = 0;
+static unsigned long long base_time = 0;
+// -timeline, or empty for the directory of our own
+static string file_name;
+
+#ifdef    TIMELINE_THREADS
+// static objects are made by the thread that runs main()
+static const pthread_t loop_thread = pthread_self();
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_key_t key;
+static bool writer = False;
+
+static void releaseBuffer(void *data);
+#endif // TIMELINE_THREADS
+
+
+BTimeline::Span::Span(const char *c, const char *n, unsigned long window)
+  : category(c), name(n), generation(0) {
+  const unsigned int g = __atomic_load_n(&recording, __ATOMIC_ACQUIRE);
+  // without the beginning, the end is left out too
+  if (g && put('B', category, name, window, g))
+    generation = g;
+}
+
+
+void BTimeline::Span::end(void) {
+  if (! generation)
+    return;
+
+  put('E', category, name, 0, generation);
+  generation = 0;
+}
+
+
+static TimelineBuffer *threadBuffer(void) {
+#ifdef    TIMELINE_THREADS
+  TimelineBuffer *b = (TimelineBuffer *) pthread_getspecific(key);
+  if (b)
+    return b;
+
+  // one left by a thread that has finished will do
+  for (b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); b; b = b->next) {
+    int unowned = 0;
+    if (__atomic_compare_exchange_n(&b->owned, &unowned, 1, False,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      break;
+  }
+
+  if (! b) {
+    b = new TimelineBuffer;
+    b->head = b->tail = b->dropped = 0;
+    b->id = __atomic_add_fetch(&buffer_count, 1, __ATOMIC_RELAXED);
+    b->named = 0;
+    // the event loop never finishes, so its buffer is never taken over
+    b->loop = pthread_equal(pthread_self(), loop_thread);
+    b->owned = 1;
+    b->next = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+    while (! __atomic_compare_exchange_n(&buffers, &b->next, b, False,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      ;
+  }
+
+  pthread_setspecific(key, b);
+  return b;
+#else // !TIMELINE_THREADS
+  if (! buffers) {
+    buffers = new TimelineBuffer;
+    buffers->head = buffers->tail = buffers->dropped = 0;
+    buffers->id = buffer_count = 1;
+    buffers->named = 0;
+    buffers->loop = True;
+    buffers->owned = 1;
+    buffers->next = (TimelineBuffer *) 0;
+  }
+  return buffers;
+#endif // TIMELINE_THREADS
+}
+
+
+#ifdef    TIMELINE_THREADS
+static void releaseBuffer(void *data) {
+  TimelineBuffer *b = (TimelineBuffer *) data;
+  __atomic_store_n(&b->owned, 0, __ATOMIC_RELEASE);
+}
+#endif // TIMELINE_THREADS
+
+
+bool BTimeline::put(char phase, const char *category, const char *name,
+                    unsigned long window, unsigned int generation) {
+  TimelineBuffer *b = threadBuffer();
+
+  const unsigned long head = b->head;
+  const unsigned long tail = __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE);
+  if (head - tail == TimelineBuffer::Size) {
+#ifdef    TIMELINE_THREADS
+    __atomic_fetch_add(&b->dropped, 1, __ATOMIC_RELAXED);
+    return False;
+#else // !TIMELINE_THREADS
+    // with nothing else running, the writer is whoever fills the buffer
+    drain();
+#endif // TIMELINE_THREADS
+  }
+
+  TimelineRecord &r = b->records[head % TimelineBuffer::Size];
+  r.time = monotonicTime();
+  r.category = category;
+  r.name = name;
+  r.window = window;
+  r.generation = generation;
+  r.phase = phase;
+  __atomic_store_n(&b->head, head + 1, __ATOMIC_RELEASE);
+  return True;
+}
+
+
+// with the lock held
+void BTimeline::drain(void) {
+  const int pid = getpid();
+
+  TimelineBuffer *b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+  for (; b; b = b->next) {
+    const unsigned long head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+    unsigned long tail = b->tail;
+
+    for (; tail != head; ++tail) {
+      const TimelineRecord &r = b->records[tail % TimelineBuffer::Size];
+      // what was begun for another file is not wanted in this one
+      if (! file || r.generation != file_generation)
+        continue;
+
+      if (b->named != file_generation) {
+        b->named = file_generation;
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                "\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"", pid, b->id);
+        if (b->loop)
+          fputs("event loop\"}}", file);
+        else
+          fprintf(file, "thread %u\"}}", b->id);
+      }
+
+      // the viewers take microseconds, with a fraction
+      const unsigned long long ns =
+        (r.time > base_time) ? r.time - base_time : 0;
+      fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+              "\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%u", r.name,
+              r.category, r.phase, ns / 1000, ns % 1000, pid, b->id);
+      if (r.window)
+        fprintf(file, ",\"args\":{\"window\":\"0x%lx\"}", r.window);
+      fputc('}', file);
+    }
+
+    __atomic_store_n(&b->tail, tail, __ATOMIC_RELEASE);
+  }
+}
+
+
+// with the lock held
+void BTimeline::finish(void) {
+  if (! file)
+    return;
+
+  __atomic_store_n(&recording, 0, __ATOMIC_RELEASE);
+  drain();
+
+  unsigned long dropped = 0;
+  for (TimelineBuffer *b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); b;
+       b = b->next)
+    dropped += __atomic_exchange_n(&b->dropped, 0, __ATOMIC_RELAXED);
+
+  if (dropped > 0)
+    fprintf(file, ",\n{\"name\":\"dropped\",\"ph\":\"i\",\"s\":\"g\","
+            "\"ts\":%llu,\"pid\":%d,\"tid\":0,\"args\":{\"spans\":%lu}}",
+            (monotonicTime() - base_time) / 1000, (int) getpid(), dropped);
+
+  fputs("\n]\n", file);
+  fclose(file);
+  file = (FILE *) 0;
+  file_generation = 0;
+}
+
+
+void BTimeline::setFile(const char *path) {
+  file_name = (path) ? path : "";
+}
+
+
+/*
+ * a directory only we can get into, so nobody else can put a link where
+ * the timeline is to go
+ */
+static bool privateDirectory(string &dir) {
+  const char *tmpdir = getenv("TMPDIR");
+  char uid[32];
+  sprintf(uid, "%lu", (unsigned long) getuid());
+  dir = (tmpdir && *tmpdir) ? tmpdir : "/tmp";
+  dir += "/xwinwm-";
+  dir += uid;
+
+  if (mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST)
+    return False;
+
+  struct stat st;
+  return (lstat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) &&
+          st.st_uid == getuid() && (st.st_mode & 077) == 0);
+}
+
+
+/*
+ * a file of our own making: nothing already there is ever written to, so
+ * each recording, and each restart, gets the next free number
+ */
+static FILE *createFile(string &path) {
+  string base = file_name;
+  if (base.empty()) {
+    if (! privateDirectory(base))
+      return (FILE *) 0;
+    base += "/timeline.json";
+  }
+
+  // the number goes before the extension, so viewers still know the file
+  string stem = base, extension;
+  const string::size_type dot = base.rfind('.');
+  if (dot != string::npos && base.find('/', dot) == string::npos) {
+    stem = base.substr(0, dot);
+    extension = base.substr(dot);
+  }
+
+  int flags = O_WRONLY | O_CREAT | O_EXCL;
+#ifdef    O_NOFOLLOW
+  flags |= O_NOFOLLOW;
+#endif // O_NOFOLLOW
+
+  for (unsigned int n = 0; n < 1000; ++n) {
+    path = base;
+    if (n > 0) {
+      char number[16];
+      sprintf(number, ".%u", n);
+      path = stem + number + extension;
+    }
+
+    const int fd = open(path.c_str(), flags, 0600);
+    if (fd != -1) {
+      FILE *f = fdopen(fd, "w");
+      if (! f)
+        close(fd);
+      return f;
+    }
+    if (errno != EEXIST)
+      break;
+  }
+  return (FILE *) 0;
+}
+
+
+bool BTimeline::start(string &path) {
+#ifdef    TIMELINE_THREADS
+  pthread_mutex_lock(&lock);
+#endif // TIMELINE_THREADS
+
+  finish();
+
+  file = createFile(path);
+  if (file) {
+    base_time = monotonicTime();
+    file_generation = ++last_generation;
+    fprintf(file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":0,\"args\":{\"name\":\"xwinwm\"}}", (int) getpid());
+
+#ifdef    TIMELINE_THREADS
+    if (! writer) {
+      pthread_t thread;
+      writer = (pthread_key_create(&key, releaseBuffer) == 0 &&
+                pthread_create(&thread, 0, threadMain, 0) == 0);
+      if (writer)
+        pthread_detach(thread);
+    }
+
+    if (! writer) {
+      fclose(file);
+      file = (FILE *) 0;
+      file_generation = 0;
+    }
+#endif // TIMELINE_THREADS
+  }
+
+  if (file) {
+    __atomic_store_n(&recording, file_generation, __ATOMIC_RELEASE);
+#ifdef    TIMELINE_THREADS
+    pthread_cond_signal(&wakeup);
+#endif // TIMELINE_THREADS
+  }
+
+  const bool started = (file != (FILE *) 0);
+#ifdef    TIMELINE_THREADS
+  pthread_mutex_unlock(&lock);
+#endif // TIMELINE_THREADS
+  return started;
+}
+
+
+void BTimeline::stop(void) {
+#ifdef    TIMELINE_THREADS
+  pthread_mutex_lock(&lock);
+  finish();
+  pthread_mutex_unlock(&lock);
+#else // !TIMELINE_THREADS
+  finish();
+#endif // TIMELINE_THREADS
+}
+
+
+void *BTimeline::threadMain(void *) {
+#ifdef    TIMELINE_THREADS
+  pthread_mutex_lock(&lock);
+  for (;;) {
+    while (! file)
+      pthread_cond_wait(&wakeup, &lock);
+
+    drain();
+
+    pthread_mutex_unlock(&lock);
+    usleep(WriteInterval);
+    pthread_mutex_lock(&lock);
+  }
+#endif // TIMELINE_THREADS
+  return 0;
+}
@@ -0,0 +1,85 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Timeline.hh for XWinWM - a timeline of what xwinwm does, for trace viewers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Timeline_hh
+#define   __Timeline_hh
+
+#include <string>
+
+/*
+ * Writes spans to a file in the Chrome trace event format, which
+ * chrome://tracing and the Perfetto UI open as a timeline: the events
+ * handled, the operations they led to (manage, unmanage, configure,
+ * raise, lower, focus, workspace switch and reconfigure) and the Xlib
+ * calls that waited for the server, on whichever thread made them.
+ *
+ * Recording is started with -timeline, or at any time by setting the
+ * _XWINWM_TIMELINE property of a root window, to anything,
+ *
+ *   xprop -root -f _XWINWM_TIMELINE 8s -set _XWINWM_TIMELINE on
+ *
+ * and stopped by removing it again.  Only xwinwm decides where the file
+ * goes: where -timeline says, or else timeline.json in a directory of
+ * its own, $TMPDIR/xwinwm-<uid>.  A file that is there already is never
+ * written over; the name is numbered instead, timeline.1.json and so on.
+ *
+ * Each thread puts its spans in a buffer of its own without taking a
+ * lock, and a thread of the timeline writes them out every few
+ * milliseconds; if a buffer fills up before then, what does not fit is
+ * dropped and counted in the file.  Built without threads, the one
+ * buffer is written out whenever it fills.
+ */
+class BTimeline {
+public:
+  // from here to end() or the end of the scope, if recording
+  class Span {
+  public:
+    Span(const char *category, const char *name, unsigned long window = 0);
+    inline ~Span(void) { end(); }
+
+    void end(void);
+
+  private:
+    const char *category, *name;
+    unsigned int generation;
+  };
+
+  // where the files go, 0 for the directory of our own
+  static void setFile(const char *path);
+  // starts a new file, after the one being written is finished; path is
+  // set to its name
+  static bool start(std::string &path);
+  static void stop(void);
+  static inline bool active(void)
+    { return __atomic_load_n(&recording, __ATOMIC_ACQUIRE) != 0; }
+
+private:
+  // the generation being recorded, 0 if none is
+  static unsigned int recording;
+
+  static bool put(char phase, const char *category, const char *name,
+                  unsigned long window, unsigned int generation);
+  static void drain(void);
+  static void finish(void);
+  static void *threadMain(void *data);
+};
+
+#endif // __Timeline_hh
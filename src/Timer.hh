@@ -46,6 +46,24 @@ public:
   virtual void timeout(void) = 0;
 };
 
+/*
+ * forwards a timeout to a member function, so one object can own more
+ * than one timer
+ */
+template <class T>
+class BTimerForward: public TimeoutHandler {
+public:
+  typedef void (T::*Handler)(void);
+
+  BTimerForward(T *o, Handler h): object(o), handler(h) {}
+
+  virtual void timeout(void) { (object->*handler)(); }
+
+private:
+  T *object;
+  Handler handler;
+};
+
 class BTimer {
 private:
   TimerQueueManager *manager;
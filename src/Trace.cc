@@ -0,0 +1,384 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Trace.cc for XWinWM - a flight recorder for the event loop
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+
+#ifdef    HAVE_STDIO_H
+#  include <stdio.h>
+#endif // HAVE_STDIO_H
+
+#include <errno.h>
+
+#ifdef    HAVE_STRING_H
+#  include <string.h>
+#endif // HAVE_STRING_H
+
+#ifdef    HAVE_UNISTD_H
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif // HAVE_UNISTD_H
+
+#ifdef    HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif // HAVE_FCNTL_H
+
+#ifdef    HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif // HAVE_SYS_MMAN_H
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#  include <pthread.h>
+#  define   TRACE_LOCKING
+#endif
+}
+
+#include <algorithm>
+#include <string>
+
+#include "Trace.hh"
+#include "Util.hh"
+
+using std::string;
+
+
+#ifdef    TRACE_LOCKING
+#  define LOCK()   pthread_mutex_lock((pthread_mutex_t *) lock)
+#  define UNLOCK() pthread_mutex_unlock((pthread_mutex_t *) lock)
+#else // !TRACE_LOCKING
+#  define LOCK()
+#  define UNLOCK()
+#endif // TRACE_LOCKING
+
+
+static const char TraceMagic[8] = {
+  'X', 'W', 'W', 'M', 'T', 'R', 'C', 'E'
+};
+static const unsigned int TraceVersion = 1;
+static const unsigned int MaxScreens = 8, AtomSlots = 2048,
+  AtomNameSize = 56;
+// the ring starts on a page of its own
+static const unsigned long RingOffset = 256 * 1024;
+
+/*
+ * the layout is the native one, as the trace is read back by the same
+ * build, if not on the same machine; the sizes it was written with are
+ * kept to tell
+ */
+struct BTrace::Header {
+  char magic[8];
+  unsigned int version;
+  unsigned int long_size, record_size, event_size;
+  unsigned long long capacity;
+  // every byte ever written, and where the oldest record kept starts
+  volatile unsigned long long head, tail;
+  unsigned int screen_count, atom_count;
+  BTraceScreen screens[MaxScreens];
+  struct {
+    unsigned long atom;
+    char name[AtomNameSize];
+  } atoms[AtomSlots];
+};
+
+
+BTrace *BTrace::trace = (BTrace *) 0;
+
+
+BTrace::BTrace(void)
+  : map((unsigned char *) 0), map_size(0), header((Header *) 0),
+    ring((unsigned char *) 0), too_large(0), lock((void *) 0) {
+#ifdef    TRACE_LOCKING
+  pthread_mutex_t *mutex = new pthread_mutex_t;
+  pthread_mutex_init(mutex, 0);
+  lock = mutex;
+#endif // TRACE_LOCKING
+}
+
+
+BTrace::~BTrace(void) {
+  if (map) {
+    msync(map, map_size, MS_ASYNC);
+    munmap(map, map_size);
+  }
+
+#ifdef    TRACE_LOCKING
+  pthread_mutex_destroy((pthread_mutex_t *) lock);
+  delete (pthread_mutex_t *) lock;
+#endif // TRACE_LOCKING
+}
+
+
+bool BTrace::start(const char *path, unsigned long size) {
+  if (trace)
+    return True;
+
+  BTrace *t = new BTrace;
+  if (! t->open(path, size)) {
+    delete t;
+    return False;
+  }
+
+  trace = t;
+  return True;
+}
+
+
+void BTrace::stop(void) {
+  BTrace *t = trace;
+  trace = (BTrace *) 0;
+  delete t;
+}
+
+
+bool BTrace::open(const char *path, unsigned long size) {
+  // whole records, and room for the largest to make it in
+  const unsigned long capacity = std::max(size, 1024ul * 1024ul) & ~15ul;
+
+  const int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1) {
+    perror(path);
+    return False;
+  }
+
+  map_size = RingOffset + capacity;
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, map_size) == 0)
+    p = mmap(0, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    perror(path);
+  // the mapping lasts without it
+  close(fd);
+  if (p == MAP_FAILED)
+    return False;
+
+  map = (unsigned char *) p;
+  header = (Header *) map;
+  ring = map + RingOffset;
+
+  memset(header, 0, sizeof(Header));
+  header->version = TraceVersion;
+  header->long_size = sizeof(long);
+  header->record_size = sizeof(BTraceRecord);
+  header->event_size = sizeof(XEvent);
+  header->capacity = capacity;
+  // the magic goes last, once the rest can be believed
+  memcpy(header->magic, TraceMagic, sizeof(header->magic));
+  return True;
+}
+
+
+void BTrace::recordScreens(Display *display) {
+  LOCK();
+  if (header->screen_count == 0) {
+    const int count = std::min(ScreenCount(display), (int) MaxScreens);
+    for (int i = 0; i < count; ++i) {
+      BTraceScreen &s = header->screens[i];
+      const Visual *visual = DefaultVisual(display, i);
+      s.root = RootWindow(display, i);
+      s.width = DisplayWidth(display, i);
+      s.height = DisplayHeight(display, i);
+      s.depth = DefaultDepth(display, i);
+      s.visual_class = visual->c_class;
+      s.red_mask = visual->red_mask;
+      s.green_mask = visual->green_mask;
+      s.blue_mask = visual->blue_mask;
+    }
+    header->screen_count = count;
+  }
+  UNLOCK();
+}
+
+
+void BTrace::recordAtom(Atom atom, const char *name) {
+  if (atom == None || strlen(name) >= AtomNameSize)
+    return;
+
+  LOCK();
+  unsigned int i = 0;
+  for (; i < header->atom_count; ++i) {
+    if (header->atoms[i].atom == atom)
+      break;
+  }
+  if (i == header->atom_count && i < AtomSlots) {
+    header->atoms[i].atom = atom;
+    strcpy(header->atoms[i].name, name);
+    header->atom_count = i + 1;
+  }
+  UNLOCK();
+}
+
+
+void BTrace::recordEvent(const XEvent &e) {
+  record(Event, 0, e.xany.window, e.type, &e, sizeof(e));
+}
+
+
+// drops the oldest records until size more bytes fit
+void BTrace::makeRoom(unsigned long size) {
+  while (header->head + size - header->tail > header->capacity) {
+    const unsigned long offset = header->tail % header->capacity;
+    if (header->capacity - offset < sizeof(BTraceRecord)) {
+      // too short for a pad record, but padding all the same
+      header->tail += header->capacity - offset;
+      continue;
+    }
+
+    const BTraceRecord *r = (const BTraceRecord *) (ring + offset);
+    header->tail += r->size;
+  }
+}
+
+
+void BTrace::record(Kind kind, int status, Window window, unsigned long key,
+                    const void *data, unsigned long length,
+                    const void *more, unsigned long more_length) {
+  const unsigned long size =
+    (sizeof(BTraceRecord) + length + more_length + 15) & ~15ul;
+
+  LOCK();
+
+  // an icon or two would push out everything else
+  if (size > header->capacity / 4) {
+    ++too_large;
+    UNLOCK();
+    return;
+  }
+
+  // records are never split, the end of the ring is padded instead
+  unsigned long offset = header->head % header->capacity;
+  if (offset + size > header->capacity) {
+    const unsigned long pad = header->capacity - offset;
+    makeRoom(pad);
+
+    if (pad >= sizeof(BTraceRecord)) {
+      BTraceRecord *r = (BTraceRecord *) (ring + offset);
+      memset(r, 0, sizeof(BTraceRecord));
+      r->size = pad;
+      r->kind = Pad;
+    }
+    header->head += pad;
+    offset = 0;
+  }
+
+  makeRoom(size);
+
+  BTraceRecord *r = (BTraceRecord *) (ring + offset);
+  r->size = size;
+  r->kind = kind;
+  r->status = status;
+  r->time = monotonicTime();
+  r->window = window;
+  r->key = key;
+
+  unsigned char *payload = (unsigned char *) (r + 1);
+  if (length > 0)
+    memcpy(payload, data, length);
+  if (more_length > 0)
+    memcpy(payload + length, more, more_length);
+
+  // the record is only counted once it is all there
+  header->head += size;
+
+  UNLOCK();
+}
+
+
+BTraceReader::BTraceReader(void): position(0), end(0) {}
+
+
+BTraceReader::~BTraceReader(void) {}
+
+
+bool BTraceReader::open(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (! f) {
+    message = string(path) + ": " + strerror(errno);
+    return False;
+  }
+
+  BTrace::Header *header = new BTrace::Header;
+  bool ok = fread(header, sizeof(BTrace::Header), 1, f) == 1 &&
+    memcmp(header->magic, TraceMagic, sizeof(header->magic)) == 0;
+  if (! ok) {
+    message = string(path) + ": not a trace";
+  } else if (header->version != TraceVersion ||
+             header->long_size != sizeof(long) ||
+             header->record_size != sizeof(BTraceRecord) ||
+             header->event_size != sizeof(XEvent)) {
+    message = string(path) + ": written by another kind of build";
+    ok = False;
+  }
+
+  if (ok) {
+    ring.resize(header->capacity);
+    ok = fseek(f, RingOffset, SEEK_SET) == 0 &&
+      fread(&ring[0], 1, ring.size(), f) == ring.size();
+    if (! ok)
+      message = string(path) + ": the trace is cut short";
+  }
+  fclose(f);
+
+  if (ok) {
+    screen_list.assign(header->screens,
+                       header->screens + std::min(header->screen_count,
+                                                  MaxScreens));
+    for (unsigned int i = 0; i < std::min(header->atom_count, AtomSlots);
+         ++i)
+      atom_list.push_back(std::make_pair((Atom) header->atoms[i].atom,
+                                         string(header->atoms[i].name)));
+    position = header->tail;
+    end = header->head;
+  }
+
+  delete header;
+  return ok;
+}
+
+
+bool BTraceReader::next(std::vector<unsigned char> &record) {
+  while (position < end) {
+    const unsigned long offset = position % ring.size();
+    if (ring.size() - offset < sizeof(BTraceRecord)) {
+      position += ring.size() - offset;
+      continue;
+    }
+
+    const BTraceRecord *r = (const BTraceRecord *) &ring[offset];
+    if (r->size < sizeof(BTraceRecord) || (r->size & 15) ||
+        offset + r->size > ring.size()) {
+      // torn by a crash in the middle of a write
+      position = end;
+      break;
+    }
+
+    position += r->size;
+    if (r->kind == BTrace::Pad)
+      continue;
+
+    record.assign(&ring[offset], &ring[offset] + r->size);
+    return True;
+  }
+  return False;
+}
@@ -0,0 +1,152 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Trace.hh for XWinWM - a flight recorder for the event loop
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Trace_hh
+#define   __Trace_hh
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+}
+
+#include <string>
+#include <vector>
+
+/*
+ * With -trace, every event that reaches Blackbox::process_event() is
+ * written to a ring in a file mapped into memory, with the time it was
+ * handled.  So are the replies to the questions xwinwm asks the server
+ * about windows, their properties, attributes, children and ICCCM hints,
+ * which are asked through the calls in TracedCalls.hh, the extensions it
+ * looks for, the windows it creates and the atoms it interns.  Once the
+ * ring is full the oldest records make way, and as the file is shared,
+ * whatever was recorded survives a crash.  The size of the ring is
+ * session.traceSize, in megabytes.
+ *
+ * bench/replay reads a trace back and feeds the events through
+ * process_event() again, on a display that answers from the replies, so
+ * a session that went wrong can be profiled and stepped through off the
+ * machine it happened on.
+ */
+
+// one screen as the server described it
+struct BTraceScreen {
+  unsigned long root;
+  int width, height, depth, visual_class;
+  unsigned long red_mask, green_mask, blue_mask;
+};
+
+// what every record starts with; records are a multiple of 16 bytes
+struct BTraceRecord {
+  unsigned int size;            // the whole record, this included
+  unsigned short kind;
+  short status;                 // what the call returned
+  unsigned long long time;      // ns on the monotonic clock
+  unsigned long window;
+  unsigned long key;            // the atom of a property, the event type
+};
+
+// the fixed part of a property reply, the data follows it
+struct BTraceProperty {
+  long offset;                  // as asked for
+  unsigned long type;
+  int format;
+  unsigned long nitems, bytes_after;
+};
+
+class BTrace {
+public:
+  enum Kind { Pad = 0, Event, Property, Attributes, Tree, Focus,
+              WMHints, NormalHints, WMName, WMIconName, Protocols,
+              TransientFor, Extension, Created, KindCount };
+
+  // starts recording, returns False if the file cannot be set up
+  static bool start(const char *path, unsigned long size);
+  static void stop(void);
+  // the recorder, if one was started
+  static inline BTrace *active(void) { return trace; }
+
+  void recordScreens(Display *display);
+  void recordAtom(Atom atom, const char *name);
+  void recordEvent(const XEvent &e);
+  void record(Kind kind, int status, Window window, unsigned long key,
+              const void *data, unsigned long length,
+              const void *more = 0, unsigned long more_length = 0);
+
+  inline unsigned long dropped(void) const { return too_large; }
+
+private:
+  struct Header;
+
+  static BTrace *trace;
+
+  unsigned char *map;
+  unsigned long map_size;
+  Header *header;
+  unsigned char *ring;
+  unsigned long too_large;
+  void *lock;
+
+  BTrace(void);
+  ~BTrace(void);
+  BTrace(const BTrace &_nocopy);
+  BTrace &operator=(const BTrace &_nocopy);
+
+  bool open(const char *path, unsigned long size);
+  void makeRoom(unsigned long size);
+
+  friend class BTraceReader;
+};
+
+/*
+ * reads a trace, oldest record first.  The records and their payloads
+ * are copied out, so the trace can still be growing.
+ */
+class BTraceReader {
+public:
+  typedef std::vector<BTraceScreen> ScreenList;
+  typedef std::vector<std::pair<Atom, std::string> > AtomList;
+
+  BTraceReader(void);
+  ~BTraceReader(void);
+
+  // returns False with a message in error() if it is not a trace
+  bool open(const char *path);
+  inline const std::string &error(void) const { return message; }
+
+  inline const ScreenList &screens(void) const { return screen_list; }
+  inline const AtomList &atoms(void) const { return atom_list; }
+
+  // the next record, its payload after it; returns False at the end
+  bool next(std::vector<unsigned char> &record);
+
+private:
+  std::vector<unsigned char> ring;
+  unsigned long long position, end;
+  ScreenList screen_list;
+  AtomList atom_list;
+  std::string message;
+
+  BTraceReader(const BTraceReader &_nocopy);
+  BTraceReader &operator=(const BTraceReader &_nocopy);
+};
+
+#endif // __Trace_hh
@@ -0,0 +1,287 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// TracedCalls.cc for XWinWM - the Xlib calls whose answers are traced
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#ifdef    HAVE_STRING_H
+#  include <string.h>
+#endif // HAVE_STRING_H
+
+#ifdef    SHAPE
+#  include <X11/extensions/shape.h>
+#endif // SHAPE
+}
+
+#include "RoundTrips.hh"
+#include "Trace.hh"
+#include "TracedCalls.hh"
+
+// the name, encoding and format come first, the text after them
+static void recordText(BTrace::Kind kind, Status status, Window w,
+                       const XTextProperty &text) {
+  const unsigned long header[3] = {
+    text.encoding, (unsigned long) text.format, text.nitems
+  };
+  unsigned long length = 0;
+  if (status && text.value)
+    length = text.nitems * (text.format == 32 ? sizeof(long) :
+                            text.format == 16 ? sizeof(short) : 1);
+  BTrace::active()->record(kind, status ? 1 : 0, w, 0, header,
+                           sizeof(header), text.value, length);
+}
+
+
+Display *tracedOpenDisplay(const char *name) {
+  Display *display = XOpenDisplay(name);
+  if (display && BTrace::active())
+    BTrace::active()->recordScreens(display);
+  return display;
+}
+
+
+// the opcode and the bases, with the name after them
+static void recordExtension(const char *name, Bool ret, int opcode,
+                            int event_base, int error_base) {
+  const int bases[3] = { opcode, event_base, error_base };
+  BTrace::active()->record(BTrace::Extension, ret ? 1 : 0, None, 0,
+                           bases, sizeof(bases), name, strlen(name));
+}
+
+
+Bool tracedQueryExtension(Display *display, const char *name, int *opcode,
+                          int *event_base, int *error_base) {
+  Bool ret = BROUNDTRIP(QueryExtension,
+                        XQueryExtension(display, name, opcode, event_base,
+                                        error_base));
+  if (BTrace::active())
+    recordExtension(name, ret, *opcode, *event_base, *error_base);
+  return ret;
+}
+
+
+#ifdef    SHAPE
+Bool tracedShapeQueryExtension(Display *display, int *event_base,
+                               int *error_base) {
+  Bool ret = BROUNDTRIP(QueryExtension,
+                        XShapeQueryExtension(display, event_base,
+                                             error_base));
+  if (BTrace::active())
+    recordExtension(SHAPENAME, ret, 0, *event_base, *error_base);
+  return ret;
+}
+#endif // SHAPE
+
+
+Window tracedCreateWindow(Display *display, Window parent, int x, int y,
+                          unsigned int width, unsigned int height,
+                          unsigned int border_width, int depth,
+                          unsigned int klass, Visual *visual,
+                          unsigned long valuemask,
+                          XSetWindowAttributes *attributes) {
+  Window w = XCreateWindow(display, parent, x, y, width, height,
+                           border_width, depth, klass, visual, valuemask,
+                           attributes);
+  if (BTrace::active())
+    BTrace::active()->record(BTrace::Created, 0, w, parent, 0, 0);
+  return w;
+}
+
+
+Atom tracedInternAtom(Display *display, const char *name,
+                      Bool only_if_exists) {
+  BRoundTrips::Wait wait(BRoundTrips::InternAtom);
+  Atom atom = XInternAtom(display, name, only_if_exists);
+  wait.finish();
+  if (BTrace::active())
+    BTrace::active()->recordAtom(atom, name);
+  return atom;
+}
+
+
+int tracedGetWindowProperty(Display *display, Window w, Atom property,
+                            long offset, long length, Bool remove,
+                            Atom req_type, Atom *type, int *format,
+                            unsigned long *nitems,
+                            unsigned long *bytes_after,
+                            unsigned char **value) {
+  BRoundTrips::Wait wait(BRoundTrips::GetWindowProperty);
+  int ret = XGetWindowProperty(display, w, property, offset, length, remove,
+                               req_type, type, format, nitems, bytes_after,
+                               value);
+  wait.finish();
+  if (BTrace::active()) {
+    if (ret == Success)
+      traceProperty(w, property, offset, ret, *type, *format, *nitems,
+                    *bytes_after, *value);
+    else
+      traceProperty(w, property, offset, ret, None, 0, 0, 0, 0);
+  }
+  return ret;
+}
+
+
+// format 32 values are longs, as Xlib hands them over
+void traceProperty(Window w, Atom property, long offset, int status,
+                   Atom type, int format, unsigned long nitems,
+                   unsigned long bytes_after, const void *value) {
+  if (! BTrace::active())
+    return;
+
+  BTraceProperty reply;
+  reply.offset = offset;
+  reply.type = type;
+  reply.format = format;
+  reply.nitems = nitems;
+  reply.bytes_after = bytes_after;
+  unsigned long size = 0;
+  if (value)
+    size = nitems * (format == 32 ? sizeof(long) :
+                     format == 16 ? sizeof(short) : 1);
+  BTrace::active()->record(BTrace::Property, status, w, property,
+                           &reply, sizeof(reply), size ? value : 0, size);
+}
+
+
+Status tracedGetWindowAttributes(Display *display, Window w,
+                                 XWindowAttributes *attributes) {
+  BRoundTrips::Wait wait(BRoundTrips::GetWindowAttributes);
+  Status ret = XGetWindowAttributes(display, w, attributes);
+  wait.finish();
+  if (BTrace::active())
+    BTrace::active()->record(BTrace::Attributes, ret, w, 0, attributes,
+                             ret ? sizeof(XWindowAttributes) : 0);
+  return ret;
+}
+
+
+Status tracedQueryTree(Display *display, Window w, Window *root,
+                       Window *parent, Window **children,
+                       unsigned int *count) {
+  BRoundTrips::Wait wait(BRoundTrips::QueryTree);
+  Status ret = XQueryTree(display, w, root, parent, children, count);
+  wait.finish();
+  if (BTrace::active()) {
+    Window family[2] = { None, None };
+    unsigned long length = 0;
+    if (ret) {
+      family[0] = *root;
+      family[1] = *parent;
+      if (*children)
+        length = *count * sizeof(Window);
+    }
+    BTrace::active()->record(BTrace::Tree, ret, w, 0, family,
+                             sizeof(family), length ? *children : 0, length);
+  }
+  return ret;
+}
+
+
+int tracedGetInputFocus(Display *display, Window *focus, int *revert_to) {
+  BRoundTrips::Wait wait(BRoundTrips::GetInputFocus);
+  int ret = XGetInputFocus(display, focus, revert_to);
+  wait.finish();
+  if (BTrace::active())
+    BTrace::active()->record(BTrace::Focus, ret, *focus, *revert_to,
+                             0, 0);
+  return ret;
+}
+
+
+void traceInputFocus(Window focus, int revert_to) {
+  if (BTrace::active())
+    BTrace::active()->record(BTrace::Focus, 1, focus, revert_to, 0, 0);
+}
+
+
+XWMHints *tracedGetWMHints(Display *display, Window w) {
+  BRoundTrips::Wait wait(BRoundTrips::GetWMHints);
+  XWMHints *hints = XGetWMHints(display, w);
+  wait.finish();
+  if (BTrace::active())
+    BTrace::active()->record(BTrace::WMHints, hints ? 1 : 0, w, 0, hints,
+                             hints ? sizeof(XWMHints) : 0);
+  return hints;
+}
+
+
+Status tracedGetWMNormalHints(Display *display, Window w, XSizeHints *hints,
+                              long *supplied) {
+  BRoundTrips::Wait wait(BRoundTrips::GetWMNormalHints);
+  Status ret = XGetWMNormalHints(display, w, hints, supplied);
+  wait.finish();
+  if (BTrace::active())
+    BTrace::active()->record(BTrace::NormalHints, ret, w,
+                             ret ? *supplied : 0, hints,
+                             ret ? sizeof(XSizeHints) : 0);
+  return ret;
+}
+
+
+Status tracedGetWMName(Display *display, Window w, XTextProperty *name) {
+  BRoundTrips::Wait wait(BRoundTrips::GetWMName);
+  Status ret = XGetWMName(display, w, name);
+  wait.finish();
+  if (BTrace::active())
+    recordText(BTrace::WMName, ret, w, *name);
+  return ret;
+}
+
+
+Status tracedGetWMIconName(Display *display, Window w, XTextProperty *name) {
+  BRoundTrips::Wait wait(BRoundTrips::GetWMIconName);
+  Status ret = XGetWMIconName(display, w, name);
+  wait.finish();
+  if (BTrace::active())
+    recordText(BTrace::WMIconName, ret, w, *name);
+  return ret;
+}
+
+
+Status tracedGetWMProtocols(Display *display, Window w, Atom **protocols,
+                            int *count) {
+  BRoundTrips::Wait wait(BRoundTrips::GetWMProtocols);
+  Status ret = XGetWMProtocols(display, w, protocols, count);
+  wait.finish();
+  if (BTrace::active())
+    BTrace::active()->record(BTrace::Protocols, ret, w, 0,
+                             ret ? *protocols : 0,
+                             ret ? *count * sizeof(Atom) : 0);
+  return ret;
+}
+
+
+Status tracedGetTransientForHint(Display *display, Window w,
+                                 Window *transient) {
+  BRoundTrips::Wait wait(BRoundTrips::GetTransientForHint);
+  Status ret = XGetTransientForHint(display, w, transient);
+  wait.finish();
+  if (BTrace::active())
+    BTrace::active()->record(BTrace::TransientFor, ret, w,
+                             ret ? *transient : None, 0, 0);
+  return ret;
+}
+
@@ -0,0 +1,83 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// TracedCalls.hh for XWinWM - the Xlib calls whose answers are traced
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __TracedCalls_hh
+#define   __TracedCalls_hh
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+}
+
+/*
+ * The Xlib calls whose answers xwinwm goes by are made through these
+ * instead, with the same arguments.  Each makes the Xlib call, counts the
+ * wait with BRoundTrips if it makes one, and with -trace puts the answer
+ * in the trace, so bench/replay can give it again.  Nothing is caught on
+ * its way out of Xlib, so whatever is not made through here is not
+ * recorded; the calls that are only counted are wrapped in BROUNDTRIP()
+ * where they are made.
+ */
+
+Display *tracedOpenDisplay(const char *name);
+Bool tracedQueryExtension(Display *display, const char *name, int *opcode,
+                          int *event_base, int *error_base);
+#ifdef    SHAPE
+Bool tracedShapeQueryExtension(Display *display, int *event_base,
+                               int *error_base);
+#endif // SHAPE
+Window tracedCreateWindow(Display *display, Window parent, int x, int y,
+                          unsigned int width, unsigned int height,
+                          unsigned int border_width, int depth,
+                          unsigned int klass, Visual *visual,
+                          unsigned long valuemask,
+                          XSetWindowAttributes *attributes);
+Atom tracedInternAtom(Display *display, const char *name,
+                      Bool only_if_exists);
+int tracedGetWindowProperty(Display *display, Window w, Atom property,
+                            long offset, long length, Bool remove,
+                            Atom req_type, Atom *type, int *format,
+                            unsigned long *nitems,
+                            unsigned long *bytes_after,
+                            unsigned char **value);
+Status tracedGetWindowAttributes(Display *display, Window w,
+                                 XWindowAttributes *attributes);
+Status tracedQueryTree(Display *display, Window w, Window *root,
+                       Window *parent, Window **children,
+                       unsigned int *count);
+int tracedGetInputFocus(Display *display, Window *focus, int *revert_to);
+XWMHints *tracedGetWMHints(Display *display, Window w);
+Status tracedGetWMNormalHints(Display *display, Window w, XSizeHints *hints,
+                              long *supplied);
+Status tracedGetWMName(Display *display, Window w, XTextProperty *name);
+Status tracedGetWMIconName(Display *display, Window w, XTextProperty *name);
+Status tracedGetWMProtocols(Display *display, Window w, Atom **protocols,
+                            int *count);
+Status tracedGetTransientForHint(Display *display, Window w,
+                                 Window *transient);
+
+// for the replies read off the wire instead, as BPropertyFetcher does
+void traceProperty(Window w, Atom property, long offset, int status,
+                   Atom type, int format, unsigned long nitems,
+                   unsigned long bytes_after, const void *value);
+void traceInputFocus(Window focus, int revert_to);
+
+#endif // __TracedCalls_hh
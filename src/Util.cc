@@ -48,13 +48,14 @@ extern "C" {
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif // HAVE_UNISTD_H
-#if defined(HAVE_PROCESS_H) && defined(__EMX__)
-#  include <process.h>
-#endif //   HAVE_PROCESS_H             __EMX__
 
 #include <assert.h>
 }
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif // __SSE2__
+
 #include <algorithm>
 
 #include "Util.hh"
@@ -153,23 +154,6 @@ string expandTilde(const string& s) {
 }
 
 
-void bexec(const string& command, const string& displaystring) {
-#ifndef    __EMX__
-  if (! fork()) {
-    setsid();
-    int ret = putenv(const_cast<char *>(displaystring.c_str()));
-    assert(ret != -1);
-    string cmd = "exec ";
-    cmd += command;
-    ret = execl("/bin/sh", "/bin/sh", "-c", cmd.c_str(), NULL);
-    exit(ret);
-  }
-#else //   __EMX__
-  spawnlp(P_NOWAIT, "cmd.exe", "cmd.exe", "/c", command, NULL);
-#endif // !__EMX__
-}
-
-
 #ifndef   HAVE_BASENAME
 string basename (const string& path) {
   string::size_type slash = path.rfind('/');
@@ -180,31 +164,156 @@ string basename (const string& path) {
 #endif // HAVE_BASENAME
 
 
-string textPropertyToString(Display *display, XTextProperty& text_prop) {
+/*
+ * Returns the text of a property as UTF-8.  STRING, and COMPOUND_TEXT
+ * without any escape sequences, are Latin-1 and UTF8_STRING is already
+ * UTF-8, so these are converted here.  Only the remaining compound text
+ * goes through Xlib's locale converters.  The caller has the two atoms
+ * interned already, so nothing here waits on the server.
+ */
+string textPropertyToString(Display *display, XTextProperty& text_prop,
+                            Atom utf8_string, Atom compound_text) {
   string ret;
 
-  if (text_prop.value && text_prop.nitems > 0) {
-    if (text_prop.encoding == XA_STRING) {
-      ret = (char *) text_prop.value;
-    } else {
-      text_prop.nitems = strlen((char *) text_prop.value);
-
-      char **list;
-      int num;
-      int r = XmbTextPropertyToTextList(display, &text_prop,
-                                        &list, &num);
-      if ((r == Success||r > 0)&&
-          num > 0 && *list) {
-        for (int i = 0; i < num; i++)
-          {
-            ret += list[i];
-          }
-        XFreeStringList(list);
+  if (! text_prop.value || text_prop.nitems == 0 || text_prop.format != 8)
+    return ret;
+
+  // only the first string of a list is used
+  const char *value = (const char *) text_prop.value;
+  const char *nul = (const char *) memchr(value, '\0', text_prop.nitems);
+  size_t len = nul ? nul - value : text_prop.nitems;
+
+  if (text_prop.encoding == utf8_string) {
+    if (isValidUTF8(value, len))
+      ret.assign(value, len);
+    else
+      latin1ToUTF8(value, len, ret);
+    return ret;
+  }
+
+  if (text_prop.encoding == XA_STRING ||
+      (text_prop.encoding == compound_text &&
+       ! memchr(value, 0x1b, len) && ! memchr(value, 0x9b, len))) {
+    latin1ToUTF8(value, len, ret);
+    return ret;
+  }
+
+  char **list;
+  int num;
+  int r = Xutf8TextPropertyToTextList(display, &text_prop, &list, &num);
+  if ((r == Success || r > 0) && num > 0 && *list) {
+    ret = list[0];
+    XFreeStringList(list);
+  }
+
+  return ret;
+}
+
+
+/*
+ * Titles are mostly ASCII, so both of these skip over runs of ASCII
+ * sixteen bytes at a time where SSE2 is available.  That is all SSE2 is
+ * used for: multibyte sequences are checked, and converted, a byte at a
+ * time.
+ */
+#if defined(__SSE2__)
+static inline const unsigned char *skipASCII(const unsigned char *p,
+                                             const unsigned char *end) {
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    if (_mm_movemask_epi8(v))
+      break;
+    p += 16;
+  }
+  return p;
+}
+#else // !__SSE2__
+static inline const unsigned char *skipASCII(const unsigned char *p,
+                                             const unsigned char *) {
+  return p;
+}
+#endif // __SSE2__
+
+
+bool isValidUTF8(const char *s, size_t len) {
+  const unsigned char *p = (const unsigned char *) s, *end = p + len;
+
+  while (p < end) {
+    p = skipASCII(p, end);
+
+    // go back to the vector loop after another sixteen bytes
+    const unsigned char *stop = std::min(p + 16, end);
+    while (p < stop) {
+      unsigned int c = *p, n, min;
+      if (c < 0x80) {
+        ++p;
+        continue;
+      } else if ((c & 0xe0) == 0xc0) {
+        n = 2;
+        c &= 0x1f;
+        min = 0x80;
+      } else if ((c & 0xf0) == 0xe0) {
+        n = 3;
+        c &= 0x0f;
+        min = 0x800;
+      } else if ((c & 0xf8) == 0xf0) {
+        n = 4;
+        c &= 0x07;
+        min = 0x10000;
+      } else {
+        return False;
       }
+
+      if ((size_t) (end - p) < n)
+        return False;
+
+      for (unsigned int i = 1; i < n; ++i) {
+        if ((p[i] & 0xc0) != 0x80)
+          return False;
+        c = (c << 6) | (p[i] & 0x3f);
+      }
+
+      // no overlong forms, surrogates or code points past U+10FFFF
+      if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+        return False;
+
+      p += n;
     }
   }
 
-  return ret;
+  return True;
+}
+
+
+void latin1ToUTF8(const char *s, size_t len, string &out) {
+  const unsigned char *p = (const unsigned char *) s, *end = p + len;
+
+  if (len == 0) {
+    out.erase();
+    return;
+  }
+
+  // every byte becomes at most two
+  out.resize(len * 2);
+  char *o = &out[0], *const start = o;
+
+  while (p < end) {
+    const unsigned char *run = skipASCII(p, end);
+    memcpy(o, p, run - p);
+    o += run - p;
+    p = run;
+
+    for (; p < end && (p - run) < 16; ++p) {
+      if (*p < 0x80) {
+        *o++ = *p;
+      } else {
+        *o++ = 0xc0 | (*p >> 6);
+        *o++ = 0x80 | (*p & 0x3f);
+      }
+    }
+  }
+
+  out.resize(o - start);
 }
 
 
@@ -231,6 +340,40 @@ timeval normalizeTimeval(const timeval &tm) {
 }
 
 
+unsigned long long monotonicTime(void) {
+#ifdef    HAVE_CLOCK_GETTIME
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#else // !HAVE_CLOCK_GETTIME
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return (unsigned long long) tv.tv_sec * 1000000000ull +
+    tv.tv_usec * 1000ull;
+#endif // HAVE_CLOCK_GETTIME
+}
+
+
+const char *eventTypeName(int type) {
+  static const char * const names[] = {
+    0, 0, "KeyPress", "KeyRelease", "ButtonPress", "ButtonRelease",
+    "MotionNotify", "EnterNotify", "LeaveNotify", "FocusIn", "FocusOut",
+    "KeymapNotify", "Expose", "GraphicsExpose", "NoExpose",
+    "VisibilityNotify", "CreateNotify", "DestroyNotify", "UnmapNotify",
+    "MapNotify", "MapRequest", "ReparentNotify", "ConfigureNotify",
+    "ConfigureRequest", "GravityNotify", "ResizeRequest",
+    "CirculateNotify", "CirculateRequest", "PropertyNotify",
+    "SelectionClear", "SelectionRequest", "SelectionNotify",
+    "ColormapNotify", "ClientMessage", "MappingNotify", "GenericEvent"
+  };
+
+  if (type < 0 || type >= LASTEvent ||
+      type >= (int) (sizeof(names) / sizeof(names[0])))
+    return 0;
+  return names[type];
+}
+
+
 string itostring(unsigned long i) {
   if (i == 0)
     return string("0");
@@ -82,17 +82,26 @@ const unsigned int BSENTINEL = 65535;
 
 std::string expandTilde(const std::string& s);
 
-void bexec(const std::string& command, const std::string& displaystring);
 
 #ifndef   HAVE_BASENAME
 std::string basename(const std::string& path);
 #endif
 
-std::string textPropertyToString(Display *display, XTextProperty& text_prop);
+std::string textPropertyToString(Display *display, XTextProperty& text_prop,
+                                 Atom utf8_string, Atom compound_text);
+
+bool isValidUTF8(const char *s, size_t len);
+void latin1ToUTF8(const char *s, size_t len, std::string &out);
 
 struct timeval; // forward declare to avoid the header
 timeval normalizeTimeval(const timeval &tm);
 
+// nanoseconds on a clock that is never set back, where there is one
+unsigned long long monotonicTime(void);
+
+// the name of a core event type, or 0 for any other
+const char *eventTypeName(int type);
+
 struct PointerAssassin {
   template<typename T>
   inline void operator()(const T ptr) const {
@@ -51,14 +51,21 @@ extern "C" {
 
 #include <assert.h>
 
+#include <algorithm>
+
 #include "i18n.hh"
 #include "blackbox.hh"
 #include "GCCache.hh"
+#include "RoundTrips.hh"
 #include "Screen.hh"
+#include "TracedCalls.hh"
 #include "Util.hh"
 #include "Window.hh"
 #include "Workspace.hh"
 
+// the native windows are only raised and minimized where there is Win32,
+// elsewhere the WindowsWM extension is all there is
+#ifdef    HAVE_WINDOWS_H
 /* Fixups to prevent collisions between Windows and X headers */
 #undef MINSHORT
 #undef MAXSHORT
@@ -74,12 +81,34 @@ extern "C" {
 
 #define _NO_BOOL_TYPEDEF
 #include <windows.h>
+#endif // HAVE_WINDOWS_H
+
+
+BlackboxWindow::FrameMarginCache BlackboxWindow::marginCache;
+BlackboxWindow::FrameStatistics BlackboxWindow::frame_stats;
+
+// how long title changes are collected before the names are read again
+static const long TitleUpdateDelay = 100;
+
+// the sizes of the taskbar icons which _NET_WM_ICON is read for
+static const unsigned int TaskbarIconSize = 32;
+static const unsigned int TaskbarSmallIconSize = 16;
+
+// the number of CARD32s in WM_HINTS and WM_NORMAL_HINTS, and in the
+// shorter forms written by clients older than ICCCM 1.0
+static const long WMHintsElements = 9, OldWMHintsElements = 8;
+static const long SizeHintsElements = 18, OldSizeHintsElements = 15;
 
 
 /*
  * Initializes the class with default values/the window's set initial values.
  */
-BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
+BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s,
+                               const BSnapshotWindow *snapshot,
+                               const XWindowAttributes *attributes)
+  : frame_timeout(this, &BlackboxWindow::flushFrameDraw),
+    title_timeout(this, &BlackboxWindow::updateTitle),
+    button_grabs(b, w) {
   // fprintf(stderr, "BlackboxWindow size: %d bytes\n",
   // sizeof(BlackboxWindow));
 
@@ -97,16 +126,20 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
   client.window = w;
   screen = s;
 
-  if (! validateClient()) {
+  // the attributes were just read, which is as good as a sync
+  if ((attributes) ? clientGone() : ! validateClient()) {
     delete this;
     return;
   }
 
   // fetch client size and placement
   XWindowAttributes wattrib;
-  if (! XGetWindowAttributes(blackbox->getXDisplay(),
-                             client.window, &wattrib) ||
-      ! wattrib.screen || wattrib.override_redirect) {
+  if (attributes)
+    wattrib = *attributes;
+  else if (! tracedGetWindowAttributes(blackbox->getXDisplay(),
+                                       client.window, &wattrib))
+    wattrib.screen = 0;
+  if (! wattrib.screen || wattrib.override_redirect) {
 #if defined(DEBUG)
     fprintf(stderr,
             "BlackboxWindow::BlackboxWindow(): XGetWindowAttributes failed\n");
@@ -128,7 +161,10 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
 
   flags.moving = flags.resizing = flags.visible =
     flags.iconic = flags.focused = flags.modal =
-    flags.send_focus_message = flags.shaped = False;
+    flags.send_focus_message = flags.shaped = flags.frame_extents =
+    flags.title_changed = flags.icon_title_changed = False;
+  // not known until they are first read
+  flags.net_wm_name = flags.net_wm_icon_name = True;
   flags.maximized = 0;
 
   blackbox_attrib.workspace = window_number = BSENTINEL;
@@ -148,6 +184,12 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
 
   client.normal_hint_flags = 0;
   client.window_group = None;
+  client.icon_pixmap = client.icon_mask = None;
+  client.icon_window = None;
+  client.wm_hints.flags = 0;
+  client.protocols = 0;
+  client.net_icon = client.net_small_icon = (BIconCacheItem *) 0;
+  client.pid = 0;
   client.transient_for = 0;
 
   current_state = NormalState;
@@ -169,6 +211,16 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
   timer = new BTimer(blackbox, this);
   timer->setTimeout(blackbox->getAutoRaiseDelay());
 
+  frame_timer = new BTimer(blackbox, &frame_timeout);
+  frame_timer->setTimeout(0l);
+
+  title_timer = new BTimer(blackbox, &title_timeout);
+  title_timer->setTimeout(TitleUpdateDelay);
+
+  icon_loader = new BIconLoader(blackbox, client.window,
+                                blackbox->getNETWMIconAtom(), this,
+                                TaskbarIconSize, TaskbarSmallIconSize);
+
   // get size, aspect, minimum/maximum size and other hints set by the
   // client
 
@@ -187,14 +239,27 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
   XSelectInput(blackbox->getXDisplay(), window_in_taskbar,
                StructureNotifyMask);
 
-  //FIXME:
-  if (! getBlackboxHints())
-    getMWMHints();
+  if (snapshot) {
+    // the instance before us read all this, and followed every change
+    // until it exec'd us
+    restoreHints(*snapshot);
+    recheckHints();
+  } else {
+    //FIXME:
+    if (! getBlackboxHints())
+      getMWMHints();
 
-  getWMProtocols();
-  getWMHints();
-  getWMNormalHints();
-  getWMClass();
+    getWMProtocols();
+    getWMHints();
+    getWMNormalHints();
+
+    fetchProperty(XA_WM_CLASS);
+    fetchProperty(XA_WM_COMMAND);
+    fetchProperty(XA_WM_CLIENT_MACHINE);
+    fetchProperty(blackbox->getNETWMPidAtom());
+  }
+
+  icon_loader->start();
 
   /*XChangeProperty(blackbox->getXDisplay(), frame.window,
                   blackbox->getWindowsWMClientWindow(),
@@ -202,7 +267,10 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
                   PropModeReplace, (unsigned char *) &client.window, 1);*/
 
   // determine if this is a transient window
-  getTransientInfo();
+  if (snapshot)
+    setTransientFor(snapshot->transient_for);
+  else
+    getTransientInfo();
 
   // adjust the window decorations based on transience and window sizes
 
@@ -248,7 +316,7 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
 
   XGrabServer(blackbox->getXDisplay());
 
-  associateClientWindow();
+  associateClientWindow(! snapshot);
 
   blackbox->saveWindowSearch(client.window, this);
 
@@ -287,9 +355,13 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
 
   // preserve the window's initial state on first map, and its current state
   // across a restart
-  unsigned long initial_state = current_state;
-  if (! getState())
-    current_state = initial_state;
+  if (snapshot) {
+    current_state = snapshot->state;
+  } else {
+    unsigned long initial_state = current_state;
+    if (! getState())
+      current_state = initial_state;
+  }
 
   if (flags.maximized && (functions & Func_Maximize))
     remaximize();
@@ -314,6 +386,10 @@ BlackboxWindow::~BlackboxWindow(void) {
   }
 
   delete timer;
+  delete frame_timer;
+  delete title_timer;
+  delete icon_loader;
+  blackbox->propertyFetcher()->cancel(this);
 
   if (client.window_group) {
     BWindowGroup *group = blackbox->searchGroup(client.window_group);
@@ -338,11 +414,14 @@ BlackboxWindow::~BlackboxWindow(void) {
   if (window_in_taskbar) {
     XDestroyWindow(blackbox->getXDisplay(), window_in_taskbar);
   }
+  releaseNetWMIcon();
 
   XDeleteProperty(blackbox->getXDisplay(), client.window,
                   blackbox->getWindowsWMRaiseOnClick());
   XDeleteProperty(blackbox->getXDisplay(), client.window,
                   blackbox->getWindowsWMMouseActivate());
+  XDeleteProperty(blackbox->getXDisplay(), client.window,
+                  blackbox->getNETFrameExtentsAtom());
 
   blackbox->removeWindowSearch(window_in_taskbar);
   blackbox->removeWindowSearch(client.window);
@@ -364,10 +443,10 @@ Window BlackboxWindow::createToplevelWindow(void) {
   attrib_create.override_redirect = True;
   attrib_create.event_mask = EnterWindowMask | LeaveWindowMask;
 
-  return XCreateWindow(blackbox->getXDisplay(), screen->getRootWindow(),
-                       0, 0, 1, 1, 0, screen->getDepth(),
-                       InputOutput, screen->getVisual(), create_mask,
-                       &attrib_create);
+  return tracedCreateWindow(blackbox->getXDisplay(), screen->getRootWindow(),
+                            0, 0, 1, 1, 0, screen->getDepth(),
+                            InputOutput, screen->getVisual(), create_mask,
+                            &attrib_create);
 }
 
 
@@ -390,24 +469,20 @@ Window BlackboxWindow::createChildWindow(Window parent,
     attrib_create.cursor = cursor;
   }
 
-  return XCreateWindow(blackbox->getXDisplay(), parent, 0, 0, 1, 1, 0,
-                       screen->getDepth(), InputOutput, screen->getVisual(),
-                       create_mask, &attrib_create);
+  return tracedCreateWindow(blackbox->getXDisplay(), parent, 0, 0, 1, 1, 0,
+                            screen->getDepth(), InputOutput,
+                            screen->getVisual(), create_mask, &attrib_create);
 }
 
 
-void BlackboxWindow::associateClientWindow(void) {
+void BlackboxWindow::associateClientWindow(bool read_names) {
   XSetWindowBorderWidth(blackbox->getXDisplay(), client.window, 0);
-  getWMName();
-  getWMIconName();
-  getWMClass();
-
-#if defined(DEBUG)
-  fprintf(stderr, "XWindowsWMFrameSetTitle %s\n", client.title.c_str());
-#endif
+  if (read_names) {
+    getWMName();
+    getWMIconName();
+  }
 
-  XWindowsWMFrameSetTitle(blackbox->getXDisplay(), 0, client.window,
-                          client.title.length(), client.title.c_str());
+  setNativeTitle(client.window, native, client.title);
 
   XChangeSaveSet(blackbox->getXDisplay(), client.window, SetModeInsert);
 
@@ -437,9 +512,10 @@ void BlackboxWindow::associateClientWindow(void) {
     int foo;
     unsigned int ufoo;
 
-    XShapeQueryExtents(blackbox->getXDisplay(), client.window, &shaped,
-                       &foo, &foo, &ufoo, &ufoo, &foo, &foo, &foo,
-                       &ufoo, &ufoo);
+    BROUNDTRIP(ShapeQueryExtents,
+               XShapeQueryExtents(blackbox->getXDisplay(), client.window,
+                                  &shaped, &foo, &foo, &ufoo, &ufoo, &foo,
+                                  &foo, &foo, &ufoo, &ufoo));
     flags.shaped = shaped;
   }
 #endif // SHAPE
@@ -489,11 +565,7 @@ void BlackboxWindow::decorate(void) {
     frame.rect.setPos(frame.rect.x()*2 - fx, frame.rect.y()*2 - fy);
 #endif
 
-  XWindowsWMFrameDraw(blackbox->getXDisplay(), 0, client.window,
-                      frame_style,
-                      frame_style_ex,
-                      client.rect.x(), client.rect.y(),
-                      client.rect.width(), client.rect.height());
+  queueFrameDraw();
 
   //  XSetWindowBorder(blackbox->getXDisplay(), frame.window,
   //                   screen->getBorderColor()->pixel());
@@ -540,11 +612,7 @@ void BlackboxWindow::createTitlebar(void) {
   if (decorations & Decor_Close) {
   } else {
   }
-  XWindowsWMFrameDraw(blackbox->getXDisplay(), 0, client.window,
-                      frame_style,
-                      frame_style_ex,
-                      client.rect.x(), client.rect.y(),
-                      client.rect.width(), client.rect.height());
+  queueFrameDraw();
 }
 
 
@@ -580,50 +648,56 @@ void BlackboxWindow::positionButtons(bool /*redecorate_label*/) {
 }
 
 
-void BlackboxWindow::reconfigure(void) {
-  restoreGravity(client.rect);
-  upsize();
-  applyGravity(frame.rectFrame);
-  positionWindows();
-  decorate();
-  redrawWindowFrame();
+void BlackboxWindow::reconfigure(unsigned int changes) {
+  if (changes & ReconfigureFrame) {
+    restoreGravity(client.rect);
+    upsize();
+    applyGravity(frame.rectFrame);
+    positionWindows();
+    decorate();
+    redrawWindowFrame();
+  }
 
-  ungrabButtons();
-  grabButtons();
+  if (changes & ReconfigureGrabs)
+    grabButtons();
 }
 
 
+/*
+ * Sets up the button grabs for the current focus model and functions.  Only
+ * the grabs that differ from the ones already in place are sent.
+ */
 void BlackboxWindow::grabButtons(void) {
+  button_grabs.begin();
+
   if (! screen->isSloppyFocus() || screen->doClickRaise())
     // grab button 1 for changing focus/raising
-    blackbox->grabButton(Button1, 0, client.window, True, ButtonPressMask,
-                         GrabModeSync, GrabModeSync, client.window, None,
-                         screen->allowScrollLock());
+    button_grabs.add(Button1, 0, True, ButtonPressMask, GrabModeSync,
+                     GrabModeSync, client.window, None,
+                     screen->allowScrollLock());
 
   if (functions & Func_Move)
-    blackbox->grabButton(Button1, Mod1Mask, client.window, True,
-                         ButtonReleaseMask | ButtonMotionMask, GrabModeAsync,
-                         GrabModeAsync, client.window,
-                         blackbox->getMoveCursor(),
-                         screen->allowScrollLock());
+    button_grabs.add(Button1, Mod1Mask, True,
+                     ButtonReleaseMask | ButtonMotionMask, GrabModeAsync,
+                     GrabModeAsync, client.window,
+                     blackbox->getMoveCursor(), screen->allowScrollLock());
   if (functions & Func_Resize)
-    blackbox->grabButton(Button3, Mod1Mask, client.window, True,
-                         ButtonReleaseMask | ButtonMotionMask, GrabModeAsync,
-                         GrabModeAsync, client.window,
-                         blackbox->getLowerRightAngleCursor(),
-                         screen->allowScrollLock());
+    button_grabs.add(Button3, Mod1Mask, True,
+                     ButtonReleaseMask | ButtonMotionMask, GrabModeAsync,
+                     GrabModeAsync, client.window,
+                     blackbox->getLowerRightAngleCursor(),
+                     screen->allowScrollLock());
   // alt+middle lowers the window
-  blackbox->grabButton(Button2, Mod1Mask, client.window, True,
-                       ButtonReleaseMask, GrabModeAsync, GrabModeAsync,
-                       client.window, None, screen->allowScrollLock());
+  button_grabs.add(Button2, Mod1Mask, True, ButtonReleaseMask, GrabModeAsync,
+                   GrabModeAsync, client.window, None,
+                   screen->allowScrollLock());
+
+  button_grabs.commit();
 }
 
 
 void BlackboxWindow::ungrabButtons(void) {
-  blackbox->ungrabButton(Button1, 0, client.window);
-  blackbox->ungrabButton(Button1, Mod1Mask, client.window);
-  blackbox->ungrabButton(Button2, Mod1Mask, client.window);
-  blackbox->ungrabButton(Button3, Mod1Mask, client.window);
+  button_grabs.release();
 }
 
 
@@ -667,7 +741,7 @@ void BlackboxWindow::positionWindows(void) {
     //WindowsWM ext
   } else {
   }
-  XSync(blackbox->getXDisplay(), False);
+  BROUNDTRIP(Sync, XSync(blackbox->getXDisplay(), False));
 #if 0
   fprintf(stderr, "BlackboxWindow::positionWindows - \n"
           "\t%d %d %d %d\n",
@@ -694,13 +768,61 @@ void BlackboxWindow::positionWindows(void) {
 }
 
 
+/*
+ * Reads an EWMH text property, which is always UTF-8 and so can be used
+ * as it is.  Returns False if the property is missing or not valid UTF-8,
+ * and sets exists to whether the client has set it at all.
+ */
+bool BlackboxWindow::getUTF8Property(Atom atom, std::string &value,
+                                     bool &exists) const {
+  Atom atom_return;
+  int format;
+  unsigned long nitems, after;
+  unsigned char *data = 0;
+
+  if (tracedGetWindowProperty(blackbox->getXDisplay(), client.window, atom,
+                              0l, 10000000l, False,
+                              blackbox->getUTF8StringAtom(), &atom_return,
+                              &format, &nitems, &after, &data) != Success) {
+    exists = False;
+    return False;
+  }
+  exists = (atom_return != None);
+  if (! data)
+    return False;
+
+  bool ret = False;
+  if (atom_return == blackbox->getUTF8StringAtom() && format == 8 &&
+      nitems > 0) {
+    const char *str = (const char *) data;
+    const char *nul = (const char *) memchr(str, '\0', nitems);
+    size_t len = nul ? nul - str : nitems;
+
+    if (len > 0 && isValidUTF8(str, len)) {
+      value.assign(str, len);
+      ret = True;
+    }
+  }
+
+  XFree(data);
+  return ret;
+}
+
+
 void BlackboxWindow::getWMName(void) {
   XTextProperty text_prop;
 
   std::string name;
 
-  if (XGetWMName(blackbox->getXDisplay(), client.window, &text_prop)) {
-    name = textPropertyToString(blackbox->getXDisplay(), text_prop);
+  // most clients only set WM_NAME, so _NET_WM_NAME is asked for only
+  // until it is found missing, and again once the client sets it
+  if (! (flags.net_wm_name &&
+         getUTF8Property(blackbox->getNETWMNameAtom(), name,
+                         flags.net_wm_name)) &&
+      tracedGetWMName(blackbox->getXDisplay(), client.window, &text_prop)) {
+    name = textPropertyToString(blackbox->getXDisplay(), text_prop,
+                                blackbox->getUTF8StringAtom(),
+                                blackbox->getCompoundTextAtom());
     XFree((char *) text_prop.value);
   }
   if (! name.empty())
@@ -723,14 +845,17 @@ void BlackboxWindow::getWMIconName(void) {
 
   std::string name;
 
-  if (XGetWMIconName(blackbox->getXDisplay(), client.window, &text_prop)) {
-    name = textPropertyToString(blackbox->getXDisplay(), text_prop);
+  if (! (flags.net_wm_icon_name &&
+         getUTF8Property(blackbox->getNETWMIconNameAtom(), name,
+                         flags.net_wm_icon_name)) &&
+      tracedGetWMIconName(blackbox->getXDisplay(), client.window,
+                          &text_prop)) {
+    name = textPropertyToString(blackbox->getXDisplay(), text_prop,
+                                blackbox->getUTF8StringAtom(),
+                                blackbox->getCompoundTextAtom());
     XFree((char *) text_prop.value);
   }
-  if (! name.empty())
-    client.icon_title = name;
-  else
-    client.icon_title = client.title;
+  client.icon_title = name;
 }
 
 
@@ -745,29 +870,44 @@ void BlackboxWindow::getWMProtocols(void) {
   Atom *proto;
   int num_return = 0;
 
-  if (XGetWMProtocols(blackbox->getXDisplay(), client.window,
-                      &proto, &num_return)) {
-    for (int i = 0; i < num_return; ++i) {
-      if (proto[i] == blackbox->getWMDeleteAtom()) {
-        decorations |= Decor_Close;
-        functions |= Func_Close;
-      } else if (proto[i] == blackbox->getWMTakeFocusAtom()) {
-        flags.send_focus_message = True;
-      } else if (proto[i] == blackbox->getBlackboxStructureMessagesAtom()) {
-        screen->addNetizen(new Netizen(screen, client.window));
-      }
-    }
-
+  if (tracedGetWMProtocols(blackbox->getXDisplay(), client.window,
+                           &proto, &num_return)) {
+    setWMProtocols(proto, num_return);
     XFree(proto);
   }
 }
 
 
+void BlackboxWindow::setWMProtocols(const Atom *proto, unsigned long count) {
+  for (unsigned long i = 0; i < count; ++i) {
+    if (proto[i] == blackbox->getWMDeleteAtom()) {
+      client.protocols |= Protocol_Delete;
+      decorations |= Decor_Close;
+      functions |= Func_Close;
+    } else if (proto[i] == blackbox->getWMTakeFocusAtom()) {
+      client.protocols |= Protocol_TakeFocus;
+      flags.send_focus_message = True;
+    } else if (proto[i] == blackbox->getBlackboxStructureMessagesAtom()) {
+      client.protocols |= Protocol_StructureMessages;
+      screen->addNetizen(new Netizen(screen, client.window));
+    }
+  }
+}
+
+
 /*
  * Gets the value of the WM_HINTS property.
  * If the property is not set, then use a set of default values.
  */
 void BlackboxWindow::getWMHints(void) {
+  XWMHints *wmhint = tracedGetWMHints(blackbox->getXDisplay(), client.window);
+  setWMHints(wmhint);
+  if (wmhint) XFree(wmhint);
+}
+
+
+// what getWMHints() does with the hints, which are 0 if there are none
+void BlackboxWindow::setWMHints(const XWMHints *wmhint) {
   focus_mode = F_Passive;
 
   // remove from current window group
@@ -777,9 +917,11 @@ void BlackboxWindow::getWMHints(void) {
   }
   client.window_group = None;
 
-  XWMHints *wmhint = XGetWMHints(blackbox->getXDisplay(), client.window);
-  if (! wmhint)
+  if (! wmhint) {
+    client.wm_hints.flags = 0;
+    setTaskbarHints();
     return;
+  }
 
   if (wmhint->flags & InputHint) {
     if (wmhint->input == True) {
@@ -809,16 +951,105 @@ void BlackboxWindow::getWMHints(void) {
       group->addWindow(this);
   }
 
-  XSetWMHints(blackbox->getXDisplay(), window_in_taskbar, wmhint);
+  client.wm_hints = *wmhint;
+  setTaskbarHints();
 
-  //Redraw Icon
-  XWindowsWMFrameDraw(blackbox->getXDisplay(), 0, client.window,
-                      frame_style,
-                      frame_style_ex,
-                      client.rect.x(), client.rect.y(),
-                      client.rect.width(), client.rect.height());
+  // the native frame picks up the icon when it is drawn, so only redraw
+  // it when the icon really changed
+  Pixmap icon_pixmap =
+    (wmhint->flags & IconPixmapHint) ? wmhint->icon_pixmap : None;
+  Pixmap icon_mask =
+    (wmhint->flags & IconMaskHint) ? wmhint->icon_mask : None;
+  Window icon_window =
+    (wmhint->flags & IconWindowHint) ? wmhint->icon_window : None;
+  if (icon_pixmap != client.icon_pixmap || icon_mask != client.icon_mask ||
+      icon_window != client.icon_window) {
+    client.icon_pixmap = icon_pixmap;
+    client.icon_mask = icon_mask;
+    client.icon_window = icon_window;
 
-  XFree(wmhint);
+    native.drawn = False;
+    queueFrameDraw();
+  }
+}
+
+
+/*
+ * Gives the taskbar proxy the client's WM_HINTS, with the icon made from
+ * _NET_WM_ICON in place of the client's own if there is one.
+ */
+void BlackboxWindow::setTaskbarHints(void) {
+  XWMHints hints = client.wm_hints;
+  if (client.net_icon) {
+    hints.flags &= ~IconWindowHint;
+    hints.flags |= IconPixmapHint | IconMaskHint;
+    hints.icon_pixmap = client.net_icon->pixmap();
+    hints.icon_mask = client.net_icon->mask();
+  }
+
+  XSetWMHints(blackbox->getXDisplay(), window_in_taskbar, &hints);
+}
+
+
+/*
+ * Gives the taskbar proxy a _NET_WM_ICON with just the large and small
+ * icons, which is where XWin takes the taskbar and title bar icons from.
+ */
+void BlackboxWindow::setTaskbarIcon(void) {
+  if (! client.net_icon) {
+    XDeleteProperty(blackbox->getXDisplay(), window_in_taskbar,
+                    blackbox->getNETWMIconAtom());
+    return;
+  }
+
+  std::vector<unsigned long> data(client.net_icon->data());
+  if (client.net_small_icon)
+    data.insert(data.end(), client.net_small_icon->data().begin(),
+                client.net_small_icon->data().end());
+
+  XChangeProperty(blackbox->getXDisplay(), window_in_taskbar,
+                  blackbox->getNETWMIconAtom(), XA_CARDINAL, 32,
+                  PropModeReplace, (unsigned char *) &data[0], data.size());
+}
+
+
+void BlackboxWindow::releaseNetWMIcon(void) {
+  if (client.net_icon)
+    blackbox->iconCache()->release(client.net_icon);
+  if (client.net_small_icon)
+    blackbox->iconCache()->release(client.net_small_icon);
+  client.net_icon = client.net_small_icon = (BIconCacheItem *) 0;
+}
+
+
+/*
+ * Called by the icon loader once _NET_WM_ICON has been read.
+ */
+void BlackboxWindow::iconLoaded(const BIcon &large, const BIcon &small) {
+  BIconCacheItem *item =
+    blackbox->iconCache()->find(screen, large, TaskbarIconSize);
+  BIconCacheItem *small_item =
+    blackbox->iconCache()->find(screen, small, TaskbarSmallIconSize);
+  if (item == client.net_icon && small_item == client.net_small_icon) {
+    // the same images were set again
+    if (item) blackbox->iconCache()->release(item);
+    if (small_item) blackbox->iconCache()->release(small_item);
+    return;
+  }
+
+  releaseNetWMIcon();
+  client.net_icon = item;
+  client.net_small_icon = small_item;
+  setTaskbarHints();
+  setTaskbarIcon();
+
+  // an iconified window shows its icon through the taskbar proxy
+  if (flags.iconic) {
+    native_taskbar.drawn = False;
+    drawNativeFrame(window_in_taskbar, native_taskbar,
+                    WindowsWMFrameStylePopup, WindowsWMFrameStyleExAppWindow,
+                    client.rect);
+  }
 }
 
 
@@ -830,6 +1061,17 @@ void BlackboxWindow::getWMNormalHints(void) {
   long icccm_mask;
   XSizeHints sizehint;
 
+  if (tracedGetWMNormalHints(blackbox->getXDisplay(), client.window,
+                             &sizehint, &icccm_mask))
+    setWMNormalHints(&sizehint);
+  else
+    setWMNormalHints(0);
+}
+
+
+// what getWMNormalHints() does with the hints, which are 0 if there are
+// none
+void BlackboxWindow::setWMNormalHints(const XSizeHints *sizehint) {
   client.min_width = client.min_height =
     client.width_inc = client.height_inc = 1;
   client.base_width = client.base_height = 0;
@@ -848,52 +1090,51 @@ void BlackboxWindow::getWMNormalHints(void) {
   client.max_width = screen_area.width();
   client.max_height = screen_area.height();
 
-  if (! XGetWMNormalHints(blackbox->getXDisplay(), client.window,
-                          &sizehint, &icccm_mask))
+  if (! sizehint)
     return;
 
-  client.normal_hint_flags = sizehint.flags;
+  client.normal_hint_flags = sizehint->flags;
 
-  if (sizehint.flags & PMinSize) {
-    if (sizehint.min_width >= 0)
-      client.min_width = sizehint.min_width;
-    if (sizehint.min_height >= 0)
-      client.min_height = sizehint.min_height;
+  if (sizehint->flags & PMinSize) {
+    if (sizehint->min_width >= 0)
+      client.min_width = sizehint->min_width;
+    if (sizehint->min_height >= 0)
+      client.min_height = sizehint->min_height;
   }
 
-  if (sizehint.flags & PMaxSize) {
-    if (sizehint.max_width > static_cast<signed>(client.min_width))
-      client.max_width = sizehint.max_width;
+  if (sizehint->flags & PMaxSize) {
+    if (sizehint->max_width > static_cast<signed>(client.min_width))
+      client.max_width = sizehint->max_width;
     else
       client.max_width = client.min_width;
 
-    if (sizehint.max_height > static_cast<signed>(client.min_height))
-      client.max_height = sizehint.max_height;
+    if (sizehint->max_height > static_cast<signed>(client.min_height))
+      client.max_height = sizehint->max_height;
     else
       client.max_height = client.min_height;
   }
 
-  if (sizehint.flags & PResizeInc) {
-    client.width_inc = sizehint.width_inc;
-    client.height_inc = sizehint.height_inc;
+  if (sizehint->flags & PResizeInc) {
+    client.width_inc = sizehint->width_inc;
+    client.height_inc = sizehint->height_inc;
   }
 
 #if 0 // we do not support this at the moment
-  if (sizehint.flags & PAspect) {
-    client.min_aspect_x = sizehint.min_aspect.x;
-    client.min_aspect_y = sizehint.min_aspect.y;
-    client.max_aspect_x = sizehint.max_aspect.x;
-    client.max_aspect_y = sizehint.max_aspect.y;
+  if (sizehint->flags & PAspect) {
+    client.min_aspect_x = sizehint->min_aspect.x;
+    client.min_aspect_y = sizehint->min_aspect.y;
+    client.max_aspect_x = sizehint->max_aspect.x;
+    client.max_aspect_y = sizehint->max_aspect.y;
   }
 #endif
 
-  if (sizehint.flags & PBaseSize) {
-    client.base_width = sizehint.base_width;
-    client.base_height = sizehint.base_height;
+  if (sizehint->flags & PBaseSize) {
+    client.base_width = sizehint->base_width;
+    client.base_height = sizehint->base_height;
   }
 
-  if (sizehint.flags & PWinGravity)
-    client.win_gravity = sizehint.win_gravity;
+  if (sizehint->flags & PWinGravity)
+    client.win_gravity = sizehint->win_gravity;
 
   //XSetWMNormalHints(blackbox->getXDisplay(), frame.window, &sizehint);
 
@@ -916,12 +1157,12 @@ void BlackboxWindow::getMWMHints(void) {
   unsigned long num, len;
   MwmHints *mwm_hint = 0;
 
-  int ret = XGetWindowProperty(blackbox->getXDisplay(), client.window,
-                               blackbox->getMotifWMHintsAtom(), 0,
-                               PropMwmHintsElements, False,
-                               blackbox->getMotifWMHintsAtom(), &atom_return,
-                               &format, &num, &len,
-                               (unsigned char **) &mwm_hint);
+  int ret = tracedGetWindowProperty(blackbox->getXDisplay(), client.window,
+                                    blackbox->getMotifWMHintsAtom(), 0,
+                                    PropMwmHintsElements, False,
+                                    blackbox->getMotifWMHintsAtom(),
+                                    &atom_return, &format, &num, &len,
+                                    (unsigned char **) &mwm_hint);
 
   if (ret != Success || ! mwm_hint || num != PropMwmHintsElements)
     return;
@@ -970,19 +1211,86 @@ void BlackboxWindow::getMWMHints(void) {
 
 
 /*
- * Gets the value of the WM_CLASS property.
- * If the property is not set, then use a set of default values.
+ * Asks for a property which nothing needs to manage the window, so that
+ * reading it does not hold up the event loop.  propertyFetched() gets it.
  */
-void BlackboxWindow::getWMClass(void) {
-  XClassHint classhints;
+void BlackboxWindow::fetchProperty(Atom property) {
+  Atom type = AnyPropertyType;
+  long length = 65536l;
 
-  //FIXME: move to extension?
-  if (XGetClassHint(blackbox->getXDisplay(), client.window, &classhints) == 0)
+  if (property == blackbox->getNETWMPidAtom()) {
+    type = XA_CARDINAL;
+    length = 1;
+  } else if (property == XA_WM_CLASS || property == XA_WM_COMMAND) {
+    type = XA_STRING;
+  }
+
+  blackbox->propertyFetcher()->fetch(this, client.window, property, type,
+                                     length);
+}
+
+
+void BlackboxWindow::propertyFetched(const BProperty &property) {
+  if (property.property == blackbox->getNETWMPidAtom()) {
+    client.pid = (property.exists && property.format == 32 &&
+                  ! property.values.empty()) ? property.values[0] : 0;
+    return;
+  }
+
+  if (property.property == blackbox->getWMProtocolsAtom()) {
+    if (property.exists && property.format == 32 &&
+        ! property.values.empty())
+      setWMProtocols(&property.values[0], property.values.size());
+    return;
+  }
+
+  if (property.property == XA_WM_HINTS ||
+      property.property == XA_WM_NORMAL_HINTS) {
+    hintsFetched(property);
     return;
+  }
 
-  //XSetClassHint(blackbox->getXDisplay(), frame.window, &classhints);
-  XFree(classhints.res_name);
-  XFree(classhints.res_class);
+  if (property.property == blackbox->getNETWMNameAtom() ||
+      property.property == blackbox->getNETWMIconNameAtom() ||
+      property.property == XA_WM_NAME ||
+      property.property == XA_WM_ICON_NAME) {
+    nameFetched(property);
+    return;
+  }
+
+  if (property.property == XA_WM_TRANSIENT_FOR) {
+    setTransientFor((property.exists && property.format == 32 &&
+                     ! property.values.empty()) ?
+                    property.values[0] : client.window);
+    transientChanged();
+    return;
+  }
+
+  // the rest are lists of strings, each ended by a NUL
+  std::string value;
+  if (property.exists && property.format == 8)
+    value = property.data;
+
+  switch (property.property) {
+  case XA_WM_CLASS: {
+    std::string::size_type n = value.find('\0');
+    client.res_name = value.substr(0, n);
+    client.res_class = (n == std::string::npos) ? std::string() :
+      value.substr(n + 1, value.find('\0', n + 1) - (n + 1));
+    break;
+  }
+
+  case XA_WM_COMMAND:
+    while (! value.empty() && value[value.size() - 1] == '\0')
+      value.erase(value.size() - 1);
+    std::replace(value.begin(), value.end(), '\0', ' ');
+    client.command = value;
+    break;
+
+  case XA_WM_CLIENT_MACHINE:
+    client.machine = value.substr(0, value.find('\0'));
+    break;
+  }
 }
 
 
@@ -999,12 +1307,12 @@ bool BlackboxWindow::getBlackboxHints(void) {
   unsigned long num, len;
   BlackboxHints *blackbox_hint = 0;
 
-  int ret = XGetWindowProperty(blackbox->getXDisplay(), client.window,
-                               blackbox->getBlackboxHintsAtom(), 0,
-                               PropBlackboxHintsElements, False,
-                               blackbox->getBlackboxHintsAtom(), &atom_return,
-                               &format, &num, &len,
-                               (unsigned char **) &blackbox_hint);
+  int ret = tracedGetWindowProperty(blackbox->getXDisplay(), client.window,
+                                    blackbox->getBlackboxHintsAtom(), 0,
+                                    PropBlackboxHintsElements, False,
+                                    blackbox->getBlackboxHintsAtom(),
+                                    &atom_return, &format, &num, &len,
+                                    (unsigned char **) &blackbox_hint);
   if (ret != Success || ! blackbox_hint || num != PropBlackboxHintsElements)
     return False;
 
@@ -1063,6 +1371,22 @@ bool BlackboxWindow::getBlackboxHints(void) {
 
 
 void BlackboxWindow::getTransientInfo(void) {
+  Window trans_for;
+  if (!tracedGetTransientForHint(blackbox->getXDisplay(), client.window,
+                                 &trans_for)) {
+    // transient_for hint not set
+    trans_for = client.window;
+  }
+
+  setTransientFor(trans_for);
+}
+
+
+/*
+ * Makes this window a transient for trans_for, or for nothing if
+ * trans_for is the window itself.
+ */
+void BlackboxWindow::setTransientFor(Window trans_for) {
   if (client.transient_for &&
       client.transient_for != (BlackboxWindow *) ~0ul) {
     // reset transient_for in preparation of looking for a new owner
@@ -1072,13 +1396,6 @@ void BlackboxWindow::getTransientInfo(void) {
   // we have no transient_for until we find a new one
   client.transient_for = (BlackboxWindow *) 0;
 
-  Window trans_for;
-  if (!XGetTransientForHint(blackbox->getXDisplay(), client.window,
-                            &trans_for)) {
-    // transient_for hint not set
-    return;
-  }
-
   if (trans_for == client.window) {
     // wierd client... treat this window as a normal window
     return;
@@ -1129,6 +1446,18 @@ void BlackboxWindow::getTransientInfo(void) {
 }
 
 
+// called when WM_TRANSIENT_FOR changes after the window is managed
+void BlackboxWindow::transientChanged(void) {
+  // adjust the window decorations based on transience
+  if (isTransient()) {
+    decorations &= ~(Decor_Maximize | Decor_Handle);
+    functions &= ~Func_Maximize;
+  }
+
+  reconfigure();
+}
+
+
 BlackboxWindow *BlackboxWindow::getTransientFor(void) const {
   if (client.transient_for &&
       client.transient_for != (BlackboxWindow*) ~0ul)
@@ -1145,6 +1474,8 @@ BlackboxWindow *BlackboxWindow::getTransientFor(void) const {
  */
 void BlackboxWindow::configure(int dx, int dy,
                                unsigned int dw, unsigned int dh) {
+  BRoundTrips::OperationScope operation(BRoundTrips::Configure);
+
 #if defined(DEBUG)
   fprintf(stderr, "configure req:%d %d %d %d - frame:%d %d %d %d\n",
          dx, dy, dw, dh,
@@ -1235,6 +1566,8 @@ void BlackboxWindow::configureShape(void) {
 bool BlackboxWindow::setInputFocus(void) {
   if (flags.focused) return True;
 
+  BRoundTrips::OperationScope operation(BRoundTrips::Focus);
+
   // do not give focus to a window that is about to close
   if (! validateClient()) return False;
 
@@ -1298,7 +1631,9 @@ bool BlackboxWindow::setInputFocus(void) {
                NoEventMask, &ce);
     XFlush(blackbox->getXDisplay());
   }
+#ifdef    HAVE_WINDOWS_H
   SetForegroundWindow((HWND)getHWnd(client.window));
+#endif // HAVE_WINDOWS_H
 
   return ret;
 }
@@ -1361,26 +1696,27 @@ void BlackboxWindow::iconify(void) {
   XSelectInput(blackbox->getXDisplay(), client.window, event_mask);
   XUngrabServer(blackbox->getXDisplay());
 
+  frame_timer->stop();
+  native.reset();
+
   /* Create taskbar icon
    * FIXME: Shold XWinWM directly create Win32 window instead of X window?
    */
   XGrabServer(blackbox->getXDisplay());
   XWindowsWMSelectInput(blackbox->getXDisplay(), 0);
   XMapWindow(blackbox->getXDisplay(), window_in_taskbar);
-  std::string taskbar_title = "[*]" + client.icon_title;
-  XWindowsWMFrameSetTitle(blackbox->getXDisplay(), 0, window_in_taskbar,
-                          taskbar_title.length(), taskbar_title.c_str());
-
-  XWindowsWMFrameDraw(blackbox->getXDisplay(), 0, window_in_taskbar,
-                      WindowsWMFrameStylePopup,
-                      WindowsWMFrameStyleExAppWindow,
-                      client.rect.x(), client.rect.y(),
-                      client.rect.width(), client.rect.height());
+  setNativeTitle(window_in_taskbar, native_taskbar,
+                 std::string("[*]") + getIconTitle());
+  drawNativeFrame(window_in_taskbar, native_taskbar,
+                  WindowsWMFrameStylePopup, WindowsWMFrameStyleExAppWindow,
+                  client.rect);
 
+#ifdef    HAVE_WINDOWS_H
   HWND hWnd = (HWND)getHWnd(window_in_taskbar);
   if (hWnd) {
     ShowWindow (hWnd, SW_MINIMIZE);
   }
+#endif // HAVE_WINDOWS_H
 
   XWindowsWMSelectInput(blackbox->getXDisplay(),
                         WindowsWMControllerNotifyMask
@@ -1394,15 +1730,21 @@ void BlackboxWindow::show(void) {
   setState(current_state);
 
   XUnmapWindow(blackbox->getXDisplay(), window_in_taskbar);
+  native_taskbar.reset();
   XMapWindow(blackbox->getXDisplay(), client.window);
   //XMapSubwindows(blackbox->getXDisplay(), frame.window);
 
+  // the native frame is created again when the window is mapped
+  native.reset();
+  queueFrameDraw();
+
 #if defined(DEBUG)
   int real_x, real_y;
   Window child;
-  XTranslateCoordinates(blackbox->getXDisplay(), client.window,
-                        screen->getRootWindow(),
-                        0, 0, &real_x, &real_y, &child);
+  BROUNDTRIP(TranslateCoordinates,
+             XTranslateCoordinates(blackbox->getXDisplay(), client.window,
+                                   screen->getRootWindow(),
+                                   0, 0, &real_x, &real_y, &child));
   fprintf(stderr, "%s -- assumed: (%d, %d), real: (%d, %d)\n", getTitle(),
           client.rect.left(), client.rect.top(), real_x, real_y);
   //assert(client.rect.left() == real_x && client.rect.top() == real_y);
@@ -1416,11 +1758,11 @@ void BlackboxWindow::show(void) {
   unsigned long ulfoo, nitems;
   HWND *phWnd;
 
-  if ((XGetWindowProperty (blackbox->getXDisplay(), client.window,
-                           blackbox->getWindowsWMNativeHWnd(),
-                           0l, 1l, False, XA_INTEGER,
-                           &atom_return, &format, &nitems, &ulfoo,
-                           (unsigned char **) &phWnd) == Success)
+  if ((tracedGetWindowProperty(blackbox->getXDisplay(), client.window,
+                               blackbox->getWindowsWMNativeHWnd(),
+                               0l, 1l, False, XA_INTEGER,
+                               &atom_return, &format, &nitems, &ulfoo,
+                               (unsigned char **) &phWnd) == Success)
       && phWnd)
     {
       //if (*phWnd) ShowWindow (*phWnd, SW_SHOWNORMAL);
@@ -1480,6 +1822,7 @@ void BlackboxWindow::withdraw(void) {
 
   //XUnmapWindow(blackbox->getXDisplay(), client.window);
   XUnmapWindow(blackbox->getXDisplay(), window_in_taskbar);
+  native_taskbar.reset();
 
   XGrabServer(blackbox->getXDisplay());
 
@@ -1491,6 +1834,9 @@ void BlackboxWindow::withdraw(void) {
   XSelectInput(blackbox->getXDisplay(), client.window, event_mask);
 
   XUngrabServer(blackbox->getXDisplay());
+
+  frame_timer->stop();
+  native.reset();
 }
 
 
@@ -1593,12 +1939,14 @@ void BlackboxWindow::setFocusFlag(bool focus) {
 
 void BlackboxWindow::installColormap(bool install) {
   int i = 0, ncmap = 0;
-  Colormap *cmaps = XListInstalledColormaps(blackbox->getXDisplay(),
-                                            client.window, &ncmap);
+  Colormap *cmaps =
+    BROUNDTRIP(ListInstalledColormaps,
+               XListInstalledColormaps(blackbox->getXDisplay(),
+                                       client.window, &ncmap));
   if (cmaps) {
     XWindowAttributes wattrib;
-    if (XGetWindowAttributes(blackbox->getXDisplay(),
-                             client.window, &wattrib)) {
+    if (tracedGetWindowAttributes(blackbox->getXDisplay(),
+                                  client.window, &wattrib)) {
       if (install) {
         // install the window's colormap
         for (i = 0; i < ncmap; i++) {
@@ -1650,11 +1998,11 @@ bool BlackboxWindow::getState(void) {
   int foo;
   unsigned long *state, ulfoo, nitems;
 
-  if ((XGetWindowProperty(blackbox->getXDisplay(), client.window,
-                          blackbox->getWMStateAtom(),
-                          0l, 2l, False, blackbox->getWMStateAtom(),
-                          &atom_return, &foo, &nitems, &ulfoo,
-                          (unsigned char **) &state) != Success) ||
+  if ((tracedGetWindowProperty(blackbox->getXDisplay(), client.window,
+                               blackbox->getWMStateAtom(),
+                               0l, 2l, False, blackbox->getWMStateAtom(),
+                               &atom_return, &foo, &nitems, &ulfoo,
+                               (unsigned char **) &state) != Success) ||
       (! state)) {
     return False;
   }
@@ -1671,18 +2019,321 @@ bool BlackboxWindow::getState(void) {
 }
 
 
+/*
+ * What restoreAttributes() would read back after a restart, and where the
+ * window is left once restore() is done with it.
+ */
+void BlackboxWindow::saveSnapshot(BSnapshotWindow &snapshot,
+                                  std::string
+                                  text[BSnapshotWindow::TextCount]) {
+  snapshot.window = client.window;
+  snapshot.screen = screen->getScreenNumber();
+  snapshot.workspace = blackbox_attrib.workspace;
+  snapshot.state = current_state;
+
+  Rect r = client.rect;
+  restoreGravity(r);
+  snapshot.x = r.x();
+  snapshot.y = r.y();
+  snapshot.width = r.width();
+  snapshot.height = r.height();
+
+  snapshot.maximized = flags.maximized;
+  snapshot.premax_x = blackbox_attrib.premax_x;
+  snapshot.premax_y = blackbox_attrib.premax_y;
+  snapshot.premax_w = blackbox_attrib.premax_w;
+  snapshot.premax_h = blackbox_attrib.premax_h;
+
+  // everything the constructor would otherwise read from the client
+  snapshot.decorations = decorations;
+  snapshot.functions = functions;
+  snapshot.protocols = client.protocols;
+  snapshot.wm_hints = client.wm_hints;
+  snapshot.normal_hint_flags = client.normal_hint_flags;
+  snapshot.min_width = client.min_width;
+  snapshot.min_height = client.min_height;
+  snapshot.max_width = client.max_width;
+  snapshot.max_height = client.max_height;
+  snapshot.width_inc = client.width_inc;
+  snapshot.height_inc = client.height_inc;
+  snapshot.base_width = client.base_width;
+  snapshot.base_height = client.base_height;
+  snapshot.win_gravity = client.win_gravity;
+  snapshot.pid = client.pid;
+
+  // in the terms setTransientFor() understands
+  if (! client.transient_for)
+    snapshot.transient_for = client.window;
+  else if (client.transient_for == (BlackboxWindow *) ~0ul)
+    snapshot.transient_for = screen->getRootWindow();
+  else
+    snapshot.transient_for = client.transient_for->client.window;
+
+  text[BSnapshotWindow::Title] = client.title;
+  text[BSnapshotWindow::IconTitle] = client.icon_title;
+  text[BSnapshotWindow::ResName] = client.res_name;
+  text[BSnapshotWindow::ResClass] = client.res_class;
+  text[BSnapshotWindow::Command] = client.command;
+  text[BSnapshotWindow::Machine] = client.machine;
+}
+
+
+/*
+ * Takes the hints, protocols, size hints and names from a snapshot
+ * instead of reading them from the client again.
+ */
+void BlackboxWindow::restoreHints(const BSnapshotWindow &snapshot) {
+  Atom proto[3];
+  unsigned long count = 0;
+  if (snapshot.protocols & Protocol_Delete)
+    proto[count++] = blackbox->getWMDeleteAtom();
+  if (snapshot.protocols & Protocol_TakeFocus)
+    proto[count++] = blackbox->getWMTakeFocusAtom();
+  if (snapshot.protocols & Protocol_StructureMessages)
+    proto[count++] = blackbox->getBlackboxStructureMessagesAtom();
+  // the focus mode in the WM_HINTS depends on WM_TAKE_FOCUS
+  setWMProtocols(proto, count);
+  setWMHints((snapshot.wm_hints.flags) ? &snapshot.wm_hints : 0);
+
+  decorations = snapshot.decorations;
+  functions = snapshot.functions;
+
+  client.normal_hint_flags = snapshot.normal_hint_flags;
+  client.min_width = snapshot.min_width;
+  client.min_height = snapshot.min_height;
+  client.max_width = snapshot.max_width;
+  client.max_height = snapshot.max_height;
+  client.width_inc = snapshot.width_inc;
+  client.height_inc = snapshot.height_inc;
+  client.base_width = snapshot.base_width;
+  client.base_height = snapshot.base_height;
+  client.win_gravity = snapshot.win_gravity;
+  client.pid = snapshot.pid;
+
+  const BSnapshot &s = *blackbox->restartSnapshot();
+  client.title = s.text(snapshot, BSnapshotWindow::Title);
+  client.icon_title = s.text(snapshot, BSnapshotWindow::IconTitle);
+  client.res_name = s.text(snapshot, BSnapshotWindow::ResName);
+  client.res_class = s.text(snapshot, BSnapshotWindow::ResClass);
+  client.command = s.text(snapshot, BSnapshotWindow::Command);
+  client.machine = s.text(snapshot, BSnapshotWindow::Machine);
+  if (client.title.empty())
+    client.title = i18n(WindowSet, WindowUnnamed, "Unnamed");
+}
+
+
+/*
+ * What the client changed after the instance before us exec'd us, and
+ * before we selected PropertyChangeMask again, sent no event to anyone.
+ * So read the hints, size hints, protocols and names once more, without
+ * waiting for them; propertyFetched() applies whatever is not what the
+ * snapshot said.  Each name is read as getWMName() reads it, WM_NAME only
+ * once _NET_WM_NAME turns out not to be usable.
+ */
+void BlackboxWindow::recheckHints(void) {
+  BPropertyFetcher *fetcher = blackbox->propertyFetcher();
+  fetcher->fetch(this, client.window, XA_WM_HINTS, XA_WM_HINTS,
+                 WMHintsElements);
+  fetcher->fetch(this, client.window, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS,
+                 SizeHintsElements);
+  fetcher->fetch(this, client.window, blackbox->getWMProtocolsAtom(),
+                 XA_ATOM);
+  fetcher->fetch(this, client.window, blackbox->getNETWMNameAtom(),
+                 blackbox->getUTF8StringAtom());
+  fetcher->fetch(this, client.window, blackbox->getNETWMIconNameAtom(),
+                 blackbox->getUTF8StringAtom());
+}
+
+
+/*
+ * WM_HINTS or WM_NORMAL_HINTS read by recheckHints(), applied as a
+ * PropertyNotify for them would have been if they are not the ones held.
+ */
+void BlackboxWindow::hintsFetched(const BProperty &property) {
+  const std::vector<unsigned long> &v = property.values;
+  bool valid = property.exists && property.format == 32;
+
+  if (property.property == XA_WM_HINTS) {
+    XWMHints hints;
+    valid = valid && v.size() >= (unsigned long) OldWMHintsElements;
+    if (valid) {
+      hints.flags = v[0];
+      hints.input = (v[1] != 0);
+      hints.initial_state = v[2];
+      hints.icon_pixmap = v[3];
+      hints.icon_window = v[4];
+      hints.icon_x = (long) v[5];
+      hints.icon_y = (long) v[6];
+      hints.icon_mask = v[7];
+      if (v.size() >= (unsigned long) WMHintsElements) {
+        hints.window_group = v[8];
+      } else {
+        hints.window_group = None;
+        hints.flags &= ~WindowGroupHint;
+      }
+    }
+
+    const XWMHints &held = client.wm_hints;
+    if (! valid) {
+      if (held.flags) setWMHints(0);
+    } else if (hints.flags != held.flags || hints.input != held.input ||
+               hints.initial_state != held.initial_state ||
+               hints.icon_pixmap != held.icon_pixmap ||
+               hints.icon_window != held.icon_window ||
+               hints.icon_x != held.icon_x || hints.icon_y != held.icon_y ||
+               hints.icon_mask != held.icon_mask ||
+               hints.window_group != held.window_group) {
+      setWMHints(&hints);
+      frame_timer->start();
+    }
+    return;
+  }
+
+  XSizeHints hints;
+  valid = valid && v.size() >= (unsigned long) OldSizeHintsElements;
+  if (valid) {
+    hints.flags = v[0];
+    hints.x = (long) v[1];
+    hints.y = (long) v[2];
+    hints.width = (long) v[3];
+    hints.height = (long) v[4];
+    hints.min_width = (long) v[5];
+    hints.min_height = (long) v[6];
+    hints.max_width = (long) v[7];
+    hints.max_height = (long) v[8];
+    hints.width_inc = (long) v[9];
+    hints.height_inc = (long) v[10];
+    hints.min_aspect.x = (long) v[11];
+    hints.min_aspect.y = (long) v[12];
+    hints.max_aspect.x = (long) v[13];
+    hints.max_aspect.y = (long) v[14];
+    if (v.size() >= (unsigned long) SizeHintsElements) {
+      hints.base_width = (long) v[15];
+      hints.base_height = (long) v[16];
+      hints.win_gravity = (long) v[17];
+    } else {
+      hints.base_width = hints.base_height = 0;
+      hints.win_gravity = NorthWestGravity;
+      hints.flags &= ~(PBaseSize | PWinGravity);
+    }
+  }
+
+  const unsigned long old_flags = client.normal_hint_flags;
+  const unsigned int old[] = {
+    client.min_width, client.min_height, client.max_width, client.max_height,
+    client.width_inc, client.height_inc, client.base_width,
+    client.base_height, client.win_gravity
+  };
+  setWMNormalHints(valid ? &hints : 0);
+  const unsigned int now[] = {
+    client.min_width, client.min_height, client.max_width, client.max_height,
+    client.width_inc, client.height_inc, client.base_width,
+    client.base_height, client.win_gravity
+  };
+  if (client.normal_hint_flags != old_flags ||
+      ! std::equal(old, old + sizeof(old) / sizeof(old[0]), now)) {
+    normalHintsChanged();
+    frame_timer->start();
+  }
+}
+
+
+/*
+ * A name read by recheckHints().  A change is left to updateTitle(), like
+ * one a PropertyNotify tells of.
+ */
+void BlackboxWindow::nameFetched(const BProperty &property) {
+  const bool icon = (property.property == blackbox->getNETWMIconNameAtom() ||
+                     property.property == XA_WM_ICON_NAME);
+  const std::string &held = icon ? client.icon_title : client.title;
+
+  std::string name;
+  if (property.property == blackbox->getNETWMNameAtom() ||
+      property.property == blackbox->getNETWMIconNameAtom()) {
+    if (icon)
+      flags.net_wm_icon_name = property.exists;
+    else
+      flags.net_wm_name = property.exists;
+    if (property.exists && property.format == 8) {
+      const std::string &data = property.data;
+      name = data.substr(0, data.find('\0'));
+      if (! isValidUTF8(name.data(), name.size()))
+        name.erase();
+    }
+    if (name.empty()) {
+      // not usable, so the name comes from the ICCCM property
+      blackbox->propertyFetcher()->fetch(this, client.window,
+                                         icon ? XA_WM_ICON_NAME : XA_WM_NAME);
+      return;
+    }
+  } else {
+    XTextProperty text_prop;
+    text_prop.value =
+      (unsigned char *) const_cast<char *>(property.data.data());
+    text_prop.encoding = property.type;
+    text_prop.format = property.exists ? property.format : 0;
+    text_prop.nitems = property.data.size();
+    name = textPropertyToString(blackbox->getXDisplay(), text_prop,
+                                blackbox->getUTF8StringAtom(),
+                                blackbox->getCompoundTextAtom());
+    if (name.empty() && ! icon)
+      name = i18n(WindowSet, WindowUnnamed, "Unnamed");
+  }
+
+  if (name != held) queueTitleUpdate(icon);
+}
+
+
+/*
+ * A transient for a window adopted after it could not find its owner;
+ * now that the whole snapshot is managed, look again.
+ */
+void BlackboxWindow::resolveTransient(const BSnapshotWindow &snapshot) {
+  if (client.transient_for || snapshot.transient_for == client.window ||
+      snapshot.transient_for == screen->getRootWindow())
+    return;
+
+  setTransientFor(snapshot.transient_for);
+  if (client.transient_for) transientChanged();
+}
+
+
+// like restoreAttributes(), without the round trip
+void BlackboxWindow::restoreSnapshot(const BSnapshotWindow &snapshot) {
+  if (snapshot.workspace != screen->getCurrentWorkspaceID() &&
+      snapshot.workspace < screen->getWorkspaceCount()) {
+    screen->reassociateWindow(this, snapshot.workspace, True);
+
+    // set to WithdrawnState so it will be mapped on the new workspace
+    if (current_state == NormalState) current_state = WithdrawnState;
+  } else if (current_state == WithdrawnState) {
+    current_state = NormalState;
+  }
+
+  if (snapshot.maximized) {
+    blackbox_attrib.premax_x = snapshot.premax_x;
+    blackbox_attrib.premax_y = snapshot.premax_y;
+    blackbox_attrib.premax_w = snapshot.premax_w;
+    blackbox_attrib.premax_h = snapshot.premax_h;
+
+    flags.maximized = snapshot.maximized;
+    remaximize();
+  }
+}
+
+
 void BlackboxWindow::restoreAttributes(void) {
   Atom atom_return;
   int foo;
   unsigned long ulfoo, nitems;
 
   BlackboxAttributes *net;
-  int ret = XGetWindowProperty(blackbox->getXDisplay(), client.window,
-                               blackbox->getBlackboxAttributesAtom(), 0l,
-                               PropBlackboxAttributesElements, False,
-                               blackbox->getBlackboxAttributesAtom(),
-                               &atom_return, &foo, &nitems, &ulfoo,
-                               (unsigned char **) &net);
+  int ret = tracedGetWindowProperty(blackbox->getXDisplay(), client.window,
+                                    blackbox->getBlackboxAttributesAtom(), 0l,
+                                    PropBlackboxAttributesElements, False,
+                                    blackbox->getBlackboxAttributesAtom(),
+                                    &atom_return, &foo, &nitems, &ulfoo,
+                                    (unsigned char **) &net);
   if (ret != Success || !net || nitems != PropBlackboxAttributesElements)
     return;
 
@@ -1907,13 +2558,8 @@ void BlackboxWindow::restoreGravity(Rect &r) {
 }
 
 
-void BlackboxWindow::redrawLabel(void) const {
-  //WindowsWM ext
-#if defined(DEBUG)
-  fprintf(stderr, "XWindowsWMFrameSetTitle %s\n", client.title.c_str());
-#endif
-  XWindowsWMFrameSetTitle(blackbox->getXDisplay(), 0, client.window,
-                          client.title.length(), client.title.c_str());
+void BlackboxWindow::redrawLabel(void) {
+  setNativeTitle(client.window, native, client.title);
 }
 
 
@@ -1958,7 +2604,8 @@ void BlackboxWindow::mapRequestEvent(const XMapRequestEvent *re) {
     show();
     screen->getWorkspace(blackbox_attrib.workspace)->raiseWindow(this);
     if (! blackbox->isStartup() && (isTransient() || screen->doFocusNew())) {
-      XSync(blackbox->getXDisplay(), False); // make sure the frame is mapped..
+      // make sure the frame is mapped..
+      BROUNDTRIP(Sync, XSync(blackbox->getXDisplay(), False));
       setInputFocus();
     }
     break;
@@ -2003,12 +2650,25 @@ void BlackboxWindow::reparentNotifyEvent(const XReparentEvent *re) {
 
   XEvent ev;
   ev.xreparent = *re;
-  XPutBackEvent(blackbox->getXDisplay(), &ev);
+  blackbox->putBackEvent(&ev);
   screen->unmanageWindow(this, True);
 }
 
 
 void BlackboxWindow::propertyNotifyEvent(const XPropertyEvent *pe) {
+  // the EWMH names are only read while the client has them set, see
+  // getWMName()
+  if (pe->atom == blackbox->getNETWMNameAtom()) {
+    flags.net_wm_name = (pe->state == PropertyNewValue);
+    queueTitleUpdate(False);
+    return;
+  }
+  if (pe->atom == blackbox->getNETWMIconNameAtom()) {
+    flags.net_wm_icon_name = (pe->state == PropertyNewValue);
+    queueTitleUpdate(True);
+    return;
+  }
+
   if (pe->state == PropertyDelete || ! validateClient())
     return;
 
@@ -2019,25 +2679,15 @@ void BlackboxWindow::propertyNotifyEvent(const XPropertyEvent *pe) {
 
   switch(pe->atom) {
   case XA_WM_CLASS:
-    getWMClass();
-    break;
-
   case XA_WM_CLIENT_MACHINE:
   case XA_WM_COMMAND:
+    fetchProperty(pe->atom);
     break;
 
-  case XA_WM_TRANSIENT_FOR: {
-    // determine if this is a transient window
-    getTransientInfo();
-
-    // adjust the window decorations based on transience
-    if (isTransient()) {
-      decorations &= ~(Decor_Maximize | Decor_Handle);
-      functions &= ~Func_Maximize;
-    }
-
-    reconfigure();
-  }
+  case XA_WM_TRANSIENT_FOR:
+    // determine if this is a transient window, once the hint is read
+    blackbox->propertyFetcher()->fetch(this, client.window,
+                                       XA_WM_TRANSIENT_FOR, XA_WINDOW, 1);
     break;
 
   case XA_WM_HINTS:
@@ -2045,54 +2695,25 @@ void BlackboxWindow::propertyNotifyEvent(const XPropertyEvent *pe) {
     break;
 
   case XA_WM_ICON_NAME:
-    getWMIconName();
-    if (flags.iconic) screen->propagateWindowName(this);
+    queueTitleUpdate(True);
     break;
 
   case XA_WM_NAME:
-    getWMName();
-
-    if (decorations & Decor_Titlebar)
-      redrawLabel();
-
-    screen->propagateWindowName(this);
+    queueTitleUpdate(False);
     break;
 
-  case XA_WM_NORMAL_HINTS: {
+  case XA_WM_NORMAL_HINTS:
     getWMNormalHints();
-
-    if ((client.normal_hint_flags & PMinSize) &&
-        (client.normal_hint_flags & PMaxSize)) {
-      // the window now can/can't resize itself, so the buttons need to be
-      // regrabbed.
-      ungrabButtons();
-      if (client.max_width <= client.min_width &&
-          client.max_height <= client.min_height) {
-        decorations &= ~(Decor_Maximize | Decor_Handle);
-        functions &= ~(Func_Resize | Func_Maximize);
-      } else {
-        if (! isTransient()) {
-          decorations |= Decor_Maximize | Decor_Handle;
-          functions |= Func_Maximize;
-        }
-        functions |= Func_Resize;
-      }
-      grabButtons();
-    }
-
-    Rect old_rect = frame.rectFrame;
-
-    upsize();
-
-    if (old_rect != frame.rectFrame)
-      reconfigure();
-
+    normalHintsChanged();
     break;
-  }
 
   default:
-    if (pe->atom == blackbox->getWMProtocolsAtom()) {
-      getWMProtocols();
+    if (pe->atom == blackbox->getNETWMIconAtom()) {
+      icon_loader->start();
+    } else if (pe->atom == blackbox->getWMProtocolsAtom()) {
+      blackbox->propertyFetcher()->fetch(this, client.window,
+                                         blackbox->getWMProtocolsAtom(),
+                                         XA_ATOM);
 /*
       if ((decorations & Decor_Close) && (! frame.close_button)) {
         createCloseButton();
@@ -2139,12 +2760,10 @@ void BlackboxWindow::configureRequestEvent(const XConfigureRequestEvent *cr) {
 #if defined(DEBUG)
           fprintf(stderr, "configureRequestEvent - maximized");
 #endif
-          short fx, fy, fw, fh;
-          XWindowsWMFrameGetRect(blackbox->getXDisplay(),
-                                 frame_style, frame_style_ex, 0,
-                                 cr->x, cr->y, cr->width, cr->height,
-                                 &fx, &fy, &fw, &fh);
-          frame.rectFrame.setRect(fx, fy, fw, fh);
+          const Strut &margin = frameMargin();
+          frame.rectFrame.setRect(cr->x - margin.left, cr->y - margin.top,
+                                  cr->width + margin.left + margin.right,
+                                  cr->height + margin.top + margin.bottom);
 
           XWindowChanges wc;
           wc.x = cr->x;
@@ -2421,8 +3040,7 @@ void BlackboxWindow::enterNotifyEvent(const XCrossingEvent* ce) {
   XEvent e;
   bool leave = False, inferior = False;
 
-  while (XCheckTypedWindowEvent(blackbox->getXDisplay(), ce->window,
-                                LeaveNotify, &e)) {
+  while (blackbox->checkTypedWindowEvent(ce->window, LeaveNotify, &e)) {
     if (e.type == LeaveNotify && e.xcrossing.mode == NotifyNormal) {
       leave = True;
       inferior = (e.xcrossing.detail == NotifyInferior);
@@ -2568,19 +3186,23 @@ void BlackboxWindow::windowsWMControllerEvent(XWindowsWMNotifyEvent *windows_wm_
 
 
 bool BlackboxWindow::validateClient(void) const {
-  XSync(blackbox->getXDisplay(), False);
+  blackbox->syncEvents();
 
+  return ! clientGone();
+}
+
+
+// whether a DestroyNotify or UnmapNotify for the client is already queued
+bool BlackboxWindow::clientGone(void) const {
   XEvent e;
-  if (XCheckTypedWindowEvent(blackbox->getXDisplay(), client.window,
-                             DestroyNotify, &e) ||
-      XCheckTypedWindowEvent(blackbox->getXDisplay(), client.window,
-                             UnmapNotify, &e)) {
-    XPutBackEvent(blackbox->getXDisplay(), &e);
+  if (blackbox->checkTypedWindowEvent(client.window, DestroyNotify, &e) ||
+      blackbox->checkTypedWindowEvent(client.window, UnmapNotify, &e)) {
+    blackbox->putBackEvent(&e);
 
-    return False;
+    return True;
   }
 
-  return True;
+  return False;
 }
 
 
@@ -2594,12 +3216,14 @@ void BlackboxWindow::restore(bool remap) {
 
   XUnmapWindow(blackbox->getXDisplay(), window_in_taskbar);
   XUnmapWindow(blackbox->getXDisplay(), client.window);
+  frame_timer->stop();
+  native_taskbar.reset();
+  native.reset();
 
   XSetWindowBorderWidth(blackbox->getXDisplay(), client.window, client.old_bw);
 
   XEvent ev;
-  if (XCheckTypedWindowEvent(blackbox->getXDisplay(), client.window,
-                             ReparentNotify, &ev)) {
+  if (blackbox->checkTypedWindowEvent(client.window, ReparentNotify, &ev)) {
     remap = True;
   } else {
     // according to the ICCCM - if the client doesn't reparent to
@@ -2608,11 +3232,9 @@ void BlackboxWindow::restore(bool remap) {
                     screen->getRootWindow(),
                     client.rect.x(), client.rect.y());
   }
-  XWindowsWMFrameDraw(blackbox->getXDisplay(), 0, client.window,
-                      WindowsWMFrameStylePopup | WindowsWMFrameStyleClipChildren,
-                      WindowsWMFrameStyleExToolWindow,
-                      client.rect.x(), client.rect.y(),
-                      client.rect.width(), client.rect.height());
+  drawNativeFrame(client.window, native,
+                  WindowsWMFrameStylePopup | WindowsWMFrameStyleClipChildren,
+                  WindowsWMFrameStyleExToolWindow, client.rect);
 
   if (remap) XMapWindow(blackbox->getXDisplay(), client.window);
 }
@@ -2735,13 +3357,20 @@ void BlackboxWindow::upsize(void) {
     frame_style &= ~WindowsWMFrameStyleSizeBox;
   }
 #endif
-  short fx, fy, fw, fh;
-  XWindowsWMFrameGetRect(blackbox->getXDisplay(),
-                         frame_style, frame_style_ex, 0,
-                         client.rect.x(), client.rect.y(),
-                         client.rect.width(), client.rect.height(),
-                         &fx, &fy, &fw, &fh);
-  frame.rectFrame.setRect(fx, fy, fw, fh);
+  const Strut &margin = frameMargin();
+  bool changed = (! flags.frame_extents ||
+                  margin.left != frame.margin.left ||
+                  margin.right != frame.margin.right ||
+                  margin.top != frame.margin.top ||
+                  margin.bottom != frame.margin.bottom);
+  frame.margin = margin;
+
+  frame.rectFrame.setRect(client.rect.x() - frame.margin.left,
+                          client.rect.y() - frame.margin.top,
+                          client.rect.width() +
+                          frame.margin.left + frame.margin.right,
+                          client.rect.height() +
+                          frame.margin.top + frame.margin.bottom);
 #if defined(DEBUG)
   fprintf(stderr, "upsize\n"
           "\t%d %d %d %d\n"
@@ -2751,17 +3380,208 @@ void BlackboxWindow::upsize(void) {
           frame.rectFrame.x(), frame.rectFrame.y(),
           frame.rectFrame.width(), frame.rectFrame.height());
 #endif
-  frame.margin.left = client.rect.x() - fx;
-  assert(frame.margin.left >= 0);
 
-  frame.margin.right = fx + fw - (client.rect.x() + client.rect.width());
-  assert(frame.margin.right >= 0);
+  if (changed)
+    setFrameExtents();
+}
+
+
+/*
+ * Returns the margins the native frame adds around the client for the
+ * current frame style.  XWindowsWMFrameGetRect is a round trip, so it is
+ * only called the first time a style pair is seen.
+ */
+const Strut &BlackboxWindow::frameMargin(void) const {
+  FrameStyle style(frame_style, frame_style_ex);
+  FrameMarginCache::iterator it = marginCache.find(style);
+  if (it != marginCache.end())
+    return it->second;
+
+  short fx, fy, fw, fh;
+  BROUNDTRIP(FrameGetRect,
+             XWindowsWMFrameGetRect(blackbox->getXDisplay(),
+                                    frame_style, frame_style_ex, 0,
+                                    client.rect.x(), client.rect.y(),
+                                    client.rect.width(),
+                                    client.rect.height(),
+                                    &fx, &fy, &fw, &fh));
+
+  int left = client.rect.x() - fx,
+    right = fx + fw - (client.rect.x() + client.rect.width()),
+    top = client.rect.y() - fy,
+    bottom = fy + fh - (client.rect.y() + client.rect.height());
+  assert(left >= 0 && right >= 0 && top >= 0 && bottom >= 0);
+
+  Strut margin;
+  margin.left = left;
+  margin.right = right;
+  margin.top = top;
+  margin.bottom = bottom;
+
+  return marginCache.insert(FrameMarginCache::value_type(style, margin)).
+    first->second;
+}
+
 
-  frame.margin.top = client.rect.y() - fy;
-  assert(frame.margin.top >= 0);
+/*
+ * Publish the frame margins as _NET_FRAME_EXTENTS so clients do not have
+ * to work them out from their own position.
+ */
+void BlackboxWindow::setFrameExtents(void) {
+  unsigned long extents[4];
+  extents[0] = frame.margin.left;
+  extents[1] = frame.margin.right;
+  extents[2] = frame.margin.top;
+  extents[3] = frame.margin.bottom;
+
+  XChangeProperty(blackbox->getXDisplay(), client.window,
+                  blackbox->getNETFrameExtentsAtom(), XA_CARDINAL, 32,
+                  PropModeReplace, (unsigned char *) extents, 4);
+  flags.frame_extents = True;
+}
+
+
+/*
+ * Send a frame to the WindowsWM extension, unless the native window was
+ * last drawn with exactly the same style and geometry.
+ */
+void BlackboxWindow::drawNativeFrame(Window w, NativeFrame &nf,
+                                     unsigned int style,
+                                     unsigned int style_ex, const Rect &r) {
+  if (nf.drawn && nf.style == style && nf.style_ex == style_ex &&
+      nf.rect == r) {
+    ++frame_stats.draws_skipped;
+    return;
+  }
+
+  XWindowsWMFrameDraw(blackbox->getXDisplay(), 0, w, style, style_ex,
+                      r.x(), r.y(), r.width(), r.height());
+  ++frame_stats.draws;
+
+  nf.drawn = True;
+  nf.style = style;
+  nf.style_ex = style_ex;
+  nf.rect = r;
+}
+
+
+void BlackboxWindow::setNativeTitle(Window w, NativeFrame &nf,
+                                    const std::string &title) {
+  if (nf.titled && nf.title == title) {
+    ++frame_stats.titles_skipped;
+    return;
+  }
+
+#if defined(DEBUG)
+  fprintf(stderr, "XWindowsWMFrameSetTitle %s\n", title.c_str());
+#endif
+  XWindowsWMFrameSetTitle(blackbox->getXDisplay(), 0, w,
+                          title.length(), title.c_str());
+  ++frame_stats.titles;
+
+  nf.titled = True;
+  nf.title = title;
+}
+
+
+/*
+ * Schedule a redraw of the client's native frame.  The timer has no delay,
+ * so it fires once the pending events have been handled, and any number
+ * of changes made while handling them end in a single draw.
+ */
+void BlackboxWindow::queueFrameDraw(void) {
+  if (frame_timer->isTiming()) {
+    ++frame_stats.draws_coalesced;
+    return;
+  }
+
+  frame_timer->start();
+}
+
+
+/*
+ * Fits the decorations and the frame to size hints that have changed.
+ */
+void BlackboxWindow::normalHintsChanged(void) {
+  if ((client.normal_hint_flags & PMinSize) &&
+      (client.normal_hint_flags & PMaxSize)) {
+    // the window now can/can't resize itself, so the buttons need to be
+    // regrabbed.
+    if (client.max_width <= client.min_width &&
+        client.max_height <= client.min_height) {
+      decorations &= ~(Decor_Maximize | Decor_Handle);
+      functions &= ~(Func_Resize | Func_Maximize);
+    } else {
+      if (! isTransient()) {
+        decorations |= Decor_Maximize | Decor_Handle;
+        functions |= Func_Maximize;
+      }
+      functions |= Func_Resize;
+    }
+    grabButtons();
+  }
+
+  Rect old_rect = frame.rectFrame;
+
+  upsize();
+
+  if (old_rect != frame.rectFrame)
+    reconfigure();
+}
+
+
+/*
+ * Note that a name changed.  The timer is not restarted by later changes,
+ * so the names are read at most once per TitleUpdateDelay however often
+ * the client sets them, and the last value set always gets through.
+ */
+void BlackboxWindow::queueTitleUpdate(bool icon) {
+  if (icon)
+    flags.icon_title_changed = True;
+  else
+    flags.title_changed = True;
+
+  if (! title_timer->isTiming()) title_timer->start();
+}
+
+
+void BlackboxWindow::updateTitle(void) {
+  std::string old_title = client.title,
+    old_icon_title = getIconTitle();
+
+  if (flags.title_changed) getWMName();
+  if (flags.icon_title_changed) getWMIconName();
+  flags.title_changed = flags.icon_title_changed = False;
+
+  const bool title_changed = (client.title != old_title),
+    icon_title_changed = (old_icon_title != getIconTitle());
+  if (! title_changed && ! icon_title_changed)
+    return;
+
+  if (flags.iconic) {
+    // only the frame's title waits until the window is shown again
+    if (icon_title_changed)
+      setNativeTitle(window_in_taskbar, native_taskbar,
+                     std::string("[*]") + getIconTitle());
+  } else if (title_changed && flags.visible) {
+    // the native title is also shown in the taskbar, so it is set even if
+    // the frame has no caption.  an unmapped window gets it when shown.
+    redrawLabel();
+  }
+
+  // the window lists show the names in every state
+  screen->propagateWindowName(this);
+}
+
+
+void BlackboxWindow::flushFrameDraw(void) {
+  // there is no native frame until the window is mapped
+  if (! flags.visible)
+    return;
 
-  frame.margin.bottom = fy + fh - (client.rect.y() + client.rect.height());
-  assert(frame.margin.bottom >= 0);
+  setNativeTitle(client.window, native, client.title);
+  drawNativeFrame(client.window, native, frame_style, frame_style_ex,
+                  client.rect);
 }
 
 
@@ -2847,13 +3667,13 @@ void* BlackboxWindow::getHWnd(Window w) {
   Atom atom_return;
   int format;
   unsigned long ulfoo, nitems;
-  HWND hWnd, *phWnd;
+  void *hWnd, **phWnd;
 
-  if ((XGetWindowProperty (blackbox->getXDisplay(), w,
-                           blackbox->getWindowsWMNativeHWnd(),
-                           0l, 1l, False, XA_INTEGER,
-                           &atom_return, &format, &nitems, &ulfoo,
-                           (unsigned char **) &phWnd) == Success)
+  if ((tracedGetWindowProperty(blackbox->getXDisplay(), w,
+                               blackbox->getWindowsWMNativeHWnd(),
+                               0l, 1l, False, XA_INTEGER,
+                               &atom_return, &format, &nitems, &ulfoo,
+                               (unsigned char **) &phWnd) == Success)
       && phWnd){
     hWnd = *phWnd;
     XFree (phWnd);
@@ -2869,7 +3689,7 @@ void* BlackboxWindow::getHWnd(Window w) {
 BWindowGroup::BWindowGroup(Blackbox *b, Window _group)
   : blackbox(b), group(_group) {
   XWindowAttributes wattrib;
-  if (! XGetWindowAttributes(blackbox->getXDisplay(), group, &wattrib)) {
+  if (! tracedGetWindowAttributes(blackbox->getXDisplay(), group, &wattrib)) {
     // group window doesn't seem to exist anymore
     delete this;
     return;
@@ -35,9 +35,13 @@ extern "C" {
 #include <X11/extensions/windowswmstr.h>
 }
 
+#include <map>
 #include <string>
 
 #include "BaseDisplay.hh"
+#include "Icon.hh"
+#include "PropertyFetcher.hh"
+#include "Snapshot.hh"
 #include "Timer.hh"
 #include "Util.hh"
 
@@ -93,7 +97,8 @@ public:
 };
 
 
-class BlackboxWindow : public TimeoutHandler {
+class BlackboxWindow : public TimeoutHandler, public BIconHandler,
+                       public BPropertyHandler {
 public:
   enum Function { Func_Resize   = (1l << 0),
                   Func_Move     = (1l << 1),
@@ -110,12 +115,37 @@ public:
                     Decor_Close    = (1l << 5) };
   typedef unsigned char DecorationFlags;
 
+  // what reconfigure() redoes
+  enum Reconfigure { ReconfigureFrame = (1l << 0),
+                     ReconfigureGrabs = (1l << 1),
+                     ReconfigureAll   = (ReconfigureFrame |
+                                         ReconfigureGrabs) };
+
+  struct FrameStatistics {
+    unsigned long draws, draws_skipped, draws_coalesced,
+      titles, titles_skipped;
+  };
+
 private:
   Blackbox *blackbox;
   BScreen *screen;
   BTimer *timer;
   BlackboxAttributes blackbox_attrib;
 
+  // redraws the native frame once the current batch of events is handled
+  BTimerForward<BlackboxWindow> frame_timeout;
+  BTimer *frame_timer;
+
+  // reads the window and icon names a short while after they change
+  BTimerForward<BlackboxWindow> title_timeout;
+  BTimer *title_timer;
+
+  // reads _NET_WM_ICON in the background
+  BIconLoader *icon_loader;
+
+  // the buttons grabbed on the client window
+  BButtonGrabs button_grabs;
+
   Time lastButtonPressTime;  // used for double clicks, when were we clicked
 
   unsigned int window_number;
@@ -125,6 +155,11 @@ private:
                    F_LocallyActive, F_GloballyActive };
   FocusMode focus_mode;
 
+  // the WM_PROTOCOLS we act on
+  enum Protocol { Protocol_Delete            = (1l << 0),
+                  Protocol_TakeFocus         = (1l << 1),
+                  Protocol_StructureMessages = (1l << 2) };
+
   struct _flags {
     bool moving,             // is moving?
       resizing,              // is resizing?
@@ -135,7 +170,12 @@ private:
       //stuck,                 // is omnipresent
       modal,                 // is modal? (must be dismissed to continue)
       send_focus_message,    // should we send focus messages to our client?
-      shaped;                // does the frame use the shape extension?
+      shaped,                // does the frame use the shape extension?
+      frame_extents,         // have the margins been published to the client?
+      title_changed,         // has WM_NAME changed since it was read?
+      icon_title_changed,    // has WM_ICON_NAME changed since it was read?
+      net_wm_name,           // might the client have set _NET_WM_NAME?
+      net_wm_icon_name;      // might it have set _NET_WM_ICON_NAME?
     unsigned int maximized;  // maximize is special, the number corresponds
                              // with a mouse button
                              // if 0, not maximized
@@ -148,7 +188,21 @@ private:
     BlackboxWindow *transient_for;  // which window are we a transient for?
     BlackboxWindowList transientList; // which windows are our transients?
 
-    std::string title, icon_title;
+    std::string title, icon_title;   // icon_title is empty if not set
+
+    Pixmap icon_pixmap, icon_mask;
+    Window icon_window;
+
+    XWMHints wm_hints;                // as last read, flags is 0 if unset
+    unsigned long protocols;          // Protocol flags, as last read
+
+    // read in the background and only kept for now, empty until then
+    std::string res_name, res_class,  // WM_CLASS
+      command,                        // WM_COMMAND, with spaces for NULs
+      machine;                        // WM_CLIENT_MACHINE
+    unsigned long pid;                // _NET_WM_PID, 0 if unset
+    BIconCacheItem *net_icon,         // made from _NET_WM_ICON
+      *net_small_icon;
 
     Rect rect;
 
@@ -179,6 +233,15 @@ private:
   unsigned int frame_style;
   unsigned int frame_style_ex;
 
+  /*
+   * the margins of a native frame depend only on its style, so they are
+   * asked from the WindowsWM extension once per style pair and shared by
+   * all windows
+   */
+  typedef std::pair<unsigned int, unsigned int> FrameStyle;
+  typedef std::map<FrameStyle, Strut> FrameMarginCache;
+  static FrameMarginCache marginCache;
+
   /*
    * client window = the application's window
    * frame window = the window drawn around the outside of the client window
@@ -221,6 +284,25 @@ private:
 
   Window window_in_taskbar;       // the frame
 
+  /*
+   * what was last sent to the WindowsWM extension for one of our native
+   * windows, so that requests which would change nothing can be skipped.
+   * the native window goes away when its X window is unmapped, so the
+   * record is reset then.
+   */
+  struct NativeFrame {
+    bool drawn, titled;
+    unsigned int style, style_ex;
+    Rect rect;
+    std::string title;
+
+    NativeFrame(void): drawn(False), titled(False), style(0), style_ex(0) {}
+    void reset(void) { drawn = titled = False; }
+  };
+  NativeFrame native, native_taskbar;
+
+  static FrameStatistics frame_stats;
+
   BlackboxWindow(const BlackboxWindow&);
   BlackboxWindow& operator=(const BlackboxWindow&);
 
@@ -229,17 +311,32 @@ private:
   Window createChildWindow(Window parent, unsigned long event_mask,
                            Cursor = None);
 
+  bool getUTF8Property(Atom atom, std::string &value, bool &exists) const;
   void getWMName(void);
   void getWMIconName(void);
   void getWMNormalHints(void);
+  void setWMNormalHints(const XSizeHints *sizehint);
+  void normalHintsChanged(void);
   void getWMProtocols(void);
+  void setWMProtocols(const Atom *proto, unsigned long count);
   void getWMHints(void);
+  void setWMHints(const XWMHints *wmhint);
+  void restoreHints(const BSnapshotWindow &snapshot);
+  void recheckHints(void);
+  void hintsFetched(const BProperty &property);
+  void nameFetched(const BProperty &property);
+  void setTaskbarHints(void);
+  void setTaskbarIcon(void);
+  void releaseNetWMIcon(void);
   void getMWMHints(void);
-  void getWMClass(void);
+  void fetchProperty(Atom property);
   bool getBlackboxHints(void);
   void getTransientInfo(void);
+  void setTransientFor(Window trans_for);
+  void transientChanged(void);
   void setNetWMAttributes(void);
-  void associateClientWindow(void);
+  void associateClientWindow(bool read_names);
+  bool clientGone(void) const;
   void decorate(void);
   void decorateLabel(void);
   void positionButtons(bool redecorate_label = False);
@@ -255,7 +352,7 @@ private:
   void createMaximizeButton(void);
   void destroyMaximizeButton(void);
   void redrawWindowFrame(void) const;
-  void redrawLabel(void) const;
+  void redrawLabel(void);
   void redrawAllButtons(void) const;
   void redrawCloseButton(bool pressed) const;
   void redrawIconifyButton(bool pressed) const;
@@ -264,15 +361,32 @@ private:
   void restoreGravity(Rect &r);
   void setState(unsigned long new_state);
   void upsize(void);
+  void drawNativeFrame(Window w, NativeFrame &nf, unsigned int style,
+                       unsigned int style_ex, const Rect &r);
+  void setNativeTitle(Window w, NativeFrame &nf, const std::string &title);
+  void queueFrameDraw(void);
+  void flushFrameDraw(void);
+  void queueTitleUpdate(bool icon);
+  void updateTitle(void);
+  const Strut &frameMargin(void) const;
+  void setFrameExtents(void);
   void* getHWnd(Window w);
 
   enum Corner { TopLeft, TopRight };
   void constrain(Corner anchor, unsigned int *pw = 0, unsigned int *ph = 0);
 
 public:
-  BlackboxWindow(Blackbox *b, Window w, BScreen *s);
+  // with a snapshot, what it says replaces reading the state and the
+  // hints back from the window's properties, and the attributes are those
+  // the snapshot was checked against
+  BlackboxWindow(Blackbox *b, Window w, BScreen *s,
+                 const BSnapshotWindow *snapshot = 0,
+                 const XWindowAttributes *attributes = 0);
   virtual ~BlackboxWindow(void);
 
+  virtual void iconLoaded(const BIcon &large, const BIcon &small);
+  virtual void propertyFetched(const BProperty &property);
+
   inline bool isTransient(void) const { return client.transient_for != 0; }
   inline bool isFocused(void) const { return flags.focused; }
   inline bool isVisible(void) const { return flags.visible; }
@@ -298,10 +412,21 @@ public:
   inline Window getClientWindow(void) const { return client.window; }
   inline Window getGroupWindow(void) const { return client.window_group; }
 
+  inline const std::string &getResName(void) const
+  { return client.res_name; }
+  inline const std::string &getResClass(void) const
+  { return client.res_class; }
+  inline const std::string &getCommand(void) const
+  { return client.command; }
+  inline const std::string &getClientMachine(void) const
+  { return client.machine; }
+  inline unsigned long getPid(void) const { return client.pid; }
+
   inline const char *getTitle(void) const
   { return client.title.c_str(); }
   inline const char *getIconTitle(void) const
-  { return client.icon_title.c_str(); }
+  { return (client.icon_title.empty() ? client.title : client.icon_title).
+      c_str(); }
 
   inline unsigned int getWorkspaceNumber(void) const
   { return blackbox_attrib.workspace; }
@@ -328,7 +453,7 @@ public:
   void remaximize(void);
   //  void shade(void);
   //  void stick(void);
-  void reconfigure(void);
+  void reconfigure(unsigned int changes = ReconfigureAll);
   void grabButtons(void);
   void ungrabButtons(void);
   void installColormap(bool install);
@@ -337,6 +462,12 @@ public:
   void setWorkspace(unsigned int n);
   void changeBlackboxHints(const BlackboxHints *net);
   void restoreAttributes(void);
+  void saveSnapshot(BSnapshotWindow &snapshot,
+                    std::string text[BSnapshotWindow::TextCount]);
+  void restoreSnapshot(const BSnapshotWindow &snapshot);
+  // once every window of a snapshot is managed, for a transient managed
+  // before the window it is for
+  void resolveTransient(const BSnapshotWindow &snapshot);
 
   void buttonPressEvent(const XButtonEvent *be);
   void buttonReleaseEvent(const XButtonEvent *re);
@@ -359,6 +490,8 @@ public:
   void windowsWMControllerEvent(XWindowsWMNotifyEvent *windows_wm_event);
 
   virtual void timeout(void);
+
+  static const FrameStatistics &frameStatistics(void) { return frame_stats; }
 };
 
 
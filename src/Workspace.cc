@@ -49,7 +49,10 @@ using std::string;
 #include "i18n.hh"
 #include "blackbox.hh"
 #include "Netizen.hh"
+#include "Placement.hh"
+#include "RoundTrips.hh"
 #include "Screen.hh"
+#include "Stacking.hh"
 #include "Util.hh"
 #include "Window.hh"
 #include "Workspace.hh"
@@ -165,100 +168,48 @@ void Workspace::removeAll(void) {
 
 
 /*
- * returns the number of transients for win, plus the number of transients
- * associated with each transient of win
+ * puts each window it is given next in the stack, and on the top or the
+ * bottom of the stacking list of its workspace
  */
-static unsigned int countTransients(const BlackboxWindow * const win) {
-  BlackboxWindowList transients = win->getTransients();
-  if (transients.empty()) return 0;
+class Workspace::Stacker {
+public:
+  Stacker(BScreen *s, StackVector &v, bool r)
+    : screen(s), stack(v.begin()), raise(r) {}
 
-  unsigned int ret = transients.size();
-  BlackboxWindowList::const_iterator it = transients.begin(),
-    end = transients.end();
-  for (; it != end; ++it)
-    ret += countTransients(*it);
-
-  return ret;
-}
-
-
-/*
- * puts the transients of win into the stack. windows are stacked above
- * the window before it in the stackvector being iterated, meaning
- * stack[0] is on bottom, stack[1] is above stack[0], stack[2] is above
- * stack[1], etc...
- */
-void Workspace::raiseTransients(const BlackboxWindow * const win,
-                                StackVector::iterator &stack) {
-  if (win->getTransients().empty()) return; // nothing to do
-
-  // put win's transients in the stack
-  BlackboxWindowList::const_iterator it, end = win->getTransients().end();
-  for (it = win->getTransients().begin(); it != end; ++it) {
-    BlackboxWindow *w = *it;
+  void operator()(BlackboxWindow *w) {
     *stack++ = w->getClientWindow();
-    screen->updateNetizenWindowRaise(w->getClientWindow());
+    if (raise)
+      screen->updateNetizenWindowRaise(w->getClientWindow());
+    else
+      screen->updateNetizenWindowLower(w->getClientWindow());
 
     if (! w->isIconic()) {
       Workspace *wkspc = screen->getWorkspace(w->getWorkspaceNumber());
       wkspc->stackingList.remove(w);
-      wkspc->stackingList.push_front(w);
+      if (raise)
+        wkspc->stackingList.push_front(w);
+      else
+        wkspc->stackingList.push_back(w);
     }
   }
 
-  // put transients of win's transients in the stack
-  for (it = win->getTransients().begin(); it != end; ++it)
-    raiseTransients(*it, stack);
-}
-
-
-void Workspace::lowerTransients(const BlackboxWindow * const win,
-                                StackVector::iterator &stack) {
-  if (win->getTransients().empty()) return; // nothing to do
-
-  // put transients of win's transients in the stack
-  BlackboxWindowList::const_reverse_iterator it,
-    end = win->getTransients().rend();
-  for (it = win->getTransients().rbegin(); it != end; ++it)
-    lowerTransients(*it, stack);
-
-  // put win's transients in the stack
-  for (it = win->getTransients().rbegin(); it != end; ++it) {
-    BlackboxWindow *w = *it;
-    *stack++ = w->getClientWindow();
-    screen->updateNetizenWindowLower(w->getClientWindow());
-
-    if (! w->isIconic()) {
-      Workspace *wkspc = screen->getWorkspace(w->getWorkspaceNumber());
-      wkspc->stackingList.remove(w);
-      wkspc->stackingList.push_back(w);
-    }
-  }
-}
+private:
+  BScreen *screen;
+  StackVector::iterator stack;
+  bool raise;
+};
 
 
 void Workspace::raiseWindow(BlackboxWindow *w) {
-  BlackboxWindow *win = w;
-
-  // walk up the transient_for's to the window that is not a transient
-  while (win->isTransient() && win->getTransientFor())
-    win = win->getTransientFor();
+  BRoundTrips::OperationScope operation(BRoundTrips::Raise);
 
-  // get the total window count (win and all transients)
-  unsigned int i = 1 + countTransients(win);
+  BlackboxWindow *win = transientRoot(w);
 
   // stack the window with all transients above
-  StackVector stack_vector(i);
-  StackVector::iterator stack = stack_vector.begin();
-
-  *(stack++) = win->getClientWindow();
-  screen->updateNetizenWindowRaise(win->getClientWindow());
-  if (! win->isIconic()) {
-    Workspace *wkspc = screen->getWorkspace(win->getWorkspaceNumber());
-    wkspc->stackingList.remove(win);
-    wkspc->stackingList.push_front(win);
-  }
+  StackVector stack_vector(1 + countTransients(win));
+  Stacker stack(screen, stack_vector, True);
 
+  stack(win);
   raiseTransients(win, stack);
 
   screen->raiseWindows(&stack_vector[0], stack_vector.size());
@@ -266,28 +217,16 @@ void Workspace::raiseWindow(BlackboxWindow *w) {
 
 
 void Workspace::lowerWindow(BlackboxWindow *w) {
-  BlackboxWindow *win = w;
-
-  // walk up the transient_for's to the window that is not a transient
-  while (win->isTransient() && win->getTransientFor())
-    win = win->getTransientFor();
+  BRoundTrips::OperationScope operation(BRoundTrips::Lower);
 
-  // get the total window count (win and all transients)
-  unsigned int i = 1 + countTransients(win);
+  BlackboxWindow *win = transientRoot(w);
 
   // stack the window with all transients above
-  StackVector stack_vector(i);
-  StackVector::iterator stack = stack_vector.begin();
+  StackVector stack_vector(1 + countTransients(win));
+  Stacker stack(screen, stack_vector, False);
 
   lowerTransients(win, stack);
-
-  *(stack++) = win->getClientWindow();
-  screen->updateNetizenWindowLower(win->getClientWindow());
-  if (! win->isIconic()) {
-    Workspace *wkspc = screen->getWorkspace(win->getWorkspaceNumber());
-    wkspc->stackingList.remove(win);
-    wkspc->stackingList.push_back(win);
-  }
+  stack(win);
 
   XLowerWindow(screen->getBaseDisplay()->getXDisplay(), stack_vector.front());
   XRestackWindows(screen->getBaseDisplay()->getXDisplay(),
@@ -295,9 +234,10 @@ void Workspace::lowerWindow(BlackboxWindow *w) {
 }
 
 
-void Workspace::reconfigure(void) {
-  std::for_each(windowList.begin(), windowList.end(),
-                std::mem_fun(&BlackboxWindow::reconfigure));
+void Workspace::reconfigure(unsigned int changes) {
+  BlackboxWindowList::iterator it = windowList.begin();
+  for (; it != windowList.end(); ++it)
+    (*it)->reconfigure(changes);
 }
 
 
@@ -387,7 +327,7 @@ void Workspace::show(void) {
   std::for_each(stackingList.begin(), stackingList.end(),
                 std::mem_fun(&BlackboxWindow::show));
 
-  XSync(screen->getBlackbox()->getXDisplay(), False);
+  BROUNDTRIP(Sync, XSync(screen->getBlackbox()->getXDisplay(), False));
 
   if (screen->doFocusLast()) {
     if (! screen->isSloppyFocus() && ! lastfocus && ! stackingList.empty())
@@ -427,174 +367,23 @@ void Workspace::setName(const string& new_name) {
 }
 
 
-/*
- * Calculate free space available for window placement.
- */
-typedef std::vector<Rect> rectList;
-
-static rectList calcSpace(const Rect &win, const rectList &spaces) {
-  Rect isect, extra;
-  rectList result;
-  rectList::const_iterator siter, end = spaces.end();
-  for (siter = spaces.begin(); siter != end; ++siter) {
-    const Rect &curr = *siter;
-
-    if(! win.intersects(curr)) {
-      result.push_back(curr);
-      continue;
-    }
-
-    /* Use an intersection of win and curr to determine the space around
-     * curr that we can use.
-     *
-     * NOTE: the spaces calculated can overlap.
-     */
-    isect = curr & win;
-
-    // left
-    extra.setCoords(curr.left(), curr.top(),
-                    isect.left() - 1, curr.bottom());
-    if (extra.valid()) result.push_back(extra);
-
-    // top
-    extra.setCoords(curr.left(), curr.top(),
-                    curr.right(), isect.top() - 1);
-    if (extra.valid()) result.push_back(extra);
-
-    // right
-    extra.setCoords(isect.right() + 1, curr.top(),
-                    curr.right(), curr.bottom());
-    if (extra.valid()) result.push_back(extra);
-
-    // bottom
-    extra.setCoords(curr.left(), isect.bottom() + 1,
-                    curr.right(), curr.bottom());
-    if (extra.valid()) result.push_back(extra);
-  }
-  return result;
-}
-
-
-static bool rowRLBT(const Rect &first, const Rect &second) {
-  if (first.bottom() == second.bottom())
-    return first.right() > second.right();
-  return first.bottom() > second.bottom();
-}
-
-static bool rowRLTB(const Rect &first, const Rect &second) {
-  if (first.y() == second.y())
-    return first.right() > second.right();
-  return first.y() < second.y();
-}
-
-static bool rowLRBT(const Rect &first, const Rect &second) {
-  if (first.bottom() == second.bottom())
-    return first.x() < second.x();
-  return first.bottom() > second.bottom();
-}
-
-static bool rowLRTB(const Rect &first, const Rect &second) {
-  if (first.y() == second.y())
-    return first.x() < second.x();
-  return first.y() < second.y();
-}
-
-static bool colLRTB(const Rect &first, const Rect &second) {
-  if (first.x() == second.x())
-    return first.y() < second.y();
-  return first.x() < second.x();
-}
-
-static bool colLRBT(const Rect &first, const Rect &second) {
-  if (first.x() == second.x())
-    return first.bottom() > second.bottom();
-  return first.x() < second.x();
-}
-
-static bool colRLTB(const Rect &first, const Rect &second) {
-  if (first.right() == second.right())
-    return first.y() < second.y();
-  return first.right() > second.right();
-}
-
-static bool colRLBT(const Rect &first, const Rect &second) {
-  if (first.right() == second.right())
-    return first.bottom() > second.bottom();
-  return first.right() > second.right();
-}
-
-
 bool Workspace::smartPlacement(Rect& win, const Rect& availableArea) {
-  rectList spaces;
-  spaces.push_back(availableArea); //initially the entire screen is free
+  RectList frames;
+  frames.reserve(windowList.size());
 
-  //Find Free Spaces
   BlackboxWindowList::const_iterator wit = windowList.begin(),
     end = windowList.end();
-  Rect tmp;
   for (; wit != end; ++wit) {
-    const BlackboxWindow* const curr = *wit;
-
-    tmp.setRect(curr->frameRectFrame().x(), curr->frameRectFrame().y(),
-                curr->frameRectFrame().width() + screen->getBorderWidth(),
-                curr->frameRectFrame().height() + screen->getBorderWidth());
-
-    spaces = calcSpace(tmp, spaces);
+    const Rect &frame = (*wit)->frameRectFrame();
+    frames.push_back(Rect(frame.x(), frame.y(),
+                          frame.width() + screen->getBorderWidth(),
+                          frame.height() + screen->getBorderWidth()));
   }
 
-  if (screen->getPlacementPolicy() == BScreen::RowSmartPlacement) {
-    if(screen->getRowPlacementDirection() == BScreen::LeftRight) {
-      if(screen->getColPlacementDirection() == BScreen::TopBottom)
-        std::sort(spaces.begin(), spaces.end(), rowLRTB);
-      else
-        std::sort(spaces.begin(), spaces.end(), rowLRBT);
-    } else {
-      if(screen->getColPlacementDirection() == BScreen::TopBottom)
-        std::sort(spaces.begin(), spaces.end(), rowRLTB);
-      else
-        std::sort(spaces.begin(), spaces.end(), rowRLBT);
-    }
-  } else {
-    if(screen->getColPlacementDirection() == BScreen::TopBottom) {
-      if(screen->getRowPlacementDirection() == BScreen::LeftRight)
-        std::sort(spaces.begin(), spaces.end(), colLRTB);
-      else
-        std::sort(spaces.begin(), spaces.end(), colRLTB);
-    } else {
-      if(screen->getRowPlacementDirection() == BScreen::LeftRight)
-        std::sort(spaces.begin(), spaces.end(), colLRBT);
-      else
-        std::sort(spaces.begin(), spaces.end(), colRLBT);
-    }
-  }
-
-  rectList::const_iterator sit = spaces.begin(), spaces_end = spaces.end();
-  for(; sit != spaces_end; ++sit) {
-    if (sit->width() >= win.width() && sit->height() >= win.height())
-      break;
-  }
-
-  if (sit == spaces_end)
-    return False;
-
-  //set new position based on the empty space found
-  const Rect& where = *sit;
-  win.setX(where.x());
-  win.setY(where.y());
-
-  // adjust the location() based on left/right and top/bottom placement
-  if (screen->getPlacementPolicy() == BScreen::RowSmartPlacement) {
-    if (screen->getRowPlacementDirection() == BScreen::RightLeft)
-      win.setX(where.right() - win.width());
-    if (screen->getColPlacementDirection() == BScreen::BottomTop)
-      win.setY(where.bottom() - win.height());
-  } else {
-    if (screen->getColPlacementDirection() == BScreen::BottomTop)
-      win.setY(win.y() + where.height() - win.height());
-    if (screen->getRowPlacementDirection() == BScreen::RightLeft)
-      win.setX(win.x() + where.width() - win.width());
-  }
-  return True;
+  return smartPlace(win, availableArea, frames,
+                    screen->getPlacementPolicy() == BScreen::RowSmartPlacement,
+                    screen->getRowPlacementDirection() == BScreen::RightLeft,
+                    screen->getColPlacementDirection() == BScreen::BottomTop);
 }
 
 
@@ -57,10 +57,8 @@ private:
   Workspace(const Workspace&);
   Workspace& operator=(const Workspace&);
 
-  void raiseTransients(const BlackboxWindow * const win,
-                       StackVector::iterator &stack);
-  void lowerTransients(const BlackboxWindow * const win,
-                       StackVector::iterator &stack);
+  class Stacker;
+  friend class Stacker;
 
   void placeWindow(BlackboxWindow *win);
   bool cascadePlacement(Rect& win, const Rect& availableArea);
@@ -75,6 +73,10 @@ public:
 
   inline Clientmenu *getMenu(void) { return clientmenu; }
 
+  // the top window first
+  inline const BlackboxWindowList &getStackingList(void) const
+  { return stackingList; }
+
   inline const std::string& getName(void) const { return name; }
 
   inline unsigned int getID(void) const { return id; }
@@ -100,7 +102,7 @@ public:
   void removeAll(void);
   void raiseWindow(BlackboxWindow *w);
   void lowerWindow(BlackboxWindow *w);
-  void reconfigure(void);
+  void reconfigure(unsigned int changes);
   void setCurrent(void);
   void setName(const std::string& new_name);
 };
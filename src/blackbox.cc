@@ -103,12 +103,21 @@ using std::string;
 
 #include "i18n.hh"
 #include "blackbox.hh"
+#include "EventReader.hh"
 #include "GCCache.hh"
+#include "Icon.hh"
+#include "PropertyFetcher.hh"
+#include "RoundTrips.hh"
 #include "Screen.hh"
+#include "Spawn.hh"
 #ifdef ADD_BLOAT
 #include "Slit.hh"
 #include "Toolbar.hh"
 #endif // ADD_BLOAT
+#include "Latency.hh"
+#include "Timeline.hh"
+#include "Trace.hh"
+#include "TracedCalls.hh"
 #include "Util.hh"
 #include "Window.hh"
 #include "Workspace.hh"
@@ -117,7 +126,7 @@ using std::string;
 Blackbox *blackbox;
 
 
-Blackbox::Blackbox(char **m_argv, char *dpy_name, char */*rc*/)
+Blackbox::Blackbox(char **m_argv, char *dpy_name, char *rc)
   : BaseDisplay(m_argv[0], dpy_name) {
   if (! XSupportsLocale())
     fprintf(stderr, "X server does not support locale\n");
@@ -127,8 +136,12 @@ Blackbox::Blackbox(char **m_argv, char *dpy_name, char */*rc*/)
 
   ::blackbox = this;
   argv = m_argv;
+  rc_file = rcFilename(rc);
 
   no_focus = False;
+  reconfigure_changed = False;
+  reconfigure_screens = 0;
+  focus_changes = focus_check = 0;
 
   resource.auto_raise_delay.tv_sec = resource.auto_raise_delay.tv_usec = 0;
 
@@ -137,18 +150,46 @@ Blackbox::Blackbox(char **m_argv, char *dpy_name, char */*rc*/)
 
   load_rc();
 
+  // this cannot change once windows have their grabs, so it is only read
+  // at startup
+  bool ignore_locks = False;
+  database.getValue("session.ignoreLockModifiers",
+                    "Session.IgnoreLockModifiers", ignore_locks);
+  if (ignore_locks && ! ignoreLockModifiers())
+    fprintf(stderr, "%s: the server cannot ignore lock modifiers\n",
+            getApplicationName());
+
   init_icccm();
 
+  snapshot = new BSnapshot(getXDisplay());
+  if (! snapshot->load()) {
+    delete snapshot;
+    snapshot = (BSnapshot *) 0;
+  }
+
   cursor.session = XCreateFontCursor(getXDisplay(), XC_left_ptr);
   cursor.move = XCreateFontCursor(getXDisplay(), XC_fleur);
   cursor.ll_angle = XCreateFontCursor(getXDisplay(), XC_ll_angle);
   cursor.lr_angle = XCreateFontCursor(getXDisplay(), XC_lr_angle);
 
+  // main() has set Xlib up for threads if this is on
+  bool screen_threads = False;
+  database.getValue("session.screenThreads", "Session.ScreenThreads",
+                    screen_threads);
+  if (getNumberOfScreens() < 2)
+    screen_threads = False;
+
   for (unsigned int i = 0; i < getNumberOfScreens(); i++) {
+    if (screen_threads && ! openScreenConnection(i))
+      fprintf(stderr, "%s: cannot give screen %u a thread of its own\n",
+              getApplicationName(), i);
+
+    ScreenScope scope(this, i);
     BScreen *screen = new BScreen(this, i);
 
     if (! screen->isScreenManaged()) {
       delete screen;
+      closeScreenConnection(i);
       continue;
     }
 
@@ -162,28 +203,89 @@ Blackbox::Blackbox(char **m_argv, char *dpy_name, char */*rc*/)
     ::exit(3);
   }
 
+  bool shard_events = False;
+  database.getValue("session.shardEvents", "Session.ShardEvents",
+                    shard_events);
+  if (shard_events && screenList.size() > 1 && ! hasScreenConnections())
+    setEventSharding(True);
+
   // set the screen with mouse to the first managed screen
   active_screen = screenList.front();
   setFocusedWindow(0);
 
-  XSynchronize(getXDisplay(), False);
-  XSync(getXDisplay(), False);
+  if (snapshot) {
+    BlackboxWindow *win = (snapshot->getFocus() != None) ?
+      searchWindow(snapshot->getFocus()) : (BlackboxWindow *) 0;
+    if (win && win->isVisible())
+      win->setInputFocus();
 
-  reconfigure_wait = False;
+    delete snapshot;
+    snapshot = (BSnapshot *) 0;
+  }
+
+  XSynchronize(getXDisplay(), False);
+  BROUNDTRIP(Sync, XSync(getXDisplay(), False));
+
+  // main() has set Xlib up for threads if this is on
+  bool reader_thread = False;
+  database.getValue("session.readerThread", "Session.ReaderThread",
+                    reader_thread);
+  if (reader_thread && ! startEventReader())
+    fprintf(stderr, "%s: cannot read events on a thread of their own\n",
+            getApplicationName());
+
+  // without workers, properties are still read, just by the event loop
+  int property_workers = 0;
+  database.getValue("session.propertyWorkers", "Session.PropertyWorkers",
+                    property_workers);
+  if (property_workers > 0 &&
+      ! propertyFetcher()->start(std::min(property_workers, 8)))
+    fprintf(stderr, "%s: cannot start the property workers\n",
+            getApplicationName());
+
+  bool latency_histograms = False;
+  database.getValue("session.latencyHistograms",
+                    "Session.LatencyHistograms", latency_histograms);
+  if (latency_histograms && ! BLatency::start(getXDisplayName()))
+    fprintf(stderr, "%s: cannot publish the latency histograms\n",
+            getApplicationName());
+
+  reconfigure_wait = statistics_wait = False;
 
   timer = new BTimer(this, this);
   timer->setTimeout(0l);
 }
 
 
+std::string Blackbox::rcFilename(const char *rc) {
+  return expandTilde((rc) ? rc : "~/.xwinwmrc");
+}
+
+
 Blackbox::~Blackbox(void) {
-  std::for_each(screenList.begin(), screenList.end(), PointerAssassin());
+  ScreenList::iterator it = screenList.begin();
+  for (; it != screenList.end(); ++it) {
+    ScreenScope scope(this, (*it)->getScreenNumber());
+    delete *it;
+  }
 
   delete timer;
+
+  BLatency::stop();
 }
 
 
 void Blackbox::process_event(XEvent *e) {
+  BLatency::Timing timing(e->type);
+  BRoundTrips::EventScope scope(e->type);
+
+  const char *type_name = eventTypeName(e->type);
+  BTimeline::Span span("event", (type_name) ? type_name : "extension event",
+                       e->xany.window);
+
+  if (BTrace::active())
+    BTrace::active()->recordEvent(*e);
+
   switch (e->type) {
   case ButtonPress: {
     // strip the lock key modifiers
@@ -333,8 +435,8 @@ void Blackbox::process_event(XEvent *e) {
           the window is on
         */
         XWindowAttributes wattrib;
-        if (! XGetWindowAttributes(getXDisplay(), e->xmaprequest.window,
-                                   &wattrib)) {
+        if (! tracedGetWindowAttributes(getXDisplay(), e->xmaprequest.window,
+                                        &wattrib)) {
           // failed to get the window attributes, perhaps the window has
           // now been destroyed?
           break;
@@ -410,8 +512,8 @@ void Blackbox::process_event(XEvent *e) {
     // motion notify compression...
     XEvent realevent;
     unsigned int i = 0;
-    while (XCheckTypedWindowEvent(getXDisplay(), e->xmotion.window,
-                                  MotionNotify, &realevent)) {
+    while (checkTypedWindowEvent(e->xmotion.window, MotionNotify,
+                                 &realevent)) {
       i++;
     }
 
@@ -435,6 +537,12 @@ void Blackbox::process_event(XEvent *e) {
   case PropertyNotify: {
     last_time = e->xproperty.time;
 
+    if (e->xproperty.atom == xwinwm_timeline &&
+        searchScreen(e->xproperty.window)) {
+      changeTimeline(&e->xproperty);
+      break;
+    }
+
     BlackboxWindow *win = searchWindow(e->xproperty.window);
     if (win)
       win->propertyNotifyEvent(&e->xproperty);
@@ -495,8 +603,7 @@ void Blackbox::process_event(XEvent *e) {
     ey1 = e->xexpose.y;
     ex2 = ex1 + e->xexpose.width - 1;
     ey2 = ey1 + e->xexpose.height - 1;
-    while (XCheckTypedWindowEvent(getXDisplay(), e->xexpose.window,
-                                  Expose, &realevent)) {
+    while (checkTypedWindowEvent(e->xexpose.window, Expose, &realevent)) {
       i++;
 
       // merge expose area
@@ -604,7 +711,7 @@ void Blackbox::process_event(XEvent *e) {
         (the FocusIn event handler sets the window in the event
         structure to None to indicate this).
       */
-      if (XCheckTypedEvent(getXDisplay(), FocusIn, &event)) {
+      if (checkTypedEvent(FocusIn, &event)) {
 
         process_event(&event);
         if (event.xfocus.window == None) {
@@ -616,24 +723,11 @@ void Blackbox::process_event(XEvent *e) {
       if (check_focus) {
         /*
           Second, we query the X server for the current input focus.
-          to make sure that we keep a consistent state.
+          to make sure that we keep a consistent state.  The answer comes
+          to inputFocusFetched(), and other events are handled meanwhile.
         */
-        BlackboxWindow *focus;
-        Window w;
-        int revert;
-        XGetInputFocus(getXDisplay(), &w, &revert);
-        focus = searchWindow(w);
-        if (focus) {
-          /*
-            focus got from "win" to "focus" under some very strange
-            circumstances, and we need to make sure that the focus indication
-            is correct.
-          */
-          setFocusedWindow(focus);
-        } else {
-          // we have no idea where focus went... so we set it to somewhere
-          setFocusedWindow(0);
-        }
+        focus_check = focus_changes;
+        propertyFetcher()->fetchInputFocus(this);
       }
     }
 
@@ -759,12 +853,10 @@ bool Blackbox::handleSignal(int sig) {
     break;
 
   case SIGUSR2:
-    //rereadMenu();
+    dumpStatistics();
     break;
 
   case SIGPIPE:
-  case SIGSEGV:
-  case SIGFPE:
   case SIGINT:
   case SIGTERM:
     shutdown();
@@ -779,100 +871,131 @@ bool Blackbox::handleSignal(int sig) {
 
 void Blackbox::init_icccm(void) {
   xa_wm_colormap_windows =
-    XInternAtom(getXDisplay(), "WM_COLORMAP_WINDOWS", False);
-  xa_wm_protocols = XInternAtom(getXDisplay(), "WM_PROTOCOLS", False);
-  xa_wm_state = XInternAtom(getXDisplay(), "WM_STATE", False);
-  xa_wm_change_state = XInternAtom(getXDisplay(), "WM_CHANGE_STATE", False);
-  xa_wm_delete_window = XInternAtom(getXDisplay(), "WM_DELETE_WINDOW", False);
-  xa_wm_take_focus = XInternAtom(getXDisplay(), "WM_TAKE_FOCUS", False);
-  motif_wm_hints = XInternAtom(getXDisplay(), "_MOTIF_WM_HINTS", False);
-
-  blackbox_hints = XInternAtom(getXDisplay(), "_BLACKBOX_HINTS", False);
+    tracedInternAtom(getXDisplay(), "WM_COLORMAP_WINDOWS", False);
+  xa_wm_protocols = tracedInternAtom(getXDisplay(), "WM_PROTOCOLS", False);
+  xa_wm_state = tracedInternAtom(getXDisplay(), "WM_STATE", False);
+  xa_wm_change_state =
+    tracedInternAtom(getXDisplay(), "WM_CHANGE_STATE", False);
+  xa_wm_delete_window =
+    tracedInternAtom(getXDisplay(), "WM_DELETE_WINDOW", False);
+  xa_wm_take_focus = tracedInternAtom(getXDisplay(), "WM_TAKE_FOCUS", False);
+  xa_compound_text = tracedInternAtom(getXDisplay(), "COMPOUND_TEXT", False);
+  motif_wm_hints = tracedInternAtom(getXDisplay(), "_MOTIF_WM_HINTS", False);
+
+  blackbox_hints = tracedInternAtom(getXDisplay(), "_BLACKBOX_HINTS", False);
   blackbox_attributes =
-    XInternAtom(getXDisplay(), "_BLACKBOX_ATTRIBUTES", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_ATTRIBUTES", False);
   blackbox_change_attributes =
-    XInternAtom(getXDisplay(), "_BLACKBOX_CHANGE_ATTRIBUTES", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_CHANGE_ATTRIBUTES", False);
   blackbox_structure_messages =
-    XInternAtom(getXDisplay(), "_BLACKBOX_STRUCTURE_MESSAGES", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_STRUCTURE_MESSAGES", False);
   blackbox_notify_startup =
-    XInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_STARTUP", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_STARTUP", False);
   blackbox_notify_window_add =
-    XInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_ADD", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_ADD", False);
   blackbox_notify_window_del =
-    XInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_DEL", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_DEL", False);
   blackbox_notify_current_workspace =
-    XInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_CURRENT_WORKSPACE", False);
+    tracedInternAtom(getXDisplay(),
+                     "_BLACKBOX_NOTIFY_CURRENT_WORKSPACE", False);
   blackbox_notify_workspace_count =
-    XInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WORKSPACE_COUNT", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WORKSPACE_COUNT", False);
   blackbox_notify_window_focus =
-    XInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_FOCUS", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_FOCUS", False);
   blackbox_notify_window_raise =
-    XInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_RAISE", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_RAISE", False);
   blackbox_notify_window_lower =
-    XInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_LOWER", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_NOTIFY_WINDOW_LOWER", False);
   blackbox_change_workspace =
-    XInternAtom(getXDisplay(), "_BLACKBOX_CHANGE_WORKSPACE", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_CHANGE_WORKSPACE", False);
   blackbox_change_window_focus =
-    XInternAtom(getXDisplay(), "_BLACKBOX_CHANGE_WINDOW_FOCUS", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_CHANGE_WINDOW_FOCUS", False);
   blackbox_cycle_window_focus =
-    XInternAtom(getXDisplay(), "_BLACKBOX_CYCLE_WINDOW_FOCUS", False);
+    tracedInternAtom(getXDisplay(), "_BLACKBOX_CYCLE_WINDOW_FOCUS", False);
 
   windowswm_raise_on_click =
-    XInternAtom(getXDisplay(), WINDOWSWM_RAISE_ON_CLICK, False);
+    tracedInternAtom(getXDisplay(), WINDOWSWM_RAISE_ON_CLICK, False);
   windowswm_mouse_activate =
-    XInternAtom(getXDisplay(), WINDOWSWM_MOUSE_ACTIVATE, False);
+    tracedInternAtom(getXDisplay(), WINDOWSWM_MOUSE_ACTIVATE, False);
   windowswm_client_window =
-    XInternAtom(getXDisplay(), WINDOWSWM_CLIENT_WINDOW, False);
+    tracedInternAtom(getXDisplay(), WINDOWSWM_CLIENT_WINDOW, False);
   windowswm_native_hwnd =
-    XInternAtom(getXDisplay(), WINDOWSWM_NATIVE_HWND, False);
+    tracedInternAtom(getXDisplay(), WINDOWSWM_NATIVE_HWND, False);
+
+  utf8_string = tracedInternAtom(getXDisplay(), "UTF8_STRING", False);
+  net_supported = tracedInternAtom(getXDisplay(), "_NET_SUPPORTED", False);
+  net_frame_extents =
+    tracedInternAtom(getXDisplay(), "_NET_FRAME_EXTENTS", False);
+  net_wm_name = tracedInternAtom(getXDisplay(), "_NET_WM_NAME", False);
+  net_wm_icon_name =
+    tracedInternAtom(getXDisplay(), "_NET_WM_ICON_NAME", False);
+  net_wm_icon = tracedInternAtom(getXDisplay(), "_NET_WM_ICON", False);
+  net_wm_pid = tracedInternAtom(getXDisplay(), "_NET_WM_PID", False);
 
 #ifdef    NEWWMSPEC
-  net_supported = XInternAtom(getXDisplay(), "_NET_SUPPORTED", False);
-  net_client_list = XInternAtom(getXDisplay(), "_NET_CLIENT_LIST", False);
+  net_client_list = tracedInternAtom(getXDisplay(), "_NET_CLIENT_LIST", False);
   net_client_list_stacking =
-    XInternAtom(getXDisplay(), "_NET_CLIENT_LIST_STACKING", False);
+    tracedInternAtom(getXDisplay(), "_NET_CLIENT_LIST_STACKING", False);
   net_number_of_desktops =
-    XInternAtom(getXDisplay(), "_NET_NUMBER_OF_DESKTOPS", False);
+    tracedInternAtom(getXDisplay(), "_NET_NUMBER_OF_DESKTOPS", False);
   net_desktop_geometry =
-    XInternAtom(getXDisplay(), "_NET_DESKTOP_GEOMETRY", False);
+    tracedInternAtom(getXDisplay(), "_NET_DESKTOP_GEOMETRY", False);
   net_desktop_viewport =
-    XInternAtom(getXDisplay(), "_NET_DESKTOP_VIEWPORT", False);
+    tracedInternAtom(getXDisplay(), "_NET_DESKTOP_VIEWPORT", False);
   net_current_desktop =
-    XInternAtom(getXDisplay(), "_NET_CURRENT_DESKTOP", False);
-  net_desktop_names = XInternAtom(getXDisplay(), "_NET_DESKTOP_NAMES", False);
-  net_active_window = XInternAtom(getXDisplay(), "_NET_ACTIVE_WINDOW", False);
-  net_workarea = XInternAtom(getXDisplay(), "_NET_WORKAREA", False);
+    tracedInternAtom(getXDisplay(), "_NET_CURRENT_DESKTOP", False);
+  net_desktop_names =
+    tracedInternAtom(getXDisplay(), "_NET_DESKTOP_NAMES", False);
+  net_active_window =
+    tracedInternAtom(getXDisplay(), "_NET_ACTIVE_WINDOW", False);
+  net_workarea = tracedInternAtom(getXDisplay(), "_NET_WORKAREA", False);
   net_supporting_wm_check =
-    XInternAtom(getXDisplay(), "_NET_SUPPORTING_WM_CHECK", False);
-  net_virtual_roots = XInternAtom(getXDisplay(), "_NET_VIRTUAL_ROOTS", False);
-  net_close_window = XInternAtom(getXDisplay(), "_NET_CLOSE_WINDOW", False);
-  net_wm_moveresize = XInternAtom(getXDisplay(), "_NET_WM_MOVERESIZE", False);
-  net_properties = XInternAtom(getXDisplay(), "_NET_PROPERTIES", False);
-  net_wm_name = XInternAtom(getXDisplay(), "_NET_WM_NAME", False);
-  net_wm_desktop = XInternAtom(getXDisplay(), "_NET_WM_DESKTOP", False);
+    tracedInternAtom(getXDisplay(), "_NET_SUPPORTING_WM_CHECK", False);
+  net_virtual_roots =
+    tracedInternAtom(getXDisplay(), "_NET_VIRTUAL_ROOTS", False);
+  net_close_window =
+    tracedInternAtom(getXDisplay(), "_NET_CLOSE_WINDOW", False);
+  net_wm_moveresize =
+    tracedInternAtom(getXDisplay(), "_NET_WM_MOVERESIZE", False);
+  net_properties = tracedInternAtom(getXDisplay(), "_NET_PROPERTIES", False);
+  net_wm_desktop = tracedInternAtom(getXDisplay(), "_NET_WM_DESKTOP", False);
   net_wm_window_type =
-    XInternAtom(getXDisplay(), "_NET_WM_WINDOW_TYPE", False);
-  net_wm_state = XInternAtom(getXDisplay(), "_NET_WM_STATE", False);
-  net_wm_strut = XInternAtom(getXDisplay(), "_NET_WM_STRUT", False);
+    tracedInternAtom(getXDisplay(), "_NET_WM_WINDOW_TYPE", False);
+  net_wm_state = tracedInternAtom(getXDisplay(), "_NET_WM_STATE", False);
+  net_wm_strut = tracedInternAtom(getXDisplay(), "_NET_WM_STRUT", False);
   net_wm_icon_geometry =
-    XInternAtom(getXDisplay(), "_NET_WM_ICON_GEOMETRY", False);
-  net_wm_icon = XInternAtom(getXDisplay(), "_NET_WM_ICON", False);
-  net_wm_pid = XInternAtom(getXDisplay(), "_NET_WM_PID", False);
+    tracedInternAtom(getXDisplay(), "_NET_WM_ICON_GEOMETRY", False);
   net_wm_handled_icons =
-    XInternAtom(getXDisplay(), "_NET_WM_HANDLED_ICONS", False);
-  net_wm_ping = XInternAtom(getXDisplay(), "_NET_WM_PING", False);
+    tracedInternAtom(getXDisplay(), "_NET_WM_HANDLED_ICONS", False);
+  net_wm_ping = tracedInternAtom(getXDisplay(), "_NET_WM_PING", False);
 #endif // NEWWMSPEC
 
 #ifdef    HAVE_GETPID
-  blackbox_pid = XInternAtom(getXDisplay(), "_BLACKBOX_PID", False);
+  blackbox_pid = tracedInternAtom(getXDisplay(), "_BLACKBOX_PID", False);
 #endif // HAVE_GETPID
+
+  xwinwm_timeline = tracedInternAtom(getXDisplay(), "_XWINWM_TIMELINE", False);
+}
+
+
+/*
+ * Lists on a managed root window the extended hints used regardless of
+ * NEWWMSPEC, so that clients know _NET_FRAME_EXTENTS will be set.
+ */
+void Blackbox::setNETSupported(Window root) const {
+  Atom supported[] = {
+    net_frame_extents, net_wm_name, net_wm_icon_name, net_wm_icon, net_wm_pid
+  };
+  XChangeProperty(getXDisplay(), root, net_supported, XA_ATOM, 32,
+                  PropModeReplace, (unsigned char *) supported,
+                  sizeof(supported) / sizeof(supported[0]));
 }
 
 
 bool Blackbox::validateWindow(Window window) {
   XEvent event;
-  if (XCheckTypedWindowEvent(getXDisplay(), window, DestroyNotify, &event)) {
-    XPutBackEvent(getXDisplay(), &event);
+  if (checkTypedWindowEvent(window, DestroyNotify, &event)) {
+    putBackEvent(&event);
 
     return False;
   }
@@ -975,12 +1098,29 @@ void Blackbox::removeSlitSearch(Window window) {
 
 
 void Blackbox::restart(const char *prog) {
+  // only another run of ourselves can take over from where we leave off,
+  // and the windows have to be looked at before shutdown() lets them go
+  BSnapshot handoff(getXDisplay());
+  if (! prog) {
+    ScreenList::iterator it = screenList.begin();
+    for (; it != screenList.end(); ++it)
+      (*it)->saveSnapshot(handoff);
+    if (focused_window)
+      handoff.setFocus(focused_window->getClientWindow());
+  }
+
   shutdown();
 
+  // the next run sets them again if it is asked to
+  restoreLockModifiers();
+
   if (prog) {
     putenv(const_cast<char *>(screenList.front()->displayString().c_str()));
     execlp(prog, prog, NULL);
     perror(prog);
+  } else if (! handoff.handOff()) {
+    fprintf(stderr, "%s: cannot hand the window state over to the restart\n",
+            getApplicationName());
   }
 
   // fall back in case the above execlp doesn't work
@@ -995,10 +1135,16 @@ void Blackbox::shutdown(void) {
 
   XSetInputFocus(getXDisplay(), PointerRoot, None, CurrentTime);
 
-  std::for_each(screenList.begin(), screenList.end(),
-                std::mem_fun(&BScreen::shutdown));
+  ScreenList::iterator it = screenList.begin();
+  for (; it != screenList.end(); ++it) {
+    ScreenScope scope(this, (*it)->getScreenNumber());
+    (*it)->shutdown();
+    // the screen's own connection, if it has one, is not synced below
+    if (getXDisplay() != getMainXDisplay())
+      BROUNDTRIP(Sync, XSync(getXDisplay(), False));
+  }
 
-  XSync(getXDisplay(), False);
+  BROUNDTRIP(Sync, XSync(getMainXDisplay(), False));
 
   save_rc();
 }
@@ -1009,36 +1155,131 @@ void Blackbox::save_rc(void) {
 
 
 void Blackbox::load_rc(void) {
+  database.load(rc_file);
+
+  int value;
   resource.colors_per_channel = 4;
+  if (database.getValue("session.colorsPerChannel",
+                        "Session.ColorsPerChannel", value) &&
+      value >= 2 && value <= 6)
+    resource.colors_per_channel = value;
+
   resource.double_click_interval = 250;
+  if (database.getValue("session.doubleClickInterval",
+                        "Session.DoubleClickInterval", value) && value > 0)
+    resource.double_click_interval = value;
+
   resource.auto_raise_delay.tv_usec = 400;
+  if (database.getValue("session.autoRaiseDelay", "Session.AutoRaiseDelay",
+                        value) && value >= 0)
+    resource.auto_raise_delay.tv_usec = value;
   resource.auto_raise_delay.tv_sec = resource.auto_raise_delay.tv_usec / 1000;
   resource.auto_raise_delay.tv_usec -=
     (resource.auto_raise_delay.tv_sec * 1000);
   resource.auto_raise_delay.tv_usec *= 1000;
+
   resource.cache_life = 5l;
+  if (database.getValue("session.cacheLife", "Session.CacheLife", value) &&
+      value > 0)
+    resource.cache_life = value;
   resource.cache_life *= 60000;
+
   resource.cache_max = 200;
+  if (database.getValue("session.cacheMax", "Session.CacheMax", value) &&
+      value > 0)
+    resource.cache_max = value;
+
+  resource.style_file = DEFAULTSTYLE;
+  std::string s;
+  if (database.getValue("session.styleFile", "Session.StyleFile", s))
+    resource.style_file = expandTilde(s);
+
+  ScreenList::iterator it = screenList.begin();
+  for (; it != screenList.end(); ++it)
+    load_rc(*it);
 }
 
 
 void Blackbox::load_rc(BScreen *screen) {
-  screen->saveFullMax(False);
-  //screen->saveFocusNew(False);
-  screen->saveFocusNew(True);
-  screen->saveFocusLast(False);
-  screen->saveAllowScrollLock(False);
+  char prefix[32], cprefix[32];
+  sprintf(prefix, "session.screen%u.", screen->getScreenNumber());
+  sprintf(cprefix, "Session.Screen%u.", screen->getScreenNumber());
+  const std::string name = prefix, cname = cprefix;
+
+  bool flag;
+  int value;
+  std::string s;
+
+  flag = False;
+  database.getValue(name + "fullMaximization", cname + "FullMaximization",
+                    flag);
+  screen->saveFullMax(flag);
+
+  flag = True;
+  database.getValue(name + "focusNewWindows", cname + "FocusNewWindows",
+                    flag);
+  screen->saveFocusNew(flag);
+
+  flag = False;
+  database.getValue(name + "focusLastWindow", cname + "FocusLastWindow",
+                    flag);
+  screen->saveFocusLast(flag);
+
+  flag = False;
+  database.getValue(name + "allowScrollLock", cname + "AllowScrollLock",
+                    flag);
+  screen->saveAllowScrollLock(flag);
+
   screen->saveRowPlacementDirection(BScreen::LeftRight);
+  if (database.getValue(name + "rowPlacementDirection",
+                        cname + "RowPlacementDirection", s) &&
+      s == "RightToLeft")
+    screen->saveRowPlacementDirection(BScreen::RightLeft);
+
   screen->saveColPlacementDirection(BScreen::TopBottom);
+  if (database.getValue(name + "colPlacementDirection",
+                        cname + "ColPlacementDirection", s) &&
+      s == "BottomToTop")
+    screen->saveColPlacementDirection(BScreen::BottomTop);
+
   screen->saveWorkspaces(1);
+  if (database.getValue(name + "workspaces", cname + "Workspaces", value) &&
+      value > 0)
+    screen->saveWorkspaces(value);
+
   screen->saveSloppyFocus(True);
   screen->saveAutoRaise(False);
   screen->saveClickRaise(False);
+  if (database.getValue(name + "focusModel", cname + "FocusModel", s)) {
+    if (s.find("ClickToFocus") != std::string::npos)
+      screen->saveSloppyFocus(False);
+    if (s.find("AutoRaise") != std::string::npos)
+      screen->saveAutoRaise(True);
+    if (s.find("ClickRaise") != std::string::npos)
+      screen->saveClickRaise(True);
+  }
+
   screen->savePlacementPolicy(BScreen::RowSmartPlacement);
+  if (database.getValue(name + "windowPlacement", cname + "WindowPlacement",
+                        s)) {
+    if (s == "ColSmartPlacement")
+      screen->savePlacementPolicy(BScreen::ColSmartPlacement);
+    else if (s == "CascadePlacement")
+      screen->savePlacementPolicy(BScreen::CascadePlacement);
+  }
 
-  screen->saveEdgeSnapThreshold(0);
-  screen->saveImageDither(True);
-  screen->saveOpaqueMove(False);
+  value = 0;
+  database.getValue(name + "edgeSnapThreshold", cname + "EdgeSnapThreshold",
+                    value);
+  screen->saveEdgeSnapThreshold(value);
+
+  flag = True;
+  database.getValue(name + "imageDither", cname + "ImageDither", flag);
+  screen->saveImageDither(flag);
+
+  flag = False;
+  database.getValue(name + "opaqueMove", cname + "OpaqueMove", flag);
+  screen->saveOpaqueMove(flag);
 }
 
 
@@ -1055,11 +1296,91 @@ void Blackbox::reconfigure(void) {
 }
 
 
+/*
+ * each screen is reconfigured in a turn of its own, see handleMessage(),
+ * and the last of them to finish finishes the reconfigure
+ */
 void Blackbox::real_reconfigure(void) {
-  gcCache()->purge();
+  reconfigure_screens += screenList.size();
+
+  ScreenList::iterator it = screenList.begin();
+  for (; it != screenList.end(); ++it)
+    postScreenMessage((*it)->getScreenNumber(), this, ReconfigureScreen,
+                      (*it)->getScreenNumber());
+}
+
+
+/*
+ * Print the internal counters to stderr.  Like reconfigure(), the work is
+ * deferred to the timer, so a burst of signals prints them once.
+ */
+void Blackbox::dumpStatistics(void) {
+  statistics_wait = True;
+
+  if (! timer->isTiming()) timer->start();
+}
+
+
+/*
+ * The property turns the timeline on and off, and nothing more: what it
+ * holds is never used as the name of the file, as any client can set it.
+ */
+void Blackbox::changeTimeline(const XPropertyEvent *e) {
+  if (e->state == PropertyDelete) {
+    BTimeline::stop();
+    return;
+  }
+
+  string path;
+  if (BTimeline::start(path))
+    fprintf(stderr, "%s: recording a timeline in '%s'\n",
+            getApplicationName(), path.c_str());
+  else
+    fprintf(stderr, "%s: couldn't record a timeline\n",
+            getApplicationName());
+}
 
-  std::for_each(screenList.begin(), screenList.end(),
-                std::mem_fun(&BScreen::reconfigure));
+
+void Blackbox::printStatistics(void) {
+  const BlackboxWindow::FrameStatistics &frame =
+    BlackboxWindow::frameStatistics();
+
+  fprintf(stderr, "%s: frame draws: %lu sent, %lu skipped, %lu coalesced\n",
+          getApplicationName(), frame.draws, frame.draws_skipped,
+          frame.draws_coalesced);
+  fprintf(stderr, "%s: frame titles: %lu sent, %lu skipped\n",
+          getApplicationName(), frame.titles, frame.titles_skipped);
+
+  const BGCCache *gcs = gcCache();
+  fprintf(stderr, "%s: gc cache: %lu hits, %lu misses, %lu evictions, "
+          "%lu contexts\n", getApplicationName(), gcs->hits(), gcs->misses(),
+          gcs->evictions(), gcs->count());
+
+  const BIconCache *icons = iconCache();
+  fprintf(stderr, "%s: icon cache: %lu hits, %lu misses, %lu icons\n",
+          getApplicationName(), icons->hits(), icons->misses(),
+          icons->count());
+
+  const BEventReader *events = eventReader();
+  if (events)
+    fprintf(stderr, "%s: event reader: %lu events, %lu waiting, "
+            "%lu most waiting, %lu stalls\n", getApplicationName(),
+            events->events(), events->backlog(), events->maxBacklog(),
+            events->stalls());
+
+  const BPropertyFetcher *properties = propertyFetcher();
+  fprintf(stderr, "%s: property reads: %lu asked for, %lu done, "
+          "%lu cancelled, %u workers\n", getApplicationName(),
+          properties->requests(), properties->fetched(),
+          properties->cancelled(), properties->workers());
+
+  const unsigned long rounds = reapRounds();
+  fprintf(stderr, "%s: children: %lu reaped in %lu rounds, %lu us average "
+          "and %lu us longest after the signal\n", getApplicationName(),
+          childrenReaped(), rounds, (rounds) ? reapLatency() / rounds : 0,
+          reapLatencyMax());
+
+  BRoundTrips::print(stderr, getApplicationName());
 }
 
 
@@ -1067,7 +1388,30 @@ void Blackbox::timeout(void) {
   if (reconfigure_wait)
     real_reconfigure();
 
-  reconfigure_wait = False;
+  if (statistics_wait)
+    printStatistics();
+
+  reconfigure_wait = statistics_wait = False;
+}
+
+
+void Blackbox::inputFocusFetched(Window w) {
+  // the answer is stale if focus has been set since the question
+  if (focus_changes != focus_check)
+    return;
+
+  BlackboxWindow *focus = searchWindow(w);
+  if (focus) {
+    /*
+      focus got from "win" to "focus" under some very strange
+      circumstances, and we need to make sure that the focus indication
+      is correct.
+    */
+    setFocusedWindow(focus);
+  } else {
+    // we have no idea where focus went... so we set it to somewhere
+    setFocusedWindow(0);
+  }
 }
 
 
@@ -1075,6 +1419,8 @@ void Blackbox::setFocusedWindow(BlackboxWindow *win) {
   if (focused_window && focused_window == win) // nothing to do
     return;
 
+  ++focus_changes;
+
   BScreen *old_screen = 0;
 
   if (focused_window) {
@@ -1112,17 +1458,72 @@ void Blackbox::setFocusedWindow(BlackboxWindow *win) {
 #endif // ADD_BLOAT
   }
 
-#ifdef ADD_BLOAT
-  if (active_screen && active_screen->isScreenManaged()) {
-    active_screen->getToolbar()->redrawWindowLabel(True);
-    active_screen->updateNetizenWindowFocus();
+  // each screen tells its netizens in its own turn
+  if (active_screen)
+    postScreenMessage(active_screen->getScreenNumber(), this,
+                      ScreenFocusChanged, active_screen->getScreenNumber());
+  if (old_screen && old_screen != active_screen)
+    postScreenMessage(old_screen->getScreenNumber(), this,
+                      ScreenFocusChanged, old_screen->getScreenNumber());
+}
+
+
+BScreen *Blackbox::findScreen(unsigned int screen_number) {
+  ScreenList::iterator it = screenList.begin();
+  for (; it != screenList.end(); ++it) {
+    if ((*it)->getScreenNumber() == screen_number)
+      return *it;
   }
 
-  if (old_screen && old_screen != active_screen) {
-    old_screen->getToolbar()->redrawWindowLabel(True);
-    old_screen->updateNetizenWindowFocus();
+  return (BScreen *) 0;
+}
+
+
+int Blackbox::eventScreen(const XEvent *e) {
+  const BlackboxWindow *win = searchWindow(e->xany.window);
+  if (win)
+    return win->getScreen()->getScreenNumber();
+
+  const BScreen *screen = searchScreen(e->xany.window);
+  if (screen)
+    return screen->getScreenNumber();
+
+  return -1;
+}
+
+
+void Blackbox::handleMessage(unsigned int message, unsigned long data) {
+  switch (message) {
+  case ReconfigureScreen: {
+    BScreen *screen = findScreen(data);
+    if (screen && screen->reconfigure())
+      reconfigure_changed = True;
+    if (--reconfigure_screens == 0)
+      postMessage(this, ReconfigureDone);
+    break;
   }
+
+  case ReconfigureDone:
+    if (reconfigure_changed) {
+      // the GCs and colors of the old style are given back together
+      gcCache()->purge();
+      BColor::cleanupColorCache();
+      reconfigure_changed = False;
+    }
+    break;
+
+  case ScreenFocusChanged: {
+    BScreen *screen = findScreen(data);
+    if (! screen || ! screen->isScreenManaged())
+      break;
+
+#ifdef ADD_BLOAT
+    screen->getToolbar()->redrawWindowLabel(True);
 #endif // ADD_BLOAT
+    screen->updateNetizenWindowFocus();
+    break;
+  }
+  }
 }
 
 #ifdef ENABLE_KEYBINDINGS
@@ -1133,19 +1534,12 @@ void Blackbox::setKeys() {
     }
     
     if (enableKeyBindings()) { 
-      chpid = fork();
-		
+      chpid = spawnCommand(getkeycmd());
+
       if (chpid < 0){
           //cerr << "Error: Can't Fork Keybindings" << endl;
+          chpid = 0;
       }
-	  
-      if (chpid == 0){
-	    extern char **environ;
- 
-	    char *args[]= {"sh", "-c", (char*)getkeycmd(), 0};
-	    execve("/bin/sh", args, environ);
-	    exit(0);
-       }
     } 
 }
 #endif // ENABLE_KEYBINDINGS
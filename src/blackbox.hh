@@ -55,6 +55,9 @@ extern "C" {
 
 #include "i18n.hh"
 #include "BaseDisplay.hh"
+#include "Database.hh"
+#include "PropertyFetcher.hh"
+#include "Snapshot.hh"
 #include "Timer.hh"
 
 #define AttribShaded      (1l << 0)
@@ -101,7 +104,12 @@ class Slit;
 
 extern I18n i18n;
 
-class Blackbox : public BaseDisplay, public TimeoutHandler {
+class Blackbox : public BaseDisplay, public TimeoutHandler,
+                 public BMessageHandler, public BPropertyHandler {
+public:
+  // how the managed windows are found from their clients, bench/ uses it
+  typedef std::map<Window, BlackboxWindow*> WindowLookup;
+
 private:
   struct BCursor {
     Cursor session, move, ll_angle, lr_angle;
@@ -114,13 +122,16 @@ private:
     int colors_per_channel;
     timeval auto_raise_delay;
     unsigned long cache_life, cache_max;
+    std::string style_file;
 #ifdef ENABLE_KEYBINDINGS
     bool enable_Key_Bindings;
 	std::string  key_cmd;
 #endif // ENABLE_KEYBINDINGS
   } resource;
 
-  typedef std::map<Window, BlackboxWindow*> WindowLookup;
+  std::string rc_file;
+  BDatabase database;
+
   typedef WindowLookup::value_type WindowLookupPair;
   WindowLookup windowSearchList;
 
@@ -144,14 +155,21 @@ private:
   BScreen *active_screen;
   BlackboxWindow *focused_window;
   BTimer *timer;
-
-  bool no_focus, reconfigure_wait;
+  // what the instance that restarted into us left, only during startup
+  BSnapshot *snapshot;
+
+  bool no_focus, reconfigure_wait, statistics_wait, reconfigure_changed;
+  // the screens still to be reconfigured
+  unsigned int reconfigure_screens;
+  // how often the focused window has changed, and what that was when the
+  // server was last asked where the focus is
+  unsigned long focus_changes, focus_check;
   Time last_time;
   char **argv;
 
   Atom xa_wm_colormap_windows, xa_wm_protocols, xa_wm_state,
     xa_wm_delete_window, xa_wm_take_focus, xa_wm_change_state,
-    motif_wm_hints;
+    xa_compound_text, motif_wm_hints;
 
   // NETAttributes
   Atom blackbox_attributes, blackbox_change_attributes, blackbox_hints;
@@ -159,6 +177,9 @@ private:
   Atom blackbox_pid;
 #endif // HAVE_GETPID
 
+  // the file a timeline is recorded in, see Timeline.hh
+  Atom xwinwm_timeline;
+
   // NETStructureMessages
   Atom blackbox_structure_messages, blackbox_notify_startup,
     blackbox_notify_window_add, blackbox_notify_window_del,
@@ -174,9 +195,13 @@ private:
   Atom windowswm_raise_on_click, windowswm_mouse_activate,
     windowswm_client_window, windowswm_native_hwnd;
 
+  // extended window manager hints used regardless of NEWWMSPEC
+  Atom utf8_string, net_supported, net_frame_extents, net_wm_name,
+    net_wm_icon_name, net_wm_icon, net_wm_pid;
+
 #ifdef    NEWWMSPEC
   // root window properties
-  Atom net_supported, net_client_list, net_client_list_stacking,
+  Atom net_client_list, net_client_list_stacking,
     net_number_of_desktops, net_desktop_geometry, net_desktop_viewport,
     net_current_desktop, net_desktop_names, net_active_window, net_workarea,
     net_supporting_wm_check, net_virtual_roots;
@@ -185,9 +210,8 @@ private:
   Atom net_close_window, net_wm_moveresize;
 
   // application window properties
-  Atom net_properties, net_wm_name, net_wm_desktop, net_wm_window_type,
-    net_wm_state, net_wm_strut, net_wm_icon_geometry, net_wm_icon, net_wm_pid,
-    net_wm_handled_icons;
+  Atom net_properties, net_wm_desktop, net_wm_window_type,
+    net_wm_state, net_wm_strut, net_wm_icon_geometry, net_wm_handled_icons;
 
   // application protocols
   Atom net_wm_ping;
@@ -200,16 +224,26 @@ private:
   void save_rc(void);
   void reload_rc(void);
   void real_reconfigure(void);
+  void printStatistics(void);
+  void changeTimeline(const XPropertyEvent *e);
 
   void init_icccm(void);
 
+  // posted to ourselves, see handleMessage()
+  enum Message { ReconfigureScreen, ReconfigureDone, ScreenFocusChanged };
+  BScreen *findScreen(unsigned int screen_number);
+
   virtual void process_event(XEvent *e);
+  virtual int eventScreen(const XEvent *e);
 
 
 public:
   Blackbox(char **m_argv, char *dpy_name = 0, char *rc = 0);
   virtual ~Blackbox(void);
 
+  // the rc file used when rc is given with -rc, or by default
+  static std::string rcFilename(const char *rc);
+
   BWindowGroup *searchGroup(Window window);
   BlackboxWindow *searchWindow(Window window);
   BScreen *searchScreen(Window window);
@@ -244,6 +278,7 @@ public:
 #endif // ENABLE_KEYBINDINGS
 
   inline BlackboxWindow *getFocusedWindow(void) { return focused_window; }
+  inline const BSnapshot *restartSnapshot(void) const { return snapshot; }
 
   inline const Time &getDoubleClickInterval(void) const
   { return resource.double_click_interval; }
@@ -260,6 +295,9 @@ public:
   inline unsigned long getCacheMax(void) const
     { return resource.cache_max; }
 
+  inline const char *getStyleFilename(void) const
+    { return resource.style_file.c_str(); }
+
   inline void setNoFocus(bool f) { no_focus = f; }
 
   inline Cursor getSessionCursor(void) const
@@ -276,12 +314,16 @@ public:
   void load_rc(BScreen *screen);
   void restart(const char *prog = 0);
   void reconfigure(void);
+  void dumpStatistics(void);
 
   bool validateWindow(Window window);
 
   virtual bool handleSignal(int sig);
 
   virtual void timeout(void);
+  virtual void handleMessage(unsigned int message, unsigned long data);
+  virtual void propertyFetched(const BProperty &) {}
+  virtual void inputFocusFetched(Window focus);
 
 #ifdef    HAVE_GETPID
   inline Atom getBlackboxPidAtom(void) const { return blackbox_pid; }
@@ -299,6 +341,8 @@ public:
     { return xa_wm_take_focus; }
   inline Atom getWMColormapAtom(void) const
     { return xa_wm_colormap_windows; }
+  inline Atom getCompoundTextAtom(void) const
+    { return xa_compound_text; }
   inline Atom getMotifWMHintsAtom(void) const
     { return motif_wm_hints; }
 
@@ -358,10 +402,25 @@ public:
   inline Atom getWindowsWMNativeHWnd(void) const
     { return windowswm_native_hwnd; }
 
-#ifdef    NEWWMSPEC
-  // root window properties
+  inline Atom getUTF8StringAtom(void) const
+    { return utf8_string; }
   inline Atom getNETSupportedAtom(void) const
     { return net_supported; }
+  inline Atom getNETFrameExtentsAtom(void) const
+    { return net_frame_extents; }
+  inline Atom getNETWMNameAtom(void) const
+    { return net_wm_name; }
+  inline Atom getNETWMIconNameAtom(void) const
+    { return net_wm_icon_name; }
+  inline Atom getNETWMIconAtom(void) const
+    { return net_wm_icon; }
+  inline Atom getNETWMPidAtom(void) const
+    { return net_wm_pid; }
+  // sets _NET_SUPPORTED on a root window we manage
+  void setNETSupported(Window root) const;
+
+#ifdef    NEWWMSPEC
+  // root window properties
   inline Atom getNETClientListAtom(void) const
     { return net_client_list; }
   inline Atom getNETClientListStackingAtom(void) const
@@ -394,8 +453,6 @@ public:
   // application window properties
   inline Atom getNETPropertiesAtom(void) const
     { return net_properties; }
-  inline Atom getNETWMNameAtom(void) const
-    { return net_wm_name; }
   inline Atom getNETWMDesktopAtom(void) const
     { return net_wm_desktop; }
   inline Atom getNETWMWindowTypeAtom(void) const
@@ -406,10 +463,6 @@ public:
     { return net_wm_strut; }
   inline Atom getNETWMIconGeometryAtom(void) const
     { return net_wm_icon_geometry; }
-  inline Atom getNETWMIconAtom(void) const
-    { return net_wm_icon; }
-  inline Atom getNETWMPidAtom(void) const
-    { return net_wm_pid; }
   inline Atom getNETWMHandledIconsAtom(void) const
     { return net_wm_handled_icons; }
 
@@ -50,11 +50,17 @@ extern "C" {
 #endif // HAVE_SYS_PARAM_H
 }
 
+#include <algorithm>
 #include <string>
 using std::string;
 
 #include "i18n.hh"
 #include "blackbox.hh"
+#include "BaseDisplay.hh"
+#include "Database.hh"
+#include "Spawn.hh"
+#include "Timeline.hh"
+#include "Trace.hh"
 #include <X11/Xlocale.h>
 
 
@@ -68,6 +74,8 @@ static void showHelp(int exitval) {
               "\t\t\t 2001 - 2002 Sean 'Shaleh' Perry\n"
               "\t\t\t 1997 - 2000 Brad Hughes\n"
               "  -display <string>\t\tuse display connection.\n"
+              "  -trace <file>\t\t\trecord the events handled in file.\n"
+              "  -timeline <file>\t\twrite a trace viewer timeline to file.\n"
               "  -version\t\t\tdisplay version and exit.\n"
               "  -help\t\t\t\tdisplay this help text and exit.\n\n"),
          __blackbox_version);
@@ -104,6 +112,8 @@ static void showHelp(int exitval) {
 int main(int argc, char **argv) {
   char *session_display = (char *) 0;
   char *rc_file = (char *) 0;
+  char *trace_file = (char *) 0;
+  char *timeline_file = (char *) 0;
   
   i18n.openCatalog("blackbox.cat");
 
@@ -120,6 +130,26 @@ int main(int argc, char **argv) {
       }
 
       rc_file = argv[i];
+    } else if (! strcmp(argv[i], "-trace")) {
+      // record the events as they are handled, for bench/replay
+
+      if ((++i) >= argc) {
+        fprintf(stderr, "error: '-trace' requires an argument\n");
+
+        ::exit(1);
+      }
+
+      trace_file = argv[i];
+    } else if (! strcmp(argv[i], "-timeline")) {
+      // spans of what is done, for chrome://tracing or Perfetto
+
+      if ((++i) >= argc) {
+        fprintf(stderr, "error: '-timeline' requires an argument\n");
+
+        ::exit(1);
+      }
+
+      timeline_file = argv[i];
     } else if (! strcmp(argv[i], "-display")) {
       // check for -display option... to run on a display other than the one
       // set by the environment variable DISPLAY
@@ -161,6 +191,48 @@ int main(int argc, char **argv) {
   _chdir2(getenv("X11ROOT"));
 #endif // __EMX__
 
+  {
+    // the event reader thread, the screen threads and the property
+    // workers need Xlib set up for threads before anything else in Xlib
+    // is called, and the spawn server is best forked before we grow, so
+    // these settings are read early
+    BDatabase database;
+    bool reader_thread = False, screen_threads = False, spawn_server = False;
+    int property_workers = 0, trace_size = 32;
+    if (database.load(Blackbox::rcFilename(rc_file))) {
+      database.getValue("session.readerThread", "Session.ReaderThread",
+                        reader_thread);
+      database.getValue("session.screenThreads", "Session.ScreenThreads",
+                        screen_threads);
+      database.getValue("session.propertyWorkers",
+                        "Session.PropertyWorkers", property_workers);
+      database.getValue("session.spawnServer", "Session.SpawnServer",
+                        spawn_server);
+      database.getValue("session.traceSize", "Session.TraceSize",
+                        trace_size);
+    }
+    if (reader_thread || screen_threads || property_workers > 0)
+      BaseDisplay::initThreads();
+
+    // forked now, while we are small and have no connections or threads
+    if (spawn_server && ! startSpawnServer())
+      fprintf(stderr, "warning: couldn't start the spawn server\n");
+
+    // before the display is opened, so the screens are in the trace
+    if (trace_file &&
+        ! BTrace::start(trace_file,
+                        (unsigned long) std::max(trace_size, 1) << 20))
+      fprintf(stderr, "warning: couldn't record a trace in '%s'\n",
+              trace_file);
+
+    // the file the property on the root window turns recording on into
+    BTimeline::setFile(timeline_file);
+    string timeline_path;
+    if (timeline_file && ! BTimeline::start(timeline_path))
+      fprintf(stderr, "warning: couldn't record a timeline in '%s'\n",
+              timeline_file);
+  }
+
   char *locale = _Xsetlocale(LC_ALL, "");
   if (! locale) {
     fprintf(stderr, "failed to set locale, reverting to \"C\"\n");
@@ -171,8 +243,13 @@ int main(int argc, char **argv) {
       }
   }
 
-  Blackbox blackbox(argv, session_display, rc_file);
-  blackbox.eventLoop();
+  {
+    Blackbox blackbox(argv, session_display, rc_file);
+    blackbox.eventLoop();
+  }
+
+  BTimeline::stop();
+  BTrace::stop();
 
   return(0);
 }
@@ -0,0 +1,140 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// xwinwm-latency.cc for XWinWM - the dispatch latency of a running xwinwm
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Prints the p50, p99 and p99.9 of the time xwinwm took to handle each
+ * type of event, from the histograms it keeps with
+ * session.latencyHistograms.  They are read from shared memory, so
+ * neither xwinwm nor the server is asked anything.
+ *
+ *   xwinwm-latency [-display <string>]
+ */
+
+#ifdef    HAVE_CONFIG_H
+#  include "../config.h"
+#endif // HAVE_CONFIG_H
+
+extern "C" {
+#include <X11/Xlib.h>
+
+#ifdef    HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif // HAVE_FCNTL_H
+
+#ifdef    HAVE_STDIO_H
+#  include <stdio.h>
+#endif // HAVE_STDIO_H
+
+#ifdef    HAVE_STRING_H
+#  include <string.h>
+#endif // HAVE_STRING_H
+
+#ifdef    HAVE_UNISTD_H
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif // HAVE_UNISTD_H
+
+#ifdef    HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif // HAVE_SYS_MMAN_H
+}
+
+#include <string>
+
+#include "Latency.hh"
+#include "Util.hh"
+
+
+static void printHistogram(const char *name, const BLatencyHistogram &h) {
+  if (h.count == 0)
+    return;
+
+  printf("  %-20s %8llu %8.1f %8.1f %8.1f %8.1f %8.1f\n", name, h.count,
+         h.percentile(0.5) / 1e3, h.percentile(0.99) / 1e3,
+         h.percentile(0.999) / 1e3, h.max / 1e3,
+         (double) h.total / h.count / 1e3);
+}
+
+
+int main(int argc, char **argv) {
+  const char *display = (const char *) 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (! strcmp(argv[i], "-display") && i + 1 < argc) {
+      display = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [-display <string>]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  display = XDisplayName(display);
+  const std::string name = BLatency::segmentName(display);
+
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_SYS_MMAN_H)
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd == -1) {
+    fprintf(stderr, "%s: no histograms for %s, is session.latencyHistograms "
+            "set?\n", argv[0], display);
+    return 1;
+  }
+
+  void *p = mmap(0, sizeof(BLatencySegment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "%s: cannot map %s\n", argv[0], name.c_str());
+    return 1;
+  }
+
+  // a copy, so the numbers of one table go together
+  static BLatencySegment segment;
+  memcpy(&segment, p, sizeof(segment));
+  munmap(p, sizeof(BLatencySegment));
+
+  if (! BLatency::isCompatible(segment)) {
+    fprintf(stderr, "%s: %s was written by another version of xwinwm\n",
+            argv[0], name.c_str());
+    return 1;
+  }
+
+  printf("xwinwm %d on %s, %llu events handled, times in us\n",
+         segment.pid, display, segment.all.count);
+  printf("  %-20s %8s %8s %8s %8s %8s %8s\n", "event", "count", "p50",
+         "p99", "p99.9", "max", "mean");
+
+  for (unsigned int type = 0; type < BLatencySegment::Types; ++type) {
+    char buffer[32];
+    const char *type_name = eventTypeName(type);
+    if (! type_name) {
+      sprintf(buffer, "extension event %u", type);
+      type_name = buffer;
+    }
+    printHistogram(type_name, segment.type[type]);
+  }
+  printHistogram("all events", segment.all);
+
+  return 0;
+#else // !HAVE_SHM_OPEN || !HAVE_SYS_MMAN_H
+  fprintf(stderr, "%s: built without shared memory, %s cannot be read\n",
+          argv[0], name.c_str());
+  return 1;
+#endif // HAVE_SHM_OPEN && HAVE_SYS_MMAN_H
+}